@@ -26,6 +26,7 @@
 #include "eventthread.h"
 #include "filesystem.h"
 #include "graphics.h"
+#include "perfstats.h"
 #include "lang-fun.h"
 #include "sdl-util.h"
 #include "sharedstate.h"
@@ -116,6 +117,7 @@ RB_METHOD(mkxpPowerState);
 RB_METHOD(mkxpSettingsMenu);
 RB_METHOD(mkxpCpuCount);
 RB_METHOD(mkxpSystemMemory);
+RB_METHOD(mkxpStats);
 
 RB_METHOD(mriRgssMain);
 RB_METHOD(mriRgssStop);
@@ -192,6 +194,7 @@ static void mriBindingInit() {
   _rb_define_module_function(mod, "power_state", mkxpPowerState);
   _rb_define_module_function(mod, "nproc", mkxpCpuCount);
   _rb_define_module_function(mod, "memory", mkxpSystemMemory);
+  _rb_define_module_function(mod, "stats", mkxpStats);
 
   /* Load global constants */
   rb_gv_set("MKXP", Qtrue);
@@ -350,6 +353,22 @@ RB_METHOD(mkxpSystemMemory) {
   return INT2NUM(SDL_GetSystemRAM());
 }
 
+RB_METHOD(mkxpStats) {
+  RB_UNUSED_PARAM;
+
+  PerfStats &stats = shState->perfStats();
+  VALUE hash = rb_hash_new();
+
+  for (int i = 0; i < PerfStats::CounterCount; ++i) {
+    PerfStats::Counter c = (PerfStats::Counter)i;
+
+    rb_hash_aset(hash, ID2SYM(rb_intern(PerfStats::name(c))),
+                 LL2NUM(stats.get(c)));
+  }
+
+  return hash;
+}
+
 static VALUE rgssMainCb(VALUE block) {
   rb_funcall2(block, rb_intern("call"), 0, 0);
   return Qnil;
@@ -60,9 +60,23 @@ RB_METHOD(bitmapInitialize) {
     GUARD_EXC(b = new Bitmap(filename);)
   } else {
     int width, height;
-    rb_get_args(argc, argv, "ii", &width, &height RB_ARG_END);
+    VALUE opts = Qnil;
+    rb_get_args(argc, argv, "ii|o", &width, &height, &opts RB_ARG_END);
 
-    GUARD_EXC(b = new Bitmap(width, height);)
+    /* Bitmap.new(w, h, software: true) or Bitmap.new(w, h, true) */
+    VALUE software = opts;
+
+    if (RB_TYPE_P(opts, RUBY_T_HASH)) {
+      software = rb_hash_lookup2(opts, ID2SYM(rb_intern("software")), Qundef);
+
+      if (software == Qundef || RHASH_SIZE(opts) != 1)
+        rb_raise(rb_eArgError, "Expected only the 'software' option");
+    }
+
+    if (software != Qnil && software != Qtrue && software != Qfalse)
+      rb_raise(rb_eTypeError, "Argument 3: Expected true or false");
+
+    GUARD_EXC(b = new Bitmap(width, height, software == Qtrue);)
   }
 
   setPrivateData(self, b);
@@ -207,6 +221,31 @@ RB_METHOD(bitmapGetPixel) {
   return wrapObject(color, ColorType);
 }
 
+RB_METHOD(bitmapPrefetchPixels) {
+  Bitmap *b = getPrivateData<Bitmap>(self);
+
+  if (argc == 0) {
+    GUARD_EXC(b->prefetchPixels(b->rect()););
+  } else if (argc == 1) {
+    VALUE rectObj;
+    Rect *rect;
+
+    rb_get_args(argc, argv, "o", &rectObj RB_ARG_END);
+
+    rect = getPrivateDataCheck<Rect>(rectObj, RectType);
+
+    GUARD_EXC(b->prefetchPixels(rect->toIntRect()););
+  } else {
+    int x, y, width, height;
+
+    rb_get_args(argc, argv, "iiii", &x, &y, &width, &height RB_ARG_END);
+
+    GUARD_EXC(b->prefetchPixels(IntRect(x, y, width, height)););
+  }
+
+  return self;
+}
+
 RB_METHOD(bitmapSetPixel) {
   Bitmap *b = getPrivateData<Bitmap>(self);
 
@@ -408,6 +447,55 @@ RB_METHOD(bitmapSetRawData) {
   return self;
 }
 
+RB_METHOD(bitmapGetPixels) {
+  Bitmap *b = getPrivateData<Bitmap>(self);
+
+  IntRect rect;
+
+  if (argc == 1) {
+    VALUE rectObj;
+
+    rb_get_args(argc, argv, "o", &rectObj RB_ARG_END);
+
+    rect = getPrivateDataCheck<Rect>(rectObj, RectType)->toIntRect();
+  } else {
+    rb_get_args(argc, argv, "iiii", &rect.x, &rect.y, &rect.w,
+                &rect.h RB_ARG_END);
+  }
+
+  /* Validate before allocating the result string */
+  size_t size = 0;
+  GUARD_EXC(size = b->pixelRectSize(rect););
+
+  VALUE ret = rb_str_new(0, size);
+
+  GUARD_EXC(b->getPixels(rect, RSTRING_PTR(ret), size););
+
+  return ret;
+}
+
+RB_METHOD(bitmapSetPixels) {
+  Bitmap *b = getPrivateData<Bitmap>(self);
+
+  IntRect rect;
+  VALUE str;
+
+  if (argc == 2) {
+    VALUE rectObj;
+
+    rb_get_args(argc, argv, "oS", &rectObj, &str RB_ARG_END);
+
+    rect = getPrivateDataCheck<Rect>(rectObj, RectType)->toIntRect();
+  } else {
+    rb_get_args(argc, argv, "iiiiS", &rect.x, &rect.y, &rect.w, &rect.h,
+                &str RB_ARG_END);
+  }
+
+  GUARD_EXC(b->setPixels(rect, RSTRING_PTR(str), RSTRING_LEN(str)););
+
+  return self;
+}
+
 RB_METHOD(bitmapSaveToFile) {
   RB_UNUSED_PARAM;
 
@@ -444,6 +532,35 @@ RB_METHOD(bitmapGetMaxSize){
   return INT2NUM(Bitmap::maxSize());
 }
 
+static void bitmapPreloadValue(VALUE name) {
+  if (RB_TYPE_P(name, RUBY_T_ARRAY)) {
+    for (long i = 0; i < RARRAY_LEN(name); ++i)
+      bitmapPreloadValue(rb_ary_entry(name, i));
+
+    return;
+  }
+
+  Bitmap::preload(StringValueCStr(name));
+}
+
+RB_METHOD(bitmapPreload) {
+  RB_UNUSED_PARAM;
+
+  for (int i = 0; i < argc; ++i)
+    bitmapPreloadValue(argv[i]);
+
+  return Qnil;
+}
+
+RB_METHOD(bitmapIsLoaded) {
+  RB_UNUSED_PARAM;
+
+  char *filename;
+  rb_get_args(argc, argv, "z", &filename RB_ARG_END);
+
+  return rb_bool_new(Bitmap::isLoaded(filename));
+}
+
 RB_METHOD(bitmapInitializeCopy) {
   rb_check_argc(argc, 1);
   VALUE origObj = argv[0];
@@ -485,12 +602,15 @@ void bitmapBindingInit() {
   _rb_define_method(klass, "clear", bitmapClear);
   _rb_define_method(klass, "get_pixel", bitmapGetPixel);
   _rb_define_method(klass, "set_pixel", bitmapSetPixel);
+  _rb_define_method(klass, "prefetch_pixels", bitmapPrefetchPixels);
   _rb_define_method(klass, "hue_change", bitmapHueChange);
   _rb_define_method(klass, "draw_text", bitmapDrawText);
   _rb_define_method(klass, "text_size", bitmapTextSize);
 
   _rb_define_method(klass, "raw_data", bitmapGetRawData);
   _rb_define_method(klass, "raw_data=", bitmapSetRawData);
+  _rb_define_method(klass, "get_pixels", bitmapGetPixels);
+  _rb_define_method(klass, "set_pixels", bitmapSetPixels);
   _rb_define_method(klass, "to_file", bitmapSaveToFile);
 
   _rb_define_method(klass, "gradient_fill_rect", bitmapGradientFillRect);
@@ -500,6 +620,8 @@ void bitmapBindingInit() {
 
   _rb_define_method(klass, "mega?", bitmapGetMega);
   rb_define_singleton_method(klass, "max_size", RUBY_METHOD_FUNC(bitmapGetMaxSize), -1);
+  rb_define_singleton_method(klass, "preload", RUBY_METHOD_FUNC(bitmapPreload), -1);
+  rb_define_singleton_method(klass, "loaded?", RUBY_METHOD_FUNC(bitmapIsLoaded), -1);
 
   INIT_PROP_BIND(Bitmap, Font, "font");
 }
@@ -0,0 +1,43 @@
+=begin
+Benchmark Helper
+----------------
+Shared part of the benchmark scripts in this folder. Load it before any
+of them (eg. all pasted right before main), then call the benchmark
+methods they add to PerfBench, optionally with their parameters:
+
+  PerfBench.scene_order
+  PerfBench.text
+  PerfBench.tilemap_scroll
+  PerfBench.tile_atlas
+
+The counters they read are described in System.stats.
+=end
+module PerfBench
+  # Calls the block (with the frame index) and Graphics.update 'frames'
+  # times. Returns the seconds taken, and a hash holding the sum of every
+  # per frame counter, and how much every running total counter grew
+  def self.measure(frames, per_frame = [], totals = [])
+    sums = Hash.new(0)
+    before = System.stats
+    start = Time.now
+
+    frames.times do |i|
+      yield i
+      Graphics.update
+
+      stats = System.stats
+      per_frame.each { |c| sums[c] += stats[c] }
+    end
+
+    elapsed = Time.now - start
+
+    after = System.stats
+    totals.each { |c| sums[c] = after[c] - before[c] }
+
+    [elapsed, sums]
+  end
+
+  def self.report(format, *args)
+    System.puts(sprintf(format, *args))
+  end
+end
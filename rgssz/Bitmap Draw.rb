@@ -67,27 +67,33 @@ class Bitmap
   def drawCircle(color=Color.new(255,255,255),r=(self.width/2),tx=(self.width/2),ty=(self.height/2),hollow=false)
     # basic circle formula
     # (x - tx)**2 + (y - ty)**2 = r**2
-    pixels = self.raw_data.unpack('I*')
-    colori = color.to_i
-    for x in 0...self.width
+    # Only the circle's bounding box is transferred (get_pixels/set_pixels
+    # use RGBA bytes, rows top to bottom, no padding)
+    x0 = [tx - r, 0].max
+    y0 = [ty - r, 0].max
+    x1 = [tx + r, self.width - 1].min
+    y1 = [ty + r, self.height - 1].min
+    return if x1 < x0 || y1 < y0
+    w = x1 - x0 + 1
+    h = y1 - y0 + 1
+    pixels = self.get_pixels(x0, y0, w, h).unpack('L*')
+    colori = [color.red, color.green, color.blue, color.alpha].pack('C4').unpack('L')[0]
+    for x in x0..x1
       f = (r**2 - (x - tx)**2)
-      row = self.height * x
       next if f < 0
-      y1 = -Math.sqrt(f).to_i + ty
-      y2 =  Math.sqrt(f).to_i + ty
+      ya = -Math.sqrt(f).to_i + ty
+      yb =  Math.sqrt(f).to_i + ty
       if hollow
-        pixels[row + y1] = colori
-        pixels[row + y2] = colori 
-        #self.set_pixel(x,y1,color)
-        #self.set_pixel(x,y2,color)
+        # Points cut off by the bitmap edge aren't drawn
+        pixels[(ya - y0) * w + (x - x0)] = colori if ya.between?(y0, y1)
+        pixels[(yb - y0) * w + (x - x0)] = colori if yb.between?(y0, y1)
       else
-        for y in y1..y2
-          pixels[row + y] = colori
-          #self.set_pixel(x,y,color)
+        for y in [ya, y0].max..[yb, y1].min
+          pixels[(y - y0) * w + (x - x0)] = colori
         end
       end
     end
-    self.raw_data = pixels.pack('I*')
+    self.set_pixels(x0, y0, w, h, pixels.pack('L*'))
   end
   
   #=============================================================================
@@ -0,0 +1,36 @@
+=begin
+Scene Order Benchmark
+---------------------
+Moves sprites around every frame and reports how much time goes into
+keeping the scene in draw order.
+
+Under RGSS2 and later, every change of a sprite's y can change its
+place in the draw order, so this is most interesting there. Sprites
+swapping places with their neighbours are what actually costs time;
+small moves that keep the order intact are close to free.
+=end
+module PerfBench
+  def self.scene_order(count = 500, frames = 300)
+    bitmap = Bitmap.new(16, 16)
+    bitmap.fill_rect(bitmap.rect, Color.new(255, 255, 255))
+
+    sprites = Array.new(count) do
+      s = Sprite.new
+      s.bitmap = bitmap
+      s.x = rand(Graphics.width)
+      s.y = rand(Graphics.height)
+      s
+    end
+
+    _, sums = measure(frames, [:scene_reorders, :scene_order_ns]) do
+      sprites.each { |s| s.y = (s.y + rand(9) - 4) % Graphics.height }
+    end
+
+    report("%d sprites, %d frames: %.1f reorders/frame, %.3f ms/frame spent ordering",
+           count, frames, sums[:scene_reorders].to_f / frames,
+           sums[:scene_order_ns] / 1000000.0 / frames)
+
+    sprites.each(&:dispose)
+    bitmap.dispose
+  end
+end
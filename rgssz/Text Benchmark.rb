@@ -0,0 +1,64 @@
+=begin
+Text Benchmark
+--------------
+Fills a window-sized bitmap with lines of text over and over, once for
+each combination of Font#outline and Font#shadow, and reports how long
+a draw_text call takes on average.
+
+Outlined and shadowed text used to be rasterized (and blended) on the
+CPU a second time; it is now built on the GPU from the plain text. The
+old surface based path is still taken for strings the glyph atlas can't
+lay out, so each variant is run twice: once as is, and once with a
+character outside the BMP appended to every line, which forces that
+path. Every line carries a running number, so the text cache can't
+answer the draws and each one is actually built.
+=end
+module PerfBench
+  TEXT_LINES = ["HP", "MP", "Potion", "Long Sword of the Ancients",
+                "The quick brown fox jumps over the lazy dog.",
+                "0123456789 / 9999"]
+
+  # Not handled by the glyph atlas
+  TEXT_SURFACE_SUFFIX = " \u{1D11E}"
+
+  def self.text(frames = 120)
+    bitmap = Bitmap.new(Graphics.width, Graphics.height)
+    sprite = Sprite.new
+    sprite.bitmap = bitmap
+
+    line_h = bitmap.font.size + 4
+    rows = Graphics.height / line_h
+    calls = frames * rows
+
+    [[false, false], [true, false], [false, true], [true, true]].each do |outline, shadow|
+      bitmap.font.outline = outline
+      bitmap.font.shadow = shadow
+
+      gpu, surface = ["", TEXT_SURFACE_SUFFIX].map do |suffix|
+        elapsed, = measure(frames) do |frame|
+          bitmap.clear
+          rows.times do |i|
+            bitmap.draw_text(0, i * line_h, bitmap.width, line_h,
+                             "#{TEXT_LINES[i % TEXT_LINES.size]} #{frame * rows + i}#{suffix}",
+                             i % 3)
+          end
+        end
+        elapsed
+      end
+
+      report("outline=%-5s shadow=%-5s %d draws: %.1f us/draw, %.2f ms/frame " \
+             "(surface path: %.1f us/draw, %.2f ms/frame)",
+             outline, shadow, calls,
+             gpu * 1000000.0 / calls, gpu * 1000.0 / frames,
+             surface * 1000000.0 / calls, surface * 1000.0 / frames)
+    end
+
+    stats = System.stats
+    report("glyph cache: %d hits, %d misses, %d glyphs",
+           stats[:glyph_cache_hits], stats[:glyph_cache_misses],
+           stats[:glyph_cache_glyphs])
+
+    sprite.dispose
+    bitmap.dispose
+  end
+end
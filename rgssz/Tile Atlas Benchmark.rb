@@ -0,0 +1,39 @@
+=begin
+Tile Atlas Benchmark
+--------------------
+Walks back and forth between two maps with different tilesets: every
+"transfer" disposes the tilemap and sets up a new one, like Spriteset_Map
+does. Reports the time per transfer, and how many tile atlases could be
+taken from the cache instead of being assembled again.
+=end
+module PerfBench
+  def self.tile_atlas(transfers = 100)
+    vx = Tilemap.method_defined?(:bitmaps)
+    tilesets = [Color.new(96, 160, 96), Color.new(160, 96, 96)].map do |color|
+      bitmap = Bitmap.new(256, 4096)
+      bitmap.fill_rect(bitmap.rect, color)
+      bitmap
+    end
+    data = Table.new(20, 15, vx ? 4 : 3)
+    tilemap = nil
+
+    elapsed, sums = measure(transfers, [], [:tile_atlas_cache_hits,
+                                            :tile_atlas_cache_misses]) do |i|
+      tilemap.dispose if tilemap
+      tilemap = Tilemap.new
+      if vx
+        tilemap.bitmaps[5] = tilesets[i % 2]
+      else
+        tilemap.tileset = tilesets[i % 2]
+      end
+      tilemap.map_data = data
+    end
+
+    report("%d transfers: %.2f ms each, %d atlases reused, %d built",
+           transfers, elapsed * 1000 / transfers,
+           sums[:tile_atlas_cache_hits], sums[:tile_atlas_cache_misses])
+
+    tilemap.dispose
+    tilesets.each(&:dispose)
+  end
+end
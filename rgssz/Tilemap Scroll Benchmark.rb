@@ -0,0 +1,69 @@
+=begin
+Tilemap Scroll Benchmark
+------------------------
+Scrolls a tilemap diagonally across a generated map and reports how many
+tiles had to be turned into vertices per frame, and the time per frame.
+
+The XP tilemap only builds each 16x16 chunk once, and the VX tilemap
+only reads the rows and columns that scroll into view. For comparison,
+the same scroll is run a second time with a full rebuild on every tile
+crossing, like the tilemaps used to do: map_data is switched to an
+identical copy of the map whenever the view crosses a tile boundary.
+(The XP tilemap then rebuilds whole chunks, which is somewhat more than
+the map viewport it used to read.)
+=end
+module PerfBench
+  def self.tilemap_scroll(speed = 3, frames = 600)
+    map_w = map_h = 200
+    vx = Tilemap.method_defined?(:bitmaps)
+    tileset = Bitmap.new(512, 512)
+    tileset.fill_rect(tileset.rect, Color.new(96, 160, 96))
+
+    maps = Array.new(2) do
+      data = Table.new(map_w, map_h, vx ? 4 : 3)
+      if vx
+        map_h.times { |y| map_w.times { |x| data[x, y, 2] = 1 + (x + y) % 64 } }
+      else
+        map_h.times { |y| map_w.times { |x| data[x, y, 0] = 384 + (x * y) % 128 } }
+      end
+      data
+    end
+
+    results = [false, true].map do |rebuild|
+      tilemap = Tilemap.new
+      if vx
+        tilemap.bitmaps[5] = tileset
+      else
+        tilemap.tileset = tileset
+        tilemap.priorities = Table.new(384 + 128)
+      end
+      tilemap.map_data = maps[0]
+      Graphics.update
+
+      last_tile = [0, 0]
+      flip = 0
+
+      elapsed, sums = measure(frames, [:tilemap_tiles_built]) do
+        tilemap.ox += speed
+        tilemap.oy += speed
+
+        tile = [tilemap.ox / 32, tilemap.oy / 32]
+        if rebuild && tile != last_tile
+          flip ^= 1
+          tilemap.map_data = maps[flip]
+        end
+        last_tile = tile
+      end
+
+      tilemap.dispose
+
+      [sums[:tilemap_tiles_built].to_f / frames, elapsed * 1000.0 / frames]
+    end
+
+    report("%s tilemap, %d px/frame, %d frames: %.1f tiles built/frame, %.2f ms/frame " \
+           "(full rebuild: %.1f tiles built/frame, %.2f ms/frame)",
+           vx ? "VX" : "XP", speed, frames, *results.flatten)
+
+    tileset.dispose
+  end
+end
@@ -0,0 +1,36 @@
+uniform sampler2D v_texture;
+
+in vec2 v_texCoord;
+in lowp vec4 v_color;
+in lowp vec4 v_tone;
+
+/* x: opacity, y: bush depth, z: bush opacity */
+in vec3 v_effect;
+
+const vec3 lumaF = vec3(.299, .587, .114);
+
+out vec4 fragColor;
+
+void main() {
+  /* Sample source color */
+  vec4 frag = texture(v_texture, v_texCoord);
+
+  /* Apply gray */
+  float luma = dot(frag.rgb, lumaF);
+  frag.rgb = mix(frag.rgb, vec3(luma), v_tone.w);
+
+  /* Apply tone */
+  frag.rgb += v_tone.rgb;
+
+  /* Apply opacity */
+  frag.a *= v_effect.x;
+
+  /* Apply color */
+  frag.rgb = mix(frag.rgb, v_color.rgb, v_color.a);
+
+  /* Apply bush alpha by mathematical if */
+  lowp float underBush = float(v_texCoord.y < v_effect.y);
+  frag.a *= clamp(v_effect.z + underBush, 0.0, 1.0);
+
+  fragColor = frag;
+}
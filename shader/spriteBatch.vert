@@ -0,0 +1,26 @@
+
+uniform mat4 projMat;
+
+uniform vec2 texSizeInv;
+
+attribute vec2 position;
+attribute vec2 texCoord;
+attribute lowp vec4 color;
+attribute lowp vec4 tone;
+attribute vec4 effect;
+
+varying vec2 v_texCoord;
+varying lowp vec4 v_color;
+varying lowp vec4 v_tone;
+varying vec3 v_effect;
+
+void main()
+{
+	/* Positions arrive pre-transformed */
+	gl_Position = projMat * vec4(position, 0, 1);
+
+	v_texCoord = texCoord * texSizeInv;
+	v_color = color;
+	v_tone = tone;
+	v_effect = effect.xyz;
+}
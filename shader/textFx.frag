@@ -0,0 +1,61 @@
+/* Puts text together with its outline and shadow,
+ * using only the alpha mask of the plain text.
+ * Blending follows the bitmap blit equation
+ * (see bitmapBlit.frag), back to front */
+
+uniform sampler2D v_texture;
+uniform vec2 texSizeInv;
+
+uniform lowp vec4 textColor;
+uniform lowp vec4 outlineColor;
+
+/* 1.0 enables the respective effect */
+uniform lowp float outline;
+uniform lowp float shadow;
+
+in vec2 v_texCoord;
+
+out vec4 fragColor;
+
+float maskAt(vec2 offset)
+{
+  vec2 coor = v_texCoord + offset * texSizeInv;
+
+  /* Nothing outside of the mask */
+  if (any(lessThan(coor, vec2(0.0))) || any(greaterThan(coor, vec2(1.0))))
+    return 0.0;
+
+  return texture(v_texture, coor).a;
+}
+
+vec4 over(vec4 top, vec4 bottom)
+{
+  float co2 = bottom.a * (1.0 - top.a);
+  float a = top.a + co2;
+
+  if (a == 0.0)
+    return vec4(top.rgb, 0.0);
+
+  return vec4((top.a * top.rgb + co2 * bottom.rgb) / a, a);
+}
+
+void main() {
+  vec4 res = vec4(textColor.rgb, 0.0);
+
+  if (outline > 0.0)
+  {
+    /* Dilate the mask by one pixel */
+    float a = 0.0;
+
+    for (int y = -1; y <= 1; ++y)
+      for (int x = -1; x <= 1; ++x)
+        a = max(a, maskAt(vec2(x, y)));
+
+    res = vec4(outlineColor.rgb, a * outlineColor.a);
+  }
+
+  if (shadow > 0.0)
+    res = over(vec4(0.0, 0.0, 0.0, maskAt(vec2(-1.0)) * textColor.a), res);
+
+  fragColor = over(vec4(textColor.rgb, maskAt(vec2(0.0)) * textColor.a), res);
+}
@@ -6,6 +6,11 @@ uniform vec2 translation;
 
 uniform vec2 aniOffset;
 
+/* Ring buffer slot of the top left map viewport tile,
+ * and the ring size (both in tiles) */
+uniform vec2 ringOrigin;
+uniform vec2 ringSize;
+
 attribute vec2 position;
 attribute vec2 texCoord;
 
@@ -15,6 +20,10 @@ const vec2 atAreaA = vec2(9.0*32.0, 12.0*32.0);
 const float atAreaCX = 12.0*32.0;
 const float atAreaCW = 4.0*32.0;
 
+/* Vertex positions are stored as (ring slot * slotSpacing
+ * + position inside the slot) */
+const float slotSpacing = 128.0;
+
 void main()
 {
 	vec2 tex = texCoord;
@@ -28,7 +37,16 @@ void main()
 	pred = float(tex.x >= atAreaCX && tex.x <= (atAreaCX+atAreaCW) && tex.y <= atAreaA.y);
 	tex.y += aniOffset.y * pred;
 
-	gl_Position = projMat * vec4(position + translation, 0, 1);
+	/* Rotate the ring so the viewport origin comes first */
+	vec2 slot = floor(position / slotSpacing);
+	vec2 local = position - slot * slotSpacing;
+
+	slot -= ringOrigin;
+	slot += ringSize * vec2(lessThan(slot, vec2(0.0)));
+
+	vec2 pos = slot * 32.0 + local;
+
+	gl_Position = projMat * vec4(pos + translation, 0, 1);
 
 	v_texCoord = tex * texSizeInv;
 }
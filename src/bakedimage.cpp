@@ -0,0 +1,350 @@
+/*
+** bakedimage.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bakedimage.h"
+
+#include <SDL_surface.h>
+#include <SDL_rwops.h>
+#include <SDL_endian.h>
+#include <SDL_error.h>
+#include <SDL_stdinc.h>
+
+#include <stdint.h>
+#include <vector>
+
+#define FORMAT_MAGIC 0x49584b4d /* "MKXI" */
+#define FORMAT_VER 1
+
+/* Sanity limit for reading */
+#define MAX_DIMENSION (1 << 15)
+
+/* QOI chunk tags */
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_MASK     0xc0
+
+#define QOI_MAX_RUN 62
+
+/* Byte order of ABGR8888 in memory (we only
+ * support little endian hosts anyway) */
+struct Pixel
+{
+	uint8_t r, g, b, a;
+
+	bool operator==(const Pixel &o) const
+	{
+		return r == o.r && g == o.g && b == o.b && a == o.a;
+	}
+
+	int hash() const
+	{
+		return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+	}
+};
+
+struct Header
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t codec;
+	uint32_t dataSize;
+};
+
+static Pixel *pixelAt(SDL_Surface *surf, size_t i)
+{
+	const size_t x = i % surf->w;
+	const size_t y = i / surf->w;
+
+	return (Pixel*) ((uint8_t*) surf->pixels + y * surf->pitch) + x;
+}
+
+static bool decodeQOI(const std::vector<uint8_t> &data, SDL_Surface *surf)
+{
+	const size_t pixelCount = (size_t) surf->w * surf->h;
+	const size_t size = data.size();
+
+	Pixel px = { 0, 0, 0, 255 };
+	Pixel index[64] = { { 0, 0, 0, 0 } };
+
+	size_t pos = 0;
+	int run = 0;
+
+	for (size_t i = 0; i < pixelCount; ++i)
+	{
+		if (run > 0)
+		{
+			--run;
+			*pixelAt(surf, i) = px;
+			continue;
+		}
+
+		if (pos >= size)
+			return false;
+
+		const uint8_t b1 = data[pos++];
+
+		if (b1 == QOI_OP_RGB)
+		{
+			if (pos + 3 > size)
+				return false;
+
+			px.r = data[pos++];
+			px.g = data[pos++];
+			px.b = data[pos++];
+		}
+		else if (b1 == QOI_OP_RGBA)
+		{
+			if (pos + 4 > size)
+				return false;
+
+			px.r = data[pos++];
+			px.g = data[pos++];
+			px.b = data[pos++];
+			px.a = data[pos++];
+		}
+		else switch (b1 & QOI_MASK)
+		{
+		case QOI_OP_INDEX :
+			px = index[b1];
+			break;
+
+		case QOI_OP_DIFF :
+			px.r += ((b1 >> 4) & 0x03) - 2;
+			px.g += ((b1 >> 2) & 0x03) - 2;
+			px.b += ( b1       & 0x03) - 2;
+			break;
+
+		case QOI_OP_LUMA :
+		{
+			if (pos >= size)
+				return false;
+
+			const uint8_t b2 = data[pos++];
+			const int vg = (b1 & 0x3f) - 32;
+
+			px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+			px.g += vg;
+			px.b += vg - 8 +  (b2       & 0x0f);
+			break;
+		}
+
+		case QOI_OP_RUN :
+			run = b1 & 0x3f;
+			break;
+		}
+
+		index[px.hash()] = px;
+		*pixelAt(surf, i) = px;
+	}
+
+	return true;
+}
+
+static void encodeQOI(SDL_Surface *surf, std::vector<uint8_t> &out)
+{
+	const size_t pixelCount = (size_t) surf->w * surf->h;
+
+	Pixel prev = { 0, 0, 0, 255 };
+	Pixel index[64] = { { 0, 0, 0, 0 } };
+
+	int run = 0;
+
+	for (size_t i = 0; i < pixelCount; ++i)
+	{
+		const Pixel px = *pixelAt(surf, i);
+
+		if (px == prev)
+		{
+			if (++run == QOI_MAX_RUN || i == pixelCount - 1)
+			{
+				out.push_back(QOI_OP_RUN | (run - 1));
+				run = 0;
+			}
+
+			continue;
+		}
+
+		if (run > 0)
+		{
+			out.push_back(QOI_OP_RUN | (run - 1));
+			run = 0;
+		}
+
+		const int h = px.hash();
+
+		if (index[h] == px)
+		{
+			out.push_back(QOI_OP_INDEX | h);
+		}
+		else
+		{
+			index[h] = px;
+
+			const int8_t vr = px.r - prev.r;
+			const int8_t vg = px.g - prev.g;
+			const int8_t vb = px.b - prev.b;
+			const int8_t vgr = vr - vg;
+			const int8_t vgb = vb - vg;
+
+			if (px.a != prev.a)
+			{
+				out.push_back(QOI_OP_RGBA);
+				out.push_back(px.r);
+				out.push_back(px.g);
+				out.push_back(px.b);
+				out.push_back(px.a);
+			}
+			else if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+			{
+				out.push_back(QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+			}
+			else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8)
+			{
+				out.push_back(QOI_OP_LUMA | (vg + 32));
+				out.push_back((vgr + 8) << 4 | (vgb + 8));
+			}
+			else
+			{
+				out.push_back(QOI_OP_RGB);
+				out.push_back(px.r);
+				out.push_back(px.g);
+				out.push_back(px.b);
+			}
+		}
+
+		prev = px;
+	}
+}
+
+namespace BakedImage
+{
+
+const char *extension = "mkxi";
+
+bool isBakedExt(const char *ext)
+{
+	return ext && SDL_strcasecmp(ext, extension) == 0;
+}
+
+SDL_Surface *read(SDL_RWops *ops)
+{
+	if (SDL_ReadLE32(ops) != FORMAT_MAGIC || SDL_ReadLE32(ops) != FORMAT_VER)
+	{
+		SDL_SetError("Not a baked image");
+		return 0;
+	}
+
+	Header hd;
+	hd.width = SDL_ReadLE32(ops);
+	hd.height = SDL_ReadLE32(ops);
+	hd.codec = SDL_ReadLE32(ops);
+	hd.dataSize = SDL_ReadLE32(ops);
+
+	if (hd.width == 0 || hd.width > MAX_DIMENSION ||
+	    hd.height == 0 || hd.height > MAX_DIMENSION)
+	{
+		SDL_SetError("Invalid baked image size");
+		return 0;
+	}
+
+	SDL_Surface *surf =
+		SDL_CreateRGBSurfaceWithFormat(0, hd.width, hd.height, 32,
+		                               SDL_PIXELFORMAT_ABGR8888);
+
+	if (!surf)
+		return 0;
+
+	bool ok = false;
+
+	switch (hd.codec)
+	{
+	case Raw :
+	{
+		const size_t rowSize = (size_t) hd.width * 4;
+		ok = (hd.dataSize == rowSize * hd.height);
+
+		/* Straight into the surface */
+		for (uint32_t y = 0; ok && y < hd.height; ++y)
+			ok = SDL_RWread(ops, (uint8_t*) surf->pixels + y * surf->pitch,
+			                rowSize, 1) == 1;
+		break;
+	}
+
+	case QOI :
+	{
+		/* Worst case is a full RGBA chunk per pixel */
+		if (hd.dataSize > (size_t) hd.width * hd.height * 5)
+			break;
+
+		std::vector<uint8_t> data(hd.dataSize);
+
+		if (hd.dataSize > 0 && SDL_RWread(ops, &data[0], hd.dataSize, 1) == 1)
+			ok = decodeQOI(data, surf);
+		break;
+	}
+	}
+
+	if (!ok)
+	{
+		SDL_FreeSurface(surf);
+		SDL_SetError("Corrupt baked image");
+		return 0;
+	}
+
+	return surf;
+}
+
+bool write(SDL_RWops *ops, SDL_Surface *surf, Codec codec)
+{
+	const size_t rowSize = (size_t) surf->w * 4;
+	std::vector<uint8_t> data;
+
+	if (codec == QOI)
+		encodeQOI(surf, data);
+
+	Header hd;
+	hd.width = surf->w;
+	hd.height = surf->h;
+	hd.codec = codec;
+	hd.dataSize = (codec == QOI) ? data.size() : rowSize * surf->h;
+
+	bool ok = SDL_WriteLE32(ops, FORMAT_MAGIC) &&
+	          SDL_WriteLE32(ops, FORMAT_VER) &&
+	          SDL_WriteLE32(ops, hd.width) &&
+	          SDL_WriteLE32(ops, hd.height) &&
+	          SDL_WriteLE32(ops, hd.codec) &&
+	          SDL_WriteLE32(ops, hd.dataSize);
+
+	if (codec == QOI)
+		return ok && SDL_RWwrite(ops, &data[0], data.size(), 1) == 1;
+
+	for (int y = 0; ok && y < surf->h; ++y)
+		ok = SDL_RWwrite(ops, (uint8_t*) surf->pixels + y * surf->pitch,
+		                 rowSize, 1) == 1;
+
+	return ok;
+}
+
+}
@@ -0,0 +1,59 @@
+/*
+** bakedimage.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BAKEDIMAGE_H
+#define BAKEDIMAGE_H
+
+struct SDL_Surface;
+struct SDL_RWops;
+
+/* Images pre-converted into the pixel format we upload
+ * (ABGR8888), so loading them needs neither zlib nor a
+ * format conversion. Pixels are either stored raw, or
+ * compressed with the (much faster than PNG) QOI scheme.
+ * All header fields are little endian.
+ *
+ * Baked files live next to the originals under the same
+ * name, and are picked over them when both exist */
+namespace BakedImage
+{
+	/* Without the dot */
+	extern const char *extension;
+
+	enum Codec
+	{
+		Raw = 0,
+		QOI = 1
+	};
+
+	bool isBakedExt(const char *ext);
+
+	/* Returns an ABGR8888 surface, or null (with the
+	 * SDL error set) if 'ops' doesn't contain a valid
+	 * baked image. Does not close 'ops' */
+	SDL_Surface *read(SDL_RWops *ops);
+
+	/* 'surf' must be in ABGR8888 format.
+	 * Returns false on write errors */
+	bool write(SDL_RWops *ops, SDL_Surface *surf, Codec codec);
+}
+
+#endif // BAKEDIMAGE_H
@@ -29,6 +29,11 @@
 
 #include <pixman.h>
 
+#include <algorithm>
+#include <vector>
+#include <math.h>
+#include <assert.h>
+
 #include "gl-util.h"
 #include "gl-meta.h"
 #include "quad.h"
@@ -43,16 +48,27 @@
 #include "filesystem.h"
 #include "font.h"
 #include "eventthread.h"
-
-#define GUARD_MEGA \
-	{ \
-		if (p->megaSurface) \
-			throw Exception(Exception::MKXPError, \
-                            "Operation not supported for mega surfaces"); \
-	}
+#include "bitmapatlas.h"
+#include "imagedecoder.h"
+#include "imagecache.h"
+#include "texuploader.h"
+#include "pixelcache.h"
+#include "pixelkernels.h"
+#include "glyphatlas.h"
+#include "textcache.h"
+#include "perfstats.h"
+#include "scene.h"
 
 #define OUTLINE_SIZE 1
 
+/* Queued set_pixel writes are flushed early past this
+ * (stays well within the range of the quad index buffer) */
+#define MAX_PENDING_PIXELS 8192
+
+/* Flushing queued writes as a single rectangle upload only
+ * pays off if they cover a fair share of their bounding box */
+#define PENDING_RECT_DENSITY 16
+
 /* Normalize (= ensure width and
  * height are positive) */
 static IntRect normalizedRect(const IntRect &rect)
@@ -74,26 +90,146 @@ static IntRect normalizedRect(const IntRect &rect)
 	return norm;
 }
 
+/* Where text rendered at 'width' x 'height' ends up inside
+ * 'rect', squeezed horizontally if it doesn't fit. 'rawHeight'
+ * is the height without shadow or outline */
+static FloatRect textPosRect(const IntRect &rect, int width, int height,
+                             int rawHeight, int align)
+{
+	int alignX = rect.x;
+
+	switch (align)
+	{
+	default:
+	case Bitmap::Left :
+		break;
+
+	case Bitmap::Center :
+		alignX += (rect.w - width) / 2;
+		break;
+
+	case Bitmap::Right :
+		alignX += rect.w - width;
+		break;
+	}
+
+	if (alignX < rect.x)
+		alignX = rect.x;
+
+	int alignY = rect.y + (rect.h - rawHeight) / 2;
+
+	float squeeze = (float) rect.w / width;
+
+	if (squeeze > 1)
+		squeeze = 1;
+
+	return FloatRect(alignX, alignY, width * squeeze, height);
+}
+
+/* Maps the span of 'len' pixels at 'from' (inside of the source
+ * span 'src'/'srcLen') to the part of 'dst'/'dstLen' it ends up
+ * in when stretched onto it; either span may be mirrored */
+static void mapSpan(int src, int srcLen, int dst, int dstLen,
+                    int from, int len, int &srcOut, int &srcLenOut,
+                    int &dstOut, int &dstLenOut)
+{
+	/* Keep the orientation of the source span */
+	const int a = srcLen < 0 ? from + len : from;
+	const int b = srcLen < 0 ? from : from + len;
+
+	const int dstA = dst + (int) floor((double) (a - src) * dstLen / srcLen + 0.5);
+	const int dstB = dst + (int) floor((double) (b - src) * dstLen / srcLen + 0.5);
+
+	srcOut = a;
+	srcLenOut = b - a;
+	dstOut = dstA;
+	dstLenOut = dstB - dstA;
+}
+
+/* Tiles of mega bitmaps are as big as the hardware allows,
+ * rounded down to whole pixel cache tiles */
+static int megaTileSize()
+{
+	return glState.caps.maxTexSize & ~63;
+}
+
+struct BitmapPrivate;
+
+/* Iterates over the tiles of a mega bitmap that 'rect'
+ * touches, making each the current one in turn (so tex()
+ * and texRect() refer to it); the previous one is restored
+ * once done. Other bitmaps yield a single iteration */
+class MegaTiles
+{
+public:
+	MegaTiles(BitmapPrivate *p, const IntRect &rect);
+	~MegaTiles();
+
+	bool next();
+
+private:
+	BitmapPrivate *p;
+	int prevTile;
+	int x1, y1, x2, y2;
+	int x, y;
+	bool started;
+};
+
 struct BitmapPrivate
 {
 	Bitmap *self;
 
 	TEXFBO gl;
 
+	/* Small bitmaps may live inside a shared atlas page
+	 * instead of their own texture. In that case 'gl' only
+	 * carries the size, and all GL work has to go through
+	 * tex() and the slot rectangle */
+	AtlasSlot *atlasSlot;
+
 	Font *font;
 
-	/* "Mega surfaces" are a hack to allow Tilesets to be used
-	 * whose Bitmaps don't fit into a regular texture. They're
-	 * kept in RAM and will throw an error if they're used in
-	 * any context other than as Tilesets */
-	SDL_Surface *megaSurface;
+	/* Bitmaps that don't fit into a single texture ("mega
+	 * surfaces") are split into a grid of them, row by row.
+	 * 'gl' then only carries the size. While 'megaTile' is set,
+	 * that tile stands in for the whole texture: tex() returns
+	 * it, and texRect() places it at its offset, so the usual
+	 * code paths only touch its part of the bitmap */
+	std::vector<TEXFBO> megaTiles;
+	int megaTilesX;
+	int megaTile;
+
+	/* Shader whose translation was set to the offset
+	 * of the current tile by pushSetViewport() */
+	ShaderBase *megaShader;
 
 	/* A cached version of the bitmap in client memory, for
-	 * getPixel calls. Is invalidated any time the bitmap
-	 * is modified */
-	SDL_Surface *surface;
+	 * getPixel calls. Only the parts touched by a modification
+	 * are invalidated */
+	PixelCache pixelCache;
 	SDL_PixelFormat *format;
 
+	/* set_pixel writes that haven't reached the texture yet,
+	 * in call order, and their bounding box. They're applied
+	 * in one go before anything else uses the texture, or
+	 * in prepareDraw at the latest */
+	struct PendingPixel
+	{
+		int x, y;
+		uint8_t rgba[4];
+	};
+
+	std::vector<PendingPixel> pendingPixels;
+	IntRect pendingRect;
+	sigc::connection prepareCon;
+
+	/* Software bitmaps keep their pixels in here, and all
+	 * pixel level operations work on this copy. The texture
+	 * is only brought up to date ('swDirty' being the area
+	 * it lacks) once something is about to use it */
+	SDL_Surface *swSurface;
+	IntRect swDirty;
+
 	/* The 'tainted' area describes which parts of the
 	 * bitmap are not cleared, ie. don't have 0 opacity.
 	 * If we're blitting / drawing text to a cleared part
@@ -102,10 +238,17 @@ struct BitmapPrivate
 	 * ourselves the expensive blending calculation */
 	pixman_region16_t tainted;
 
+	/* Bumped on every modification */
+	unsigned int contentStamp;
+
 	BitmapPrivate(Bitmap *self)
 	    : self(self),
-	      megaSurface(0),
-	      surface(0)
+	      atlasSlot(0),
+	      megaTilesX(0),
+	      megaTile(-1),
+	      megaShader(0),
+	      swSurface(0),
+	      contentStamp(shState->genTimeStamp())
 	{
 		format = SDL_AllocFormat(SDL_PIXELFORMAT_ABGR8888);
 
@@ -115,251 +258,1127 @@ struct BitmapPrivate
 
 	~BitmapPrivate()
 	{
+		prepareCon.disconnect();
+
+		if (swSurface)
+			SDL_FreeSurface(swSurface);
+
 		SDL_FreeFormat(format);
 		pixman_region_fini(&tainted);
 	}
 
-	void allocSurface()
-	{
-		surface = SDL_CreateRGBSurface(0, gl.width, gl.height, format->BitsPerPixel,
-		                               format->Rmask, format->Gmask,
-		                               format->Bmask, format->Amask);
+	void clearTaintedArea()
+	{
+		pixman_region_fini(&tainted);
+		pixman_region_init(&tainted);
+	}
+
+	void addTaintedArea(const IntRect &rect)
+	{	
+		IntRect norm = normalizedRect(rect);
+		pixman_region_union_rect
+		        (&tainted, &tainted, norm.x, norm.y, norm.w, norm.h);
+	}
+
+	void substractTaintedArea(const IntRect &rect)
+	{
+		if (!touchesTaintedArea(rect))
+			return;
+
+		pixman_region16_t m_reg;
+		pixman_region_init_rect(&m_reg, rect.x, rect.y, rect.w, rect.h);
+
+		pixman_region_subtract(&tainted, &m_reg, &tainted);
+
+		pixman_region_fini(&m_reg);
+	}
+
+	bool touchesTaintedArea(const IntRect &rect)
+	{
+		pixman_box16_t box;
+		box.x1 = rect.x;
+		box.y1 = rect.y;
+		box.x2 = rect.x + rect.w;
+		box.y2 = rect.y + rect.h;
+
+		pixman_region_overlap_t result =
+		        pixman_region_contains_rectangle(&tainted, &box);
+
+		return result != PIXMAN_REGION_OUT;
+	}
+
+	void allocTex(int width, int height)
+	{
+		if (width > glState.caps.maxTexSize || height > glState.caps.maxTexSize)
+		{
+			allocMega(width, height);
+			return;
+		}
+
+		atlasSlot = shState->bitmapAtlas().alloc(width, height);
+
+		if (atlasSlot)
+		{
+			gl = TEXFBO();
+			gl.width = width;
+			gl.height = height;
+		}
+		else
+		{
+			gl = shState->texPool().request(width, height);
+		}
+	}
+
+	void allocMega(int width, int height)
+	{
+		const int tileSize = megaTileSize();
+
+		gl = TEXFBO();
+		gl.width = width;
+		gl.height = height;
+
+		megaTilesX = (width + tileSize - 1) / tileSize;
+		const int count = megaTilesX * ((height + tileSize - 1) / tileSize);
+
+		try
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				const IntRect r = megaTileRect(i);
+				megaTiles.push_back(shState->texPool().request(r.w, r.h));
+			}
+		}
+		catch (const Exception &e)
+		{
+			releaseTex();
+			throw e;
+		}
+	}
+
+	void releaseTex()
+	{
+		if (isMega())
+		{
+			for (size_t i = 0; i < megaTiles.size(); ++i)
+				shState->texPool().release(megaTiles[i]);
+
+			megaTiles.clear();
+		}
+		else if (atlasSlot)
+		{
+			shState->bitmapAtlas().release(atlasSlot);
+		}
+		else
+		{
+			shState->texPool().release(gl);
+		}
+
+		atlasSlot = 0;
+	}
+
+	/* Takes over 'newTex' in place of tex(), which is released */
+	void replaceTex(TEXFBO &newTex)
+	{
+		shState->texPool().release(tex());
+
+		if (megaTile >= 0)
+			megaTiles[megaTile] = newTex;
+		else
+			gl = newTex;
+	}
+
+	bool isMega() const
+	{
+		return !megaTiles.empty();
+	}
+
+	/* Area of tile 'i' in bitmap coordinates */
+	IntRect megaTileRect(int i) const
+	{
+		const int tileSize = megaTileSize();
+		const int x = (i % megaTilesX) * tileSize;
+		const int y = (i / megaTilesX) * tileSize;
+
+		return IntRect(x, y, std::min(tileSize, gl.width - x),
+		               std::min(tileSize, gl.height - y));
+	}
+
+	/* The part of the bitmap held by tex() */
+	IntRect bounds() const
+	{
+		if (megaTile >= 0)
+			return megaTileRect(megaTile);
+
+		return IntRect(0, 0, gl.width, gl.height);
+	}
+
+	/* Normalizes 'rect' and clips it to bounds() */
+	IntRect clipToBounds(const IntRect &rect) const
+	{
+		const IntRect b = bounds();
+		const IntRect norm = normalizedRect(rect);
+		IntRect result;
+
+		if (!SDL_IntersectRect(&norm, &b, &result))
+			return IntRect();
+
+		return result;
+	}
+
+	/* Moves the contents into a texture of our own */
+	void leaveAtlas()
+	{
+		if (!atlasSlot)
+			return;
+
+		TEXFBO own = shState->texPool().request(gl.width, gl.height);
+
+		GLMeta::blitBegin(own);
+		GLMeta::blitSource(*atlasSlot->tex, 1);
+		GLMeta::blitRectangle(atlasSlot->rect, Vec2i());
+		GLMeta::blitEnd();
+
+		releaseTex();
+		gl = own;
+	}
+
+	/* Texture that actually holds our pixels */
+	TEXFBO &tex()
+	{
+		if (megaTile >= 0)
+			return megaTiles[megaTile];
+
+		return atlasSlot ? *atlasSlot->tex : gl;
+	}
+
+	/* Our area inside of tex() (for mega tiles, the
+	 * bitmap reaches beyond it on any side) */
+	IntRect texRect() const
+	{
+		if (megaTile >= 0)
+		{
+			const IntRect r = megaTileRect(megaTile);
+
+			return IntRect(-r.x, -r.y, gl.width, gl.height);
+		}
+
+		return atlasSlot ? atlasSlot->rect : IntRect(0, 0, gl.width, gl.height);
+	}
+
+	/* Translates a bitmap rectangle into tex() space */
+	IntRect toTex(const IntRect &rect) const
+	{
+		const IntRect tr = texRect();
+
+		return IntRect(rect.x + tr.x, rect.y + tr.y, rect.w, rect.h);
+	}
+
+	void upload(const void *pixels)
+	{
+		if (isMega())
+		{
+			uploadRect(IntRect(0, 0, gl.width, gl.height), pixels);
+			return;
+		}
+
+		TEX::bind(tex().tex);
+
+		if (atlasSlot)
+			shState->texUploader().subImage(atlasSlot->rect.x, atlasSlot->rect.y,
+			                                gl.width, gl.height, pixels, GL_RGBA);
+		else
+			shState->texUploader().image(gl.width, gl.height, pixels, GL_RGBA);
+	}
+
+	/* Uploads 'rect' (which must lie inside the bitmap) from
+	 * 'pixels', rows 'rect.w * 4' bytes apart */
+	void uploadRect(const IntRect &rect, const void *pixels)
+	{
+		if (!isMega())
+		{
+			const IntRect tr = texRect();
+
+			TEX::bind(tex().tex);
+			shState->texUploader().subImage(tr.x + rect.x, tr.y + rect.y,
+			                                rect.w, rect.h, pixels, GL_RGBA);
+			return;
+		}
+
+		SDL_Surface *surf =
+			SDL_CreateRGBSurfaceFrom(const_cast<void*>(pixels), rect.w, rect.h,
+			                         format->BitsPerPixel, rect.w * 4,
+			                         format->Rmask, format->Gmask,
+			                         format->Bmask, format->Amask);
+
+		if (!surf)
+			throw Exception(Exception::SDLError, "Error uploading pixels: %s",
+			                SDL_GetError());
+
+		for (MegaTiles t(this, rect); t.next();)
+		{
+			const IntRect part = clipToBounds(rect);
+			const IntRect tr = texRect();
+
+			TEX::bind(tex().tex);
+			GLMeta::subRectImageUpload(rect.w, part.x - rect.x, part.y - rect.y,
+			                           tr.x + part.x, tr.y + part.y,
+			                           part.w, part.h, surf, GL_RGBA);
+		}
+
+		GLMeta::subRectImageEnd();
+		SDL_FreeSurface(surf);
+	}
+
+	/* Reads 'rect' (which must lie inside the bitmap)
+	 * into 'output', rows 'rect.w * 4' bytes apart */
+	void readRect(const IntRect &rect, void *output)
+	{
+		if (!isMega() || megaTile >= 0)
+		{
+			const IntRect tr = texRect();
+
+			bindFBO();
+			::gl.ReadPixels(tr.x + rect.x, tr.y + rect.y, rect.w, rect.h,
+			                GL_RGBA, GL_UNSIGNED_BYTE, output);
+
+			shState->perfStats().add(PerfStats::ReadbackBytes, rect.w * rect.h * 4);
+			return;
+		}
+
+		std::vector<uint8_t> buffer;
+
+		for (MegaTiles t(this, rect); t.next();)
+		{
+			const IntRect part = clipToBounds(rect);
+			const size_t rowBytes = part.w * 4;
+
+			buffer.resize(rowBytes * part.h);
+			readRect(part, &buffer[0]);
+
+			for (int i = 0; i < part.h; ++i)
+				memcpy((uint8_t*) output + ((part.y - rect.y + i) * rect.w
+				                            + part.x - rect.x) * 4,
+				       &buffer[i * rowBytes], rowBytes);
+		}
+	}
+
+	/* Wrappers around GLMeta::blitBegin/End with us as target;
+	 * atlas residents must not spill into neighbouring slots */
+	void blitBegin()
+	{
+		if (atlasSlot)
+		{
+			glState.scissorTest.pushSet(true);
+			glState.scissorBox.pushSet(atlasSlot->rect);
+		}
+
+		GLMeta::blitBegin(tex());
+	}
+
+	void blitEnd()
+	{
+		GLMeta::blitEnd();
+
+		if (atlasSlot)
+		{
+			glState.scissorBox.pop();
+			glState.scissorTest.pop();
+		}
+	}
+
+	void bindTexture(ShaderBase &shader)
+	{
+		TEXFBO &t = tex();
+
+		TEX::bind(t.tex);
+		shader.setTexSize(Vec2i(t.width, t.height));
+	}
+
+	void bindFBO()
+	{
+		FBO::bind(tex().fbo);
+	}
+
+	/* Any geometry outside of the viewport is clipped,
+	 * so this also keeps atlas residents in their slot.
+	 * Mega tiles are shifted into place by the shader's
+	 * translation instead (the whole bitmap might exceed
+	 * the maximum viewport size) */
+	void pushSetViewport(ShaderBase &shader)
+	{
+		if (megaTile >= 0)
+		{
+			const IntRect r = megaTileRect(megaTile);
+
+			glState.viewport.pushSet(IntRect(0, 0, r.w, r.h));
+			shader.setTranslation(Vec2i(-r.x, -r.y));
+			megaShader = &shader;
+		}
+		else
+		{
+			glState.viewport.pushSet(texRect());
+		}
+
+		shader.applyViewportProj();
+	}
+
+	void popViewport()
+	{
+		glState.viewport.pop();
+
+		if (megaShader)
+		{
+			megaShader->setTranslation(Vec2i());
+			megaShader = 0;
+		}
+	}
+
+	void blitQuad(Quad &quad)
+	{
+		glState.blend.pushSet(false);
+		quad.draw();
+		glState.blend.pop();
+	}
+
+	void fillRect(const IntRect &rect,
+	              const Vec4 &color)
+	{
+		bindFBO();
+
+		glState.scissorTest.pushSet(true);
+		glState.scissorBox.pushSet(toTex(normalizedRect(rect)));
+		glState.clearColor.pushSet(color);
+
+		if (atlasSlot)
+			glState.scissorBox.setIntersect(atlasSlot->rect);
+
+		FBO::clear();
+
+		glState.clearColor.pop();
+		glState.scissorBox.pop();
+		glState.scissorTest.pop();
+	}
+
+	static void ensureFormat(SDL_Surface *&surf, Uint32 format)
+	{
+		if (surf->format->format == format)
+			return;
+
+		SDL_Surface *surfConv = SDL_ConvertSurfaceFormat(surf, format, 0);
+		SDL_FreeSurface(surf);
+		surf = surfConv;
+	}
+
+	void onModified()
+	{
+		pixelCache.invalidateAll();
+		notifyModified();
+	}
+
+	/* Only 'rect' changed */
+	void onModified(const IntRect &rect)
+	{
+		pixelCache.invalidate(rect);
+		notifyModified();
+	}
+
+	void notifyModified()
+	{
+		contentStamp = shState->genTimeStamp();
+		Scene::markDirty();
+		self->modified();
+	}
+
+	void queuePixel(int x, int y, const uint8_t rgba[4])
+	{
+		if (pendingPixels.empty())
+		{
+			pendingRect = IntRect(x, y, 1, 1);
+			prepareCon = shState->prepareDraw.connect
+			        (sigc::mem_fun(this, &BitmapPrivate::flushPixels));
+		}
+		else
+		{
+			const int x1 = std::min(pendingRect.x, x);
+			const int y1 = std::min(pendingRect.y, y);
+			const int x2 = std::max(pendingRect.x + pendingRect.w, x + 1);
+			const int y2 = std::max(pendingRect.y + pendingRect.h, y + 1);
+
+			pendingRect = IntRect(x1, y1, x2 - x1, y2 - y1);
+		}
+
+		PendingPixel px = { x, y, { rgba[0], rgba[1], rgba[2], rgba[3] } };
+		pendingPixels.push_back(px);
+
+		if (pendingPixels.size() >= MAX_PENDING_PIXELS)
+			flushPixels();
+	}
+
+	void flushPixels()
+	{
+		if (swSurface)
+		{
+			uploadSoftware();
+			return;
+		}
+
+		if (pendingPixels.empty())
+			return;
+
+		prepareCon.disconnect();
+
+		if (!uploadPendingRect())
+			for (MegaTiles t(this, pendingRect); t.next();)
+				drawPendingPixels();
+
+		pendingPixels.clear();
+	}
+
+	/* For operations that overwrite everything anyway */
+	void dropPixels()
+	{
+		if (pendingPixels.empty())
+			return;
+
+		prepareCon.disconnect();
+		pendingPixels.clear();
+	}
+
+	/* If all of the bounding box is cached in client memory,
+	 * (which set_pixel keeps up to date), it is uploaded as is */
+	bool uploadPendingRect()
+	{
+		const IntRect &r = pendingRect;
+
+		if ((size_t) r.w * r.h > pendingPixels.size() * PENDING_RECT_DENSITY)
+			return false;
+
+		std::vector<uint8_t> buffer(r.w * r.h * 4);
+
+		if (!pixelCache.copyRect(r, &buffer[0]))
+			return false;
+
+		uploadRect(r, &buffer[0]);
+
+		return true;
+	}
+
+	/* Otherwise, every pixel is drawn as a quad of its own,
+	 * all in a single call */
+	void drawPendingPixels()
+	{
+		ColorQuadArray qArray;
+		qArray.resize(pendingPixels.size());
+
+		for (size_t i = 0; i < pendingPixels.size(); ++i)
+		{
+			const PendingPixel &px = pendingPixels[i];
+			Vertex *vert = &qArray.vertices[i*4];
+
+			Quad::setPosRect(vert, FloatRect(px.x, px.y, 1, 1));
+			Quad::setColor(vert, Vec4(px.rgba[0] / 255.0f, px.rgba[1] / 255.0f,
+			                          px.rgba[2] / 255.0f, px.rgba[3] / 255.0f));
+		}
+
+		qArray.commit();
+
+		SimpleColorShader &shader = shState->shaders().simpleColor();
+		shader.bind();
+		shader.setTranslation(Vec2i());
+
+		bindFBO();
+		pushSetViewport(shader);
+
+		glState.blend.pushSet(false);
+		qArray.draw();
+		glState.blend.pop();
+
+		popViewport();
+	}
+
+	/* Draws 'mask' (plain text) into a new texture of
+	 * 'size' together with the font's outline and/or
+	 * shadow, taking over opacity from the colors */
+	TEXFBO applyTextEffects(TEXFBO &mask, const Vec2i &size, const Vec4 &color)
+	{
+		const bool outline = font->getOutline();
+		const int off = outline ? OUTLINE_SIZE : 0;
+
+		TEXFBO fxTex = shState->texPool().request(size.x, size.y);
+
+		TextFxShader &shader = shState->shaders().textFx();
+		shader.bind();
+		shader.setTexSize(Vec2i(mask.width, mask.height));
+		shader.setTranslation(Vec2i());
+		shader.setTextColor(color);
+		shader.setOutlineColor(font->getOutColor().norm);
+		shader.setOutline(outline);
+		shader.setShadow(font->getShadow());
+
+		TEX::bind(mask.tex);
+
+		Quad &quad = shState->gpQuad();
+		quad.setTexPosRect(FloatRect(-off, -off, size.x, size.y),
+		                   FloatRect(0, 0, size.x, size.y));
+
+		FBO::bind(fxTex.fbo);
+		glState.viewport.pushSet(IntRect(0, 0, size.x, size.y));
+		shader.applyViewportProj();
+
+		blitQuad(quad);
+
+		glState.viewport.pop();
+
+		shState->texPool().release(mask);
+
+		return fxTex;
+	}
+
+	/* Same as the surface based part of Bitmap::drawText,
+	 * with the text composed on the GPU */
+	TextCache::Line renderGlyphs(const GlyphAtlas::Layout &layout, const Vec4 &color)
+	{
+		const Vec2i &rawSize = layout.size;
+
+		/* Outline and shadow grow the text like
+		 * the TTF based versions used to */
+		int grow = 0;
+
+		if (font->getOutline())
+			grow = OUTLINE_SIZE * 2;
+		else if (font->getShadow())
+			grow = 1;
+
+		TextCache::Line line;
+		line.tex = shState->texPool().request(rawSize.x, rawSize.y);
+		line.rawHeight = rawSize.y;
+		line.opacity = color.w;
+
+		shState->glyphAtlas().draw(layout, color, line.tex);
+
+		if (grow > 0)
+		{
+			const Vec2i size(rawSize.x + grow, rawSize.y + grow);
+
+			line.tex = applyTextEffects(line.tex, size, color);
+			line.opacity = 1.0f;
+		}
+
+		return line;
+	}
+
+	/* Blends a rendered line into 'rect'. Returns
+	 * the area the text went into */
+	FloatRect drawLine(const IntRect &rect, const TextCache::Line &line, int align)
+	{
+		TEXFBO txtTex = line.tex;
+		const Vec2i size(txtTex.width, txtTex.height);
+		const float opacity = line.opacity;
+
+		FloatRect posRect = textPosRect(rect, size.x, size.y, line.rawHeight, align);
+		float squeeze = posRect.w / size.x;
+
+		if (!touchesTaintedArea(posRect) && opacity == 1.0f)
+		{
+			IntRect srcRect(0, 0, size.x, size.y);
+			IntRect dstRect = posRect;
+
+			if (squeeze == 1.0f)
+			{
+				/* Keep text hanging over the edges from
+				 * spilling into neighbouring atlas slots */
+				IntRect inters;
+				const IntRect bmRect = bounds();
+
+				if (!SDL_IntersectRect(&bmRect, &dstRect, &inters))
+					return posRect;
+
+				srcRect = IntRect(inters.x - dstRect.x, inters.y - dstRect.y,
+				                  inters.w, inters.h);
+				dstRect = inters;
+			}
+
+			blitBegin();
+			GLMeta::blitSource(txtTex, 1);
+
+			if (squeeze == 1.0f)
+				GLMeta::blitRectangle(srcRect, toTex(dstRect).pos());
+			else
+				GLMeta::blitRectangle(srcRect, toTex(dstRect), true);
+
+			blitEnd();
+		}
+		else
+		{
+			/* Aquire a partial copy of the destination
+			 * buffer we're about to render to */
+			TEXFBO &gpTex2 = shState->gpTexFBO(posRect.w, posRect.h);
+
+			GLMeta::blitBegin(gpTex2);
+			GLMeta::blitSource(tex(), 1);
+			GLMeta::blitRectangle(toTex(posRect), Vec2i());
+			GLMeta::blitEnd();
+
+			FloatRect bltRect(0, 0,
+			                  (float) (txtTex.width * squeeze) / gpTex2.width,
+			                  (float) txtTex.height / gpTex2.height);
+
+			BltShader &shader = shState->shaders().blt();
+			shader.bind();
+			shader.setTexSize(Vec2i(txtTex.width, txtTex.height));
+			shader.setSource();
+			shader.setDestination(gpTex2.tex);
+			shader.setSubRect(bltRect);
+			shader.setOpacity(opacity);
+
+			TEX::bind(txtTex.tex);
+			TEX::setSmooth(true);
+
+			Quad &quad = shState->gpQuad();
+			quad.setTexRect(FloatRect(0, 0, size.x, size.y));
+			quad.setPosRect(posRect);
+
+			bindFBO();
+			pushSetViewport(shader);
+
+			blitQuad(quad);
+
+			popViewport();
+
+			TEX::bind(txtTex.tex);
+			TEX::setSmooth(false);
+		}
+
+		return posRect;
+	}
+
+	void textDrawn(const FloatRect &posRect)
+	{
+		addTaintedArea(posRect);
+
+		if (swSurface)
+			pullSoftware(IntRect(posRect.x, posRect.y,
+			                     ceilf(posRect.w), posRect.h));
+
+		onModified(posRect);
+	}
+
+	void allocSoftware(int width, int height)
+	{
+		swSurface = SDL_CreateRGBSurface(0, width, height, format->BitsPerPixel,
+		                                 format->Rmask, format->Gmask,
+		                                 format->Bmask, format->Amask);
+
+		if (!swSurface)
+			throw Exception(Exception::SDLError, "Error creating Bitmap: %s",
+			                SDL_GetError());
+
+		swDirty = IntRect();
+	}
+
+	uint8_t *swPixel(int x, int y) const
+	{
+		return (uint8_t*) swSurface->pixels + y * swSurface->pitch + x * 4;
+	}
+
+	/* Normalizes 'rect' and clips it to the bitmap;
+	 * returns false if nothing is left of it */
+	bool clipToBitmap(IntRect &rect) const
+	{
+		const IntRect bounds(0, 0, gl.width, gl.height);
+		const IntRect norm = normalizedRect(rect);
+
+		return SDL_IntersectRect(&norm, &bounds, &rect) == SDL_TRUE;
+	}
+
+	/* 'rect' must already be clipped */
+	void markSoftwareDirty(const IntRect &rect)
+	{
+		if (swDirty.w == 0)
+		{
+			swDirty = rect;
+			prepareCon = shState->prepareDraw.connect
+			        (sigc::mem_fun(this, &BitmapPrivate::flushPixels));
+		}
+		else
+		{
+			SDL_UnionRect(&swDirty, &rect, &swDirty);
+		}
+	}
+
+	void uploadSoftware()
+	{
+		if (swDirty.w == 0)
+			return;
+
+		prepareCon.disconnect();
+
+		for (MegaTiles t(this, swDirty); t.next();)
+		{
+			const IntRect part = clipToBounds(swDirty);
+			const IntRect tr = texRect();
+
+			TEX::bind(tex().tex);
+			GLMeta::subRectImageUpload(swSurface->w, part.x, part.y,
+			                           tr.x + part.x, tr.y + part.y,
+			                           part.w, part.h, swSurface, GL_RGBA);
+		}
+
+		GLMeta::subRectImageEnd();
+
+		swDirty = IntRect();
+	}
+
+	/* Operations without a software version run on the
+	 * texture, after which their result is read back
+	 * (as far as it lies inside of the current tile) */
+	void pullSoftware(IntRect rect)
+	{
+		rect = clipToBounds(rect);
+
+		if (rect.w == 0 || rect.h == 0)
+			return;
+
+		const size_t rowBytes = rect.w * 4;
+		std::vector<uint8_t> buffer(rowBytes * rect.h);
+
+		readRect(rect, &buffer[0]);
+
+		for (int i = 0; i < rect.h; ++i)
+			memcpy(swPixel(rect.x, rect.y + i), &buffer[i * rowBytes], rowBytes);
+	}
+
+	static void colorBytes(const Vec4 &color, uint8_t rgba[4])
+	{
+		rgba[0] = clamp<float>(color.x, 0, 1) * 255.0f + 0.5f;
+		rgba[1] = clamp<float>(color.y, 0, 1) * 255.0f + 0.5f;
+		rgba[2] = clamp<float>(color.z, 0, 1) * 255.0f + 0.5f;
+		rgba[3] = clamp<float>(color.w, 0, 1) * 255.0f + 0.5f;
+	}
+
+	void fillSoftware(IntRect rect, const Vec4 &color)
+	{
+		if (!clipToBitmap(rect))
+			return;
+
+		uint8_t rgba[4];
+		colorBytes(color, rgba);
+
+		for (int i = 0; i < rect.h; ++i)
+			PixelKernels::fill(swPixel(rect.x, rect.y + i), rect.w, rgba);
+
+		markSoftwareDirty(rect);
+	}
+
+	/* Matches the vertex color interpolation of the
+	 * GL version, sampled at pixel centers */
+	void gradientSoftware(const IntRect &rect, Vec4 color1, Vec4 color2,
+	                      bool vertical)
+	{
+		const IntRect norm = normalizedRect(rect);
+		IntRect clip = rect;
+
+		if (!clipToBitmap(clip))
+			return;
+
+		if ((vertical ? rect.h : rect.w) < 0)
+			std::swap(color1, color2);
+
+		const Vec4 delta(color2.x - color1.x, color2.y - color1.y,
+		                 color2.z - color1.z, color2.w - color1.w);
+		uint8_t rgba[4];
+
+		if (vertical)
+		{
+			for (int i = 0; i < clip.h; ++i)
+			{
+				const float t = (clip.y + i - norm.y + 0.5f) / norm.h;
+
+				colorBytes(Vec4(color1.x + delta.x * t, color1.y + delta.y * t,
+				                color1.z + delta.z * t, color1.w + delta.w * t), rgba);
+				PixelKernels::fill(swPixel(clip.x, clip.y + i), clip.w, rgba);
+			}
+		}
+		else
+		{
+			uint8_t *row = swPixel(clip.x, clip.y);
+
+			for (int i = 0; i < clip.w; ++i)
+			{
+				const float t = (clip.x + i - norm.x + 0.5f) / norm.w;
+
+				colorBytes(Vec4(color1.x + delta.x * t, color1.y + delta.y * t,
+				                color1.z + delta.z * t, color1.w + delta.w * t), row + i * 4);
+			}
+
+			for (int i = 1; i < clip.h; ++i)
+				memcpy(swPixel(clip.x, clip.y + i), row, clip.w * 4);
+		}
+
+		markSoftwareDirty(clip);
 	}
 
-	void clearTaintedArea()
+	/* Source pixels come in as the 'window' part of the source
+	 * bitmap (rows 'pitch' bytes apart); samples outside of it
+	 * are clamped to its edges. Scaling is nearest neighbour */
+	void bltSoftware(IntRect destRect, IntRect srcRect,
+	                 const uint8_t *window, int pitch, const IntRect &winRect,
+	                 int opacity)
 	{
-		pixman_region_fini(&tainted);
-		pixman_region_init(&tainted);
-	}
+		/* Turn mirrored destinations into mirrored sources */
+		if (destRect.w < 0)
+		{
+			destRect.x += destRect.w;
+			destRect.w = -destRect.w;
+			srcRect.x += srcRect.w;
+			srcRect.w = -srcRect.w;
+		}
 
-	void addTaintedArea(const IntRect &rect)
-	{	
-		IntRect norm = normalizedRect(rect);
-		pixman_region_union_rect
-		        (&tainted, &tainted, norm.x, norm.y, norm.w, norm.h);
-	}
+		if (destRect.h < 0)
+		{
+			destRect.y += destRect.h;
+			destRect.h = -destRect.h;
+			srcRect.y += srcRect.h;
+			srcRect.h = -srcRect.h;
+		}
 
-	void substractTaintedArea(const IntRect &rect)
-	{
-		if (!touchesTaintedArea(rect))
+		IntRect clip = destRect;
+
+		if (destRect.w == 0 || destRect.h == 0 || !clipToBitmap(clip))
 			return;
 
-		pixman_region16_t m_reg;
-		pixman_region_init_rect(&m_reg, rect.x, rect.y, rect.w, rect.h);
+		const bool copy = (opacity == 255 && !touchesTaintedArea(destRect));
+		const bool direct = (srcRect == winRect &&
+		                     srcRect.w == destRect.w && srcRect.h == destRect.h);
 
-		pixman_region_subtract(&tainted, &m_reg, &tainted);
+		const float scaleX = (float) srcRect.w / destRect.w;
+		const float scaleY = (float) srcRect.h / destRect.h;
 
-		pixman_region_fini(&m_reg);
-	}
+		std::vector<int> columns;
+		std::vector<uint8_t> row;
 
-	bool touchesTaintedArea(const IntRect &rect)
-	{
-		pixman_box16_t box;
-		box.x1 = rect.x;
-		box.y1 = rect.y;
-		box.x2 = rect.x + rect.w;
-		box.y2 = rect.y + rect.h;
+		if (!direct)
+		{
+			columns.resize(clip.w);
+			row.resize(clip.w * 4);
 
-		pixman_region_overlap_t result =
-		        pixman_region_contains_rectangle(&tainted, &box);
+			for (int i = 0; i < clip.w; ++i)
+			{
+				int x = floorf(srcRect.x + (clip.x + i - destRect.x + 0.5f) * scaleX);
+				columns[i] = clamp(x, winRect.x, winRect.x + winRect.w - 1) - winRect.x;
+			}
+		}
 
-		return result != PIXMAN_REGION_OUT;
-	}
+		for (int i = 0; i < clip.h; ++i)
+		{
+			int y = floorf(srcRect.y + (clip.y + i - destRect.y + 0.5f) * scaleY);
+			y = clamp(y, winRect.y, winRect.y + winRect.h - 1) - winRect.y;
 
-	void bindTexture(ShaderBase &shader)
-	{
-		TEX::bind(gl.tex);
-		shader.setTexSize(Vec2i(gl.width, gl.height));
-	}
+			const uint32_t *srcRow = (const uint32_t*) (window + y * pitch);
+			const uint8_t *src;
 
-	void bindFBO()
-	{
-		FBO::bind(gl.fbo);
-	}
+			if (direct)
+			{
+				src = (const uint8_t*) (srcRow + (clip.x - destRect.x));
+			}
+			else
+			{
+				uint32_t *gather = (uint32_t*) &row[0];
 
-	void pushSetViewport(ShaderBase &shader) const
-	{
-		glState.viewport.pushSet(IntRect(0, 0, gl.width, gl.height));
-		shader.applyViewportProj();
-	}
+				for (int j = 0; j < clip.w; ++j)
+					gather[j] = srcRow[columns[j]];
 
-	void popViewport() const
-	{
-		glState.viewport.pop();
+				src = &row[0];
+			}
+
+			uint8_t *dst = swPixel(clip.x, clip.y + i);
+
+			if (copy)
+				memcpy(dst, src, clip.w * 4);
+			else
+				PixelKernels::blend(dst, src, clip.w, opacity);
+		}
+
+		markSoftwareDirty(clip);
 	}
 
-	void blitQuad(Quad &quad)
+	void hueChangeSoftware(float hueAdjust)
 	{
-		glState.blend.pushSet(false);
-		quad.draw();
-		glState.blend.pop();
+		for (int i = 0; i < swSurface->h; ++i)
+			PixelKernels::hueShift(swPixel(0, i), swSurface->w, hueAdjust);
+
+		markSoftwareDirty(IntRect(0, 0, swSurface->w, swSurface->h));
 	}
+};
 
-	void fillRect(const IntRect &rect,
-	              const Vec4 &color)
+MegaTiles::MegaTiles(BitmapPrivate *p, const IntRect &rect)
+    : p(p),
+      prevTile(p->megaTile),
+      x1(0), y1(0), x2(0), y2(0),
+      x(0), y(0),
+      started(false)
+{
+	if (!p->isMega())
+		return;
+
+	IntRect clip;
+	const IntRect norm = normalizedRect(rect);
+	const IntRect bmRect(0, 0, p->gl.width, p->gl.height);
+
+	/* Nothing to iterate over */
+	if (!SDL_IntersectRect(&norm, &bmRect, &clip))
 	{
-		bindFBO();
+		x2 = y2 = -1;
+		return;
+	}
 
-		glState.scissorTest.pushSet(true);
-		glState.scissorBox.pushSet(normalizedRect(rect));
-		glState.clearColor.pushSet(color);
+	const int tileSize = megaTileSize();
 
-		FBO::clear();
+	x1 = clip.x / tileSize;
+	y1 = clip.y / tileSize;
+	x2 = (clip.x + clip.w - 1) / tileSize;
+	y2 = (clip.y + clip.h - 1) / tileSize;
+}
 
-		glState.clearColor.pop();
-		glState.scissorBox.pop();
-		glState.scissorTest.pop();
-	}
+MegaTiles::~MegaTiles()
+{
+	p->megaTile = prevTile;
+}
 
-	static void ensureFormat(SDL_Surface *&surf, Uint32 format)
+bool MegaTiles::next()
+{
+	if (!p->isMega())
 	{
-		if (surf->format->format == format)
-			return;
+		if (started)
+			return false;
 
-		SDL_Surface *surfConv = SDL_ConvertSurfaceFormat(surf, format, 0);
-		SDL_FreeSurface(surf);
-		surf = surfConv;
+		return started = true;
 	}
 
-	void onModified(bool freeSurface = true)
+	if (!started)
 	{
-		if (surface && freeSurface)
-		{
-			SDL_FreeSurface(surface);
-			surface = 0;
-		}
-
-		self->modified();
+		x = x1;
+		y = y1;
+		started = true;
+	}
+	else if (++x > x2)
+	{
+		x = x1;
+		++y;
 	}
-};
-
-struct BitmapOpenHandler : FileSystem::OpenHandler
-{
-	SDL_Surface *surf;
-
-	BitmapOpenHandler()
-	    : surf(0)
-	{}
 
-	bool tryRead(SDL_RWops &ops, const char *ext)
+	if (x > x2 || y > y2)
 	{
-		surf = IMG_LoadTyped_RW(&ops, 1, ext);
-		return surf != 0;
+		p->megaTile = prevTile;
+		return false;
 	}
-};
+
+	p->megaTile = y * p->megaTilesX + x;
+
+	return true;
+}
 
 Bitmap::Bitmap(const char *filename)
 {
-	BitmapOpenHandler handler;
-	shState->fileSystem().openRead(handler, filename);
-	SDL_Surface *imgSurf = handler.surf;
+	ImageCache &cache = shState->imageCache();
+
+	SDL_Surface *imgSurf = cache.lookup(filename);
+	const bool cached = (imgSurf != 0);
+
+	if (!imgSurf)
+		imgSurf = shState->imageDecoder().take(filename);
+
+	if (!imgSurf)
+		imgSurf = ImageDecoder::load(shState->fileSystem(), filename);
 
 	if (!imgSurf)
 		throw Exception(Exception::SDLError, "Error loading image '%s': %s",
 		                filename, SDL_GetError());
 
-	p->ensureFormat(imgSurf, SDL_PIXELFORMAT_ABGR8888);
+	p = new BitmapPrivate(this);
 
-	if (imgSurf->w > glState.caps.maxTexSize || imgSurf->h > glState.caps.maxTexSize)
+	try
 	{
-		/* Mega surface */
-		p = new BitmapPrivate(this);
-		p->megaSurface = imgSurf;
-		SDL_SetSurfaceBlendMode(p->megaSurface, SDL_BLENDMODE_NONE);
+		p->allocTex(imgSurf->w, imgSurf->h);
 	}
-	else
+	catch (const Exception &e)
 	{
-		/* Regular surface */
-		TEXFBO tex;
+		delete p;
 
-		try
-		{
-			tex = shState->texPool().request(imgSurf->w, imgSurf->h);
-		}
-		catch (const Exception &e)
-		{
+		if (!cached)
 			SDL_FreeSurface(imgSurf);
-			throw e;
-		}
 
-		p = new BitmapPrivate(this);
-		p->gl = tex;
+		throw e;
+	}
 
-		TEX::bind(p->gl.tex);
-		TEX::uploadImage(p->gl.width, p->gl.height, imgSurf->pixels, GL_RGBA);
+	p->upload(imgSurf->pixels);
 
-		SDL_FreeSurface(imgSurf);
-	}
+	/* The cache decides whether mega surfaces
+	 * are worth keeping a copy of in RAM */
+	if (!cached)
+		cache.store(filename, imgSurf);
 
 	p->addTaintedArea(rect());
 }
 
-Bitmap::Bitmap(int width, int height)
+Bitmap::Bitmap(int width, int height, bool software)
 {
 	if (width <= 0 || height <= 0)
 		throw Exception(Exception::RGSSError, "failed to create bitmap");
 
-	TEXFBO tex = shState->texPool().request(width, height);
-
 	p = new BitmapPrivate(this);
-	p->gl = tex;
+
+	try
+	{
+		if (software)
+			p->allocSoftware(width, height);
+
+		p->allocTex(width, height);
+	}
+	catch (const Exception &e)
+	{
+		delete p;
+		throw e;
+	}
 
 	clear();
 }
 
 Bitmap::Bitmap(void *pixeldata, int width, int height)
 {
-    SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height, p->format->BitsPerPixel,
-                                                p->format->Rmask,
-                                                p->format->Gmask,
-                                                p->format->Bmask,
-                                                p->format->Amask);
-    
-    if (!surface)
-        throw Exception(Exception::SDLError, "Error creating Bitmap: %s",
-                        SDL_GetError());
-    
-    memcpy(surface->pixels, pixeldata, width*height*(p->format->BitsPerPixel/8));
-    
-    if (surface->w > glState.caps.maxTexSize || surface->h > glState.caps.maxTexSize)
-    {
-        p = new BitmapPrivate(this);
-        p->megaSurface = surface;
-        SDL_SetSurfaceBlendMode(p->megaSurface, SDL_BLENDMODE_NONE);
-    }
-    else
-    {
-        TEXFBO tex;
-        
-        try
-        {
-            tex = shState->texPool().request(surface->w, surface->h);
-        }
-        catch (const Exception &e)
-        {
-            SDL_FreeSurface(surface);
-            throw e;
-        }
-        
-        p = new BitmapPrivate(this);
-        p->gl = tex;
-        
-        TEX::bind(p->gl.tex);
-        TEX::uploadImage(p->gl.width, p->gl.height, surface->pixels, GL_RGBA);
-        
-        SDL_FreeSurface(surface);
-    }
-    
-    p->addTaintedArea(rect());
+	p = new BitmapPrivate(this);
+
+	try
+	{
+		p->allocTex(width, height);
+	}
+	catch (const Exception &e)
+	{
+		delete p;
+		throw e;
+	}
+
+	p->upload(pixeldata);
+
+	p->addTaintedArea(rect());
 }
 
 Bitmap::Bitmap(const Bitmap &other)
 {
-	other.ensureNonMega();
-
 	p = new BitmapPrivate(this);
 
-	p->gl = shState->texPool().request(other.width(), other.height());
+	try
+	{
+		if (other.p->swSurface)
+			p->allocSoftware(other.width(), other.height());
+
+		p->allocTex(other.width(), other.height());
+	}
+	catch (const Exception &e)
+	{
+		delete p;
+		throw e;
+	}
 
 	blt(0, 0, other, rect());
 }
@@ -373,9 +1392,6 @@ int Bitmap::width() const
 {
 	guardDisposed();
 
-	if (p->megaSurface)
-		return p->megaSurface->w;
-
 	return p->gl.width;
 }
 
@@ -383,16 +1399,20 @@ int Bitmap::height() const
 {
 	guardDisposed();
 
-	if (p->megaSurface)
-		return p->megaSurface->h;
-
 	return p->gl.height;
 }
 
+unsigned int Bitmap::contentStamp() const
+{
+	guardDisposed();
+
+	return p->contentStamp;
+}
+
 bool Bitmap::isMega() const{
 	guardDisposed();
 
-	return p->megaSurface;
+	return p->isMega();
 }
 
 IntRect Bitmap::rect() const
@@ -431,8 +1451,6 @@ void Bitmap::stretchBlt(const IntRect &destRect,
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
 	if (source.isDisposed())
 		return;
 
@@ -441,132 +1459,184 @@ void Bitmap::stretchBlt(const IntRect &destRect,
 	if (opacity == 0)
 		return;
 
-	SDL_Surface *srcSurf = source.megaSurface();
-
-	if (srcSurf && shState->config().subImageFix)
+	if (p->swSurface)
 	{
-		/* Blit from software surface, for broken GL drivers */
-		Vec2i gpTexSize;
-		shState->ensureTexSize(sourceRect.w, sourceRect.h, gpTexSize);
-		shState->bindTex();
-
-		GLMeta::subRectImageUpload(srcSurf->w, sourceRect.x, sourceRect.y, 0, 0,
-		                           sourceRect.w, sourceRect.h, srcSurf, GL_RGBA);
-		GLMeta::subRectImageEnd();
-
-		SimpleShader &shader = shState->shaders().simple;
-		shader.bind();
-		shader.setTranslation(Vec2i());
-		shader.setTexSize(gpTexSize);
+		stretchBltSoftware(destRect, source, sourceRect, opacity);
+		return;
+	}
 
-		p->pushSetViewport(shader);
-		p->bindFBO();
+	p->flushPixels();
+	source.p->flushPixels();
 
-		Quad &quad = shState->gpQuad();
-		quad.setTexRect(FloatRect(0, 0, sourceRect.w, sourceRect.h));
-		quad.setPosRect(destRect);
+	if (source.p == p && p->isMega())
+	{
+		/* Tiles can't be read from and drawn
+		 * to at once; go through a copy */
+		const IntRect srcNorm = normalizedRect(sourceRect);
+		const IntRect bmRect = rect();
+		IntRect window;
 
-		p->blitQuad(quad);
-		p->popViewport();
+		if (SDL_IntersectRect(&srcNorm, &bmRect, &window) != SDL_TRUE)
+			return;
 
-		p->addTaintedArea(destRect);
-		p->onModified();
+		Bitmap copy(window.w, window.h);
+		copy.blt(0, 0, *this, window);
 
+		stretchBlt(destRect, copy,
+		           IntRect(sourceRect.x - window.x, sourceRect.y - window.y,
+		                   sourceRect.w, sourceRect.h), opacity);
 		return;
 	}
-	else if (srcSurf)
+
+	if (p->isMega() && p->megaTile < 0)
 	{
-		/* Blit from software surface */
-		/* Don't do transparent blits for now */
-		if (opacity < 255)
-			source.ensureNonMega();
+		for (MegaTiles t(p, destRect); t.next();)
+			stretchBlt(destRect, source, sourceRect, opacity);
 
-		SDL_Rect srcRect = sourceRect;
-		SDL_Rect dstRect = destRect;
-		SDL_Rect btmRect = { 0, 0, width(), height() };
-		SDL_Rect bltRect;
+		return;
+	}
 
-		if (SDL_IntersectRect(&btmRect, &dstRect, &bltRect) != SDL_TRUE)
+	if (source.p->isMega() && source.p->megaTile < 0)
+	{
+		/* Every source tile is drawn to the part
+		 * of 'destRect' its pixels map to */
+		if (sourceRect.w == 0 || sourceRect.h == 0)
 			return;
 
-		int bpp;
-		Uint32 rMask, gMask, bMask, aMask;
-		SDL_PixelFormatEnumToMasks(SDL_PIXELFORMAT_ABGR8888,
-		                           &bpp, &rMask, &gMask, &bMask, &aMask);
-		SDL_Surface *blitTemp =
-			SDL_CreateRGBSurface(0, destRect.w, destRect.h, bpp, rMask, gMask, bMask, aMask);
-
-		SDL_BlitScaled(srcSurf, &srcRect, blitTemp, 0);
+		for (MegaTiles t(source.p, sourceRect); t.next();)
+		{
+			const IntRect part = source.p->clipToBounds(sourceRect);
+			IntRect srcPart, dstPart;
 
-		TEX::bind(p->gl.tex);
+			mapSpan(sourceRect.x, sourceRect.w, destRect.x, destRect.w,
+			        part.x, part.w, srcPart.x, srcPart.w, dstPart.x, dstPart.w);
+			mapSpan(sourceRect.y, sourceRect.h, destRect.y, destRect.h,
+			        part.y, part.h, srcPart.y, srcPart.h, dstPart.y, dstPart.h);
 
-		if (bltRect.w == dstRect.w && bltRect.h == dstRect.h)
-		{
-			/* Dest rectangle lies within bounding box */
-			TEX::uploadSubImage(destRect.x, destRect.y,
-			                    destRect.w, destRect.h,
-			                    blitTemp->pixels, GL_RGBA);
-		}
-		else
-		{
-			/* Clipped blit */
-			GLMeta::subRectImageUpload(blitTemp->w, bltRect.x - dstRect.x, bltRect.y - dstRect.y,
-			                           bltRect.x, bltRect.y, bltRect.w, bltRect.h, blitTemp, GL_RGBA);
-			GLMeta::subRectImageEnd();
+			if (dstPart.w != 0 && dstPart.h != 0)
+				stretchBlt(dstPart, source, srcPart, opacity);
 		}
 
-		SDL_FreeSurface(blitTemp);
-
-		p->onModified();
 		return;
 	}
 
 	if (opacity == 255 && !p->touchesTaintedArea(destRect))
 	{
 		/* Fast blit */
-		GLMeta::blitBegin(p->gl);
-		GLMeta::blitSource(source.p->gl, 1);
-		GLMeta::blitRectangle(sourceRect, destRect);
-		GLMeta::blitEnd();
+		p->blitBegin();
+		GLMeta::blitSource(source.p->tex(), 1);
+		GLMeta::blitRectangle(source.p->toTex(sourceRect), p->toTex(destRect));
+		p->blitEnd();
 	}
 	else
 	{
 		/* Fragment pipeline */
 		float normOpacity = (float) opacity / 255.0f;
 
+		/* Source coordinates are relative to its backing texture */
+		IntRect srcTexRect = source.p->toTex(sourceRect);
+		TEXFBO srcTex = source.p->tex();
+		bool srcCopied = false;
+
+		/* Sampling the texture we draw to is undefined, and atlas
+		 * neighbours share one; read the source from a copy */
+		if (srcTex.tex == p->tex().tex)
+		{
+			const IntRect srcNorm = normalizedRect(srcTexRect);
+
+			if (srcNorm.w == 0 || srcNorm.h == 0)
+				return;
+
+			TEXFBO copy = shState->texPool().request(srcNorm.w, srcNorm.h);
+
+			GLMeta::blitBegin(copy);
+			GLMeta::blitSource(srcTex, 1);
+			GLMeta::blitRectangle(srcNorm, Vec2i());
+			GLMeta::blitEnd();
+
+			srcTexRect.x -= srcNorm.x;
+			srcTexRect.y -= srcNorm.y;
+			srcTex = copy;
+			srcCopied = true;
+		}
+
 		TEXFBO &gpTex = shState->gpTexFBO(destRect.w, destRect.h);
 
 		GLMeta::blitBegin(gpTex);
-		GLMeta::blitSource(p->gl, 1);
-		GLMeta::blitRectangle(destRect, Vec2i());
+		GLMeta::blitSource(p->tex(), 1);
+		GLMeta::blitRectangle(p->toTex(destRect), Vec2i());
 		GLMeta::blitEnd();
 
-		FloatRect bltSubRect((float) sourceRect.x / source.width(),
-		                     (float) sourceRect.y / source.height(),
-		                     ((float) source.width() / sourceRect.w) * ((float) destRect.w / gpTex.width),
-		                     ((float) source.height() / sourceRect.h) * ((float) destRect.h / gpTex.height));
+		FloatRect bltSubRect((float) srcTexRect.x / srcTex.width,
+		                     (float) srcTexRect.y / srcTex.height,
+		                     ((float) srcTex.width / sourceRect.w) * ((float) destRect.w / gpTex.width),
+		                     ((float) srcTex.height / sourceRect.h) * ((float) destRect.h / gpTex.height));
 
-		BltShader &shader = shState->shaders().blt;
+		BltShader &shader = shState->shaders().blt();
 		shader.bind();
 		shader.setDestination(gpTex.tex);
 		shader.setSubRect(bltSubRect);
 		shader.setOpacity(normOpacity);
 
 		Quad &quad = shState->gpQuad();
-		quad.setTexPosRect(sourceRect, destRect);
+		quad.setTexPosRect(srcTexRect, destRect);
 		quad.setColor(Vec4(1, 1, 1, normOpacity));
 
-		source.p->bindTexture(shader);
+		TEX::bind(srcTex.tex);
+		shader.setTexSize(Vec2i(srcTex.width, srcTex.height));
 		p->bindFBO();
 		p->pushSetViewport(shader);
 
 		p->blitQuad(quad);
 
 		p->popViewport();
+
+		if (srcCopied)
+			shState->texPool().release(srcTex);
 	}
 
 	p->addTaintedArea(destRect);
-	p->onModified();
+	p->onModified(destRect);
+}
+
+void Bitmap::stretchBltSoftware(const IntRect &destRect,
+                                const Bitmap &source, const IntRect &sourceRect,
+                                int opacity)
+{
+	/* Only the part of the source that can actually be sampled */
+	const IntRect srcNorm = normalizedRect(sourceRect);
+	const IntRect srcBounds = source.rect();
+	IntRect window;
+
+	if (SDL_IntersectRect(&srcNorm, &srcBounds, &window) != SDL_TRUE)
+		return;
+
+	BitmapPrivate *sp = source.p;
+	std::vector<uint8_t> buffer;
+
+	const uint8_t *pixels;
+	int pitch;
+
+	if (sp->swSurface && sp != p)
+	{
+		pixels = sp->swPixel(window.x, window.y);
+		pitch = sp->swSurface->pitch;
+	}
+	else
+	{
+		buffer.resize(window.w * window.h * 4);
+		pixels = &buffer[0];
+		pitch = window.w * 4;
+
+		/* Also covers blits from ourselves, which
+		 * must not read what they just wrote */
+		source.getPixels(window, &buffer[0], buffer.size());
+	}
+
+	p->bltSoftware(destRect, sourceRect, pixels, pitch, window, opacity);
+
+	p->addTaintedArea(destRect);
+	p->onModified(destRect);
 }
 
 void Bitmap::fillRect(int x, int y,
@@ -580,9 +1650,17 @@ void Bitmap::fillRect(const IntRect &rect, const Vec4 &color)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
+	if (p->swSurface)
+	{
+		p->fillSoftware(rect, color);
+	}
+	else
+	{
+		p->flushPixels();
 
-	p->fillRect(rect, color);
+		for (MegaTiles t(p, rect); t.next();)
+			p->fillRect(rect, color);
+	}
 
 	if (color.w == 0)
 		/* Clear op */
@@ -591,7 +1669,7 @@ void Bitmap::fillRect(const IntRect &rect, const Vec4 &color)
 		/* Fill op */
 		p->addTaintedArea(rect);
 
-	p->onModified();
+	p->onModified(rect);
 }
 
 void Bitmap::gradientFillRect(int x, int y,
@@ -608,9 +1686,18 @@ void Bitmap::gradientFillRect(const IntRect &rect,
 {
 	guardDisposed();
 
-	GUARD_MEGA;
+	if (p->swSurface)
+	{
+		p->gradientSoftware(rect, color1, color2, vertical);
+		p->addTaintedArea(rect);
+		p->onModified(rect);
+
+		return;
+	}
+
+	p->flushPixels();
 
-	SimpleColorShader &shader = shState->shaders().simpleColor;
+	SimpleColorShader &shader = shState->shaders().simpleColor();
 	shader.bind();
 	shader.setTranslation(Vec2i());
 
@@ -633,16 +1720,19 @@ void Bitmap::gradientFillRect(const IntRect &rect,
 
 	quad.setPosRect(rect);
 
-	p->bindFBO();
-	p->pushSetViewport(shader);
+	for (MegaTiles t(p, rect); t.next();)
+	{
+		p->bindFBO();
+		p->pushSetViewport(shader);
 
-	p->blitQuad(quad);
+		p->blitQuad(quad);
 
-	p->popViewport();
+		p->popViewport();
+	}
 
 	p->addTaintedArea(rect);
 
-	p->onModified();
+	p->onModified(rect);
 }
 
 void Bitmap::clearRect(int x, int y, int width, int height)
@@ -654,75 +1744,86 @@ void Bitmap::clearRect(const IntRect &rect)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
+	if (p->swSurface)
+	{
+		p->fillSoftware(rect, Vec4());
+	}
+	else
+	{
+		p->flushPixels();
 
-	p->fillRect(rect, Vec4());
+		for (MegaTiles t(p, rect); t.next();)
+			p->fillRect(rect, Vec4());
+	}
 
-	p->onModified();
+	p->onModified(rect);
 }
 
 void Bitmap::blur()
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
-	Quad &quad = shState->gpQuad();
-	FloatRect rect(0, 0, width(), height());
-	quad.setTexPosRect(rect, rect);
+	p->flushPixels();
 
-	TEXFBO auxTex = shState->texPool().request(width(), height());
+	p->leaveAtlas();
 
-	BlurShader &shader = shState->shaders().blur;
+	BlurShader &shader = shState->shaders().blur();
 	BlurShader::HPass &pass1 = shader.pass1;
 	BlurShader::VPass &pass2 = shader.pass2;
 
-	glState.blend.pushSet(false);
-	glState.viewport.pushSet(IntRect(0, 0, width(), height()));
+	/* Tiles of mega bitmaps are blurred one by one,
+	 * so their edges don't pick up their neighbours */
+	for (MegaTiles t(p, rect()); t.next();)
+	{
+		const IntRect bounds = p->bounds();
+		const Vec2i size(bounds.w, bounds.h);
+
+		Quad &quad = shState->gpQuad();
+		FloatRect quadRect(0, 0, size.x, size.y);
+		quad.setTexPosRect(quadRect, quadRect);
+
+		TEXFBO auxTex = shState->texPool().request(size.x, size.y);
+
+		glState.blend.pushSet(false);
+		glState.viewport.pushSet(IntRect(0, 0, size.x, size.y));
+
+		TEX::bind(p->tex().tex);
+		FBO::bind(auxTex.fbo);
 
-	TEX::bind(p->gl.tex);
-	FBO::bind(auxTex.fbo);
+		pass1.bind();
+		pass1.setTexSize(size);
+		pass1.applyViewportProj();
 
-	pass1.bind();
-	pass1.setTexSize(Vec2i(width(), height()));
-	pass1.applyViewportProj();
+		quad.draw();
 
-	quad.draw();
+		TEX::bind(auxTex.tex);
+		p->bindFBO();
 
-	TEX::bind(auxTex.tex);
-	p->bindFBO();
+		pass2.bind();
+		pass2.setTexSize(size);
+		pass2.applyViewportProj();
 
-	pass2.bind();
-	pass2.setTexSize(Vec2i(width(), height()));
-	pass2.applyViewportProj();
+		quad.draw();
 
-	quad.draw();
+		glState.viewport.pop();
+		glState.blend.pop();
 
-	glState.viewport.pop();
-	glState.blend.pop();
+		shState->texPool().release(auxTex);
 
-	shState->texPool().release(auxTex);
+		if (p->swSurface)
+			p->pullSoftware(bounds);
+	}
 
 	p->onModified();
 }
 
-void Bitmap::radialBlur(int angle, int divisions)
+/* Fills 'qArray' with the part of the radial blur source held by
+ * the tile at 'tile' (in bitmap coordinates): the tile itself,
+ * plus its mirror images across the four bitmap edges, so rotated
+ * copies don't leave the corners empty */
+static void radialBlurQuads(ColorQuadArray &qArray, const IntRect &tile,
+                            int width, int height, float opacity)
 {
-	guardDisposed();
-
-	GUARD_MEGA;
-
-	angle     = clamp<int>(angle, 0, 359);
-	divisions = clamp<int>(divisions, 2, 100);
-
-	const int _width = width();
-	const int _height = height();
-
-	float angleStep = (float) angle / (divisions-1);
-	float opacity   = 1.0f / divisions;
-	float baseAngle = -((float) angle / 2);
-
-	ColorQuadArray qArray;
 	qArray.resize(5);
 
 	std::vector<Vertex> &vert = qArray.vertices;
@@ -730,28 +1831,28 @@ void Bitmap::radialBlur(int angle, int divisions)
 	int i = 0;
 
 	/* Center */
-	FloatRect texRect(0, 0, _width, _height);
-	FloatRect posRect(0, 0, _width, _height);
+	FloatRect texRect(0, 0, tile.w, tile.h);
+	FloatRect posRect(tile.x, tile.y, tile.w, tile.h);
 
 	i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
 
 	/* Upper */
-	posRect = FloatRect(0, 0, _width, -_height);
+	posRect = FloatRect(tile.x, -tile.y, tile.w, -tile.h);
 
 	i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
 
 	/* Lower */
-	posRect = FloatRect(0, _height*2, _width, -_height);
+	posRect = FloatRect(tile.x, height*2 - tile.y, tile.w, -tile.h);
 
 	i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
 
 	/* Left */
-	posRect = FloatRect(0, 0, -_width, _height);
+	posRect = FloatRect(-tile.x, tile.y, -tile.w, tile.h);
 
 	i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
 
 	/* Right */
-	posRect = FloatRect(_width*2, 0, -_width, _height);
+	posRect = FloatRect(width*2 - tile.x, tile.y, -tile.w, tile.h);
 
 	i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
 
@@ -759,44 +1860,103 @@ void Bitmap::radialBlur(int angle, int divisions)
 		vert[i].color = Vec4(1, 1, 1, opacity);
 
 	qArray.commit();
+}
+
+void Bitmap::radialBlur(int angle, int divisions)
+{
+	guardDisposed();
+
+	p->flushPixels();
+
+	p->leaveAtlas();
+
+	angle     = clamp<int>(angle, 0, 359);
+	divisions = clamp<int>(divisions, 2, 100);
+
+	const int _width = width();
+	const int _height = height();
 
-	TEXFBO newTex = shState->texPool().request(_width, _height);
+	float angleStep = (float) angle / (divisions-1);
+	float opacity   = 1.0f / divisions;
+	float baseAngle = -((float) angle / 2);
+
+	/* Rotated copies of any tile can land in any other one, so
+	 * every source tile is drawn into every new tile. Plain
+	 * bitmaps are a single tile covering everything */
+	std::vector<IntRect> tileRects;
+	std::vector<TEXFBO> srcTiles;
+	std::vector<TEXFBO> newTiles;
 
-	FBO::bind(newTex.fbo);
+	for (MegaTiles t(p, rect()); t.next();)
+	{
+		tileRects.push_back(p->bounds());
+		srcTiles.push_back(p->tex());
+	}
 
 	glState.clearColor.pushSet(Vec4());
-	FBO::clear();
+
+	for (size_t i = 0; i < tileRects.size(); ++i)
+	{
+		newTiles.push_back(shState->texPool().request(tileRects[i].w, tileRects[i].h));
+
+		FBO::bind(newTiles[i].fbo);
+		FBO::clear();
+	}
+
+	ColorQuadArray qArray;
 
 	Transform trans;
 	trans.setOrigin(Vec2(_width / 2.0f, _height / 2.0f));
-	trans.setPosition(Vec2(_width / 2.0f, _height / 2.0f));
 
 	glState.blendMode.pushSet(BlendAddition);
 
-	SimpleMatrixShader &shader = shState->shaders().simpleMatrix;
+	SimpleMatrixShader &shader = shState->shaders().simpleMatrix();
 	shader.bind();
 
-	p->bindTexture(shader);
-	TEX::setSmooth(true);
+	for (size_t s = 0; s < tileRects.size(); ++s)
+	{
+		const IntRect &src = tileRects[s];
 
-	p->pushSetViewport(shader);
+		radialBlurQuads(qArray, src, _width, _height, opacity);
 
-	for (int i = 0; i < divisions; ++i)
-	{
-		trans.setRotation(baseAngle + i*angleStep);
-		shader.setMatrix(trans.getMatrix());
-		qArray.draw();
-	}
+		TEX::bind(srcTiles[s].tex);
+		shader.setTexSize(Vec2i(src.w, src.h));
+		TEX::setSmooth(true);
+
+		for (size_t d = 0; d < tileRects.size(); ++d)
+		{
+			const IntRect &dst = tileRects[d];
+
+			FBO::bind(newTiles[d].fbo);
+			glState.viewport.pushSet(IntRect(0, 0, dst.w, dst.h));
+			shader.applyViewportProj();
+
+			trans.setPosition(Vec2(_width / 2.0f - dst.x,
+			                       _height / 2.0f - dst.y));
+
+			for (int i = 0; i < divisions; ++i)
+			{
+				trans.setRotation(baseAngle + i*angleStep);
+				shader.setMatrix(trans.getMatrix());
+				qArray.draw();
+			}
 
-	p->popViewport();
+			glState.viewport.pop();
+		}
 
-	TEX::setSmooth(false);
+		TEX::setSmooth(false);
+	}
 
 	glState.blendMode.pop();
 	glState.clearColor.pop();
 
-	shState->texPool().release(p->gl);
-	p->gl = newTex;
+	size_t k = 0;
+
+	for (MegaTiles t(p, rect()); t.next();)
+		p->replaceTex(newTiles[k++]);
+
+	if (p->swSurface)
+		p->pullSoftware(rect());
 
 	p->onModified();
 }
@@ -805,64 +1965,67 @@ void Bitmap::clear()
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
-	p->bindFBO();
-
-	glState.clearColor.pushSet(Vec4());
-
-	FBO::clear();
+	p->dropPixels();
 
-	glState.clearColor.pop();
+	if (p->swSurface)
+		p->fillSoftware(rect(), Vec4());
+	else
+		for (MegaTiles t(p, rect()); t.next();)
+			p->fillRect(rect(), Vec4());
 
 	p->clearTaintedArea();
 
 	p->onModified();
 }
 
-static uint32_t &getPixelAt(SDL_Surface *surf, SDL_PixelFormat *form, int x, int y)
-{
-	size_t offset = x*form->BytesPerPixel + y*surf->pitch;
-	uint8_t *bytes = (uint8_t*) surf->pixels + offset;
-
-	return *((uint32_t*) bytes);
-}
-
 Color Bitmap::getPixel(int x, int y) const
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
 	if (x < 0 || y < 0 || x >= width() || y >= height())
 		return Vec4();
 
-	if (!p->surface)
+	if (p->swSurface)
 	{
-		p->allocSurface();
+		const uint8_t *pixel = p->swPixel(x, y);
 
-		FBO::bind(p->gl.fbo);
+		return Color(pixel[0], pixel[1], pixel[2], pixel[3]);
+	}
 
-		glState.viewport.pushSet(IntRect(0, 0, width(), height()));
+	/* Cached tiles already carry queued writes */
+	if (!p->pixelCache.holds(x, y))
+		p->flushPixels();
 
-		gl.ReadPixels(0, 0, width(), height(), GL_RGBA, GL_UNSIGNED_BYTE, p->surface->pixels);
+	/* Cache tiles never straddle mega tiles */
+	MegaTiles tile(p, IntRect(x, y, 1, 1));
+	tile.next();
 
-		glState.viewport.pop();
-	}
+	const uint8_t *pixel = p->pixelCache.pixel(x, y, p->tex().fbo, p->texRect());
+
+	return Color(pixel[0], pixel[1], pixel[2], pixel[3]);
+}
+
+void Bitmap::prefetchPixels(const IntRect &rect) const
+{
+	guardDisposed();
+
+	/* Software bitmaps have everything at hand */
+	if (p->swSurface)
+		return;
 
-	uint32_t pixel = getPixelAt(p->surface, p->format, x, y);
+	p->flushPixels();
 
-	return Color((pixel >> p->format->Rshift) & 0xFF,
-	             (pixel >> p->format->Gshift) & 0xFF,
-	             (pixel >> p->format->Bshift) & 0xFF,
-	             (pixel >> p->format->Ashift) & 0xFF);
+	for (MegaTiles t(p, rect); t.next();)
+		p->pixelCache.prefetch(p->clipToBounds(rect), p->tex().fbo, p->texRect());
 }
 
 void Bitmap::setPixel(int x, int y, const Color &color)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
+	/* Out of bounds uploads would land in atlas neighbours */
+	if (x < 0 || y < 0 || x >= width() || y >= height())
+		return;
 
 	uint8_t pixel[] =
 	{
@@ -872,21 +2035,27 @@ void Bitmap::setPixel(int x, int y, const Color &color)
 		(uint8_t) clamp<double>(color.alpha, 0, 255)
 	};
 
-	TEX::bind(p->gl.tex);
-	TEX::uploadSubImage(x, y, 1, 1, &pixel, GL_RGBA);
+	if (p->swSurface)
+	{
+		memcpy(p->swPixel(x, y), pixel, 4);
+		p->markSoftwareDirty(IntRect(x, y, 1, 1));
+		p->addTaintedArea(IntRect(x, y, 1, 1));
+		p->notifyModified();
+
+		return;
+	}
+
+	/* Uploading every pixel on its own is slow; queue
+	 * it up with the others set before the next draw */
+	p->queuePixel(x, y, pixel);
 
 	p->addTaintedArea(IntRect(x, y, 1, 1));
 
 	/* Setting just a single pixel is no reason to throw away the
-	 * whole cached surface; we can just apply the same change */
-
-	if (p->surface)
-	{
-		uint32_t &surfPixel = getPixelAt(p->surface, p->format, x, y);
-		surfPixel = SDL_MapRGBA(p->format, pixel[0], pixel[1], pixel[2], pixel[3]);
-	}
+	 * cached tile; we can just apply the same change */
+	p->pixelCache.setPixel(x, y, pixel);
 
-	p->onModified(false);
+	p->notifyModified();
 }
 
 bool Bitmap::getRaw(void *output, int output_size)
@@ -895,24 +2064,115 @@ bool Bitmap::getRaw(void *output, int output_size)
     
     guardDisposed();
     
-    GUARD_MEGA;
+    if (p->swSurface || p->isMega())
+    {
+        getPixels(rect(), output, output_size);
+        return true;
+    }
+    
+    if (p->pixelCache.copyRect(rect(), output))
+        return true;
     
-    FBO::bind(p->gl.fbo);
-    glReadPixels(0,0,width(),height(),GL_RGBA,GL_UNSIGNED_BYTE,output);
+    p->flushPixels();
+    
+    const IntRect texRect = p->texRect();
+    
+    p->bindFBO();
+    glReadPixels(texRect.x,texRect.y,width(),height(),GL_RGBA,GL_UNSIGNED_BYTE,output);
     return true;
 }
 
+void Bitmap::getPixels(const IntRect &rect, void *output, size_t outputSize) const
+{
+	guardDisposed();
+
+	checkPixelRect(rect, outputSize);
+
+	if (rect.w == 0 || rect.h == 0)
+		return;
+
+	if (p->swSurface)
+	{
+		for (int i = 0; i < rect.h; ++i)
+			memcpy((uint8_t*) output + (size_t) i * rect.w * 4,
+			       p->swPixel(rect.x, rect.y + i), rect.w * 4);
+
+		return;
+	}
+
+	if (p->pixelCache.copyRect(rect, output))
+		return;
+
+	p->flushPixels();
+
+	p->readRect(rect, output);
+}
+
+void Bitmap::setPixels(const IntRect &rect, const void *data, size_t size)
+{
+	guardDisposed();
+
+	checkPixelRect(rect, size);
+
+	if (rect.w == 0 || rect.h == 0)
+		return;
+
+	if (p->swSurface)
+	{
+		for (int i = 0; i < rect.h; ++i)
+			memcpy(p->swPixel(rect.x, rect.y + i),
+			       (const uint8_t*) data + (size_t) i * rect.w * 4, rect.w * 4);
+
+		p->markSoftwareDirty(rect);
+	}
+	else
+	{
+		/* Keep earlier set_pixel calls from overwriting these */
+		p->flushPixels();
+
+		p->uploadRect(rect, data);
+	}
+
+	p->addTaintedArea(rect);
+	p->onModified(rect);
+}
+
+size_t Bitmap::pixelRectSize(const IntRect &rect) const
+{
+	guardDisposed();
+
+	if (rect.x < 0 || rect.y < 0 || rect.w < 0 || rect.h < 0 ||
+	    (long) rect.x + rect.w > width() || (long) rect.y + rect.h > height())
+		throw Exception(Exception::ArgumentError,
+		                "Rect (%d, %d, %d, %d) exceeds bitmap bounds",
+		                rect.x, rect.y, rect.w, rect.h);
+
+	return (size_t) rect.w * rect.h * 4;
+}
+
+void Bitmap::checkPixelRect(const IntRect &rect, size_t size) const
+{
+	size_t expected = pixelRectSize(rect);
+
+	if (size != expected)
+		throw Exception(Exception::ArgumentError,
+		                "Pixel data size mismatch (expected %lu bytes, got %lu)",
+		                (unsigned long) expected, (unsigned long) size);
+}
+
 void Bitmap::replaceRaw(void *pixel_data, int size)
 {
     guardDisposed();
     int w = width();
     int h = height();
     if (size != w*h*4) return;
-    
-    GUARD_MEGA;
 
-    TEX::bind(p->gl.tex);
-    TEX::uploadImage(w, h, pixel_data, GL_RGBA);
+    p->dropPixels();
+
+    if (p->swSurface)
+        setPixels(rect(), pixel_data, size);
+    else
+        p->upload(pixel_data);
 
     taintArea(IntRect(0,0,w,h));
     p->onModified();
@@ -922,8 +2182,6 @@ void Bitmap::saveToFile(const char *filename)
 {
     guardDisposed();
     
-    GUARD_MEGA;
-    
     SDL_Surface *surf = SDL_CreateRGBSurface(0, width(), height(),p->format->BitsPerPixel, p->format->Rmask,p->format->Gmask,p->format->Bmask,p->format->Amask);
     
     if (!surf)
@@ -938,42 +2196,59 @@ void Bitmap::saveToFile(const char *filename)
     SDL_FreeSurface(surf);
     delete fn_normalized;
     if (rc) throw new Exception(Exception::SDLError, "%s", SDL_GetError());
+
+    shState->imageCache().invalidate(filename);
 }
 
 void Bitmap::hueChange(int hue)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
 	if ((hue % 360) == 0)
 		return;
 
-	TEXFBO newTex = shState->texPool().request(width(), height());
+	if (p->swSurface)
+	{
+		p->hueChangeSoftware(wrapRange(hue, 0, 359) / 360.0f);
+		p->onModified();
 
-	FloatRect texRect(rect());
+		return;
+	}
 
-	Quad &quad = shState->gpQuad();
-	quad.setTexPosRect(texRect, texRect);
-	quad.setColor(Vec4(1, 1, 1, 1));
+	p->flushPixels();
 
-	HueShader &shader = shState->shaders().hue;
+	p->leaveAtlas();
+
+	HueShader &shader = shState->shaders().hue();
 	shader.bind();
 	/* Shader expects normalized value */
 	shader.setHueAdjust(wrapRange(hue, 0, 359) / 360.0f);
 
-	FBO::bind(newTex.fbo);
-	p->pushSetViewport(shader);
-	p->bindTexture(shader);
+	for (MegaTiles t(p, rect()); t.next();)
+	{
+		const IntRect bounds = p->bounds();
+
+		TEXFBO newTex = shState->texPool().request(bounds.w, bounds.h);
+
+		FloatRect texRect(0, 0, bounds.w, bounds.h);
+
+		Quad &quad = shState->gpQuad();
+		quad.setTexPosRect(texRect, texRect);
+		quad.setColor(Vec4(1, 1, 1, 1));
+
+		FBO::bind(newTex.fbo);
+		glState.viewport.pushSet(IntRect(0, 0, bounds.w, bounds.h));
+		shader.applyViewportProj();
+		p->bindTexture(shader);
 
-	p->blitQuad(quad);
+		p->blitQuad(quad);
 
-	p->popViewport();
+		glState.viewport.pop();
 
-	TEX::unbind();
+		TEX::unbind();
 
-	shState->texPool().release(p->gl);
-	p->gl = newTex;
+		p->replaceTex(newTex);
+	}
 
 	p->onModified();
 }
@@ -1091,7 +2366,18 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
+	/* Text is drawn into every tile of mega bitmaps on its
+	 * own, clipped to it (the line comes from the cache
+	 * after the first one) */
+	if (p->isMega() && p->megaTile < 0)
+	{
+		for (MegaTiles t(p, this->rect()); t.next();)
+			drawText(rect, str, align);
+
+		return;
+	}
+
+	p->flushPixels();
 
 	std::string fixed = fixupString(str);
 	str = fixed.c_str();
@@ -1111,6 +2397,34 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 
 	float txtAlpha = fontColor.norm.w;
 
+	TextCache &textCache = shState->textCache();
+	TextCache::Key key(font, str, fontColor.norm, outColor.norm,
+	                   p->font->getOutline(), p->font->getShadow());
+	TextCache::Line line;
+
+	if (textCache.lookup(key, line))
+	{
+		p->textDrawn(p->drawLine(rect, line, align));
+		return;
+	}
+
+	/* Text is put together from cached glyphs, with
+	 * outline and shadow added on top by a shader */
+	GlyphAtlas::Layout layout;
+
+	if (shState->glyphAtlas().layout(font, str, layout))
+	{
+		line = p->renderGlyphs(layout, fontColor.norm);
+
+		FloatRect posRect = p->drawLine(rect, line, align);
+
+		if (!textCache.store(key, line))
+			shState->texPool().release(line.tex);
+
+		p->textDrawn(posRect);
+		return;
+	}
+
 	SDL_Surface *txtSurf;
 
 	if (shState->rtData().config.solidFonts)
@@ -1150,34 +2464,8 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 		TTF_SetFontOutline(font, 0);
 	}
 
-	int alignX = rect.x;
-
-	switch (align)
-	{
-	default:
-	case Left :
-		break;
-
-	case Center :
-		alignX += (rect.w - txtSurf->w) / 2;
-		break;
-
-	case Right :
-		alignX += rect.w - txtSurf->w;
-		break;
-	}
-
-	if (alignX < rect.x)
-		alignX = rect.x;
-
-	int alignY = rect.y + (rect.h - rawTxtSurfH) / 2;
-
-	float squeeze = (float) rect.w / txtSurf->w;
-
-	if (squeeze > 1)
-		squeeze = 1;
-
-	FloatRect posRect(alignX, alignY, txtSurf->w * squeeze, txtSurf->h);
+	FloatRect posRect = textPosRect(rect, txtSurf->w, txtSurf->h, rawTxtSurfH, align);
+	float squeeze = posRect.w / txtSurf->w;
 
 	Vec2i gpTexSize;
 	shState->ensureTexSize(txtSurf->w, txtSurf->h, gpTexSize);
@@ -1193,10 +2481,9 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 			 * boundaries or texSubImage will generate errors.
 			 * If it partly lies outside bounds we have to upload
 			 * the clipped visible part of it. */
-			SDL_Rect btmRect;
-			btmRect.x = btmRect.y = 0;
-			btmRect.w = width();
-			btmRect.h = height();
+			const IntRect texRect = p->texRect();
+
+			SDL_Rect btmRect = p->bounds();
 
 			SDL_Rect txtRect;
 			txtRect.x = posRect.x;
@@ -1226,18 +2513,18 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 					posRect.h = inters.h;
 				}
 
-				TEX::bind(p->gl.tex);
+				TEX::bind(p->tex().tex);
 
 				if (!subImage)
 				{
-					TEX::uploadSubImage(posRect.x, posRect.y,
-					                    posRect.w, posRect.h,
-					                    txtSurf->pixels, GL_RGBA);
+					shState->texUploader().subImage(texRect.x + posRect.x, texRect.y + posRect.y,
+					                                posRect.w, posRect.h,
+					                                txtSurf->pixels, GL_RGBA);
 				}
 				else
 				{
 					GLMeta::subRectImageUpload(txtSurf->w, subSrcX, subSrcY,
-					                           posRect.x, posRect.y,
+					                           texRect.x + posRect.x, texRect.y + posRect.y,
 					                           posRect.w, posRect.h,
 					                           txtSurf, GL_RGBA);
 					GLMeta::subRectImageEnd();
@@ -1250,13 +2537,13 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 			TEXFBO &gpTF = shState->gpTexFBO(txtSurf->w, txtSurf->h);
 
 			TEX::bind(gpTF.tex);
-			TEX::uploadSubImage(0, 0, txtSurf->w, txtSurf->h, txtSurf->pixels, GL_RGBA);
+			shState->texUploader().subImage(0, 0, txtSurf->w, txtSurf->h, txtSurf->pixels, GL_RGBA);
 
-			GLMeta::blitBegin(p->gl);
+			p->blitBegin();
 			GLMeta::blitSource(gpTF, 1);
 			GLMeta::blitRectangle(IntRect(0, 0, txtSurf->w, txtSurf->h),
-			                      posRect, true);
-			GLMeta::blitEnd();
+			                      p->toTex(posRect), true);
+			p->blitEnd();
 		}
 	}
 	else
@@ -1266,15 +2553,15 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 		TEXFBO &gpTex2 = shState->gpTexFBO(posRect.w, posRect.h);
 
 		GLMeta::blitBegin(gpTex2);
-		GLMeta::blitSource(p->gl, 1);
-		GLMeta::blitRectangle(posRect, Vec2i());
+		GLMeta::blitSource(p->tex(), 1);
+		GLMeta::blitRectangle(p->toTex(posRect), Vec2i());
 		GLMeta::blitEnd();
 
 		FloatRect bltRect(0, 0,
 		                  (float) (gpTexSize.x * squeeze) / gpTex2.width,
 		                  (float) gpTexSize.y / gpTex2.height);
 
-		BltShader &shader = shState->shaders().blt;
+		BltShader &shader = shState->shaders().blt();
 		shader.bind();
 		shader.setTexSize(gpTexSize);
 		shader.setSource();
@@ -1283,7 +2570,7 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 		shader.setOpacity(txtAlpha);
 
 		shState->bindTex();
-		TEX::uploadSubImage(0, 0, txtSurf->w, txtSurf->h, txtSurf->pixels, GL_RGBA);
+		shState->texUploader().subImage(0, 0, txtSurf->w, txtSurf->h, txtSurf->pixels, GL_RGBA);
 		TEX::setSmooth(true);
 
 		Quad &quad = shState->gpQuad();
@@ -1299,9 +2586,8 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 	}
 
 	SDL_FreeSurface(txtSurf);
-	p->addTaintedArea(posRect);
 
-	p->onModified();
+	p->textDrawn(posRect);
 }
 
 /* http://www.lemoda.net/c/utf8-to-ucs2/index.html */
@@ -1352,13 +2638,18 @@ IntRect Bitmap::textSize(const char *str)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
 	TTF_Font *font = p->font->getSdlFont();
 
 	std::string fixed = fixupString(str);
 	str = fixed.c_str();
 
+	TextCache &textCache = shState->textCache();
+	TextCache::Key key(font, str);
+	Vec2i size;
+
+	if (textCache.lookupSize(key, size))
+		return IntRect(0, 0, size.x, size.y);
+
 	int w, h;
 	TTF_SizeUTF8(font, str, &w, &h);
 
@@ -1371,6 +2662,8 @@ IntRect Bitmap::textSize(const char *str)
 	if (p->font->getItalic() && *endPtr == '\0')
 		TTF_GlyphMetrics(font, ucs2, 0, 0, 0, 0, &w);
 
+	textCache.storeSize(key, Vec2i(w, h));
+
 	return IntRect(0, 0, w, h);
 }
 
@@ -1388,25 +2681,99 @@ void Bitmap::setInitFont(Font *value)
 
 TEXFBO &Bitmap::getGLTypes()
 {
+	assert(!p->isMega());
+
+	p->flushPixels();
+	p->leaveAtlas();
+
 	return p->gl;
 }
 
-SDL_Surface *Bitmap::megaSurface() const
+void Bitmap::blitTo(const IntRect &rect, const Vec2i &dstPos)
+{
+	p->flushPixels();
+
+	for (MegaTiles t(p, rect); t.next();)
+	{
+		const IntRect part = p->clipToBounds(rect);
+
+		if (part.w == 0 || part.h == 0)
+			continue;
+
+		GLMeta::blitSource(p->tex(), 1);
+		GLMeta::blitRectangle(p->toTex(part), Vec2i(dstPos.x + part.x - rect.x,
+		                                            dstPos.y + part.y - rect.y));
+	}
+}
+
+int Bitmap::megaTileCount() const
+{
+	return p->megaTiles.size();
+}
+
+IntRect Bitmap::megaTileRect(int i) const
+{
+	return p->megaTileRect(i);
+}
+
+void Bitmap::bindMegaTile(ShaderBase &shader, int i)
 {
-	return p->megaSurface;
+	const IntRect r = p->megaTileRect(i);
+
+	TEX::bind(p->megaTiles[i].tex);
+	shader.setTexSize(Vec2i(r.w, r.h));
+	shader.setTexOffset(Vec2i(-r.x, -r.y));
 }
 
-void Bitmap::ensureNonMega() const
+void Bitmap::ensureNonAtlas() const
 {
 	if (isDisposed())
 		return;
 
-	GUARD_MEGA;
+	p->leaveAtlas();
+}
+
+void Bitmap::bindMegaTileLocal(ShaderBase &shader, int i)
+{
+	const IntRect r = p->megaTileRect(i);
+
+	TEX::bind(p->megaTiles[i].tex);
+	shader.setTexSize(Vec2i(r.w, r.h));
 }
 
 void Bitmap::bindTex(ShaderBase &shader)
+{
+	if (p->isMega())
+	{
+		bindMegaTileLocal(shader, 0);
+		return;
+	}
+
+	p->leaveAtlas();
+	p->bindTexture(shader);
+}
+
+void Bitmap::bindAtlasTex(ShaderBase &shader)
 {
 	p->bindTexture(shader);
+	shader.setTexOffset(p->texRect().pos());
+}
+
+IntRect Bitmap::texRect() const
+{
+	return p->texRect();
+}
+
+Vec2i Bitmap::texSize() const
+{
+	const TEXFBO &tex = p->tex();
+
+	return Vec2i(tex.width, tex.height);
+}
+
+bool Bitmap::sharesTex(const Bitmap &other) const
+{
+	return p->tex().tex == other.p->tex().tex;
 }
 
 void Bitmap::taintArea(const IntRect &rect)
@@ -1418,12 +2785,24 @@ int Bitmap::maxSize(){
 	return glState.caps.maxTexSize;
 }
 
+void Bitmap::preload(const char *filename)
+{
+	if (!shState->imageCache().contains(filename))
+		shState->imageDecoder().preload(filename);
+}
+
+bool Bitmap::isLoaded(const char *filename)
+{
+	return shState->imageCache().contains(filename) ||
+	       shState->imageDecoder().isLoaded(filename);
+}
+
 void Bitmap::releaseResources()
 {
-	if (p->megaSurface)
-		SDL_FreeSurface(p->megaSurface);
-	else
-		shState->texPool().release(p->gl);
+	/* Anything still displaying us stops doing so */
+	Scene::markDirty();
+
+	p->releaseTex();
 
 	delete p;
 }
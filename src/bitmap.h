@@ -31,7 +31,6 @@
 class Font;
 class ShaderBase;
 struct TEXFBO;
-struct SDL_Surface;
 
 struct BitmapPrivate;
 // FIXME make this class use proper RGSS classes again
@@ -39,7 +38,10 @@ class Bitmap : public Disposable
 {
 public:
 	Bitmap(const char *filename);
-	Bitmap(int width, int height);
+	/* Software bitmaps keep their pixels in client memory and
+	 * run pixel operations on the CPU; the texture is only
+	 * updated (where changed) once the bitmap is drawn */
+	Bitmap(int width, int height, bool software = false);
     Bitmap(void *pixeldata, int width, int height);
 	/* Clone constructor */
 	Bitmap(const Bitmap &other);
@@ -82,9 +84,25 @@ public:
 	void clear();
 
 	Color getPixel(int x, int y) const;
+
+	/* Starts reading back 'rect' in the background,
+	 * so getPixel calls inside of it don't stall */
+	void prefetchPixels(const IntRect &rect) const;
+
 	void setPixel(int x, int y, const Color &color);
     
     bool getRaw(void *output, int output_size);
+
+	/* Pixels of 'rect', which must lie inside the bitmap, as
+	 * RGBA bytes; rows top to bottom, 'rect.w * 4' bytes
+	 * each and no padding ('rect.w * rect.h * 4' in total) */
+	void getPixels(const IntRect &rect, void *output, size_t outputSize) const;
+	void setPixels(const IntRect &rect, const void *data, size_t size);
+
+	/* Byte size of the pixels of 'rect'; throws if
+	 * 'rect' doesn't lie inside the bitmap */
+	size_t pixelRectSize(const IntRect &rect) const;
+
     void replaceRaw(void *pixel_data, int size);
     void saveToFile(const char *filename);
 
@@ -113,14 +131,52 @@ public:
 	void setInitFont(Font *value);
 
 	/* <internal> */
+	/* Not for mega bitmaps, which have no single texture */
 	TEXFBO &getGLTypes();
-	SDL_Surface *megaSurface() const;
-	void ensureNonMega() const;
+
+	/* Blits 'rect' to 'dstPos' of the target set up with
+	 * GLMeta::blitBegin(); unlike getGLTypes(), this also
+	 * works for mega bitmaps (and atlas residents) */
+	void blitTo(const IntRect &rect, const Vec2i &dstPos);
+
+	/* Mega bitmaps are backed by a grid of textures; these
+	 * are their areas in bitmap coordinates. bindMegaTile()
+	 * binds tile 'i' and sets the texture size and offset
+	 * uniforms in shader so that bitmap coordinates map to it.
+	 * bindMegaTileLocal() is for shaders without a texture offset
+	 * uniform, which have to be fed tile relative coordinates */
+	int megaTileCount() const;
+	IntRect megaTileRect(int i) const;
+	void bindMegaTile(ShaderBase &shader, int i);
+	void bindMegaTileLocal(ShaderBase &shader, int i);
+
+	/* Moves the bitmap out of the shared atlas (if it lives
+	 * in there). Users that need a texture of their own, eg.
+	 * for tiling, must call this outside of the draw cycle */
+	void ensureNonAtlas() const;
 
 	/* Binds the backing texture and sets the correct
-	 * texture size uniform in shader */
+	 * texture size uniform in shader. Mega bitmaps bind
+	 * their top left tile, which shares the bitmap's
+	 * coordinates, so users that only ever sample near
+	 * the origin (eg. windowskins) work unchanged */
 	void bindTex(ShaderBase &shader);
 
+	/* Like bindTex(), but leaves atlas residents in place
+	 * and additionally sets the texture offset uniform */
+	void bindAtlasTex(ShaderBase &shader);
+
+	/* Area of the backing texture holding our pixels,
+	 * and the size of the backing texture itself */
+	IntRect texRect() const;
+	Vec2i texSize() const;
+
+	bool sharesTex(const Bitmap &other) const;
+
+	/* Changes whenever the pixels do, and is never
+	 * the same for two different bitmaps */
+	unsigned int contentStamp() const;
+
 	/* Adds 'rect' to tainted area */
 	void taintArea(const IntRect &rect);
 
@@ -128,8 +184,17 @@ public:
 
 	static int maxSize();
 
+	/* Decodes 'filename' in the background so that a
+	 * later Bitmap(filename) only has to upload it */
+	static void preload(const char *filename);
+	static bool isLoaded(const char *filename);
+
 private:
 	void releaseResources();
+	void stretchBltSoftware(const IntRect &destRect,
+	                        const Bitmap &source, const IntRect &sourceRect,
+	                        int opacity);
+	void checkPixelRect(const IntRect &rect, size_t size) const;
 	const char *klassName() const { return "bitmap"; }
 
 	BitmapPrivate *p;
@@ -0,0 +1,441 @@
+/*
+** bitmapatlas.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bitmapatlas.h"
+
+#include "config.h"
+#include "sharedstate.h"
+#include "glstate.h"
+#include "gl-meta.h"
+#include "perfstats.h"
+
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+
+/* Empty gutter kept around every slot so filtered or
+ * transformed sampling never picks up a neighbour */
+#define SLOT_PADDING 1
+
+struct Shelf
+{
+	int y, h;
+
+	/* Horizontal fill cursor */
+	int x;
+
+	/* Number of live slots on this shelf */
+	int live;
+};
+
+struct ShelfPacker
+{
+	std::vector<Shelf> shelves;
+
+	/* Start of the unused space below the last shelf */
+	int top;
+
+	ShelfPacker()
+	    : top(0)
+	{}
+
+	bool pack(int pageSize, int w, int h, IntRect &out)
+	{
+		const int need = h + SLOT_PADDING;
+		Shelf *best = 0;
+
+		for (size_t i = 0; i < shelves.size(); ++i)
+		{
+			Shelf &s = shelves[i];
+
+			if (s.h < need || s.x + w > pageSize)
+				continue;
+
+			if (!best || s.h < best->h)
+				best = &s;
+		}
+
+		/* Only settle for a considerably taller shelf
+		 * if we can't open a new one */
+		if (!best || (best->h > need + need / 2 && top + need <= pageSize))
+		{
+			if (top + need > pageSize)
+				return false;
+
+			Shelf s = { top, need, 0, 0 };
+			shelves.push_back(s);
+			top += need;
+
+			best = &shelves.back();
+		}
+
+		out = IntRect(best->x, best->y, w, h);
+
+		best->x += w + SLOT_PADDING;
+		++best->live;
+
+		return true;
+	}
+
+	void unpack(const IntRect &rect)
+	{
+		for (size_t i = 0; i < shelves.size(); ++i)
+		{
+			Shelf &s = shelves[i];
+
+			if (s.y != rect.y)
+				continue;
+
+			assert(s.live > 0);
+
+			/* Empty shelves can be filled up again from the start */
+			if (--s.live == 0)
+				s.x = 0;
+
+			break;
+		}
+
+		while (!shelves.empty() && shelves.back().live == 0)
+		{
+			top = shelves.back().y;
+			shelves.pop_back();
+		}
+	}
+};
+
+struct AtlasPage
+{
+	TEXFBO tex;
+	ShelfPacker packer;
+
+	std::vector<AtlasSlot*> slots;
+
+	/* Sum of all live slot areas */
+	int usedArea;
+
+	/* Set after a repack; nothing more can be reclaimed
+	 * by another one until a slot is released again */
+	bool repacked;
+
+	AtlasPage()
+	    : usedArea(0),
+	      repacked(false)
+	{}
+};
+
+static bool compareSlotHeight(const AtlasSlot *a, const AtlasSlot *b)
+{
+	return a->rect.h > b->rect.h;
+}
+
+static void blitSlot(TEXFBO &src, const IntRect &srcRect,
+                     TEXFBO &dst, const Vec2i &dstPos)
+{
+	GLMeta::blitBegin(dst);
+	GLMeta::blitSource(src, 1);
+	GLMeta::blitRectangle(srcRect, dstPos);
+	GLMeta::blitEnd();
+}
+
+struct BitmapAtlasPrivate
+{
+	std::vector<AtlasPage*> pages;
+
+	bool enabled;
+	int maxBitmapSize;
+	int pageSize;
+
+	BitmapAtlasPrivate(const Config &conf)
+	    : enabled(conf.bitmapAtlas.enabled),
+	      maxBitmapSize(conf.bitmapAtlas.maxBitmapSize),
+	      pageSize(conf.bitmapAtlas.pageSize)
+	{}
+
+	~BitmapAtlasPrivate()
+	{
+		for (size_t i = 0; i < pages.size(); ++i)
+		{
+			for (size_t j = 0; j < pages[i]->slots.size(); ++j)
+				delete pages[i]->slots[j];
+
+			TEXFBO::fini(pages[i]->tex);
+			delete pages[i];
+		}
+	}
+
+	static void clearTex(TEXFBO &tex)
+	{
+		FBO::bind(tex.fbo);
+
+		glState.clearColor.pushSet(Vec4());
+		FBO::clear();
+		glState.clearColor.pop();
+	}
+
+	AtlasPage *createPage()
+	{
+		AtlasPage *page = new AtlasPage;
+
+		TEXFBO::init(page->tex);
+		TEXFBO::allocEmpty(page->tex, pageSize, pageSize);
+		TEXFBO::linkFBO(page->tex);
+		clearTex(page->tex);
+
+		pages.push_back(page);
+
+		return page;
+	}
+
+	void destroyPage(AtlasPage *page)
+	{
+		assert(page->slots.empty());
+
+		pages.erase(std::find(pages.begin(), pages.end(), page));
+
+		TEXFBO::fini(page->tex);
+		delete page;
+	}
+
+	AtlasSlot *place(AtlasPage *page, int w, int h)
+	{
+		IntRect rect;
+
+		if (!page->packer.pack(pageSize, w, h, rect))
+			return 0;
+
+		AtlasSlot *slot = new AtlasSlot;
+		slot->tex = &page->tex;
+		slot->rect = rect;
+		slot->page = page;
+
+		page->slots.push_back(slot);
+		page->usedArea += w * h;
+
+		return slot;
+	}
+
+	void unplace(AtlasSlot *slot)
+	{
+		AtlasPage *page = slot->page;
+
+		page->packer.unpack(slot->rect);
+		page->slots.erase(std::find(page->slots.begin(), page->slots.end(), slot));
+		page->usedArea -= slot->rect.w * slot->rect.h;
+		page->repacked = false;
+	}
+
+	/* Packs all slots of a page anew, tallest first, which
+	 * reclaims the holes left behind by released slots.
+	 * Returns false if there was nothing to reclaim */
+	bool repack(AtlasPage *page)
+	{
+		if (page->repacked)
+			return false;
+
+		page->repacked = true;
+
+		std::vector<AtlasSlot*> sorted = page->slots;
+		std::sort(sorted.begin(), sorted.end(), compareSlotHeight);
+
+		ShelfPacker packer;
+		std::vector<IntRect> newRects(sorted.size());
+
+		for (size_t i = 0; i < sorted.size(); ++i)
+			if (!packer.pack(pageSize, sorted[i]->rect.w, sorted[i]->rect.h, newRects[i]))
+				return false;
+
+		TEXFBO newTex;
+		TEXFBO::init(newTex);
+		TEXFBO::allocEmpty(newTex, pageSize, pageSize);
+		TEXFBO::linkFBO(newTex);
+		clearTex(newTex);
+
+		for (size_t i = 0; i < sorted.size(); ++i)
+		{
+			blitSlot(page->tex, sorted[i]->rect, newTex, newRects[i].pos());
+			sorted[i]->rect = newRects[i];
+		}
+
+		/* Slots point at the page's TEXFBO, which
+		 * stays put; only its contents change */
+		TEXFBO::fini(page->tex);
+		page->tex = newTex;
+		page->packer = packer;
+
+		shState->perfStats().add(PerfStats::AtlasDefrags);
+
+		return true;
+	}
+
+	/* Tries to move every slot of 'page' into the other
+	 * pages. Returns true if the page ended up empty */
+	bool drain(AtlasPage *page)
+	{
+		std::vector<AtlasSlot*> slots = page->slots;
+
+		for (size_t i = 0; i < slots.size(); ++i)
+		{
+			AtlasSlot *slot = slots[i];
+			bool moved = false;
+
+			for (size_t j = 0; j < pages.size() && !moved; ++j)
+			{
+				AtlasPage *dst = pages[j];
+				IntRect rect;
+
+				if (dst == page || !dst->packer.pack(pageSize, slot->rect.w, slot->rect.h, rect))
+					continue;
+
+				blitSlot(page->tex, slot->rect, dst->tex, rect.pos());
+
+				unplace(slot);
+
+				slot->tex = &dst->tex;
+				slot->rect = rect;
+				slot->page = dst;
+
+				dst->slots.push_back(slot);
+				dst->usedArea += rect.w * rect.h;
+
+				moved = true;
+			}
+
+			if (!moved)
+				return false;
+		}
+
+		return true;
+	}
+
+	void updateStats()
+	{
+		PerfStats &stats = shState->perfStats();
+
+		int64_t slots = 0;
+		int64_t used = 0;
+
+		for (size_t i = 0; i < pages.size(); ++i)
+		{
+			slots += pages[i]->slots.size();
+			used += pages[i]->usedArea;
+		}
+
+		int64_t total = (int64_t) pages.size() * pageSize * pageSize;
+
+		stats.set(PerfStats::AtlasPages, pages.size());
+		stats.set(PerfStats::AtlasBitmaps, slots);
+		stats.set(PerfStats::AtlasFill, total ? (used * 100) / total : 0);
+	}
+};
+
+BitmapAtlas::BitmapAtlas(const Config &conf)
+{
+	p = new BitmapAtlasPrivate(conf);
+}
+
+BitmapAtlas::~BitmapAtlas()
+{
+	delete p;
+}
+
+AtlasSlot *BitmapAtlas::alloc(int width, int height)
+{
+	if (!p->enabled)
+		return 0;
+
+	if (width > p->maxBitmapSize || height > p->maxBitmapSize)
+		return 0;
+
+	/* Can't know the hardware limit any earlier than this */
+	p->pageSize = std::min(p->pageSize, glState.caps.maxTexSize);
+
+	if (width > p->pageSize || height > p->pageSize)
+		return 0;
+
+	AtlasSlot *slot = 0;
+
+	for (size_t i = 0; i < p->pages.size() && !slot; ++i)
+		slot = p->place(p->pages[i], width, height);
+
+	/* Before growing the atlas, see if a page with enough
+	 * scattered free space can be compacted */
+	const int area = (width + SLOT_PADDING) * (height + SLOT_PADDING);
+
+	for (size_t i = 0; i < p->pages.size() && !slot; ++i)
+	{
+		AtlasPage *page = p->pages[i];
+
+		if (p->pageSize * p->pageSize - page->usedArea < area * 2)
+			continue;
+
+		if (p->repack(page))
+			slot = p->place(page, width, height);
+	}
+
+	if (!slot)
+		slot = p->place(p->createPage(), width, height);
+
+	p->updateStats();
+
+	return slot;
+}
+
+void BitmapAtlas::release(AtlasSlot *slot)
+{
+	AtlasPage *page = slot->page;
+
+	p->unplace(slot);
+	delete slot;
+
+	/* Hold on to the last page to avoid churning
+	 * through allocations on scene changes */
+	if (page->slots.empty() && p->pages.size() > 1)
+		p->destroyPage(page);
+
+	p->updateStats();
+}
+
+void BitmapAtlas::defragment()
+{
+	if (p->pages.empty())
+		return;
+
+	for (size_t i = 0; i < p->pages.size(); ++i)
+		p->repack(p->pages[i]);
+
+	/* Empty out sparsely used pages, least occupied first */
+	std::vector<AtlasPage*> candidates;
+
+	for (size_t i = 0; i < p->pages.size(); ++i)
+		if (p->pages[i]->usedArea < p->pageSize * p->pageSize / 2)
+			candidates.push_back(p->pages[i]);
+
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		if (p->pages.size() == 1)
+			break;
+
+		if (p->drain(candidates[i]))
+			p->destroyPage(candidates[i]);
+	}
+
+	p->updateStats();
+}
@@ -0,0 +1,66 @@
+/*
+** bitmapatlas.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BITMAPATLAS_H
+#define BITMAPATLAS_H
+
+#include "gl-util.h"
+#include "etc-internal.h"
+
+struct Config;
+struct AtlasPage;
+struct BitmapAtlasPrivate;
+
+/* A rectangle handed out by the atlas. Defragmentation may
+ * move it to a different position or page at any time outside
+ * of the draw cycle, so holders should never cache either */
+struct AtlasSlot
+{
+	/* Backing page texture */
+	TEXFBO *tex;
+	IntRect rect;
+
+	AtlasPage *page;
+};
+
+/* Sub-allocates small Bitmaps from large shared textures
+ * ("pages") using shelf packing, so sprites drawing from
+ * different bitmaps can still end up in the same batch */
+class BitmapAtlas
+{
+public:
+	BitmapAtlas(const Config &conf);
+	~BitmapAtlas();
+
+	/* Returns 0 if the atlas is disabled or the
+	 * requested size doesn't qualify for it */
+	AtlasSlot *alloc(int width, int height);
+	void release(AtlasSlot *slot);
+
+	/* Repacks all pages and tries to empty out
+	 * the least occupied ones */
+	void defragment();
+
+private:
+	BitmapAtlasPrivate *p;
+};
+
+#endif // BITMAPATLAS_H
@@ -56,6 +56,27 @@ struct Config {
   bool subImageFix;
   bool enableBlitting;
   int maxTextureSize;
+  bool spriteBatching;
+  bool skipUnchangedFrames;
+  bool shaderCache;
+  bool asyncTexUploads;
+  std::vector<std::string> shaderWarmup;
+
+  struct {
+    bool enabled;
+    int maxBitmapSize;
+    int pageSize;
+  } bitmapAtlas;
+
+  struct {
+    int threads;
+    int budget;
+  } imageDecode;
+
+  int imageCacheSize;
+  int textCacheSize;
+  int tileAtlasCacheSize;
+  int fontPoolSize;
 
   std::string gameFolder;
   bool anyAltToggleFS;
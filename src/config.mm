@@ -63,6 +63,20 @@ void Config::read(int argc, char *argv[]) {
     @"subImageFix" : @false,
     @"enableBlitting" : @true,
     @"maxTextureSize" : @0,
+    @"spriteBatching" : @true,
+    @"skipUnchangedFrames" : @true,
+    @"shaderCache" : @true,
+    @"asyncTexUploads" : @true,
+    @"shaderWarmup" : @[],
+    @"bitmapAtlas" : @false,
+    @"bitmapAtlasMaxSize" : @256,
+    @"bitmapAtlasPageSize" : @2048,
+    @"imageDecodeThreads" : @0,
+    @"imageDecodeBudget" : @128,
+    @"imageCacheSize" : @64,
+    @"textCacheSize" : @16,
+    @"tileAtlasCacheSize" : @32,
+    @"fontPoolSize" : @64,
     @"gameFolder" : @".",
     @"anyAltToggleFS" : @false,
     @"enableReset" : @true,
@@ -147,6 +161,19 @@ void Config::read(int argc, char *argv[]) {
   SET_OPT(subImageFix, boolValue);
   SET_OPT(enableBlitting, boolValue);
   SET_OPT(maxTextureSize, intValue);
+  SET_OPT(spriteBatching, boolValue);
+  SET_OPT(skipUnchangedFrames, boolValue);
+  SET_OPT(shaderCache, boolValue);
+  SET_OPT(asyncTexUploads, boolValue);
+  SET_OPT_CUSTOMKEY(bitmapAtlas.enabled, bitmapAtlas, boolValue);
+  SET_OPT_CUSTOMKEY(bitmapAtlas.maxBitmapSize, bitmapAtlasMaxSize, intValue);
+  SET_OPT_CUSTOMKEY(bitmapAtlas.pageSize, bitmapAtlasPageSize, intValue);
+  SET_OPT_CUSTOMKEY(imageDecode.threads, imageDecodeThreads, intValue);
+  SET_OPT_CUSTOMKEY(imageDecode.budget, imageDecodeBudget, intValue);
+  SET_OPT(imageCacheSize, intValue);
+  SET_OPT(textCacheSize, intValue);
+  SET_OPT(tileAtlasCacheSize, intValue);
+  SET_OPT(fontPoolSize, intValue);
   SET_STRINGOPT(gameFolder, gameFolder);
   SET_OPT(anyAltToggleFS, boolValue);
   SET_OPT(enableReset, boolValue);
@@ -167,9 +194,19 @@ void Config::read(int argc, char *argv[]) {
   fillStringVec(opts[@"preloadScript"], preloadScripts);
   fillStringVec(opts[@"RTP"], rtps);
   fillStringVec(opts[@"fontSub"], fontSubs);
+  fillStringVec(opts[@"shaderWarmup"], shaderWarmup);
   fillStringVec(opts[@"rubyLoadpath"], rubyLoadpaths);
   rgssVersion = clamp(rgssVersion, 0, 3);
   SE.sourceCount = clamp(SE.sourceCount, 1, 64);
+  bitmapAtlas.pageSize = clamp(bitmapAtlas.pageSize, 256, 16384);
+  bitmapAtlas.maxBitmapSize =
+      clamp(bitmapAtlas.maxBitmapSize, 1, bitmapAtlas.pageSize);
+  imageDecode.threads = clamp(imageDecode.threads, 0, 16);
+  imageDecode.budget = clamp(imageDecode.budget, 1, 4096);
+  imageCacheSize = clamp(imageCacheSize, 0, 4096);
+  textCacheSize = clamp(textCacheSize, 0, 1024);
+  tileAtlasCacheSize = clamp(tileAtlasCacheSize, 0, 4096);
+  fontPoolSize = clamp(fontPoolSize, 1, 4096);
 
   if ([opts[@"openGL4"] boolValue]) {
     glVersion.major = 4;
@@ -23,10 +23,19 @@
 
 #include "serial-util.h"
 #include "exception.h"
+#include "scene.h"
 
 #include <SDL_types.h>
 #include <SDL_pixels.h>
 
+/* Colors and tones feed straight into what's drawn, so
+ * any effective change needs the scene redrawn */
+static void checkNormChange(const Vec4 &prev, const Vec4 &norm)
+{
+	if (!(prev == norm))
+		Scene::markDirty();
+}
+
 Color::Color(double red, double green, double blue, double alpha)
 	: red(red), green(green), blue(blue), alpha(alpha)
 {
@@ -54,6 +63,8 @@ bool Color::operator==(const Color &o) const
 
 const Color &Color::operator=(const Color &o)
 {
+	checkNormChange(norm, o.norm);
+
 	red   = o.red;
 	green = o.green;
 	blue  = o.blue;
@@ -65,36 +76,55 @@ const Color &Color::operator=(const Color &o)
 
 void Color::set(double red, double green, double blue, double alpha)
 {
+	const Vec4 prev = norm;
+
 	this->red   = red;
 	this->green = green;
 	this->blue  = blue;
 	this->alpha = alpha;
 
 	updateInternal();
+	checkNormChange(prev, norm);
 }
 
 void Color::setRed(double value)
 {
+	const Vec4 prev = norm;
+
 	red = value;
 	norm.x = clamp<double>(value, 0, 255) / 255;
+
+	checkNormChange(prev, norm);
 }
 
 void Color::setGreen(double value)
 {
+	const Vec4 prev = norm;
+
 	green = value;
 	norm.y = clamp<double>(value, 0, 255) / 255;
+
+	checkNormChange(prev, norm);
 }
 
 void Color::setBlue(double value)
 {
+	const Vec4 prev = norm;
+
 	blue = value;
 	norm.z = clamp<double>(value, 0, 255) / 255;
+
+	checkNormChange(prev, norm);
 }
 
 void Color::setAlpha(double value)
 {
+	const Vec4 prev = norm;
+
 	alpha = value;
 	norm.w = clamp<double>(value, 0, 255) / 255;
+
+	checkNormChange(prev, norm);
 }
 
 /* Serializable */
@@ -176,17 +206,22 @@ bool Tone::operator==(const Tone &o) const
 
 void Tone::set(double red, double green, double blue, double gray)
 {
+	const Vec4 prev = norm;
+
 	this->red   = red;
 	this->green = green;
 	this->blue  = blue;
 	this->gray  = gray;
 
 	updateInternal();
+	checkNormChange(prev, norm);
 	valueChanged();
 }
 
 const Tone& Tone::operator=(const Tone &o)
 {
+	checkNormChange(norm, o.norm);
+
 	red   = o.red;
 	green = o.green;
 	blue  = o.blue;
@@ -200,33 +235,45 @@ const Tone& Tone::operator=(const Tone &o)
 
 void Tone::setRed(double value)
 {
+	const Vec4 prev = norm;
+
 	red = value;
 	norm.x = (float) clamp<double>(value, -255, 255) / 255;
 
+	checkNormChange(prev, norm);
 	valueChanged();
 }
 
 void Tone::setGreen(double value)
 {
+	const Vec4 prev = norm;
+
 	green = value;
 	norm.y = (float) clamp<double>(value, -255, 255) / 255;
 
+	checkNormChange(prev, norm);
 	valueChanged();
 }
 
 void Tone::setBlue(double value)
 {
+	const Vec4 prev = norm;
+
 	blue = value;
 	norm.z = (float) clamp<double>(value, -255, 255) / 255;
 
+	checkNormChange(prev, norm);
 	valueChanged();
 }
 
 void Tone::setGray(double value)
 {
+	const Vec4 prev = norm;
+
 	gray = value;
 	norm.w = (float) clamp<double>(value, 0, 255) / 255;
 
+	checkNormChange(prev, norm);
 	valueChanged();
 }
 
@@ -312,11 +359,15 @@ void Rect::set(int x, int y, int w, int h)
 	this->y = y;
 	width = w;
 	height = h;
+	Scene::markDirty();
 	valueChanged();
 }
 
 const Rect &Rect::operator=(const Rect &o)
 {
+	if (!(*this == o))
+		Scene::markDirty();
+
 	x      = o.x;
 	y      = o.y;
 	width  = o.width;
@@ -333,6 +384,7 @@ void Rect::empty()
 		return;
 
 	x = y = width = height = 0;
+	Scene::markDirty();
 	valueChanged();
 }
 
@@ -347,6 +399,7 @@ void Rect::setX(int value)
 		return;
 
 	x = value;
+	Scene::markDirty();
 	valueChanged();
 }
 
@@ -356,6 +409,7 @@ void Rect::setY(int value)
 		return;
 
 	y = value;
+	Scene::markDirty();
 	valueChanged();
 }
 
@@ -365,6 +419,7 @@ void Rect::setWidth(int value)
 		return;
 
 	width = value;
+	Scene::markDirty();
 	valueChanged();
 }
 
@@ -374,6 +429,7 @@ void Rect::setHeight(int value)
 		return;
 
 	height = value;
+	Scene::markDirty();
 	valueChanged();
 }
 
@@ -70,6 +70,10 @@ public:
 	/* Does not perform extension supplementing */
 	bool exists(const char *filename);
 
+	/* Location of 'filename' on disk if it is a plain file,
+	 * empty if it lives inside an archive (or doesn't exist) */
+	std::string diskPath(const char *filename);
+
 	const char *desensitize(const char *filename);
 
 private:
@@ -40,6 +40,7 @@
 #import <stack>
 #import <stdio.h>
 #import <string.h>
+#import <sys/stat.h>
 #import <unistd.h>
 #import <vector>
 
@@ -550,8 +551,12 @@ openReadEnumCB(void *d, const char *dirpath, const char *filename) {
 
   /* If the path cache is active, translate from lower case
    * to mixed case path */
-  if (data.pathTrans)
+  if (data.pathTrans) {
+    if (!data.pathTrans->contains(fullPath))
+      return PHYSFS_ENUM_OK;
+
     fullPath = (*data.pathTrans)[fullPath].c_str();
+  }
 
   PHYSFS_File *phys = PHYSFS_openRead(fullPath);
 
@@ -608,11 +613,14 @@ void FileSystem::openRead(OpenHandler &handler, const char *filename) {
 
   if (p->havePathCache) {
     /* Get the list of files contained in this directory
-     * and manually iterate over them */
-    const std::vector<std::string> &fileList = p->fileLists[dir];
+     * and manually iterate over them. This may run on image
+     * decoder threads, so never insert into the cache here */
+    if (p->fileLists.contains(dir)) {
+      const std::vector<std::string> &fileList = p->fileLists[dir];
 
-    for (size_t i = 0; i < fileList.size(); ++i)
-      openReadEnumCB(&data, dir, fileList[i].c_str());
+      for (size_t i = 0; i < fileList.size(); ++i)
+        openReadEnumCB(&data, dir, fileList[i].c_str());
+    }
   } else {
     PHYSFS_enumerate(dir, openReadEnumCB, &data);
   }
@@ -673,6 +681,23 @@ bool FileSystem::exists(const char *filename) {
   return PHYSFS_exists(filename);
 }
 
+std::string FileSystem::diskPath(const char *filename) {
+  const char *fn = desensitize(filename);
+  const char *dir = PHYSFS_getRealDir(fn);
+
+  if (!dir)
+    return std::string();
+
+  // For files inside of archives, 'dir' is the archive itself
+  std::string path = std::string(dir) + "/" + fn;
+  struct stat st;
+
+  if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    return std::string();
+
+  return path;
+}
+
 const char *FileSystem::desensitize(const char *filename) {
   OFString *fn_lower = @(filename).lowercaseString;
   if (p->havePathCache && p->pathCache.contains(fn_lower.UTF8String))
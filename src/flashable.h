@@ -24,6 +24,7 @@
 
 #include "etc.h"
 #include "etc-internal.h"
+#include "scene.h"
 
 class Flashable
 {
@@ -45,6 +46,8 @@ public:
 		this->duration = duration;
 		counter = 0;
 
+		Scene::markDirty();
+
 		if (!color)
 		{
 			emptyFlashFlag = true;
@@ -60,6 +63,8 @@ public:
 		if (!flashing)
 			return;
 
+		Scene::markDirty();
+
 		if (++counter > duration)
 		{
 			/* Flash finished. Cleanup */
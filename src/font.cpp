@@ -25,14 +25,30 @@
 #include "filesystem.h"
 #include "exception.h"
 #include "boost-hash.h"
+#include "lru-cache.h"
 #include "util.h"
 #include "config.h"
+#include "perfstats.h"
+#include "glyphatlas.h"
+#include "textcache.h"
 
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <SDL_ttf.h>
 
+#ifdef __WINDOWS__
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #ifndef CJK_FALLBACK
 #include "liberation.ttf.xxd"
 #else
@@ -66,6 +82,117 @@ static SDL_RWops *openBundledFont()
 	return SDL_RWFromConstMem(BNDL_F_D(BUNDLED_FONT), BNDL_F_L(BUNDLED_FONT));
 }
 
+/* Contents of a font file, shared by all handles
+ * opened from it (ie. all sizes of the face) */
+struct FontFile
+{
+	const uint8_t *data;
+	size_t size;
+
+	/* Handles opened from this file */
+	int refCount;
+
+	FontFile()
+	    : data(0),
+	      size(0),
+	      refCount(0),
+	      mapped(false)
+	{}
+
+	~FontFile()
+	{
+		if (!mapped)
+			return;
+
+#ifdef __WINDOWS__
+		UnmapViewOfFile(data);
+#else
+		munmap((void*) data, size);
+#endif
+	}
+
+	/* Maps the file at 'path' on disk into memory */
+	bool map(const char *path)
+	{
+#ifdef __WINDOWS__
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0,
+		                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		HANDLE mapping = 0;
+
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+			mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+
+		/* The view keeps the mapping (and file) alive */
+		CloseHandle(file);
+
+		if (!mapping)
+			return false;
+
+		void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+
+		if (!view)
+			return false;
+
+		size = fileSize.QuadPart;
+#else
+		int fd = open(path, O_RDONLY);
+
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		void *view = MAP_FAILED;
+
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+			view = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		/* The mapping stays valid without the descriptor */
+		close(fd);
+
+		if (view == MAP_FAILED)
+			return false;
+
+		size = st.st_size;
+#endif
+		data = (const uint8_t*) view;
+		mapped = true;
+
+		return true;
+	}
+
+	/* Reads 'path' into memory through the filesystem */
+	void read(const char *path)
+	{
+		SDL_RWops ops;
+		shState->fileSystem().openReadRaw(ops, path);
+
+		Sint64 len = SDL_RWsize(&ops);
+
+		if (len > 0)
+		{
+			buffer.resize(len);
+
+			if (SDL_RWread(&ops, &buffer[0], len, 1) != 1)
+				buffer.clear();
+		}
+
+		SDL_RWclose(&ops);
+
+		data = buffer.empty() ? 0 : &buffer[0];
+		size = buffer.size();
+	}
+
+private:
+	std::vector<uint8_t> buffer;
+	bool mapped;
+};
+
 struct FontSet
 {
 	/* 'Regular' style */
@@ -85,14 +212,108 @@ struct SharedFontStatePrivate
 	 * font filenames located in "Fonts/" */
 	BoostHash<std::string, FontSet> sets;
 
-	/* Pool of already opened fonts; once opened, they are reused
-	 * and never closed until the termination of the program */
-	BoostHash<FontKey, TTF_Font*> pool;
+	struct PoolEntry
+	{
+		TTF_Font *font;
+
+		/* Path of the file, empty for the built-in font */
+		std::string path;
+	};
+
+	typedef LruCache<FontKey, PoolEntry> FontPool;
+
+	/* Pool of already opened fonts. Once it holds 'poolSize'
+	 * handles, the least recently used one is closed for
+	 * every new one opened */
+	FontPool pool;
+
+	const size_t poolSize;
+
+	/* Bumped whenever a handle is closed */
+	unsigned int generation;
+
+	/* Maps: font file path, To: its contents */
+	BoostHash<std::string, FontFile*> files;
+	size_t fileBytes;
+
+	SharedFontStatePrivate(const Config &conf)
+	    : poolSize(conf.fontPoolSize),
+	      generation(0),
+	      fileBytes(0)
+	{}
+
+	FontFile *acquireFile(const std::string &path)
+	{
+		FontFile *file = files.value(path, 0);
+
+		if (!file)
+		{
+			file = new FontFile;
+
+			std::string diskPath = shState->fileSystem().diskPath(path.c_str());
+
+			try
+			{
+				if (diskPath.empty() || !file->map(diskPath.c_str()))
+					file->read(path.c_str());
+			}
+			catch (const Exception &)
+			{
+				delete file;
+				throw;
+			}
+
+			files.insert(path, file);
+			fileBytes += file->size;
+		}
+
+		++file->refCount;
+
+		return file;
+	}
+
+	void releaseFile(const std::string &path)
+	{
+		FontFile *file = files.value(path, 0);
+
+		if (!file || --file->refCount > 0)
+			return;
+
+		fileBytes -= file->size;
+		files.remove(path);
+
+		delete file;
+	}
+
+	void close(const FontKey &key)
+	{
+		PoolEntry entry = pool.remove(key);
+
+		/* Nothing drawn or measured with the handle
+		 * may be mistaken for a later one's */
+		shState->glyphAtlas().invalidate(entry.font);
+		shState->textCache().invalidate(entry.font);
+
+		TTF_CloseFont(entry.font);
+
+		if (!entry.path.empty())
+			releaseFile(entry.path);
+
+		++generation;
+	}
+
+	void updateStats()
+	{
+		PerfStats &stats = shState->perfStats();
+
+		stats.set(PerfStats::FontHandles, pool.count());
+		stats.set(PerfStats::FontFileBytes, fileBytes);
+	}
 };
 
 SharedFontState::SharedFontState(const Config &conf)
 {
-	p = new SharedFontStatePrivate;
+	p = new SharedFontStatePrivate(conf);
 
 	/* Parse font substitutions */
 	for (size_t i = 0; i < conf.fontSubs.size(); ++i)
@@ -112,9 +333,13 @@ SharedFontState::SharedFontState(const Config &conf)
 
 SharedFontState::~SharedFontState()
 {
-	BoostHash<FontKey, TTF_Font*>::const_iterator iter;
-	for (iter = p->pool.cbegin(); iter != p->pool.cend(); ++iter)
-		TTF_CloseFont(iter->second);
+	SharedFontStatePrivate::FontPool::const_iterator iter;
+	for (iter = p->pool.begin(); iter != p->pool.end(); ++iter)
+		TTF_CloseFont(p->pool[*iter].font);
+
+	BoostHash<std::string, FontFile*>::const_iterator fIter;
+	for (fIter = p->files.cbegin(); fIter != p->files.cend(); ++fIter)
+		delete fIter->second;
 
 	delete p;
 }
@@ -158,12 +383,17 @@ _TTF_Font *SharedFontState::getFont(std::string family,
 
 	FontKey key(family, size);
 
-	TTF_Font *font = p->pool.value(key);
+	if (p->pool.contains(key))
+		return p->pool.touch(key).font;
 
-	if (font)
-		return font;
+	/* Not in pool; make room and open new handle */
+	while (!p->pool.empty() && p->pool.count() >= p->poolSize)
+	{
+		p->close(p->pool.oldest());
+		shState->perfStats().add(PerfStats::FontHandleEvictions);
+	}
 
-	/* Not in pool; open new handle */
+	SharedFontStatePrivate::PoolEntry entry;
 	SDL_RWops *ops;
 
 	if (family.empty())
@@ -175,24 +405,37 @@ _TTF_Font *SharedFontState::getFont(std::string family,
 	{
 		/* Use 'other' path as alternative in case
 		 * we have no 'regular' styled font asset */
-		const char *path = !req.regular.empty()
-		                 ? req.regular.c_str() : req.other.c_str();
+		entry.path = !req.regular.empty() ? req.regular : req.other;
 
-		ops = SDL_AllocRW();
-		shState->fileSystem().openReadRaw(*ops, path, true);
+		FontFile *file = p->acquireFile(entry.path);
+		ops = SDL_RWFromConstMem(file->data, file->size);
 	}
 
 	// FIXME 0.9 is guesswork at this point
 //	float gamma = (96.0/45.0)*(5.0/14.0)*(size-5);
 //	font = TTF_OpenFontRW(ops, 1, gamma /** .90*/);
-	font = TTF_OpenFontRW(ops, 1, size* 0.90f);
+	entry.font = TTF_OpenFontRW(ops, 1, size* 0.90f);
+
+	if (!entry.font)
+	{
+		if (!entry.path.empty())
+			p->releaseFile(entry.path);
+
+		p->updateStats();
 
-	if (!font)
 		throw Exception(Exception::SDLError, "%s", SDL_GetError());
+	}
+
+	p->pool.insert(key, entry);
+
+	p->updateStats();
 
-	p->pool.insert(key, font);
+	return entry.font;
+}
 
-	return font;
+unsigned int SharedFontState::generation() const
+{
+	return p->generation;
 }
 
 bool SharedFontState::fontPresent(std::string family) const
@@ -267,6 +510,11 @@ struct FontPrivate
 	 * set to null */
 	TTF_Font *sdlFont;
 
+	/* SharedFontState::generation() at the time
+	 * 'sdlFont' was queried; once that changes, the
+	 * handle might have been closed */
+	unsigned int sdlFontGen;
+
 	FontPrivate(int size)
 	    : size(size),
 	      bold(defaultBold),
@@ -277,7 +525,8 @@ struct FontPrivate
 	      outColor(&outColorTmp),
 	      colorTmp(*defaultColor),
 	      outColorTmp(*defaultOutColor),
-	      sdlFont(0)
+	      sdlFont(0),
+	      sdlFontGen(0)
 	{}
 
 	FontPrivate(const FontPrivate &other)
@@ -291,7 +540,8 @@ struct FontPrivate
 	      outColor(&outColorTmp),
 	      colorTmp(*other.color),
 	      outColorTmp(*other.outColor),
-	      sdlFont(other.sdlFont)
+	      sdlFont(other.sdlFont),
+	      sdlFontGen(other.sdlFontGen)
 	{}
 
 	void operator=(const FontPrivate &o)
@@ -454,9 +704,13 @@ void Font::initDefaults(const SharedFontState &sfs)
 
 _TTF_Font *Font::getSdlFont()
 {
-	if (!p->sdlFont)
-		p->sdlFont = shState->fontState().getFont(p->name.c_str(),
-		                                          p->size);
+	SharedFontState &sfs = shState->fontState();
+
+	if (!p->sdlFont || p->sdlFontGen != sfs.generation())
+	{
+		p->sdlFont = sfs.getFont(p->name.c_str(), p->size);
+		p->sdlFontGen = sfs.generation();
+	}
 
 	int style = TTF_STYLE_NORMAL;
 
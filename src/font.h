@@ -47,9 +47,14 @@ public:
 	void initFontSetCB(SDL_RWops &ops,
 	                   const std::string &filename);
 
+	/* The returned handle stays valid until generation()
+	 * changes, which happens when the least recently used
+	 * handle is closed to make room for a new one */
 	_TTF_Font *getFont(std::string family,
 	                   int size);
 
+	unsigned int generation() const;
+
 	bool fontPresent(std::string family) const;
 
 	static _TTF_Font *openBundled(int size);
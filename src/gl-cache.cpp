@@ -0,0 +1,69 @@
+/*
+** gl-cache.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gl-cache.h"
+
+#include "perfstats.h"
+
+namespace GLCache
+{
+
+/* Matches the default state of a fresh context */
+State state = { { 0 }, 0, 0, 0, 0, 0 };
+Counters counters = { 0, 0 };
+
+void forgetTexture(GLuint tex)
+{
+	for (int i = 0; i < TexUnits; ++i)
+		if (state.tex[i] == tex)
+			state.tex[i] = 0;
+}
+
+void forgetFramebuffer(GLuint fbo)
+{
+	if (state.readFBO == fbo)
+		state.readFBO = 0;
+
+	if (state.drawFBO == fbo)
+		state.drawFBO = 0;
+}
+
+void forgetArrayBuffer(GLuint buffer)
+{
+	if (state.arrayBuffer == buffer)
+		state.arrayBuffer = 0;
+}
+
+void forgetVertexArray(GLuint vao)
+{
+	if (state.vertexArray == vao)
+		state.vertexArray = 0;
+}
+
+void flushCounters(PerfStats &stats)
+{
+	stats.add(PerfStats::GLCallsIssued, counters.issued);
+	stats.add(PerfStats::GLCallsFiltered, counters.filtered);
+
+	counters.issued = counters.filtered = 0;
+}
+
+}
@@ -0,0 +1,159 @@
+/*
+** gl-cache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GLCACHE_H
+#define GLCACHE_H
+
+#include "gl-fun.h"
+
+#include <stdint.h>
+
+class PerfStats;
+
+/* Shadows the objects bound to the binding points we use,
+ * so redundant binds never reach the driver. Unlike GLState
+ * this is needed long before SharedState exists (GlobalIBO,
+ * stream buffer, shader setup), so it's kept global.
+ *
+ * GL silently unbinds deleted objects and hands their names
+ * out again later, so deletions have to go through forget*().
+ *
+ * The element array binding is not cached as it belongs to
+ * the currently bound VAO */
+namespace GLCache
+{
+	/* We only ever use the first four units
+	 * (the transition shader needs all of them) */
+	enum { TexUnits = 4 };
+
+	struct State
+	{
+		GLuint tex[TexUnits];
+		unsigned int activeUnit;
+
+		GLuint readFBO;
+		GLuint drawFBO;
+
+		GLuint arrayBuffer;
+		GLuint vertexArray;
+	};
+
+	struct Counters
+	{
+		int64_t issued;
+		int64_t filtered;
+	};
+
+	extern State state;
+	extern Counters counters;
+
+	inline void countIssued()   { ++counters.issued;   }
+	inline void countFiltered() { ++counters.filtered; }
+
+	/* Unit switches only happen as part of a bind,
+	 * so they aren't counted as filtered calls */
+	inline void activeTexture(unsigned int unit)
+	{
+		if (state.activeUnit == unit)
+			return;
+
+		gl.ActiveTexture(GL_TEXTURE0 + unit);
+		state.activeUnit = unit;
+		countIssued();
+	}
+
+	/* Everything else expects unit 0 to be active, so
+	 * switch back to it after binding to any other unit */
+	inline void bindTexture(unsigned int unit, GLuint tex)
+	{
+		if (state.tex[unit] == tex)
+		{
+			countFiltered();
+			return;
+		}
+
+		activeTexture(unit);
+		gl.BindTexture(GL_TEXTURE_2D, tex);
+		state.tex[unit] = tex;
+		countIssued();
+
+		activeTexture(0);
+	}
+
+	/* 'target' is any of GL_(READ_|DRAW_)FRAMEBUFFER */
+	inline void bindFramebuffer(GLenum target, GLuint fbo)
+	{
+		const bool read = target != GL_DRAW_FRAMEBUFFER;
+		const bool draw = target != GL_READ_FRAMEBUFFER;
+
+		if ((!read || state.readFBO == fbo) && (!draw || state.drawFBO == fbo))
+		{
+			countFiltered();
+			return;
+		}
+
+		gl.BindFramebuffer(target, fbo);
+		countIssued();
+
+		if (read)
+			state.readFBO = fbo;
+		if (draw)
+			state.drawFBO = fbo;
+	}
+
+	inline void bindArrayBuffer(GLuint buffer)
+	{
+		if (state.arrayBuffer == buffer)
+		{
+			countFiltered();
+			return;
+		}
+
+		gl.BindBuffer(GL_ARRAY_BUFFER, buffer);
+		state.arrayBuffer = buffer;
+		countIssued();
+	}
+
+	inline void bindVertexArray(GLuint vao)
+	{
+		if (state.vertexArray == vao)
+		{
+			countFiltered();
+			return;
+		}
+
+		gl.BindVertexArray(vao);
+		state.vertexArray = vao;
+		countIssued();
+	}
+
+	/* Call right before the object is deleted */
+	void forgetTexture(GLuint tex);
+	void forgetFramebuffer(GLuint fbo);
+	void forgetArrayBuffer(GLuint buffer);
+	void forgetVertexArray(GLuint vao);
+
+	/* Moves the issued / filtered counts of the
+	 * past frame into 'stats' and resets them */
+	void flushCounters(PerfStats &stats);
+}
+
+#endif // GLCACHE_H
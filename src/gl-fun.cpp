@@ -97,6 +97,7 @@ void initGLFunctions()
 
 	/* Assume single digit */
 	int glMajor = *ver - '0';
+	int glMinor = (ver[1] == '.') ? ver[2] - '0' : 0;
 
 	if (glMajor < 2)
 		throw EXC("OpenGL (ES) version >= 2 required");
@@ -163,6 +164,58 @@ void initGLFunctions()
 		GL_VAO_FUN;
 	}
 
+	/* Buffer mapping entrypoints */
+	if (glMajor >= 3 || HAVE_EXT(ARB_map_buffer_range))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+		GL_MAP_RANGE_FUN;
+	}
+	else if (gles && HAVE_EXT(EXT_map_buffer_range))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "EXT"
+		GL_MAP_RANGE_FUN;
+
+		/* Comes from OES_mapbuffer on ES 2 */
+		gl.UnmapBuffer = (_PFNGLUNMAPBUFFERPROC) SDL_GL_GetProcAddress("glUnmapBufferOES");
+	}
+
+	/* Sync object entrypoints */
+	if ((gles && glMajor >= 3) ||
+	    (!gles && (glMajor > 3 || (glMajor == 3 && glMinor >= 2))) ||
+	    HAVE_EXT(ARB_sync))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+		GL_SYNC_FUN;
+	}
+
+	/* Persistently mapped buffers need explicit syncing */
+	if (!gles && gl.MapBufferRange && gl.FenceSync &&
+	    (glMajor > 4 || (glMajor == 4 && glMinor >= 4) || HAVE_EXT(ARB_buffer_storage)))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+		GL_BUFFER_STORAGE_FUN;
+	}
+
+	/* Program binary entrypoints */
+	if ((gles && glMajor >= 3) ||
+	    (!gles && (glMajor > 4 || (glMajor == 4 && glMinor >= 1))) ||
+	    HAVE_EXT(ARB_get_program_binary))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+		GL_PROGRAM_BINARY_FUN;
+	}
+	else if (gles && HAVE_EXT(OES_get_program_binary))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "OES"
+		GL_PROGRAM_BINARY_FUN;
+	}
+
 	/* Debug callback entrypoints */
 	if (HAVE_EXT(KHR_debug))
 	{
@@ -190,4 +243,9 @@ void initGLFunctions()
 
 	if (!gles || glMajor >= 3 || HAVE_EXT(OES_texture_npot))
 		gl.npot_repeat = true;
+
+	if ((gles && glMajor >= 3) ||
+	    (!gles && (glMajor >= 3 || (glMajor == 2 && glMinor >= 1))) ||
+	    HAVE_EXT(ARB_pixel_buffer_object) || HAVE_EXT(NV_pixel_buffer_object))
+		gl.pixel_buffer = true;
 }
@@ -24,6 +24,8 @@
 #include "sharedstate.h"
 #include "glstate.h"
 #include "quad.h"
+#include "texuploader.h"
+#include "perfstats.h"
 
 namespace GLMeta
 {
@@ -32,6 +34,13 @@ void subRectImageUpload(GLint srcW, GLint srcX, GLint srcY,
                         GLint dstX, GLint dstY, GLsizei dstW, GLsizei dstH,
                         SDL_Surface *src, GLenum format)
 {
+	/* Staging packs the rows by itself */
+	if (shState->texUploader().subRect(srcW, srcX, srcY, dstX, dstY, dstW, dstH,
+	                                   src->pixels, format))
+		return;
+
+	shState->perfStats().add(PerfStats::TexUploadBytes, dstW * dstH * 4);
+
 	if (gl.unpack_subimage)
 	{
 		gl.PixelStorei(GL_UNPACK_ROW_LENGTH, srcW);
@@ -77,19 +86,22 @@ static void vaoBindRes(VAO &vao)
 		const VertexAttribute &va = vao.attr[i];
 
 		gl.EnableVertexAttribArray(va.index);
-		gl.VertexAttribPointer(va.index, va.size, va.type, GL_FALSE, vao.vertSize, va.offset);
+		gl.VertexAttribPointer(va.index, va.size, va.type, GL_FALSE, vao.vertSize,
+		                       (const GLchar*) va.offset + vao.offset);
 	}
 }
 
 void vaoInit(VAO &vao, bool keepBound)
 {
+	vao.offset = 0;
+
 	if (HAVE_NATIVE_VAO)
 	{
 		gl.GenVertexArrays(1, &vao.nativeVAO);
-		gl.BindVertexArray(vao.nativeVAO);
+		GLCache::bindVertexArray(vao.nativeVAO);
 		vaoBindRes(vao);
 		if (!keepBound)
-			gl.BindVertexArray(0);
+			GLCache::bindVertexArray(0);
 	}
 	else
 	{
@@ -104,13 +116,33 @@ void vaoInit(VAO &vao, bool keepBound)
 void vaoFini(VAO &vao)
 {
 	if (HAVE_NATIVE_VAO)
+	{
+		GLCache::forgetVertexArray(vao.nativeVAO);
 		gl.DeleteVertexArrays(1, &vao.nativeVAO);
+	}
+}
+
+void vaoRebase(VAO &vao, VBO::ID vbo, GLintptr offset)
+{
+	if (vao.vbo == vbo && vao.offset == offset)
+		return;
+
+	vao.vbo = vbo;
+	vao.offset = offset;
+
+	/* Without native VAOs, this happens on every bind anyway */
+	if (HAVE_NATIVE_VAO)
+	{
+		GLCache::bindVertexArray(vao.nativeVAO);
+		vaoBindRes(vao);
+		GLCache::bindVertexArray(0);
+	}
 }
 
 void vaoBind(VAO &vao)
 {
 	if (HAVE_NATIVE_VAO)
-		gl.BindVertexArray(vao.nativeVAO);
+		GLCache::bindVertexArray(vao.nativeVAO);
 	else
 		vaoBindRes(vao);
 }
@@ -119,7 +151,7 @@ void vaoUnbind(VAO &vao)
 {
 	if (HAVE_NATIVE_VAO)
 	{
-		gl.BindVertexArray(0);
+		GLCache::bindVertexArray(0);
 	}
 	else
 	{
@@ -137,13 +169,13 @@ static void _blitBegin(FBO::ID fbo, const Vec2i &size)
 {
 	if (HAVE_NATIVE_BLIT)
 	{
-		gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo.gl);
+		GLCache::bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo.gl);
 	}
 	else
 	{
 		FBO::bind(fbo);
 		glState.viewport.pushSet(IntRect(0, 0, size.x, size.y));
-		SimpleShader &shader = shState->shaders().simple;
+		SimpleShader &shader = shState->shaders().simple();
 		shader.bind();
 		shader.applyViewportProj();
 		shader.setTranslation(Vec2i());
@@ -164,11 +196,11 @@ void blitSource(TEXFBO &source, int pixellation)
 {
 	if (HAVE_NATIVE_BLIT)
 	{
-		gl.BindFramebuffer(GL_READ_FRAMEBUFFER, source.fbo.gl);
+		GLCache::bindFramebuffer(GL_READ_FRAMEBUFFER, source.fbo.gl);
 	}
 	else
 	{
-		SimpleShader &shader = shState->shaders().simple;
+		SimpleShader &shader = shState->shaders().simple();
 		shader.setTexSize(Vec2i(source.width, source.height));
 		float ar = ((float)source.width)/source.height;
 		// Apply extra shader stuff?
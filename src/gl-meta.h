@@ -49,6 +49,7 @@ struct VAO
 
 	/* Don't touch */
 	GLuint nativeVAO;
+	GLintptr offset;
 };
 
 template<class VertexType>
@@ -64,6 +65,10 @@ void vaoFini(VAO &vao);
 void vaoBind(VAO &vao);
 void vaoUnbind(VAO &vao);
 
+/* Points the vertex attributes at 'offset' bytes into
+ * 'vbo'. Call before vaoBind(); a no-op if nothing changed */
+void vaoRebase(VAO &vao, VBO::ID vbo, GLintptr offset);
+
 /* EXT_framebuffer_blit */
 void blitBegin(TEXFBO &target);
 void blitBeginScreen(const Vec2i &size);
@@ -23,8 +23,15 @@
 #define GLUTIL_H
 
 #include "gl-fun.h"
+#include "gl-cache.h"
 #include "etc-internal.h"
 
+/* Pixel size of the RGBA textures we upload and read back */
+#define BYTES_PER_PIXEL 4
+
+/* Don't stall forever on a fence if the driver misbehaves */
+#define FENCE_TIMEOUT_NS 1000000000ull
+
 /* Struct wrapping GLuint for some light type safety */
 #define DEF_GL_ID \
 struct ID \
@@ -63,12 +70,14 @@ namespace TEX
 
 	static inline void del(ID id)
 	{
+		GLCache::forgetTexture(id.gl);
 		gl.DeleteTextures(1, &id.gl);
 	}
 
+	/* Binds to unit 0, which all texture operations go through */
 	static inline void bind(ID id)
 	{
-		gl.BindTexture(GL_TEXTURE_2D, id.gl);
+		GLCache::bindTexture(0, id.gl);
 	}
 
 	static inline void unbind()
@@ -119,12 +128,13 @@ namespace FBO
 
 	static inline void del(ID id)
 	{
+		GLCache::forgetFramebuffer(id.gl);
 		gl.DeleteFramebuffers(1, &id.gl);
 	}
 
 	static inline void bind(ID id)
 	{
-		gl.BindFramebuffer(GL_FRAMEBUFFER, id.gl);
+		GLCache::bindFramebuffer(GL_FRAMEBUFFER, id.gl);
 	}
 
 	static inline void unbind()
@@ -158,12 +168,18 @@ struct GenericBO
 
 	static inline void del(ID id)
 	{
+		if (target == GL_ARRAY_BUFFER)
+			GLCache::forgetArrayBuffer(id.gl);
+
 		gl.DeleteBuffers(1, &id.gl);
 	}
 
 	static inline void bind(ID id)
 	{
-		gl.BindBuffer(target, id.gl);
+		if (target == GL_ARRAY_BUFFER)
+			GLCache::bindArrayBuffer(id.gl);
+		else
+			gl.BindBuffer(target, id.gl);
 	}
 
 	static inline void unbind()
@@ -193,6 +209,12 @@ typedef struct GenericBO<GL_ARRAY_BUFFER> VBO;
 /* Index Buffer Object */
 typedef struct GenericBO<GL_ELEMENT_ARRAY_BUFFER> IBO;
 
+/* Pixel (unpack) Buffer Object */
+typedef struct GenericBO<GL_PIXEL_UNPACK_BUFFER> PBO;
+
+/* Pixel (pack) Buffer Object */
+typedef struct GenericBO<GL_PIXEL_PACK_BUFFER> PackBO;
+
 #undef DEF_GL_ID
 
 /* Convenience struct wrapping a framebuffer
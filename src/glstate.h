@@ -23,6 +23,7 @@
 #define GLSTATE_H
 
 #include "etc.h"
+#include "gl-cache.h"
 
 #include <stack>
 #include <assert.h>
@@ -49,8 +50,12 @@ struct GLProperty
 	void set(const T &value)
 	{
 		if (value == current)
+		{
+			GLCache::countFiltered();
 			return;
+		}
 
+		GLCache::countIssued();
 		init(value);
 	}
 
@@ -0,0 +1,433 @@
+/*
+** glyphatlas.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "glyphatlas.h"
+
+#include "gl-fun.h"
+#include "gl-meta.h"
+#include "glstate.h"
+#include "shader.h"
+#include "quad.h"
+#include "quadarray.h"
+#include "sharedstate.h"
+#include "texuploader.h"
+#include "perfstats.h"
+#include "boost-hash.h"
+#include "config.h"
+
+#include <SDL_ttf.h>
+
+#include <string>
+#include <vector>
+
+#define PAGE_SIZE 1024
+
+/* Keeps linear filtering of the composed
+ * text from picking up neighbours */
+#define GLYPH_PADDING 1
+
+/* Stays within the range of the quad index buffer */
+#define MAX_GLYPHS 8192
+
+struct GlyphKey
+{
+	TTF_Font *font;
+	int style;
+	uint16_t ch;
+
+	bool operator==(const GlyphKey &o) const
+	{
+		return font == o.font && style == o.style && ch == o.ch;
+	}
+};
+
+static size_t hash_value(const GlyphKey &key)
+{
+	size_t seed = 0;
+	boost::hash_combine(seed, key.font);
+	boost::hash_combine(seed, key.style);
+	boost::hash_combine(seed, key.ch);
+
+	return seed;
+}
+
+struct Glyph
+{
+	/* Empty for blank glyphs (eg. spaces) */
+	IntRect rect;
+
+	/* Offset of the rendered glyph from the pen position */
+	int offsetX;
+	int advance;
+};
+
+/* Decodes one character, advancing 'str'. Sequences encoding
+ * characters outside the BMP (which the glyph functions of
+ * SDL_ttf can't handle) and broken ones yield false */
+static bool nextChar(const char *&str, uint16_t &ch)
+{
+	const unsigned char *s = (const unsigned char*) str;
+
+	if (s[0] < 0x80)
+	{
+		ch = s[0];
+		str += 1;
+	}
+	else if ((s[0] & 0xE0) == 0xC0)
+	{
+		if ((s[1] & 0xC0) != 0x80)
+			return false;
+
+		ch = (s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+		str += 2;
+	}
+	else if ((s[0] & 0xF0) == 0xE0)
+	{
+		if ((s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80)
+			return false;
+
+		ch = (s[0] & 0x0F) << 12 | (s[1] & 0x3F) << 6 | (s[2] & 0x3F);
+		str += 3;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+struct GlyphAtlasPrivate
+{
+	TEXFBO tex;
+	int size;
+
+	BoostHash<GlyphKey, Glyph> glyphs;
+	size_t glyphCount;
+
+	/* Shelf packing state */
+	int penX, penY;
+	int rowH;
+
+	/* Set when a glyph didn't fit anymore */
+	bool full;
+
+	SimpleQuadArray quads;
+
+	GlyphAtlasPrivate()
+	    : size(0),
+	      glyphCount(0),
+	      penX(0), penY(0),
+	      rowH(0),
+	      full(false)
+	{}
+
+	~GlyphAtlasPrivate()
+	{
+		if (size > 0)
+			TEXFBO::fini(tex);
+	}
+
+	void init()
+	{
+		if (size > 0)
+			return;
+
+		size = std::min(PAGE_SIZE, glState.caps.maxTexSize);
+
+		TEXFBO::init(tex);
+		TEXFBO::allocEmpty(tex, size, size);
+		TEXFBO::linkFBO(tex);
+
+		reset();
+	}
+
+	void reset()
+	{
+		FBO::bind(tex.fbo);
+		glState.clearColor.pushSet(Vec4());
+		FBO::clear();
+		glState.clearColor.pop();
+
+		glyphs = BoostHash<GlyphKey, Glyph>();
+		glyphCount = 0;
+
+		penX = penY = rowH = 0;
+		full = false;
+
+		shState->perfStats().set(PerfStats::GlyphCacheGlyphs, 0);
+	}
+
+	/* Returns false if there's no room left */
+	bool pack(int w, int h, IntRect &out)
+	{
+		w += GLYPH_PADDING;
+		h += GLYPH_PADDING;
+
+		if (w > size || h > size)
+			return false;
+
+		if (penX + w > size)
+		{
+			penX = 0;
+			penY += rowH;
+			rowH = 0;
+		}
+
+		if (penY + h > size)
+		{
+			full = true;
+			return false;
+		}
+
+		out = IntRect(penX, penY, w - GLYPH_PADDING, h - GLYPH_PADDING);
+
+		penX += w;
+		rowH = std::max(rowH, h);
+
+		return true;
+	}
+
+	/* 'utf8' holds just the one character */
+	bool render(TTF_Font *font, uint16_t ch, const std::string &utf8, Glyph &out)
+	{
+		int minX, advance;
+
+		if (TTF_GlyphMetrics(font, ch, &minX, 0, 0, 0, &advance) < 0)
+			return false;
+
+		/* Rendering a single character the same way whole strings
+		 * are rendered keeps the vertical placement identical */
+		const SDL_Color white = { 255, 255, 255, 255 };
+		SDL_Surface *surf;
+
+		if (shState->config().solidFonts)
+			surf = TTF_RenderUTF8_Solid(font, utf8.c_str(), white);
+		else
+			surf = TTF_RenderUTF8_Blended(font, utf8.c_str(), white);
+
+		out.offsetX = std::min(minX, 0);
+		out.advance = advance;
+		out.rect = IntRect();
+
+		/* Blank glyphs might not produce a surface at all */
+		if (!surf)
+			return true;
+
+		if (surf->format->format != SDL_PIXELFORMAT_ABGR8888)
+		{
+			SDL_Surface *conv = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ABGR8888, 0);
+			SDL_FreeSurface(surf);
+			surf = conv;
+
+			if (!surf)
+				return false;
+		}
+
+		bool fits = pack(surf->w, surf->h, out.rect);
+
+		if (fits)
+		{
+			TEX::bind(tex.tex);
+			GLMeta::subRectImageUpload(surf->pitch / 4, 0, 0, out.rect.x, out.rect.y,
+			                           surf->w, surf->h, surf, GL_RGBA);
+			GLMeta::subRectImageEnd();
+		}
+
+		SDL_FreeSurface(surf);
+
+		return fits;
+	}
+
+	bool lookup(TTF_Font *font, int style, uint16_t ch,
+	            const char *begin, const char *end, Glyph &out)
+	{
+		GlyphKey key = { font, style, ch };
+
+		if (glyphs.contains(key))
+		{
+			out = glyphs.value(key);
+			shState->perfStats().add(PerfStats::GlyphCacheHits);
+
+			return true;
+		}
+
+		shState->perfStats().add(PerfStats::GlyphCacheMisses);
+
+		if (!render(font, ch, std::string(begin, end), out))
+			return false;
+
+		glyphs.insert(key, out);
+		shState->perfStats().set(PerfStats::GlyphCacheGlyphs, ++glyphCount);
+
+		return true;
+	}
+
+	bool layout(TTF_Font *font, const char *str, GlyphAtlas::Layout &out)
+	{
+		const int style = TTF_GetFontStyle(font);
+		const bool kerning = TTF_GetFontKerning(font);
+
+		out.quads.clear();
+
+		int pen = 0;
+		uint16_t prev = 0;
+
+		while (*str)
+		{
+			const char *begin = str;
+			uint16_t ch;
+			Glyph glyph;
+
+			if (!nextChar(str, ch))
+				return false;
+
+			if (!lookup(font, style, ch, begin, str, glyph))
+				return false;
+
+			if (kerning && prev)
+				pen += TTF_GetFontKerningSizeGlyphs(font, prev, ch);
+
+			if (glyph.rect.w > 0 && glyph.rect.h > 0)
+			{
+				GlyphAtlas::Layout::Quad q;
+				q.src = glyph.rect;
+				q.pos = Vec2i(pen + glyph.offsetX, 0);
+
+				out.quads.push_back(q);
+			}
+
+			pen += glyph.advance;
+			prev = ch;
+
+			if (out.quads.size() > MAX_GLYPHS)
+				return false;
+		}
+
+		return true;
+	}
+};
+
+GlyphAtlas::GlyphAtlas()
+{
+	p = new GlyphAtlasPrivate;
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+	delete p;
+}
+
+bool GlyphAtlas::layout(_TTF_Font *font, const char *str, Layout &out)
+{
+	/* Underlines and strike-throughs span the
+	 * whole string, not single glyphs */
+	if (TTF_GetFontStyle(font) & (TTF_STYLE_UNDERLINE | TTF_STYLE_STRIKETHROUGH))
+		return false;
+
+	if (TTF_SizeUTF8(font, str, &out.size.x, &out.size.y) < 0)
+		return false;
+
+	if (out.size.x <= 0 || out.size.y <= 0)
+		return false;
+
+	p->init();
+
+	if (p->layout(font, str, out))
+		return true;
+
+	if (!p->full)
+		return false;
+
+	/* Start over with an empty texture */
+	p->reset();
+
+	return p->layout(font, str, out);
+}
+
+void GlyphAtlas::invalidate(_TTF_Font *font)
+{
+	std::vector<GlyphKey> doomed;
+
+	BoostHash<GlyphKey, Glyph>::const_iterator iter;
+	for (iter = p->glyphs.cbegin(); iter != p->glyphs.cend(); ++iter)
+		if (iter->first.font == font)
+			doomed.push_back(iter->first);
+
+	for (size_t i = 0; i < doomed.size(); ++i)
+		p->glyphs.remove(doomed[i]);
+
+	p->glyphCount -= doomed.size();
+	shState->perfStats().set(PerfStats::GlyphCacheGlyphs, p->glyphCount);
+}
+
+void GlyphAtlas::draw(const Layout &layout, const Vec4 &rgb, TEXFBO &target)
+{
+	const size_t count = layout.quads.size();
+
+	p->quads.resize(count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Layout::Quad &q = layout.quads[i];
+
+		Quad::setTexPosRect(&p->quads.vertices[i*4], q.src,
+		                    IntRect(q.pos.x, q.pos.y, q.src.w, q.src.h));
+	}
+
+	p->quads.commit();
+
+	FBO::bind(target.fbo);
+	glState.viewport.pushSet(IntRect(0, 0, target.width, target.height));
+
+	/* With the color channels preset to the text color and
+	 * masked off, blending builds up the alpha just like
+	 * SDL_ttf does when it renders whole strings */
+	glState.scissorTest.pushSet(false);
+	glState.clearColor.pushSet(Vec4(rgb.x, rgb.y, rgb.z, 0));
+	FBO::clear();
+	glState.clearColor.pop();
+	glState.scissorTest.pop();
+
+	if (count > 0)
+	{
+		SimpleShader &shader = shState->shaders().simple();
+		shader.bind();
+		shader.setTranslation(Vec2i());
+		shader.setTexSize(Vec2i(p->size, p->size));
+		shader.setPixellation(1);
+		shader.applyViewportProj();
+
+		TEX::bind(p->tex.tex);
+
+		gl.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_TRUE);
+		glState.blendMode.pushSet(BlendNormal);
+		glState.blend.pushSet(true);
+
+		p->quads.draw();
+
+		glState.blend.pop();
+		glState.blendMode.pop();
+		gl.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	}
+
+	glState.viewport.pop();
+}
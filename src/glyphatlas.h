@@ -0,0 +1,82 @@
+/*
+** glyphatlas.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include "gl-util.h"
+#include "etc-internal.h"
+
+#include <vector>
+
+struct _TTF_Font;
+struct GlyphAtlasPrivate;
+
+/* Keeps every glyph rendered so far, per font (which implies
+ * face and size) and style, in a shared texture. Text is then
+ * put together from those on the GPU instead of rasterizing
+ * whole strings with SDL_ttf every time.
+ *
+ * Glyphs are rendered in white; draw() paints only the alpha
+ * channel from them, so one copy serves every text color.
+ * Once the texture is full, it is emptied and filled anew */
+class GlyphAtlas
+{
+public:
+	/* Placement of a string's glyphs, valid until
+	 * the next call to layout() */
+	struct Layout
+	{
+		/* Same as what TTF_SizeUTF8 reports */
+		Vec2i size;
+
+		struct Quad
+		{
+			IntRect src;
+			Vec2i pos;
+		};
+
+		std::vector<Quad> quads;
+	};
+
+	GlyphAtlas();
+	~GlyphAtlas();
+
+	/* Lays out 'str' in 'font' with its current style, rendering
+	 * glyphs that aren't cached yet. Returns false if the string
+	 * can't be put together from single glyphs (eg. characters
+	 * outside of the BMP), in which case it should be rendered
+	 * the old way */
+	bool layout(_TTF_Font *font, const char *str, Layout &out);
+
+	/* Draws 'layout' into the origin of 'target', which is
+	 * overwritten entirely, in the color 'rgb' */
+	void draw(const Layout &layout, const Vec4 &rgb, TEXFBO &target);
+
+	/* Forgets all glyphs of 'font' (their space in the
+	 * texture is only reclaimed on the next reset) */
+	void invalidate(_TTF_Font *font);
+
+private:
+	GlyphAtlasPrivate *p;
+};
+
+#endif // GLYPHATLAS_H
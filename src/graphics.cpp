@@ -23,16 +23,21 @@
 
 #include "binding.h"
 #include "bitmap.h"
+#include "bitmapatlas.h"
 #include "config.h"
 #include "debugwriter.h"
 #include "disposable.h"
 #include "etc-internal.h"
 #include "eventthread.h"
+#include "exception.h"
 #include "filesystem.h"
+#include "gl-cache.h"
 #include "gl-fun.h"
 #include "gl-util.h"
 #include "glstate.h"
+#include "imagecache.h"
 #include "intrulist.h"
+#include "perfstats.h"
 #include "quad.h"
 #include "scene.h"
 #include "shader.h"
@@ -143,13 +148,16 @@ public:
     Scene::composite();
 
     if (brightEffect) {
-      SimpleColorShader &shader = shState->shaders().simpleColor;
+      SimpleColorShader &shader = shState->shaders().simpleColor();
       shader.bind();
       shader.applyViewportProj();
       shader.setTranslation(Vec2i());
 
       brightnessQuad.draw();
     }
+
+    /* The front buffer is up to date again */
+    clearDirty();
   }
 
   void requestViewportRender(const Vec4 &c, const Vec4 &f, const Vec4 &t) {
@@ -178,7 +186,7 @@ public:
         glState.scissorTest.pop();
       }
 
-      GrayShader &shader = shState->shaders().gray;
+      GrayShader &shader = shState->shaders().gray();
       shader.bind();
       shader.setGray(t.w);
       shader.applyViewportProj();
@@ -194,7 +202,7 @@ public:
     if (!toneRGBEffect && !colorEffect && !flashEffect)
       return;
 
-    FlatColorShader &shader = shState->shaders().flatColor;
+    FlatColorShader &shader = shState->shaders().flatColor();
     shader.bind();
     shader.applyViewportProj();
 
@@ -342,6 +350,14 @@ struct FPSLimiter {
     if (toDelay < 0)
       toDelay = 0;
 
+    /* Put some of the time we'd sleep anyway to use */
+    if (toDelay > 0 && shState->shaders().idleWork(toDelay / tickFreqNS)) {
+      toDelay -= SDL_GetPerformanceCounter() - lastTickCount - tickDelta;
+
+      if (toDelay < 0)
+        toDelay = 0;
+    }
+
     delayTicks(toDelay);
 
     uint64_t now = lastTickCount = SDL_GetPerformanceCounter();
@@ -429,6 +445,8 @@ struct GraphicsPrivate {
   // Can be set from Ruby. Takes priority over config setting.
   bool useFrameSkip;
 
+  bool skipUnchangedFrames;
+
   bool frozen;
   TEXFBO frozenScene;
   Quad screenQuad;
@@ -443,7 +461,9 @@ struct GraphicsPrivate {
         screen(scRes.x, scRes.y), threadData(rtData),
         glCtx(SDL_GL_GetCurrentContext()), frameRate(DEF_FRAMERATE),
         frameCount(0), brightness(255), fpsLimiter(frameRate),
-        useFrameSkip(rtData->config.frameSkip), frozen(false) {
+        useFrameSkip(rtData->config.frameSkip),
+        skipUnchangedFrames(rtData->config.skipUnchangedFrames),
+        frozen(false) {
     recalculateScreenSize(rtData);
     updateScreenResoRatio(rtData);
 
@@ -518,6 +538,12 @@ struct GraphicsPrivate {
 
     ++frameCount;
 
+    if (frameCount == 1)
+      shState->shaders().reportStartup();
+
+    GLCache::flushCounters(shState->perfStats());
+    shState->perfStats().endFrame();
+
     threadData->ethread->notifyFrame();
   }
 
@@ -538,7 +564,13 @@ struct GraphicsPrivate {
   }
 
   void redrawScreen() {
-    screen.composite();
+    /* If nothing changed since the last composite, the
+     * front buffer already holds what we would draw, so
+     * just present it again. Frame pacing is unaffected */
+    if (skipUnchangedFrames && !Scene::isDirty())
+      shState->perfStats().add(PerfStats::SkippedComposites);
+    else
+      screen.composite();
 
     GLMeta::blitBeginScreen(winSize);
     GLMeta::blitSource(screen.getPP().frontBuffer(), 2);
@@ -636,8 +668,30 @@ void Graphics::transition(int duration, const char *filename, int vague) {
   vague = clamp(vague, 1, 256);
   Bitmap *transMap = *filename ? new Bitmap(filename) : 0;
 
+  /* The map is stretched across the screen anyway; mega
+   * bitmaps have no single texture to sample from */
+  if (transMap && transMap->isMega()) {
+    Bitmap *scaled = 0;
+
+    try {
+      scaled = new Bitmap(p->scRes.x, p->scRes.y);
+      scaled->stretchBlt(scaled->rect(), *transMap, transMap->rect(), 255);
+    } catch (const Exception &e) {
+      delete scaled;
+      delete transMap;
+      throw e;
+    }
+
+    delete transMap;
+    transMap = scaled;
+  }
+
   setBrightness(255);
 
+  /* The previous scene's bitmaps are gone by now, and
+   * the transition hides any hitch from compacting */
+  shState->bitmapAtlas().defragment();
+
   /* Capture new scene */
   p->screen.composite();
 
@@ -650,8 +704,8 @@ void Graphics::transition(int duration, const char *filename, int vague) {
 
   /* If no transition bitmap is provided,
    * we can use a simplified shader */
-  TransShader &transShader = shState->shaders().trans;
-  SimpleTransShader &simpleShader = shState->shaders().simpleTrans;
+  TransShader &transShader = shState->shaders().trans();
+  SimpleTransShader &simpleShader = shState->shaders().simpleTrans();
 
   if (transMap) {
     TransShader &shader = transShader;
@@ -899,6 +953,8 @@ void Graphics::screenshot(const char *filename) {
   delete fn_normalized;
   if (rc)
     throw new Exception(Exception::SDLError, "%s", SDL_GetError());
+
+  shState->imageCache().invalidate(filename);
 }
 
 /*
@@ -916,6 +972,8 @@ void Graphics::setBrightness(int value) {
 
   p->brightness = value;
   p->screen.setBrightness(value / 255.0);
+
+  Scene::markDirty();
 }
 
 void Graphics::reset() {
@@ -933,6 +991,7 @@ void Graphics::reset() {
   p->fpsLimiter.resetFrameAdjust();
   p->frozen = false;
   p->screen.getPP().clearBuffers();
+  Scene::markDirty();
 
   setFrameRate(DEF_FRAMERATE);
   setBrightness(255);
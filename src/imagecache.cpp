@@ -0,0 +1,153 @@
+/*
+** imagecache.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagecache.h"
+
+#include "config.h"
+#include "sharedstate.h"
+#include "perfstats.h"
+#include "lru-cache.h"
+#include "sdl-util.h"
+
+#include <SDL_surface.h>
+
+#include <ctype.h>
+
+struct ImageCachePrivate
+{
+	typedef LruCache<std::string, SDL_Surface*> SurfaceCache;
+
+	SurfaceCache surfaces;
+
+	const size_t budget;
+
+	ImageCachePrivate(const Config &conf)
+	    : budget((size_t) conf.imageCacheSize << 20)
+	{}
+
+	~ImageCachePrivate()
+	{
+		SurfaceCache::const_iterator iter;
+		for (iter = surfaces.begin(); iter != surfaces.end(); ++iter)
+			SDL_FreeSurface(surfaces[*iter]);
+	}
+
+	void remove(const std::string &key)
+	{
+		SDL_FreeSurface(surfaces.remove(key));
+	}
+
+	void updateStats()
+	{
+		shState->perfStats().set(PerfStats::ImageCacheBytes, surfaces.bytes());
+	}
+};
+
+ImageCache::ImageCache(const Config &conf)
+{
+	p = new ImageCachePrivate(conf);
+}
+
+ImageCache::~ImageCache()
+{
+	delete p;
+}
+
+std::string ImageCache::makeKey(const char *filename)
+{
+	std::string key(filename);
+
+	for (size_t i = 0; i < key.size(); ++i)
+		key[i] = (key[i] == '\\') ? '/' : tolower(key[i]);
+
+	return key;
+}
+
+bool ImageCache::contains(const char *filename) const
+{
+	return p->surfaces.contains(makeKey(filename));
+}
+
+SDL_Surface *ImageCache::lookup(const char *filename)
+{
+	if (p->budget == 0)
+		return 0;
+
+	const std::string key = makeKey(filename);
+
+	if (!p->surfaces.contains(key))
+	{
+		shState->perfStats().add(PerfStats::ImageCacheMisses);
+		return 0;
+	}
+
+	shState->perfStats().add(PerfStats::ImageCacheHits);
+
+	return p->surfaces.touch(key);
+}
+
+void ImageCache::store(const char *filename, SDL_Surface *surf)
+{
+	const size_t size = surfaceBytes(surf);
+
+	if (size > p->budget)
+	{
+		SDL_FreeSurface(surf);
+		return;
+	}
+
+	const std::string key = makeKey(filename);
+
+	if (p->surfaces.contains(key))
+		p->remove(key);
+
+	while (p->surfaces.bytes() + size > p->budget)
+	{
+		p->remove(p->surfaces.oldest());
+		shState->perfStats().add(PerfStats::ImageCacheEvictions);
+	}
+
+	p->surfaces.insert(key, surf, size);
+
+	p->updateStats();
+}
+
+void ImageCache::invalidate(const char *filename)
+{
+	std::string key = makeKey(filename);
+
+	/* Images are usually loaded without extension */
+	size_t dot = key.rfind('.');
+	size_t slash = key.rfind('/');
+
+	for (int i = 0; i < 2; ++i)
+	{
+		if (p->surfaces.contains(key))
+			p->remove(key);
+
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			break;
+
+		key.resize(dot);
+	}
+
+	p->updateStats();
+}
@@ -0,0 +1,65 @@
+/*
+** imagecache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <string>
+
+struct SDL_Surface;
+struct Config;
+struct ImageCachePrivate;
+
+/* Keeps the decoded surfaces (ABGR8888) of recently loaded
+ * image files around, so loading the same file again only
+ * costs an upload. Entries are keyed by normalized path; as
+ * the search path order never changes after startup, a path
+ * always resolves to the same archive or directory. Least
+ * recently used entries are dropped once the configured
+ * memory budget is exceeded */
+class ImageCache
+{
+public:
+	ImageCache(const Config &conf);
+	~ImageCache();
+
+	/* Case folded, with forward slashes only */
+	static std::string makeKey(const char *filename);
+
+	bool contains(const char *filename) const;
+
+	/* Returns the cached surface of 'filename' or null.
+	 * The surface remains owned by the cache and must not
+	 * be modified; it stays valid until the next store() */
+	SDL_Surface *lookup(const char *filename);
+
+	/* Takes ownership of 'surf' (freeing it right away
+	 * if the cache is disabled or it doesn't fit) */
+	void store(const char *filename, SDL_Surface *surf);
+
+	/* Call after writing to 'filename' on disk */
+	void invalidate(const char *filename);
+
+private:
+	ImageCachePrivate *p;
+};
+
+#endif // IMAGECACHE_H
@@ -0,0 +1,430 @@
+/*
+** imagedecoder.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagedecoder.h"
+
+#include "imagecache.h"
+#include "bakedimage.h"
+#include "config.h"
+#include "filesystem.h"
+#include "exception.h"
+#include "sharedstate.h"
+#include "perfstats.h"
+#include "boost-hash.h"
+#include "sdl-util.h"
+#include "util.h"
+
+#include <SDL_image.h>
+#include <SDL_cpuinfo.h>
+#include <SDL_mutex.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+
+#define MAX_AUTO_THREADS 4
+
+/* Baked images are picked over anything else, no matter the
+ * order files are found in. So that one directory search is
+ * enough, the first other image found is only opened, and kept
+ * aside until the search is over (unless 'deferPlain' is off) */
+struct ImageOpenHandler : FileSystem::OpenHandler
+{
+	SDL_Surface *surf;
+
+	bool deferPlain;
+	bool havePlain;
+	SDL_RWops plainOps;
+	std::string plainExt;
+
+	ImageOpenHandler(bool deferPlain)
+	    : surf(0),
+	      deferPlain(deferPlain),
+	      havePlain(false)
+	{}
+
+	bool tryRead(SDL_RWops &ops, const char *ext)
+	{
+		if (BakedImage::isBakedExt(ext))
+		{
+			surf = BakedImage::read(&ops);
+			SDL_RWclose(&ops);
+		}
+		else if (!deferPlain)
+		{
+			surf = IMG_LoadTyped_RW(&ops, 1, ext);
+		}
+		else
+		{
+			if (havePlain)
+			{
+				SDL_RWclose(&ops);
+			}
+			else
+			{
+				plainOps = ops;
+				plainExt = ext ? ext : "";
+				havePlain = true;
+			}
+
+			return false;
+		}
+
+		return surf != 0;
+	}
+
+	/* Closes the kept aside image without decoding it */
+	void discard()
+	{
+		if (havePlain)
+			SDL_RWclose(&plainOps);
+
+		havePlain = false;
+	}
+
+	/* Decodes the kept aside image if nothing baked
+	 * was found, and closes it otherwise. Returns
+	 * false if decoding it failed */
+	bool finish()
+	{
+		if (!havePlain || surf)
+		{
+			discard();
+			return true;
+		}
+
+		havePlain = false;
+		surf = IMG_LoadTyped_RW(&plainOps, 1, plainExt.empty() ? 0 : plainExt.c_str());
+
+		return surf != 0;
+	}
+};
+
+struct ImageDecoderPrivate
+{
+	enum State
+	{
+		Queued,
+		Decoding,
+		Done,
+		Failed
+	};
+
+	struct Entry
+	{
+		State state;
+		SDL_Surface *surf;
+
+		/* Position in 'doneOrder' (only valid when Done) */
+		std::list<std::string>::iterator order;
+	};
+
+	FileSystem &fs;
+
+	int threadCount;
+	size_t budget;
+
+	std::vector<SDL_Thread*> threads;
+
+	/* Guards everything below */
+	SDL_mutex *mutex;
+	SDL_cond *workCond;
+	SDL_cond *doneCond;
+
+	BoostHash<std::string, Entry> entries;
+	std::deque<std::string> pending;
+
+	/* Decoded surfaces, oldest first */
+	std::list<std::string> doneOrder;
+	size_t usedBytes;
+
+	bool quit;
+
+	ImageDecoderPrivate(FileSystem &fs, const Config &conf)
+	    : fs(fs),
+	      budget((size_t) conf.imageDecode.budget << 20),
+	      usedBytes(0),
+	      quit(false)
+	{
+		threadCount = conf.imageDecode.threads;
+
+		if (threadCount == 0)
+			threadCount = clamp(SDL_GetCPUCount() - 1, 1, MAX_AUTO_THREADS);
+
+		mutex = SDL_CreateMutex();
+		workCond = SDL_CreateCond();
+		doneCond = SDL_CreateCond();
+	}
+
+	~ImageDecoderPrivate()
+	{
+		SDL_LockMutex(mutex);
+		quit = true;
+		SDL_CondBroadcast(workCond);
+		SDL_UnlockMutex(mutex);
+
+		for (size_t i = 0; i < threads.size(); ++i)
+			SDL_WaitThread(threads[i], 0);
+
+		BoostHash<std::string, Entry>::const_iterator iter;
+		for (iter = entries.cbegin(); iter != entries.cend(); ++iter)
+			if (iter->second.surf)
+				SDL_FreeSurface(iter->second.surf);
+
+		SDL_DestroyCond(doneCond);
+		SDL_DestroyCond(workCond);
+		SDL_DestroyMutex(mutex);
+	}
+
+	void startThreads()
+	{
+		for (int i = 0; i < threadCount; ++i)
+		{
+			SDL_Thread *thread = createSDLThread
+				<ImageDecoderPrivate, &ImageDecoderPrivate::workerMain>(this, "imagedecoder");
+
+			if (thread)
+				threads.push_back(thread);
+		}
+	}
+
+	/* Call with the mutex locked */
+	void remove(const std::string &key)
+	{
+		Entry &entry = entries[key];
+
+		if (entry.state == Done)
+		{
+			usedBytes -= surfaceBytes(entry.surf);
+			doneOrder.erase(entry.order);
+		}
+
+		entries.remove(key);
+	}
+
+	/* Call with the mutex locked */
+	void evict()
+	{
+		while (usedBytes > budget && !doneOrder.empty())
+		{
+			const std::string key = doneOrder.front();
+			SDL_FreeSurface(entries[key].surf);
+			remove(key);
+		}
+	}
+
+	SDL_Surface *decode(const std::string &filename)
+	{
+		try
+		{
+			return ImageDecoder::load(fs, filename.c_str());
+		}
+		catch (const Exception &)
+		{
+			/* The synchronous load will report it properly */
+			return 0;
+		}
+	}
+
+	void workerMain()
+	{
+		SDL_LockMutex(mutex);
+
+		while (true)
+		{
+			while (!quit && pending.empty())
+				SDL_CondWait(workCond, mutex);
+
+			if (quit)
+				break;
+
+			const std::string key = pending.front();
+			pending.pop_front();
+
+			/* Might have been taken in the meantime */
+			if (!entries.contains(key) || entries[key].state != Queued)
+				continue;
+
+			entries[key].state = Decoding;
+
+			SDL_UnlockMutex(mutex);
+			SDL_Surface *surf = decode(key);
+			SDL_LockMutex(mutex);
+
+			Entry &entry = entries[key];
+
+			if (surf)
+			{
+				entry.state = Done;
+				entry.surf = surf;
+				entry.order = doneOrder.insert(doneOrder.end(), key);
+				usedBytes += surfaceBytes(surf);
+
+				evict();
+			}
+			else
+			{
+				entry.state = Failed;
+			}
+
+			SDL_CondBroadcast(doneCond);
+		}
+
+		SDL_UnlockMutex(mutex);
+	}
+};
+
+ImageDecoder::ImageDecoder(FileSystem &fs, const Config &conf)
+{
+	p = new ImageDecoderPrivate(fs, conf);
+}
+
+ImageDecoder::~ImageDecoder()
+{
+	delete p;
+}
+
+SDL_Surface *ImageDecoder::load(FileSystem &fs, const char *filename)
+{
+	ImageOpenHandler handler(true);
+
+	try
+	{
+		fs.openRead(handler, filename);
+	}
+	catch (const Exception &e)
+	{
+		handler.discard();
+		throw e;
+	}
+
+	SDL_Surface *surf;
+
+	/* The first image found is broken; search
+	 * again, trying every file in turn */
+	if (!handler.finish())
+	{
+		ImageOpenHandler retryHandler(false);
+		fs.openRead(retryHandler, filename);
+
+		surf = retryHandler.surf;
+	}
+	else
+	{
+		surf = handler.surf;
+	}
+
+	if (surf && surf->format->format != SDL_PIXELFORMAT_ABGR8888)
+	{
+		SDL_Surface *conv = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ABGR8888, 0);
+		SDL_FreeSurface(surf);
+		surf = conv;
+	}
+
+	return surf;
+}
+
+void ImageDecoder::preload(const char *filename)
+{
+	const std::string key = ImageCache::makeKey(filename);
+
+	SDL_LockMutex(p->mutex);
+
+	if (p->threads.empty())
+		p->startThreads();
+
+	if (!p->entries.contains(key))
+	{
+		ImageDecoderPrivate::Entry entry;
+		entry.state = ImageDecoderPrivate::Queued;
+		entry.surf = 0;
+
+		p->entries.insert(key, entry);
+		p->pending.push_back(key);
+
+		SDL_CondSignal(p->workCond);
+	}
+
+	SDL_UnlockMutex(p->mutex);
+}
+
+bool ImageDecoder::isLoaded(const char *filename)
+{
+	const std::string key = ImageCache::makeKey(filename);
+	bool result = false;
+
+	SDL_LockMutex(p->mutex);
+
+	if (p->entries.contains(key))
+	{
+		ImageDecoderPrivate::State state = p->entries[key].state;
+		result = (state == ImageDecoderPrivate::Done ||
+		          state == ImageDecoderPrivate::Failed);
+	}
+
+	SDL_UnlockMutex(p->mutex);
+
+	return result;
+}
+
+SDL_Surface *ImageDecoder::take(const char *filename)
+{
+	const std::string key = ImageCache::makeKey(filename);
+	SDL_Surface *surf = 0;
+
+	SDL_LockMutex(p->mutex);
+
+	if (!p->entries.contains(key))
+	{
+		SDL_UnlockMutex(p->mutex);
+		return 0;
+	}
+
+	bool waited = false;
+
+	while (p->entries.contains(key) &&
+	       p->entries[key].state == ImageDecoderPrivate::Decoding)
+	{
+		SDL_CondWait(p->doneCond, p->mutex);
+		waited = true;
+	}
+
+	/* Queued entries are dropped (the worker skips them) and
+	 * loaded right away by the caller, which beats waiting
+	 * behind everything else in the queue */
+	if (p->entries.contains(key))
+	{
+		if (p->entries[key].state == ImageDecoderPrivate::Done)
+			surf = p->entries[key].surf;
+
+		p->remove(key);
+	}
+
+	SDL_UnlockMutex(p->mutex);
+
+	if (surf)
+		shState->perfStats().add(waited ? PerfStats::PreloadWaits
+		                                : PerfStats::PreloadHits);
+
+	return surf;
+}
@@ -0,0 +1,65 @@
+/*
+** imagedecoder.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+struct SDL_Surface;
+struct Config;
+class FileSystem;
+struct ImageDecoderPrivate;
+
+/* Decodes images on a small pool of worker threads ahead of
+ * time, so a later Bitmap.new only has to upload the pixels.
+ * Decoded surfaces (always ABGR8888) wait here until they are
+ * taken; once they exceed the configured memory budget, the
+ * oldest ones are dropped again. The workers are only started
+ * on the first preload request */
+class ImageDecoder
+{
+public:
+	ImageDecoder(FileSystem &fs, const Config &conf);
+	~ImageDecoder();
+
+	/* Loads 'filename' synchronously (on any thread), with
+	 * extension supplementing. Returns an ABGR8888 surface,
+	 * or null with the SDL error set if it couldn't be parsed.
+	 * Throws if no matching file exists */
+	static SDL_Surface *load(FileSystem &fs, const char *filename);
+
+	/* Queues 'filename' for decoding unless it
+	 * is already queued or decoded */
+	void preload(const char *filename);
+
+	/* True once decoding has finished (or failed) */
+	bool isLoaded(const char *filename);
+
+	/* Hands over the decoded surface of 'filename', waiting
+	 * for it if it's being decoded right now. Returns null if
+	 * the image wasn't preloaded, was dropped or failed to
+	 * decode; the caller then has to load it synchronously */
+	SDL_Surface *take(const char *filename);
+
+private:
+	ImageDecoderPrivate *p;
+};
+
+#endif // IMAGEDECODER_H
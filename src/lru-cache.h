@@ -0,0 +1,157 @@
+/*
+** lru-cache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LRUCACHE_H
+#define LRUCACHE_H
+
+#include "boost-hash.h"
+
+#include <stddef.h>
+#include <list>
+
+/* Hash that also keeps track of the order its entries were last
+ * used in, and of the memory their owner attributes to each.
+ * Deciding when to evict (memory budget, entry count, entries
+ * still in use) and freeing the values is left to the owner,
+ * which usually keeps removing oldest() until within its limits.
+ *
+ * 'K' needs to be hashable by BoostHash */
+template<typename K, typename V>
+class LruCache
+{
+private:
+	typedef std::list<K> KeyList;
+
+	struct Entry
+	{
+		V value;
+		size_t bytes;
+		typename KeyList::iterator lruIter;
+	};
+
+	BoostHash<K, Entry> entries;
+
+	/* Most recently used first */
+	KeyList lru;
+
+	size_t usedBytes;
+
+public:
+	/* Walks the keys, most recently used first */
+	typedef typename KeyList::const_iterator const_iterator;
+
+	LruCache()
+	    : usedBytes(0)
+	{}
+
+	inline bool contains(const K &key) const
+	{
+		return entries.contains(key);
+	}
+
+	/* 'key' must be present. Doesn't count as a use */
+	inline V &operator[](const K &key)
+	{
+		return entries[key].value;
+	}
+
+	/* Marks 'key' (which must be present) as most recently used */
+	inline V &touch(const K &key)
+	{
+		Entry &entry = entries[key];
+		lru.splice(lru.begin(), lru, entry.lruIter);
+
+		return entry.value;
+	}
+
+	/* 'key' must not be present yet */
+	inline void insert(const K &key, const V &value, size_t bytes = 0)
+	{
+		Entry entry;
+		entry.value = value;
+		entry.bytes = bytes;
+		entry.lruIter = lru.insert(lru.begin(), key);
+
+		entries.insert(key, entry);
+		usedBytes += bytes;
+	}
+
+	/* Returns the value, so the owner can free what it holds.
+	 * 'key' is taken by value as it might live in the LRU list */
+	inline V remove(const K key)
+	{
+		Entry &entry = entries[key];
+		V value = entry.value;
+
+		usedBytes -= entry.bytes;
+		lru.erase(entry.lruIter);
+		entries.remove(key);
+
+		return value;
+	}
+
+	/* Moves the entry of 'oldKey' (which must be present) to
+	 * 'newKey' (which must not), marking it as most recently used */
+	inline void rekey(const K oldKey, const K &newKey)
+	{
+		Entry entry = entries[oldKey];
+		entries.remove(oldKey);
+
+		*entry.lruIter = newKey;
+		lru.splice(lru.begin(), lru, entry.lruIter);
+
+		entries.insert(newKey, entry);
+	}
+
+	/* Least recently used key; the cache must not be empty */
+	inline const K &oldest() const
+	{
+		return lru.back();
+	}
+
+	inline bool empty() const
+	{
+		return lru.empty();
+	}
+
+	inline size_t count() const
+	{
+		return lru.size();
+	}
+
+	/* Sum of all entries' sizes */
+	inline size_t bytes() const
+	{
+		return usedBytes;
+	}
+
+	inline const_iterator begin() const
+	{
+		return lru.begin();
+	}
+
+	inline const_iterator end() const
+	{
+		return lru.end();
+	}
+};
+
+#endif // LRUCACHE_H
@@ -0,0 +1,109 @@
+/*
+** perfstats.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "perfstats.h"
+
+#include "util.h"
+
+#include <string.h>
+
+struct CounterDesc
+{
+	const char *name;
+	bool perFrame;
+};
+
+static const CounterDesc counterDesc[] =
+{
+	{ "draw_calls",              true  },
+	{ "sprite_batches",          true  },
+	{ "batched_sprites",         true  },
+	{ "scene_reorders",          true  },
+	{ "scene_order_ns",          true  },
+	{ "culled_elements",         true  },
+	{ "drawn_elements",          true  },
+	{ "stream_upload_bytes",     true  },
+	{ "stream_wraps",            true  },
+	{ "gl_calls_issued",         true  },
+	{ "gl_calls_filtered",       true  },
+	{ "tex_upload_bytes",        true  },
+	{ "tex_upload_staged_bytes", true  },
+	{ "tex_upload_stalls",       true  },
+	{ "readback_bytes",          true  },
+	{ "readback_stalls",         true  },
+	{ "tilemap_tiles_built",     true  },
+	{ "atlas_pages",             false },
+	{ "atlas_bitmaps",           false },
+	{ "atlas_fill",              false },
+	{ "image_cache_bytes",       false },
+	{ "glyph_cache_glyphs",      false },
+	{ "text_cache_bytes",        false },
+	{ "font_handles",            false },
+	{ "font_file_bytes",         false },
+	{ "tile_atlas_cache_bytes",  false },
+	{ "atlas_defrags",           false },
+	{ "skipped_composites",      false },
+	{ "preload_hits",            false },
+	{ "preload_waits",           false },
+	{ "image_cache_hits",        false },
+	{ "image_cache_misses",      false },
+	{ "image_cache_evictions",   false },
+	{ "glyph_cache_hits",        false },
+	{ "glyph_cache_misses",      false },
+	{ "text_cache_hits",         false },
+	{ "text_cache_misses",       false },
+	{ "text_cache_evictions",    false },
+	{ "text_size_hits",          false },
+	{ "text_size_misses",        false },
+	{ "font_handle_evictions",   false },
+	{ "tile_atlas_cache_hits",   false },
+	{ "tile_atlas_cache_misses", false }
+};
+
+static elementsN(counterDesc);
+
+PerfStats::PerfStats()
+{
+	memset(current, 0, sizeof(current));
+	memset(latched, 0, sizeof(latched));
+}
+
+int64_t PerfStats::get(Counter c) const
+{
+	return counterDesc[c].perFrame ? latched[c] : current[c];
+}
+
+void PerfStats::endFrame()
+{
+	for (size_t i = 0; i < counterDescN; ++i)
+	{
+		if (!counterDesc[i].perFrame)
+			continue;
+
+		latched[i] = current[i];
+		current[i] = 0;
+	}
+}
+
+const char *PerfStats::name(Counter c)
+{
+	return counterDesc[c].name;
+}
@@ -0,0 +1,114 @@
+/*
+** perfstats.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PERFSTATS_H
+#define PERFSTATS_H
+
+#include <stdint.h>
+
+/* Cheap engine-side counters used to measure what the
+ * renderer (and friends) are doing. Per-frame counters are
+ * latched at the end of every presented frame, so reading
+ * them always yields the values of the last complete frame.
+ * Other counters are running totals or current values */
+class PerfStats
+{
+public:
+	enum Counter
+	{
+		/* Per frame */
+		DrawCalls,
+		SpriteBatches,
+		BatchedSprites,
+		SceneReorders,
+		SceneOrderTime,
+		CulledElements,
+		DrawnElements,
+		StreamUploadBytes,
+		StreamWraps,
+		GLCallsIssued,
+		GLCallsFiltered,
+		TexUploadBytes,
+		TexUploadStagedBytes,
+		TexUploadStalls,
+		ReadbackBytes,
+		ReadbackStalls,
+		TilemapTilesBuilt,
+
+		/* Current values */
+		AtlasPages,
+		AtlasBitmaps,
+		AtlasFill,
+		ImageCacheBytes,
+		GlyphCacheGlyphs,
+		TextCacheBytes,
+		FontHandles,
+		FontFileBytes,
+		TileAtlasCacheBytes,
+
+		/* Totals */
+		AtlasDefrags,
+		SkippedComposites,
+		PreloadHits,
+		PreloadWaits,
+		ImageCacheHits,
+		ImageCacheMisses,
+		ImageCacheEvictions,
+		GlyphCacheHits,
+		GlyphCacheMisses,
+		TextCacheHits,
+		TextCacheMisses,
+		TextCacheEvictions,
+		TextSizeHits,
+		TextSizeMisses,
+		FontHandleEvictions,
+		TileAtlasCacheHits,
+		TileAtlasCacheMisses,
+
+		CounterCount
+	};
+
+	PerfStats();
+
+	void add(Counter c, int64_t value = 1)
+	{
+		current[c] += value;
+	}
+
+	void set(Counter c, int64_t value)
+	{
+		current[c] = value;
+	}
+
+	int64_t get(Counter c) const;
+
+	/* Latches and resets all per-frame counters */
+	void endFrame();
+
+	/* Script facing name of the counter */
+	static const char *name(Counter c);
+
+private:
+	int64_t current[CounterCount];
+	int64_t latched[CounterCount];
+};
+
+#endif // PERFSTATS_H
@@ -0,0 +1,343 @@
+/*
+** pixelcache.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pixelcache.h"
+
+#include "gl-fun.h"
+#include "sharedstate.h"
+#include "perfstats.h"
+
+#include <algorithm>
+#include <string.h>
+
+/* Small enough that a single lookup reads back next to
+ * nothing, large enough to keep the per tile cost down */
+#define TILE_SIZE 64
+
+PixelCache::PixelCache()
+    : width(0), height(0),
+      tilesX(0), tilesY(0)
+{
+	pf.pbo = PackBO::ID(0);
+	pf.fence = 0;
+}
+
+PixelCache::~PixelCache()
+{
+	dropPrefetch();
+}
+
+const uint8_t *PixelCache::pixel(int x, int y, FBO::ID fbo, const IntRect &texRect)
+{
+	init(texRect.w, texRect.h);
+
+	const size_t tile = (y / TILE_SIZE) * tilesX + (x / TILE_SIZE);
+
+	if (tiles[tile] == Pending)
+		resolvePrefetch();
+
+	if (tiles[tile] != Valid)
+		readSync(markPending(IntRect(x, y, 1, 1)), fbo, texRect);
+
+	return &pixels[(y * width + x) * BYTES_PER_PIXEL];
+}
+
+void PixelCache::setPixel(int x, int y, const uint8_t rgba[4])
+{
+	if (pixels.empty())
+		return;
+
+	uint8_t &state = tiles[(y / TILE_SIZE) * tilesX + (x / TILE_SIZE)];
+
+	if (state == Valid)
+		memcpy(&pixels[(y * width + x) * BYTES_PER_PIXEL], rgba, BYTES_PER_PIXEL);
+	else
+		/* Prefetched data doesn't have the change yet */
+		state = Invalid;
+}
+
+void PixelCache::prefetch(const IntRect &rect, FBO::ID fbo, const IntRect &texRect)
+{
+	init(texRect.w, texRect.h);
+
+	/* Only keep one readback in flight */
+	resolvePrefetch();
+
+	const IntRect area = markPending(rect);
+
+	if (area.w == 0)
+		return;
+
+	if (!gl.pixel_buffer || !gl.MapBufferRange || !gl.UnmapBuffer)
+	{
+		readSync(area, fbo, texRect);
+		return;
+	}
+
+	const GLsizeiptr size = area.w * area.h * BYTES_PER_PIXEL;
+
+	pf.pbo = PackBO::gen();
+	PackBO::bind(pf.pbo);
+	PackBO::allocEmpty(size, GL_STREAM_READ);
+
+	FBO::bind(fbo);
+	gl.ReadPixels(texRect.x + area.x, texRect.y + area.y, area.w, area.h,
+	              GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+	if (gl.FenceSync)
+		pf.fence = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	PackBO::unbind();
+
+	pf.area = area;
+
+	shState->perfStats().add(PerfStats::ReadbackBytes, size);
+}
+
+bool PixelCache::holds(int x, int y) const
+{
+	if (pixels.empty())
+		return false;
+
+	return tiles[(y / TILE_SIZE) * tilesX + (x / TILE_SIZE)] == Valid;
+}
+
+bool PixelCache::copyRect(const IntRect &rect, void *output) const
+{
+	int tx1, ty1, tx2, ty2;
+
+	if (pixels.empty() || !tileRange(rect, tx1, ty1, tx2, ty2))
+		return false;
+
+	for (int ty = ty1; ty <= ty2; ++ty)
+		for (int tx = tx1; tx <= tx2; ++tx)
+			if (tiles[ty * tilesX + tx] != Valid)
+				return false;
+
+	const size_t rowBytes = rect.w * BYTES_PER_PIXEL;
+	const size_t pitch = width * BYTES_PER_PIXEL;
+	const uint8_t *src = &pixels[rect.y * pitch + rect.x * BYTES_PER_PIXEL];
+	uint8_t *dst = (uint8_t*) output;
+
+	for (int i = 0; i < rect.h; ++i)
+		memcpy(dst + i * rowBytes, src + i * pitch, rowBytes);
+
+	return true;
+}
+
+void PixelCache::invalidate(const IntRect &rect)
+{
+	int tx1, ty1, tx2, ty2;
+
+	if (pixels.empty() || !tileRange(rect, tx1, ty1, tx2, ty2))
+		return;
+
+	for (int ty = ty1; ty <= ty2; ++ty)
+		for (int tx = tx1; tx <= tx2; ++tx)
+			tiles[ty * tilesX + tx] = Invalid;
+}
+
+void PixelCache::invalidateAll()
+{
+	dropPrefetch();
+
+	std::vector<uint8_t>().swap(pixels);
+	std::vector<uint8_t>().swap(tiles);
+}
+
+void PixelCache::init(int width, int height)
+{
+	if (!pixels.empty())
+		return;
+
+	this->width = width;
+	this->height = height;
+	tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	pixels.resize(width * height * BYTES_PER_PIXEL);
+	tiles.assign(tilesX * tilesY, Invalid);
+}
+
+bool PixelCache::tileRange(const IntRect &rect, int &tx1, int &ty1,
+                           int &tx2, int &ty2) const
+{
+	int x1 = std::min(rect.x, rect.x + rect.w);
+	int y1 = std::min(rect.y, rect.y + rect.h);
+	int x2 = std::max(rect.x, rect.x + rect.w);
+	int y2 = std::max(rect.y, rect.y + rect.h);
+
+	x1 = std::max(x1, 0);
+	y1 = std::max(y1, 0);
+	x2 = std::min(x2, width);
+	y2 = std::min(y2, height);
+
+	if (x1 >= x2 || y1 >= y2)
+		return false;
+
+	tx1 = x1 / TILE_SIZE;
+	ty1 = y1 / TILE_SIZE;
+	tx2 = (x2 - 1) / TILE_SIZE;
+	ty2 = (y2 - 1) / TILE_SIZE;
+
+	return true;
+}
+
+IntRect PixelCache::markPending(const IntRect &rect)
+{
+	int tx1, ty1, tx2, ty2;
+
+	if (!tileRange(rect, tx1, ty1, tx2, ty2))
+		return IntRect();
+
+	int minX = tilesX, minY = tilesY, maxX = -1, maxY = -1;
+
+	for (int ty = ty1; ty <= ty2; ++ty)
+		for (int tx = tx1; tx <= tx2; ++tx)
+		{
+			uint8_t &state = tiles[ty * tilesX + tx];
+
+			if (state != Invalid)
+				continue;
+
+			state = Pending;
+
+			minX = std::min(minX, tx);
+			minY = std::min(minY, ty);
+			maxX = std::max(maxX, tx);
+			maxY = std::max(maxY, ty);
+		}
+
+	if (maxX < 0)
+		return IntRect();
+
+	const int x = minX * TILE_SIZE;
+	const int y = minY * TILE_SIZE;
+
+	return IntRect(x, y,
+	               std::min((maxX + 1) * TILE_SIZE, width) - x,
+	               std::min((maxY + 1) * TILE_SIZE, height) - y);
+}
+
+void PixelCache::store(const IntRect &area, const uint8_t *data)
+{
+	int tx1, ty1, tx2, ty2;
+
+	if (!tileRange(area, tx1, ty1, tx2, ty2))
+		return;
+
+	const size_t srcPitch = area.w * BYTES_PER_PIXEL;
+	const size_t dstPitch = width * BYTES_PER_PIXEL;
+
+	for (int ty = ty1; ty <= ty2; ++ty)
+		for (int tx = tx1; tx <= tx2; ++tx)
+		{
+			uint8_t &state = tiles[ty * tilesX + tx];
+
+			/* Tiles that were touched in the meantime
+			 * must not be overwritten with stale data */
+			if (state != Pending)
+				continue;
+
+			const int x = tx * TILE_SIZE;
+			const int y = ty * TILE_SIZE;
+			const int w = std::min(TILE_SIZE, width - x);
+			const int h = std::min(TILE_SIZE, height - y);
+
+			const uint8_t *src = data + (y - area.y) * srcPitch
+			                          + (x - area.x) * BYTES_PER_PIXEL;
+			uint8_t *dst = &pixels[y * dstPitch + x * BYTES_PER_PIXEL];
+
+			for (int i = 0; i < h; ++i)
+				memcpy(dst + i * dstPitch, src + i * srcPitch, w * BYTES_PER_PIXEL);
+
+			state = Valid;
+		}
+}
+
+void PixelCache::readSync(const IntRect &area, FBO::ID fbo, const IntRect &texRect)
+{
+	if (area.w == 0)
+		return;
+
+	std::vector<uint8_t> buffer(area.w * area.h * BYTES_PER_PIXEL);
+
+	FBO::bind(fbo);
+	gl.ReadPixels(texRect.x + area.x, texRect.y + area.y, area.w, area.h,
+	              GL_RGBA, GL_UNSIGNED_BYTE, &buffer[0]);
+
+	store(area, &buffer[0]);
+
+	shState->perfStats().add(PerfStats::ReadbackBytes, buffer.size());
+}
+
+void PixelCache::resolvePrefetch()
+{
+	if (pf.pbo == PackBO::ID(0))
+		return;
+
+	if (pf.fence)
+	{
+		GLenum res = gl.ClientWaitSync(pf.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+		                               FENCE_TIMEOUT_NS);
+
+		if (res != GL_ALREADY_SIGNALED)
+			shState->perfStats().add(PerfStats::ReadbackStalls);
+	}
+
+	const GLsizeiptr size = pf.area.w * pf.area.h * BYTES_PER_PIXEL;
+
+	PackBO::bind(pf.pbo);
+
+	const uint8_t *data = (const uint8_t*)
+		gl.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+	if (data)
+	{
+		store(pf.area, data);
+		gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+
+	PackBO::unbind();
+
+	/* If mapping failed, these get read back on demand */
+	int tx1, ty1, tx2, ty2;
+
+	if (tileRange(pf.area, tx1, ty1, tx2, ty2))
+		for (int ty = ty1; ty <= ty2; ++ty)
+			for (int tx = tx1; tx <= tx2; ++tx)
+				if (tiles[ty * tilesX + tx] == Pending)
+					tiles[ty * tilesX + tx] = Invalid;
+
+	dropPrefetch();
+}
+
+void PixelCache::dropPrefetch()
+{
+	if (pf.fence)
+		gl.DeleteSync(pf.fence);
+
+	if (pf.pbo != PackBO::ID(0))
+		PackBO::del(pf.pbo);
+
+	pf.pbo = PackBO::ID(0);
+	pf.fence = 0;
+}
@@ -0,0 +1,115 @@
+/*
+** pixelcache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIXELCACHE_H
+#define PIXELCACHE_H
+
+#include "gl-util.h"
+#include "etc-internal.h"
+
+#include <stdint.h>
+#include <vector>
+
+/* Client memory copy of a bitmap's pixels (RGBA8), used to
+ * answer getPixel calls. The bitmap is split into square tiles
+ * which are read back from the GPU individually, the first
+ * time a pixel inside them is asked for, and are invalidated
+ * individually when a draw operation touches them.
+ *
+ * prefetch() starts reading back an area into a pixel buffer
+ * object without waiting for the GPU; the data is picked up
+ * once a pixel inside of it is requested. Without pixel buffer
+ * objects, prefetching reads back synchronously.
+ *
+ * All operations take the framebuffer holding the bitmap and
+ * its area inside of it ('texRect'), whose size must match
+ * the bitmap's */
+class PixelCache
+{
+public:
+	PixelCache();
+	~PixelCache();
+
+	/* Returns the 4 bytes of pixel (x, y), which must lie inside
+	 * the bitmap. Reads back its tile if necessary */
+	const uint8_t *pixel(int x, int y, FBO::ID fbo, const IntRect &texRect);
+
+	/* Applies a single pixel change to a cached tile */
+	void setPixel(int x, int y, const uint8_t rgba[4]);
+
+	void prefetch(const IntRect &rect, FBO::ID fbo, const IntRect &texRect);
+
+	/* Whether the tile holding (x, y) is cached */
+	bool holds(int x, int y) const;
+
+	/* Copies 'rect' (inside the bitmap) into 'output', tightly
+	 * packed, if every tile it touches is cached; returns
+	 * false otherwise */
+	bool copyRect(const IntRect &rect, void *output) const;
+
+	void invalidate(const IntRect &rect);
+
+	/* Also releases all memory */
+	void invalidateAll();
+
+private:
+	enum TileState
+	{
+		Invalid = 0,
+		Valid,
+		Pending
+	};
+
+	void init(int width, int height);
+
+	/* Tile index range covered by 'rect' (clipped) */
+	bool tileRange(const IntRect &rect, int &tx1, int &ty1,
+	               int &tx2, int &ty2) const;
+
+	/* Marks the invalid tiles in 'rect' pending and returns the
+	 * tile aligned bounding box of them (empty if none) */
+	IntRect markPending(const IntRect &rect);
+
+	/* Copies the pending tiles found in 'area', whose pixels
+	 * are in 'data', into the cache and validates them */
+	void store(const IntRect &area, const uint8_t *data);
+
+	void readSync(const IntRect &area, FBO::ID fbo, const IntRect &texRect);
+
+	void resolvePrefetch();
+	void dropPrefetch();
+
+	int width, height;
+	int tilesX, tilesY;
+
+	std::vector<uint8_t> pixels;
+	std::vector<uint8_t> tiles;
+
+	/* Pending asynchronous readback */
+	struct
+	{
+		PackBO::ID pbo;
+		_GLsync fence;
+		IntRect area;
+	} pf;
+};
+
+#endif // PIXELCACHE_H
@@ -0,0 +1,383 @@
+/*
+** pixelkernels.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pixelkernels.h"
+
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PIXEL_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXEL_NEON
+#endif
+
+#if defined(PIXEL_SSE2) || defined(PIXEL_NEON)
+#define PIXEL_SIMD
+#endif
+
+/* Same as in shader/hue.frag */
+#define HUE_EPS 1.0e-10f
+
+namespace PixelKernels
+{
+
+static inline uint8_t toByte(float v)
+{
+	if (v <= 0)
+		return 0;
+
+	if (v >= 255)
+		return 255;
+
+	return (uint8_t) (v + 0.5f);
+}
+
+static void blendScalar(uint8_t *dst, const uint8_t *src, int count, int opacity)
+{
+	const float op = opacity / 255.0f;
+
+	for (int i = 0; i < count; ++i, dst += 4, src += 4)
+	{
+		const float co1 = (src[3] / 255.0f) * op;
+		const float co2 = (dst[3] / 255.0f) * (1.0f - co1);
+		const float ra = co1 + co2;
+
+		if (ra == 0)
+		{
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+		}
+		else
+		{
+			for (int c = 0; c < 3; ++c)
+				dst[c] = toByte((co1 * src[c] + co2 * dst[c]) / ra);
+		}
+
+		dst[3] = toByte(ra * 255.0f);
+	}
+}
+
+static void hueScalar(uint8_t *px, int count, float hueAdjust)
+{
+	for (int i = 0; i < count; ++i, px += 4)
+	{
+		const float r = px[0] / 255.0f;
+		const float g = px[1] / 255.0f;
+		const float b = px[2] / 255.0f;
+
+		/* rgb2hsv */
+		float p[4], q[4];
+
+		if (g >= b)
+			p[0] = g, p[1] = b, p[2] = 0.0f, p[3] = -1.0f / 3.0f;
+		else
+			p[0] = b, p[1] = g, p[2] = -1.0f, p[3] = 2.0f / 3.0f;
+
+		if (r >= p[0])
+			q[0] = r, q[1] = p[1], q[2] = p[3], q[3] = p[0];
+		else
+			q[0] = p[0], q[1] = p[1], q[2] = p[2], q[3] = r;
+
+		const float d = q[0] - (q[3] < q[1] ? q[3] : q[1]);
+
+		float h = fabsf(q[2] + (q[3] - q[1]) / (6.0f * d + HUE_EPS));
+		const float s = d / (q[0] + HUE_EPS);
+		const float v = q[0];
+
+		h += hueAdjust;
+
+		/* hsv2rgb */
+		static const float k[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+		for (int c = 0; c < 3; ++c)
+		{
+			float t = h + k[c];
+			t = fabsf((t - floorf(t)) * 6.0f - 3.0f) - 1.0f;
+			t = (t < 0) ? 0 : (t > 1) ? 1 : t;
+
+			px[c] = toByte(v * (1.0f + (t - 1.0f) * s) * 255.0f);
+		}
+	}
+}
+
+#ifdef PIXEL_SIMD
+
+/* The kernels below work on 4 pixels at a time, with every
+ * color channel in a vector of its own */
+
+#ifdef PIXEL_SSE2
+
+typedef __m128  F4;
+typedef __m128i U4;
+typedef __m128  M4;
+
+static inline F4 splat(float v)       { return _mm_set1_ps(v); }
+static inline F4 add(F4 a, F4 b)      { return _mm_add_ps(a, b); }
+static inline F4 sub(F4 a, F4 b)      { return _mm_sub_ps(a, b); }
+static inline F4 mul(F4 a, F4 b)      { return _mm_mul_ps(a, b); }
+static inline F4 vdiv(F4 a, F4 b)     { return _mm_div_ps(a, b); }
+static inline F4 vmin(F4 a, F4 b)     { return _mm_min_ps(a, b); }
+static inline F4 vmax(F4 a, F4 b)     { return _mm_max_ps(a, b); }
+static inline M4 ge(F4 a, F4 b)       { return _mm_cmpge_ps(a, b); }
+static inline M4 eq(F4 a, F4 b)       { return _mm_cmpeq_ps(a, b); }
+static inline F4 sel(M4 m, F4 a, F4 b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+static inline F4 vabs(F4 a)
+{
+	return _mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)));
+}
+
+/* Only valid for non-negative values */
+static inline F4 fract(F4 a)
+{
+	return _mm_sub_ps(a, _mm_cvtepi32_ps(_mm_cvttps_epi32(a)));
+}
+
+static inline U4 load(const uint8_t *p)   { return _mm_loadu_si128((const __m128i*) p); }
+static inline void store(uint8_t *p, U4 v) { _mm_storeu_si128((__m128i*) p, v); }
+
+static inline F4 channel(U4 px, int c)
+{
+	return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, c * 8), _mm_set1_epi32(0xFF)));
+}
+
+/* Rounds and clamps to [0, 255] */
+static inline U4 toChannel(F4 v, int c)
+{
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+
+	return _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f))), c * 8);
+}
+
+static inline U4 vor(U4 a, U4 b) { return _mm_or_si128(a, b); }
+
+static inline U4 alphaBits(U4 px)
+{
+	return _mm_and_si128(px, _mm_set1_epi32(0xFF000000));
+}
+
+static inline U4 splatPixel(uint32_t v) { return _mm_set1_epi32((int) v); }
+
+#else /* PIXEL_NEON */
+
+typedef float32x4_t F4;
+typedef uint32x4_t  U4;
+typedef uint32x4_t  M4;
+
+static inline F4 splat(float v)       { return vdupq_n_f32(v); }
+static inline F4 add(F4 a, F4 b)      { return vaddq_f32(a, b); }
+static inline F4 sub(F4 a, F4 b)      { return vsubq_f32(a, b); }
+static inline F4 mul(F4 a, F4 b)      { return vmulq_f32(a, b); }
+static inline F4 vmin(F4 a, F4 b)     { return vminq_f32(a, b); }
+static inline F4 vmax(F4 a, F4 b)     { return vmaxq_f32(a, b); }
+static inline M4 ge(F4 a, F4 b)       { return vcgeq_f32(a, b); }
+static inline M4 eq(F4 a, F4 b)       { return vceqq_f32(a, b); }
+static inline F4 sel(M4 m, F4 a, F4 b) { return vbslq_f32(m, a, b); }
+static inline F4 vabs(F4 a)           { return vabsq_f32(a); }
+
+static inline F4 vdiv(F4 a, F4 b)
+{
+#ifdef __aarch64__
+	return vdivq_f32(a, b);
+#else
+	/* Two Newton-Raphson steps get the estimate to full precision */
+	F4 r = vrecpeq_f32(b);
+	r = vmulq_f32(vrecpsq_f32(b, r), r);
+	r = vmulq_f32(vrecpsq_f32(b, r), r);
+
+	return vmulq_f32(a, r);
+#endif
+}
+
+/* Only valid for non-negative values */
+static inline F4 fract(F4 a)
+{
+	return vsubq_f32(a, vcvtq_f32_u32(vcvtq_u32_f32(a)));
+}
+
+static inline U4 load(const uint8_t *p)   { return vreinterpretq_u32_u8(vld1q_u8(p)); }
+static inline void store(uint8_t *p, U4 v) { vst1q_u8(p, vreinterpretq_u8_u32(v)); }
+
+static inline F4 channel(U4 px, int c)
+{
+	U4 v = vshlq_u32(px, vdupq_n_s32(-c * 8));
+
+	return vcvtq_f32_u32(vandq_u32(v, vdupq_n_u32(0xFF)));
+}
+
+/* Rounds and clamps to [0, 255] */
+static inline U4 toChannel(F4 v, int c)
+{
+	v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0)), vdupq_n_f32(255.0f));
+
+	U4 i = vcvtq_u32_f32(vaddq_f32(v, vdupq_n_f32(0.5f)));
+
+	return vshlq_u32(i, vdupq_n_s32(c * 8));
+}
+
+static inline U4 vor(U4 a, U4 b) { return vorrq_u32(a, b); }
+
+static inline U4 alphaBits(U4 px)
+{
+	return vandq_u32(px, vdupq_n_u32(0xFF000000));
+}
+
+static inline U4 splatPixel(uint32_t v) { return vdupq_n_u32(v); }
+
+#endif
+
+static void blendVector(uint8_t *dst, const uint8_t *src, int count, int opacity)
+{
+	const F4 zero = splat(0.0f);
+	const F4 one = splat(1.0f);
+	const F4 norm = splat(1.0f / 255.0f);
+	const F4 op = splat(opacity / (255.0f * 255.0f));
+
+	for (int i = 0; i < count; i += 4, dst += 16, src += 16)
+	{
+		const U4 s = load(src);
+		const U4 d = load(dst);
+
+		const F4 co1 = mul(channel(s, 3), op);
+		const F4 co2 = mul(mul(channel(d, 3), norm), sub(one, co1));
+		const F4 ra = add(co1, co2);
+
+		/* Fully transparent results take the source colors */
+		const M4 none = eq(ra, zero);
+		const F4 inv = vdiv(one, sel(none, one, ra));
+
+		U4 res = toChannel(mul(ra, splat(255.0f)), 3);
+
+		for (int c = 0; c < 3; ++c)
+		{
+			const F4 sc = channel(s, c);
+			const F4 mixed = mul(add(mul(co1, sc), mul(co2, channel(d, c))), inv);
+
+			res = vor(res, toChannel(sel(none, sc, mixed), c));
+		}
+
+		store(dst, res);
+	}
+}
+
+static void hueVector(uint8_t *px, int count, float hueAdjust)
+{
+	const F4 zero = splat(0.0f);
+	const F4 one = splat(1.0f);
+	const F4 norm = splat(1.0f / 255.0f);
+	const F4 eps = splat(HUE_EPS);
+
+	for (int i = 0; i < count; i += 4, px += 16)
+	{
+		const U4 in = load(px);
+
+		const F4 r = mul(channel(in, 0), norm);
+		const F4 g = mul(channel(in, 1), norm);
+		const F4 b = mul(channel(in, 2), norm);
+
+		/* rgb2hsv, with mix(a, b, step()) turned into selects */
+		const M4 gb = ge(g, b);
+		const F4 p0 = sel(gb, g, b);
+		const F4 p1 = sel(gb, b, g);
+		const F4 p2 = sel(gb, zero, splat(-1.0f));
+		const F4 p3 = sel(gb, splat(-1.0f / 3.0f), splat(2.0f / 3.0f));
+
+		const M4 rp = ge(r, p0);
+		const F4 q0 = sel(rp, r, p0);
+		const F4 q1 = p1;
+		const F4 q2 = sel(rp, p3, p2);
+		const F4 q3 = sel(rp, p0, r);
+
+		const F4 d = sub(q0, vmin(q3, q1));
+
+		F4 h = vabs(add(q2, vdiv(sub(q3, q1), add(mul(splat(6.0f), d), eps))));
+		const F4 s = vdiv(d, add(q0, eps));
+		const F4 v = mul(q0, splat(255.0f));
+
+		h = add(h, splat(hueAdjust));
+
+		/* hsv2rgb */
+		static const float k[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+		U4 res = alphaBits(in);
+
+		for (int c = 0; c < 3; ++c)
+		{
+			F4 t = fract(add(h, splat(k[c])));
+			t = sub(vabs(sub(mul(t, splat(6.0f)), splat(3.0f))), one);
+			t = vmin(vmax(t, zero), one);
+
+			res = vor(res, toChannel(mul(v, add(one, mul(sub(t, one), s))), c));
+		}
+
+		store(px, res);
+	}
+}
+
+#endif // PIXEL_SIMD
+
+void fill(uint8_t *dst, int count, const uint8_t rgba[4])
+{
+	int i = 0;
+
+#ifdef PIXEL_SIMD
+	uint32_t pixel;
+	memcpy(&pixel, rgba, 4);
+
+	const U4 v = splatPixel(pixel);
+
+	for (; i + 4 <= count; i += 4)
+		store(dst + i * 4, v);
+#endif
+
+	for (; i < count; ++i)
+		memcpy(dst + i * 4, rgba, 4);
+}
+
+void blend(uint8_t *dst, const uint8_t *src, int count, int opacity)
+{
+	int done = 0;
+
+#ifdef PIXEL_SIMD
+	done = count & ~3;
+	blendVector(dst, src, done, opacity);
+#endif
+
+	blendScalar(dst + done * 4, src + done * 4, count - done, opacity);
+}
+
+void hueShift(uint8_t *px, int count, float hueAdjust)
+{
+	int done = 0;
+
+#ifdef PIXEL_SIMD
+	done = count & ~3;
+	hueVector(px, done, hueAdjust);
+#endif
+
+	hueScalar(px + done * 4, count - done, hueAdjust);
+}
+
+}
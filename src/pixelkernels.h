@@ -0,0 +1,47 @@
+/*
+** pixelkernels.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include <stdint.h>
+
+/* Row operations on RGBA8 pixels in client memory, mirroring
+ * what the GL paths of Bitmap compute. They're vectorized with
+ * SSE2 or NEON where the compiler targets either, and fall back
+ * to plain C++ otherwise */
+namespace PixelKernels
+{
+
+/* Sets 'count' pixels to 'rgba' */
+void fill(uint8_t *dst, int count, const uint8_t rgba[4]);
+
+/* Blends 'src' onto 'dst' like shader/bitmapBlit.frag
+ * does, with 'opacity' in [0, 255] */
+void blend(uint8_t *dst, const uint8_t *src, int count, int opacity);
+
+/* Rotates the hue of 'count' pixels in place like
+ * shader/hue.frag does, with 'hueAdjust' in [0, 1) */
+void hueShift(uint8_t *px, int count, float hueAdjust);
+
+}
+
+#endif // PIXELKERNELS_H
@@ -40,12 +40,42 @@
 
 #include <sigc++/connection.h>
 
+#include <algorithm>
+#include <math.h>
+
 static float fwrap(float value, float range)
 {
 	float res = fmod(value, range);
 	return res < 0 ? res + range : res;
 }
 
+/* Clips one axis of a quad, spanning 'tex' in texture and 'pos'
+ * in screen space, to [from, to) in texture space, keeping its
+ * orientation. Returns false if nothing is left */
+static bool clipSpan(float &tex, float &texLen, float &pos, float &posLen,
+                     float from, float to)
+{
+	if (texLen == 0)
+		return false;
+
+	const float lo = std::max(std::min(tex, tex + texLen), from);
+	const float hi = std::min(std::max(tex, tex + texLen), to);
+
+	if (lo >= hi)
+		return false;
+
+	const float a = texLen < 0 ? hi : lo;
+	const float b = texLen < 0 ? lo : hi;
+	const float scale = posLen / texLen;
+
+	pos += (a - tex) * scale;
+	posLen = (b - a) * scale;
+	tex = a;
+	texLen = b - a;
+
+	return true;
+}
+
 struct PlanePrivate
 {
 	Bitmap *bitmap;
@@ -74,6 +104,9 @@ struct PlanePrivate
 
 	SimpleQuadArray qArray;
 
+	/* Parts of 'qArray' held by one mega bitmap tile */
+	SimpleQuadArray megaArray;
+
 	EtcTemps tmp;
 
 	sigc::connection prepareCon;
@@ -104,10 +137,23 @@ struct PlanePrivate
 		prepareCon.disconnect();
 	}
 
+	bool megaBitmap() const
+	{
+		return !nullOrDisposed(bitmap) && bitmap->isMega();
+	}
+
 	void updateQuadSource()
 	{
-		if (gl.npot_repeat && wave.amp==0)
+		/* Mega bitmaps have no texture to wrap */
+		if (gl.npot_repeat && wave.amp==0 && !megaBitmap())
 		{
+			/* Might have emitted a quad per repetition before */
+			if (qArray.count() != 1)
+			{
+				qArray.resize(1);
+				Quad::setPosRect(&qArray.vertices[0], FloatRect(sceneGeo.rect));
+			}
+
 			FloatRect srcRect;
 			srcRect.x = (sceneGeo.orig.x + ox) / zoomX;
 			srcRect.y = (sceneGeo.orig.y + oy) / zoomY;
@@ -218,6 +264,67 @@ struct PlanePrivate
 		qArray.commit();
 	}
 
+	/* Every tile draws the parts of the quads it holds, in
+	 * tile relative coordinates (the plane shaders have no
+	 * texture offset). Texture coordinates beyond the bitmap
+	 * (from the wave effect) wrap around like with GL_REPEAT */
+	void drawMegaTiles(ShaderBase &shader)
+	{
+		const float bmW = bitmap->width();
+		const float bmH = bitmap->height();
+
+		for (int i = 0; i < bitmap->megaTileCount(); ++i)
+		{
+			const IntRect tile = bitmap->megaTileRect(i);
+
+			megaArray.clear();
+
+			for (size_t q = 0; q < qArray.count(); ++q)
+			{
+				/* Corners as laid out by Quad::setTexPosRect() */
+				const SVertex *vert = &qArray.vertices[q*4];
+
+				const FloatRect tex(vert[0].texPos.x, vert[0].texPos.y,
+				                    vert[2].texPos.x - vert[0].texPos.x,
+				                    vert[2].texPos.y - vert[0].texPos.y);
+				const FloatRect pos(vert[0].pos.x, vert[0].pos.y,
+				                    vert[2].pos.x - vert[0].pos.x,
+				                    vert[2].pos.y - vert[0].pos.y);
+
+				const float texX2 = std::max(tex.x, tex.x + tex.w);
+				const float texY2 = std::max(tex.y, tex.y + tex.h);
+
+				for (int ry = floorf(std::min(tex.y, texY2) / bmH); ry * bmH < texY2; ++ry)
+					for (int rx = floorf(std::min(tex.x, texX2) / bmW); rx * bmW < texX2; ++rx)
+					{
+						const float tileX = rx * bmW + tile.x;
+						const float tileY = ry * bmH + tile.y;
+
+						FloatRect t = tex;
+						FloatRect p = pos;
+
+						if (!clipSpan(t.x, t.w, p.x, p.w, tileX, tileX + tile.w) ||
+						    !clipSpan(t.y, t.h, p.y, p.h, tileY, tileY + tile.h))
+							continue;
+
+						t.x -= tileX;
+						t.y -= tileY;
+
+						megaArray.resize(megaArray.count() + 1);
+						Quad::setTexPosRect(&megaArray.vertices[(megaArray.count() - 1) * 4], t, p);
+					}
+			}
+
+			if (megaArray.count() == 0)
+				continue;
+
+			megaArray.commit();
+
+			bitmap->bindMegaTileLocal(shader, i);
+			megaArray.draw();
+		}
+	}
+
 	void prepare()
 	{
 		if (quadSourceDirty)
@@ -242,8 +349,8 @@ DEF_ATTR_RD_SIMPLE(Plane, OY,        int,     p->oy)
 DEF_ATTR_RD_SIMPLE(Plane, ZoomX,     float,   p->zoomX)
 DEF_ATTR_RD_SIMPLE(Plane, ZoomY,     float,   p->zoomY)
 DEF_ATTR_RD_SIMPLE(Plane, BlendType, int,     p->blendType)
+DEF_ATTR_RD_SIMPLE(Plane, Opacity,   int,     p->opacity)
 
-DEF_ATTR_SIMPLE(Plane, Opacity,   int,     p->opacity)
 DEF_ATTR_SIMPLE(Plane, Color,     Color&, *p->color)
 DEF_ATTR_SIMPLE(Plane, Tone,      Tone&,  *p->tone)
 
@@ -266,6 +373,7 @@ void Plane::setWaveAmp(int value)
 	        return;
 	p->wave.amp = value;
 	p->quadSourceDirty = true;
+	Scene::markDirty();
 }
 void Plane::setWaveLen(int value)
 {
@@ -273,7 +381,10 @@ void Plane::setWaveLen(int value)
 	if (p->wave.length == value)
 	        return;
 	p->wave.length = value;
-	if (p->wave.amp != 0) p->quadSourceDirty = true;
+	if (p->wave.amp != 0) {
+		p->quadSourceDirty = true;
+		Scene::markDirty();
+	}
 }
 void Plane::setWaveSpeed(float value)
 {
@@ -281,7 +392,10 @@ void Plane::setWaveSpeed(float value)
 	if (p->wave.speed == value)
 	        return;
 	p->wave.speed = value;
-	if (p->wave.amp != 0) p->quadSourceDirty = true;
+	if (p->wave.amp != 0) {
+		p->quadSourceDirty = true;
+		Scene::markDirty();
+	}
 }
 void Plane::setWavePhase(float value)
 {
@@ -289,7 +403,10 @@ void Plane::setWavePhase(float value)
 	if (p->wave.phase == value)
 	        return;
 	p->wave.phase = value;
-	if (p->wave.amp != 0) p->quadSourceDirty = true;
+	if (p->wave.amp != 0) {
+		p->quadSourceDirty = true;
+		Scene::markDirty();
+	}
 }
 void Plane::setWaveMode(int value)
 {
@@ -297,7 +414,10 @@ void Plane::setWaveMode(int value)
 	if (p->wave.mode == value)
 	        return;
 	p->wave.mode = value;
-	if (p->wave.amp != 0) p->quadSourceDirty = true;
+	if (p->wave.amp != 0) {
+		p->quadSourceDirty = true;
+		Scene::markDirty();
+	}
 }
 void Plane::setWaveSize(int value)
 {
@@ -305,19 +425,30 @@ void Plane::setWaveSize(int value)
 	if (p->wave.size == value)
 	        return;
 	p->wave.size = value;
-	if (p->wave.amp != 0) p->quadSourceDirty = true;
+	if (p->wave.amp != 0) {
+		p->quadSourceDirty = true;
+		Scene::markDirty();
+	}
 }
 
 void Plane::setBitmap(Bitmap *value)
 {
 	guardDisposed();
 
+	if (p->bitmap == value)
+		return;
+
 	p->bitmap = value;
+	Scene::markDirty();
 
 	if (!value)
 		return;
 
-	value->ensureNonMega();
+	/* Mega bitmaps are tiled by hand */
+	p->quadSourceDirty = true;
+
+	/* Tiling relies on texture wrapping */
+	value->ensureNonAtlas();
 }
 
 void Plane::setOX(int value)
@@ -329,6 +460,7 @@ void Plane::setOX(int value)
 
 	p->ox = value;
 	p->quadSourceDirty = true;
+	Scene::markDirty();
 }
 
 void Plane::setOY(int value)
@@ -340,6 +472,7 @@ void Plane::setOY(int value)
 
 	p->oy = value;
 	p->quadSourceDirty = true;
+	Scene::markDirty();
 }
 
 void Plane::setZoomX(float value)
@@ -351,6 +484,7 @@ void Plane::setZoomX(float value)
 
 	p->zoomX = value;
 	p->quadSourceDirty = true;
+	Scene::markDirty();
 }
 
 void Plane::setZoomY(float value)
@@ -362,25 +496,45 @@ void Plane::setZoomY(float value)
 
 	p->zoomY = value;
 	p->quadSourceDirty = true;
+	Scene::markDirty();
 }
 
 void Plane::setBlendType(int value)
 {
 	guardDisposed();
 
+	BlendType type;
+
 	switch (value)
 	{
 	default :
 	case BlendNormal :
-		p->blendType = BlendNormal;
-		return;
+		type = BlendNormal;
+		break;
 	case BlendAddition :
-		p->blendType = BlendAddition;
-		return;
+		type = BlendAddition;
+		break;
 	case BlendSubstraction :
-		p->blendType = BlendSubstraction;
-		return;
+		type = BlendSubstraction;
+		break;
 	}
+
+	if (p->blendType == type)
+		return;
+
+	p->blendType = type;
+	Scene::markDirty();
+}
+
+void Plane::setOpacity(int value)
+{
+	guardDisposed();
+
+	if (p->opacity == value)
+		return;
+
+	p->opacity = value;
+	Scene::markDirty();
 }
 
 void Plane::initDynAttribs()
@@ -394,6 +548,7 @@ void Plane::update() {
 	if (p->wave.amp != 0) {
 		p->wave.phase += (p->wave.speed / 180.0f);
 		p->quadSourceDirty = true;
+		Scene::markDirty();
 	}
 }
 
@@ -409,7 +564,7 @@ void Plane::draw()
 
 	if (p->color->hasEffect() || p->tone->hasEffect() || p->opacity != 255)
 	{
-		PlaneShader &shader = shState->shaders().plane;
+		PlaneShader &shader = shState->shaders().plane();
 
 		shader.bind();
 		shader.applyViewportProj();
@@ -422,7 +577,7 @@ void Plane::draw()
 	}
 	else
 	{
-		SimpleShader &shader = shState->shaders().simple;
+		SimpleShader &shader = shState->shaders().simple();
 
 		shader.bind();
 		shader.applyViewportProj();
@@ -433,19 +588,35 @@ void Plane::draw()
 
 	glState.blendMode.pushSet(p->blendType);
 
-	p->bitmap->bindTex(*base);
+	if (p->bitmap->isMega())
+	{
+		p->drawMegaTiles(*base);
+	}
+	else
+	{
+		p->bitmap->bindTex(*base);
 
-	if (gl.npot_repeat)
-		TEX::setRepeat(true);
+		if (gl.npot_repeat)
+			TEX::setRepeat(true);
 
-	p->qArray.draw();
+		p->qArray.draw();
 
-	if (gl.npot_repeat)
-		TEX::setRepeat(false);
+		if (gl.npot_repeat)
+			TEX::setRepeat(false);
+	}
 
 	glState.blendMode.pop();
 }
 
+bool Plane::isCulled()
+{
+	/* Planes always cover their whole scene */
+	const IntRect &rect = p->sceneGeo.rect;
+
+	return nullOrDisposed(p->bitmap) || !p->opacity ||
+	       rect.w <= 0 || rect.h <= 0;
+}
+
 void Plane::onGeometryChange(const Scene::Geometry &geo)
 {
 	if (gl.npot_repeat)
@@ -59,6 +59,7 @@ private:
 	PlanePrivate *p;
 
 	void draw();
+	bool isCulled();
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
@@ -28,12 +28,14 @@
 #include "sharedstate.h"
 #include "global-ibo.h"
 #include "shader.h"
+#include "perfstats.h"
+#include "streambuffer.h"
 
 struct Quad
 {
 	Vertex vert[4];
-	VBO::ID vbo;
 	GLMeta::VAO vao;
+	StreamRegion region;
 	bool vboDirty;
 
 	template<typename V>
@@ -73,16 +75,13 @@ struct Quad
 	}
 
 	Quad()
-	    : vbo(VBO::gen()),
-	      vboDirty(true)
+	    : vboDirty(true)
 	{
 		GLMeta::vaoFillInVertexData<Vertex>(vao);
-		vao.vbo = vbo;
+		vao.vbo = shState->streamBuffer().vbo();
 		vao.ibo = shState->globalIBO().ibo;
 
-		GLMeta::vaoInit(vao, true);
-		VBO::allocEmpty(sizeof(Vertex[4]), GL_DYNAMIC_DRAW);
-		GLMeta::vaoUnbind(vao);
+		GLMeta::vaoInit(vao);
 
 		setColor(Vec4(1, 1, 1, 1));
 	}
@@ -90,14 +89,14 @@ struct Quad
 	~Quad()
 	{
 		GLMeta::vaoFini(vao);
-		VBO::del(vbo);
 	}
 
 	void updateBuffer()
 	{
-		VBO::bind(vbo);
-		VBO::uploadSubData(0, sizeof(Vertex[4]), vert);
-		VBO::unbind();
+		StreamBuffer &stream = shState->streamBuffer();
+
+		region = stream.upload(vert, sizeof(vert));
+		GLMeta::vaoRebase(vao, stream.vbo(), region.offset);
 	}
 
 	void setPosRect(const FloatRect &r)
@@ -128,7 +127,9 @@ struct Quad
 
 	void draw()
 	{
-		if (vboDirty)
+		/* Our data may have been dropped from the stream
+		 * buffer since the last upload */
+		if (vboDirty || !shState->streamBuffer().holds(region))
 		{
 			updateBuffer();
 			vboDirty = false;
@@ -137,6 +138,8 @@ struct Quad
 		GLMeta::vaoBind(vao);
 		gl.DrawElements(GL_TRIANGLES, 6, _GL_INDEX_TYPE, 0);
 		GLMeta::vaoUnbind(vao);
+
+		shState->perfStats().add(PerfStats::DrawCalls);
 	}
 };
 
@@ -28,6 +28,8 @@
 #include "sharedstate.h"
 #include "global-ibo.h"
 #include "shader.h"
+#include "perfstats.h"
+#include "streambuffer.h"
 
 #include <vector>
 #include <stdint.h>
@@ -37,20 +39,27 @@ struct QuadArray
 {
 	std::vector<VertexType> vertices;
 
-	VBO::ID vbo;
 	GLMeta::VAO vao;
 
 	size_t quadCount;
-	GLsizeiptr vboSize;
+
+	/* Arrays that fit are streamed through the shared stream
+	 * buffer; larger ones keep a VBO of their own so they
+	 * can't crowd out everybody else */
+	StreamRegion region;
+	bool streamed;
+
+	VBO::ID ownVBO;
+	GLsizeiptr ownVBOSize;
 
 	QuadArray()
 	    : quadCount(0),
-	      vboSize(-1)
+	      streamed(true),
+	      ownVBO(0),
+	      ownVBOSize(-1)
 	{
-		vbo = VBO::gen();
-
 		GLMeta::vaoFillInVertexData<VertexType>(vao);
-		vao.vbo = vbo;
+		vao.vbo = shState->streamBuffer().vbo();
 		vao.ibo = shState->globalIBO().ibo;
 
 		GLMeta::vaoInit(vao);
@@ -59,7 +68,9 @@ struct QuadArray
 	~QuadArray()
 	{
 		GLMeta::vaoFini(vao);
-		VBO::del(vbo);
+
+		if (ownVBO != VBO::ID(0))
+			VBO::del(ownVBO);
 	}
 
 	void resize(size_t size)
@@ -78,18 +89,32 @@ struct QuadArray
 	 * and previous to the first 'draw()' call. */
 	void commit()
 	{
-		VBO::bind(vbo);
-
+		StreamBuffer &stream = shState->streamBuffer();
 		GLsizeiptr size = vertices.size() * sizeof(VertexType);
 
-		if (size > vboSize)
+		shState->ensureQuadIBO(quadCount);
+
+		streamed = size <= stream.maxUpload();
+
+		if (streamed)
+		{
+			region = stream.upload(dataPtr(vertices), size);
+			GLMeta::vaoRebase(vao, stream.vbo(), region.offset);
+
+			return;
+		}
+
+		if (ownVBO == VBO::ID(0))
+			ownVBO = VBO::gen();
+
+		VBO::bind(ownVBO);
+
+		if (size > ownVBOSize)
 		{
 			/* New data exceeds already allocated size.
 			 * Reallocate VBO. */
 			VBO::uploadData(size, dataPtr(vertices), GL_DYNAMIC_DRAW);
-			vboSize = size;
-
-			shState->ensureQuadIBO(quadCount);
+			ownVBOSize = size;
 		}
 		else
 		{
@@ -98,16 +123,24 @@ struct QuadArray
 		}
 
 		VBO::unbind();
+
+		GLMeta::vaoRebase(vao, ownVBO, 0);
 	}
 
 	void draw(size_t offset, size_t count)
 	{
+		/* Streamed data may have been dropped in the meantime */
+		if (streamed && !shState->streamBuffer().holds(region))
+			commit();
+
 		GLMeta::vaoBind(vao);
 
 		const char *_offset = (const char*) 0 + offset * 6 * sizeof(index_t);
 		gl.DrawElements(GL_TRIANGLES, count * 6, _GL_INDEX_TYPE, _offset);
 
 		GLMeta::vaoUnbind(vao);
+
+		shState->perfStats().add(PerfStats::DrawCalls);
 	}
 
 	void draw()
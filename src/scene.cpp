@@ -21,6 +21,12 @@
 
 #include "scene.h"
 #include "sharedstate.h"
+#include "spritebatch.h"
+#include "perfstats.h"
+
+#include <SDL_timer.h>
+
+bool Scene::dirty = true;
 
 Scene::Scene()
 {}
@@ -36,52 +42,63 @@ Scene::~Scene()
 	}
 }
 
+bool Scene::ElementOrder::operator()(const SceneElement *a,
+                                     const SceneElement *b) const
+{
+	return *a < *b;
+}
+
 void Scene::insert(SceneElement &element)
 {
-	IntruListLink<SceneElement> *iter;
+	ElementIndex::iterator iter = elementIndex.insert(&element).first;
+	element.indexIter = iter;
 
-	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
-	{
-		SceneElement *e = iter->data;
+	/* Link in front of our successor in the index */
+	if (++iter == elementIndex.end())
+		elements.append(element.link);
+	else
+		elements.insertBefore(element.link, (*iter)->link);
+}
 
-		if (element < *e)
-		{
-			elements.insertBefore(element.link, *iter);
-			return;
-		}
-	}
+void Scene::remove(SceneElement &element)
+{
+	if (!element.link.next)
+		return;
 
-	elements.append(element.link);
+	elementIndex.erase(element.indexIter);
+	elements.remove(element.link);
 }
 
-void Scene::insertAfter(SceneElement &element, SceneElement &after)
+void Scene::reinsert(SceneElement &element)
 {
-	IntruListLink<SceneElement> *iter;
+	IntruListLink<SceneElement> &link = element.link;
 
-	for (iter = &after.link; iter != elements.end(); iter = iter->next)
+	/* Most changes (eg. a sprite moving by a few pixels)
+	 * don't affect the order relative to our neighbours */
+	if (link.next &&
+	    (link.prev == elements.end() || *link.prev->data < element) &&
+	    (link.next == elements.end() || element < *link.next->data))
 	{
-		SceneElement *e = iter->data;
-
-		if (element < *e)
-		{
-			elements.insertBefore(element.link, *iter);
-			return;
-		}
+		return;
 	}
 
-	elements.append(element.link);
-}
+	Uint64 start = SDL_GetPerformanceCounter();
 
-void Scene::reinsert(SceneElement &element)
-{
-	elements.remove(element.link);
+	remove(element);
 	insert(element);
+
+	PerfStats &stats = shState->perfStats();
+	stats.add(PerfStats::SceneReorders);
+	stats.add(PerfStats::SceneOrderTime,
+	          (SDL_GetPerformanceCounter() - start) * 1000000000 / SDL_GetPerformanceFrequency());
 }
 
 void Scene::notifyGeometryChange()
 {
 	IntruListLink<SceneElement> *iter;
 
+	markDirty();
+
 	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
 		iter->data->onGeometryChange(geometry);
@@ -91,14 +108,34 @@ void Scene::notifyGeometryChange()
 void Scene::composite()
 {
 	IntruListLink<SceneElement> *iter;
+	SpriteBatch &batch = shState->spriteBatch();
+	PerfStats &stats = shState->perfStats();
 
 	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
 		SceneElement *e = iter->data;
 
-		if (e->visible)
+		if (!e->visible)
+			continue;
+
+		if (e->isCulled())
+		{
+			stats.add(PerfStats::CulledElements);
+			continue;
+		}
+
+		stats.add(PerfStats::DrawnElements);
+
+		/* Anything still pending has to land on screen
+		 * before the next unbatched element is drawn */
+		if (!e->batch(batch))
+		{
+			batch.flush();
 			e->draw();
+		}
 	}
+
+	batch.flush();
 }
 
 
@@ -111,6 +148,7 @@ SceneElement::SceneElement(Scene &scene, int z, int spriteY)
       spriteY(spriteY)
 {
 	scene.insert(*this);
+	Scene::markDirty();
 }
 
 SceneElement::~SceneElement()
@@ -125,6 +163,7 @@ void SceneElement::setScene(Scene &scene)
 	this->scene = &scene;
 
 	scene.insert(*this);
+	Scene::markDirty();
 
 	onGeometryChange(scene.getGeometry());
 }
@@ -145,6 +184,8 @@ void SceneElement::setZ(int value)
 
 	z = value;
 	scene->reinsert(*this);
+
+	Scene::markDirty();
 }
 
 bool SceneElement::getVisible() const
@@ -158,7 +199,11 @@ void SceneElement::setVisible(bool value)
 {
 	aboutToAccess();
 
+	if (visible == value)
+		return;
+
 	visible = value;
+	Scene::markDirty();
 }
 
 bool SceneElement::operator<(const SceneElement &o) const
@@ -197,6 +242,9 @@ void SceneElement::setSpriteY(int value)
 
 void SceneElement::unlink()
 {
-	if (scene)
-		scene->elements.remove(link);
+	if (!scene)
+		return;
+
+	scene->remove(*this);
+	Scene::markDirty();
 }
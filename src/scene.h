@@ -27,12 +27,15 @@
 #include "etc.h"
 #include "etc-internal.h"
 
+#include <set>
+
 class SceneElement;
 class Viewport;
 class WindowVX;
 class Window;
 struct ScanRow;
 struct TilemapPrivate;
+class SpriteBatch;
 
 class Scene
 {
@@ -61,21 +64,43 @@ public:
 
 	const Geometry &getGeometry() const { return geometry; }
 
+	/* Scene-wide damage flag. Anything that changes what the
+	 * next composite would put on screen (element attributes,
+	 * bitmap contents, flashes, screen effects) raises it, and
+	 * Graphics skips compositing frames while it's lowered */
+	static void markDirty() { dirty = true; }
+	static bool isDirty() { return dirty; }
+	static void clearDirty() { dirty = false; }
+
 protected:
 	void insert(SceneElement &element);
-	void insertAfter(SceneElement &element, SceneElement &after);
+	void remove(SceneElement &element);
 	void reinsert(SceneElement &element);
 
 	/* Notify all elements that geometry has changed */
 	void notifyGeometryChange();
 
+	struct ElementOrder
+	{
+		bool operator()(const SceneElement *a, const SceneElement *b) const;
+	};
+
+	typedef std::set<SceneElement*, ElementOrder> ElementIndex;
+
+	/* Draw order lives in 'elements', which keeps iteration
+	 * cheap. 'elementIndex' holds the same elements in the same
+	 * order, so insertion points are found in O(log n) */
 	IntruList<SceneElement> elements;
+	ElementIndex elementIndex;
 	Geometry geometry;
 
 	friend class SceneElement;
 	friend class Window;
 	friend class WindowVX;
 	friend struct ZLayer;
+
+private:
+	static bool dirty;
 };
 
 class SceneElement
@@ -112,6 +137,18 @@ protected:
 	 */
 	virtual void draw() = 0;
 
+	/* Offers the element to the sprite batch instead of
+	 * drawing it right away. Returns false if the element
+	 * doesn't support batching (the default), in which case
+	 * the pending batch is flushed and 'draw()' is called */
+	virtual bool batch(SpriteBatch &) { return false; }
+
+	/* Returns true if drawing the element is known to not
+	 * have any visible effect, eg. because it lies entirely
+	 * outside of the scene rect. Culled elements are skipped
+	 * by Scene::composite. Called after 'prepareDraw' fired */
+	virtual bool isCulled() { return false; }
+
 	// FIXME: This should be a signal
 	virtual void onGeometryChange(const Scene::Geometry &) {}
 
@@ -123,6 +160,7 @@ protected:
 	void unlink();
 
 	IntruListLink<SceneElement> link;
+	Scene::ElementIndex::iterator indexIter;
 	const unsigned int creationStamp;
 	int z;
 	bool visible;
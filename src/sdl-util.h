@@ -4,6 +4,7 @@
 #include <SDL_atomic.h>
 #include <SDL_thread.h>
 #include <SDL_rwops.h>
+#include <SDL_surface.h>
 
 #include <string>
 #include <iostream>
@@ -47,6 +48,12 @@ SDL_Thread *createSDLThread(C *obj, const std::string &name = std::string())
 	return SDL_CreateThread((__sdlThreadFun<C, func>), name.c_str(), obj);
 }
 
+/* Memory taken up by the pixels of 'surf' */
+inline size_t surfaceBytes(const SDL_Surface *surf)
+{
+	return (size_t) surf->pitch * surf->h;
+}
+
 /* On Android, SDL_RWFromFile always opens files from inside
  * the apk asset folder even when a file with same name exists
  * on the physical filesystem. This wrapper attempts to open a
@@ -23,17 +23,25 @@
 #include "sharedstate.h"
 #include "glstate.h"
 #include "exception.h"
+#include "shadercache.h"
+#include "config.h"
+#include "debugwriter.h"
+#include "util.h"
 
 #include <assert.h>
 #include <string.h>
 #include <iostream>
 
+#include <SDL_timer.h>
+
 #include "common.h.xxd"
 #include "sprite.frag.xxd"
+#include "spriteBatch.frag.xxd"
 #include "hue.frag.xxd"
 #include "trans.frag.xxd"
 #include "transSimple.frag.xxd"
 #include "bitmapBlit.frag.xxd"
+#include "textFx.frag.xxd"
 #include "plane.frag.xxd"
 #include "gray.frag.xxd"
 #include "flatColor.frag.xxd"
@@ -46,6 +54,7 @@
 #include "simple.vert.xxd"
 #include "simpleColor.vert.xxd"
 #include "sprite.vert.xxd"
+#include "spriteBatch.vert.xxd"
 #include "tilemap.vert.xxd"
 #include "blur.frag.xxd"
 #include "simpleMatrix.vert.xxd"
@@ -107,10 +116,29 @@ void Shader::bind()
 
 void Shader::unbind()
 {
-	gl.ActiveTexture(GL_TEXTURE0);
+	GLCache::activeTexture(0);
 	glState.program.set(0);
 }
 
+/* Bound before linking; part of the program cache key */
+static const struct
+{
+	Shader::Attribute index;
+	const char *name;
+} attribLocations[] =
+{
+	{ Shader::Position, "position" },
+	{ Shader::TexCoord, "texCoord" },
+	{ Shader::Color,    "color"    },
+	{ Shader::Tone,     "tone"     },
+	{ Shader::Effect,   "effect"   }
+};
+
+/* Bump whenever programs are set up differently in
+ * a way the hashed sources and attributes don't show
+ * (eg. setupShaderSource() prepends something else) */
+#define PROGRAM_SETUP_VER 1
+
 static void setupShaderSource(GLuint shader, GLenum type,
                               const unsigned char *body, int bodySize)
 {
@@ -153,6 +181,28 @@ void Shader::init(const unsigned char *vert, int vertSize,
 {
 	GLint success;
 
+	/* Everything that ends up in the program,
+	 * see setupShaderSource() */
+	const uint32_t setupVer = PROGRAM_SETUP_VER;
+	uint64_t sourceHash = ShaderCache::hash(&setupVer, sizeof(setupVer));
+	sourceHash = ShaderCache::hash(___shader_common_h, ___shader_common_h_len, sourceHash);
+	sourceHash = ShaderCache::hash(vert, vertSize, sourceHash);
+	sourceHash = ShaderCache::hash(frag, fragSize, sourceHash);
+
+	for (size_t i = 0; i < ARRAY_SIZE(attribLocations); ++i)
+	{
+		const uint32_t index = attribLocations[i].index;
+		const char *name = attribLocations[i].name;
+
+		sourceHash = ShaderCache::hash(&index, sizeof(index), sourceHash);
+		sourceHash = ShaderCache::hash(name, strlen(name) + 1, sourceHash);
+	}
+
+	ShaderCache &cache = shState->shaderCache();
+
+	if (cache.load(program, programName, sourceHash))
+		return;
+
 	/* Compile vertex shader */
 	setupShaderSource(vertShader, GL_VERTEX_SHADER, vert, vertSize);
 	gl.CompileShader(vertShader);
@@ -185,10 +235,11 @@ void Shader::init(const unsigned char *vert, int vertSize,
 	gl.AttachShader(program, vertShader);
 	gl.AttachShader(program, fragShader);
 
-	gl.BindAttribLocation(program, Position, "position");
-	gl.BindAttribLocation(program, TexCoord, "texCoord");
-	gl.BindAttribLocation(program, Color, "color");
+	for (size_t i = 0; i < ARRAY_SIZE(attribLocations); ++i)
+		gl.BindAttribLocation(program, attribLocations[i].index,
+		                      attribLocations[i].name);
 
+	cache.prepare(program);
 	gl.LinkProgram(program);
 
 	gl.GetProgramiv(program, GL_LINK_STATUS, &success);
@@ -200,6 +251,8 @@ void Shader::init(const unsigned char *vert, int vertSize,
 	                    "GLSL: An error occured while linking program '%s' (vertex '%s', fragment '%s')",
 	                    programName, vertName, fragName);
 	}
+
+	cache.store(program, programName, sourceHash);
 }
 
 void Shader::initFromFile(const char *_vertFile, const char *_fragFile,
@@ -214,19 +267,84 @@ void Shader::initFromFile(const char *_vertFile, const char *_fragFile,
 	     _vertFile, _fragFile, programName);
 }
 
+/* Locations are small indices on every driver we know of;
+ * anything beyond this simply isn't cached */
+#define MAX_CACHED_UNIFORMS 256
+
+bool Shader::uniformChanged(GLint location, const void *value, size_t size)
+{
+	/* Inactive uniform, GL would ignore it anyway */
+	if (location < 0)
+		return false;
+
+	if (location >= MAX_CACHED_UNIFORMS)
+	{
+		GLCache::countIssued();
+		return true;
+	}
+
+	if ((size_t) location >= uniformCache.size())
+		uniformCache.resize(location+1);
+
+	UniformValue &cached = uniformCache[location];
+
+	if (cached.valid && memcmp(cached.data, value, size) == 0)
+	{
+		GLCache::countFiltered();
+		return false;
+	}
+
+	memcpy(cached.data, value, size);
+	cached.valid = true;
+	GLCache::countIssued();
+
+	return true;
+}
+
+void Shader::setUniform1i(GLint location, GLint value)
+{
+	if (uniformChanged(location, &value, sizeof(value)))
+		gl.Uniform1i(location, value);
+}
+
+void Shader::setUniform1f(GLint location, GLfloat value)
+{
+	if (uniformChanged(location, &value, sizeof(value)))
+		gl.Uniform1f(location, value);
+}
+
+void Shader::setUniform2f(GLint location, GLfloat x, GLfloat y)
+{
+	const GLfloat value[] = { x, y };
+
+	if (uniformChanged(location, value, sizeof(value)))
+		gl.Uniform2f(location, x, y);
+}
+
+void Shader::setUniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+{
+	const GLfloat value[] = { x, y, z, w };
+
+	if (uniformChanged(location, value, sizeof(value)))
+		gl.Uniform4f(location, x, y, z, w);
+}
+
+void Shader::setUniformMatrix4(GLint location, const GLfloat value[16])
+{
+	if (uniformChanged(location, value, sizeof(GLfloat[16])))
+		gl.UniformMatrix4fv(location, 1, GL_FALSE, value);
+}
+
 void Shader::setVec4Uniform(GLint location, const Vec4 &vec)
 {
-	gl.Uniform4f(location, vec.x, vec.y, vec.z, vec.w);
+	setUniform4f(location, vec.x, vec.y, vec.z, vec.w);
 }
 
 void Shader::setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture)
 {
-	GLenum texUnit = GL_TEXTURE0 + unitIndex;
+	GLCache::bindTexture(unitIndex, texture.gl);
 
-	gl.ActiveTexture(texUnit);
-	gl.BindTexture(GL_TEXTURE_2D, texture.gl);
-	gl.Uniform1i(location, unitIndex);
-	gl.ActiveTexture(GL_TEXTURE0);
+	setUniform1i(location, unitIndex);
 }
 
 void ShaderBase::GLProjMat::apply(const Vec2i &value)
@@ -253,6 +371,7 @@ void ShaderBase::init()
 	GET_U(translation);
 	GET_U(pixellation);
 	GET_U(aspectRatio);
+	GET_U(texOffset);
 
 	projMat.u_mat = gl.GetUniformLocation(program, "projMat");
 }
@@ -265,22 +384,27 @@ void ShaderBase::applyViewportProj()
 
 void ShaderBase::setTexSize(const Vec2i &value)
 {
-	gl.Uniform2f(u_texSizeInv, 1.f / value.x, 1.f / value.y);
+	setUniform2f(u_texSizeInv, 1.f / value.x, 1.f / value.y);
 }
 
 void ShaderBase::setTranslation(const Vec2i &value)
 {
-	gl.Uniform2f(u_translation, value.x, value.y);
+	setUniform2f(u_translation, value.x, value.y);
 }
 
 void ShaderBase::setPixellation(int value)
 {
-	gl.Uniform1f(u_pixellation, value);
+	setUniform1f(u_pixellation, value);
 }
 
 void ShaderBase::setAspectRatio(const Vec2 &value)
 {
-	gl.Uniform2f(u_aspectRatio, value.x, value.y);
+	setUniform2f(u_aspectRatio, value.x, value.y);
+}
+
+void ShaderBase::setTexOffset(const Vec2i &value)
+{
+	setUniform2f(u_texOffset, value.x, value.y);
 }
 
 FlatColorShader::FlatColorShader()
@@ -309,7 +433,7 @@ SimpleShader::SimpleShader()
 
 void SimpleShader::setTexOffsetX(int value)
 {
-	gl.Uniform1f(u_texOffsetX, value);
+	setUniform1f(u_texOffsetX, value);
 }
 
 
@@ -340,7 +464,7 @@ SimpleSpriteShader::SimpleSpriteShader()
 
 void SimpleSpriteShader::setSpriteMat(const float value[16])
 {
-	gl.UniformMatrix4fv(u_spriteMat, 1, GL_FALSE, value);
+	setUniformMatrix4(u_spriteMat, value);
 }
 
 
@@ -356,12 +480,12 @@ AlphaSpriteShader::AlphaSpriteShader()
 
 void AlphaSpriteShader::setSpriteMat(const float value[16])
 {
-	gl.UniformMatrix4fv(u_spriteMat, 1, GL_FALSE, value);
+	setUniformMatrix4(u_spriteMat, value);
 }
 
 void AlphaSpriteShader::setAlpha(float value)
 {
-	gl.Uniform1f(u_alpha, value);
+	setUniform1f(u_alpha, value);
 }
 
 
@@ -395,12 +519,12 @@ void TransShader::setTransMap(TEX::ID tex)
 
 void TransShader::setProg(float value)
 {
-	gl.Uniform1f(u_prog, value);
+	setUniform1f(u_prog, value);
 }
 
 void TransShader::setVague(float value)
 {
-	gl.Uniform1f(u_vague, value);
+	setUniform1f(u_vague, value);
 }
 
 
@@ -427,7 +551,7 @@ void SimpleTransShader::setFrozenScene(TEX::ID tex)
 
 void SimpleTransShader::setProg(float value)
 {
-	gl.Uniform1f(u_prog, value);
+	setUniform1f(u_prog, value);
 }
 
 
@@ -447,7 +571,7 @@ SpriteShader::SpriteShader()
 
 void SpriteShader::setSpriteMat(const float value[16])
 {
-	gl.UniformMatrix4fv(u_spriteMat, 1, GL_FALSE, value);
+	setUniformMatrix4(u_spriteMat, value);
 }
 
 void SpriteShader::setTone(const Vec4 &tone)
@@ -462,17 +586,25 @@ void SpriteShader::setColor(const Vec4 &color)
 
 void SpriteShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setUniform1f(u_opacity, value);
 }
 
 void SpriteShader::setBushDepth(float value)
 {
-	gl.Uniform1f(u_bushDepth, value);
+	setUniform1f(u_bushDepth, value);
 }
 
 void SpriteShader::setBushOpacity(float value)
 {
-	gl.Uniform1f(u_bushOpacity, value);
+	setUniform1f(u_bushOpacity, value);
+}
+
+
+SpriteBatchShader::SpriteBatchShader()
+{
+	INIT_SHADER(spriteBatch, spriteBatch, SpriteBatchShader);
+
+	ShaderBase::init();
 }
 
 
@@ -505,7 +637,7 @@ void PlaneShader::setFlash(const Vec4 &flash)
 
 void PlaneShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setUniform1f(u_opacity, value);
 }
 
 
@@ -520,7 +652,7 @@ GrayShader::GrayShader()
 
 void GrayShader::setGray(float value)
 {
-	gl.Uniform1f(u_gray, value);
+	setUniform1f(u_gray, value);
 }
 
 
@@ -535,7 +667,7 @@ TilemapShader::TilemapShader()
 
 void TilemapShader::setAniIndex(int value)
 {
-	gl.Uniform1f(u_aniIndex, value);
+	setUniform1f(u_aniIndex, value);
 }
 
 
@@ -551,7 +683,7 @@ FlashMapShader::FlashMapShader()
 
 void FlashMapShader::setAlpha(float value)
 {
-	gl.Uniform1f(u_alpha, value);
+	setUniform1f(u_alpha, value);
 }
 
 
@@ -566,7 +698,7 @@ HueShader::HueShader()
 
 void HueShader::setHueAdjust(float value)
 {
-	gl.Uniform1f(u_hueAdjust, value);
+	setUniform1f(u_hueAdjust, value);
 }
 
 
@@ -581,7 +713,7 @@ SimpleMatrixShader::SimpleMatrixShader()
 
 void SimpleMatrixShader::setMatrix(const float value[16])
 {
-	gl.UniformMatrix4fv(u_matrix, 1, GL_FALSE, value);
+	setUniformMatrix4(u_matrix, value);
 }
 
 
@@ -607,11 +739,19 @@ TilemapVXShader::TilemapVXShader()
 	ShaderBase::init();
 
 	GET_U(aniOffset);
+	GET_U(ringOrigin);
+	GET_U(ringSize);
 }
 
 void TilemapVXShader::setAniOffset(const Vec2 &value)
 {
-	gl.Uniform2f(u_aniOffset, value.x, value.y);
+	setUniform2f(u_aniOffset, value.x, value.y);
+}
+
+void TilemapVXShader::setRing(const Vec2i &origin, const Vec2i &size)
+{
+	setUniform2f(u_ringOrigin, origin.x, origin.y);
+	setUniform2f(u_ringSize, size.x, size.y);
 }
 
 
@@ -629,7 +769,7 @@ BltShader::BltShader()
 
 void BltShader::setSource()
 {
-	gl.Uniform1i(u_source, 0);
+	setUniform1i(u_source, 0);
 }
 
 void BltShader::setDestination(const TEX::ID value)
@@ -639,10 +779,250 @@ void BltShader::setDestination(const TEX::ID value)
 
 void BltShader::setSubRect(const FloatRect &value)
 {
-	gl.Uniform4f(u_subRect, value.x, value.y, value.w, value.h);
+	setUniform4f(u_subRect, value.x, value.y, value.w, value.h);
 }
 
 void BltShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setUniform1f(u_opacity, value);
+}
+
+
+TextFxShader::TextFxShader()
+{
+	INIT_SHADER(simple, textFx, TextFxShader);
+
+	ShaderBase::init();
+
+	GET_U(textColor);
+	GET_U(outlineColor);
+	GET_U(outline);
+	GET_U(shadow);
+}
+
+void TextFxShader::setTextColor(const Vec4 &value)
+{
+	setVec4Uniform(u_textColor, value);
+}
+
+void TextFxShader::setOutlineColor(const Vec4 &value)
+{
+	setVec4Uniform(u_outlineColor, value);
+}
+
+void TextFxShader::setOutline(bool value)
+{
+	setUniform1f(u_outline, value ? 1.0f : 0.0f);
+}
+
+void TextFxShader::setShadow(bool value)
+{
+	setUniform1f(u_shadow, value ? 1.0f : 0.0f);
+}
+
+
+/* Until we have measured an actual compile, assume
+ * one takes about this long */
+#define DEFAULT_COMPILE_NS 5000000
+
+enum ShaderSetProgram
+{
+#define SHADER_SET_PROGRAM(type, name) ShaderSet_##name,
+	SHADER_SET_PROGRAMS
+#undef SHADER_SET_PROGRAM
+
+	ShaderSetProgramCount
+};
+
+static const char *programNames[] =
+{
+#define SHADER_SET_PROGRAM(type, name) #name,
+	SHADER_SET_PROGRAMS
+#undef SHADER_SET_PROGRAM
+};
+
+static elementsN(programNames);
+
+struct ShaderSetPrivate
+{
+#define SHADER_SET_PROGRAM(type, name) type *name;
+	SHADER_SET_PROGRAMS
+#undef SHADER_SET_PROGRAM
+
+	/* Programs from Config::shaderWarmup, in order */
+	std::vector<int> warmup;
+	size_t warmupNext;
+
+	enum Phase
+	{
+		Startup,
+		OnDemand,
+		WarmUp,
+
+		PhaseCount
+	};
+
+	Phase phase;
+
+	struct
+	{
+		int count;
+		uint64_t ns;
+	} timing[PhaseCount];
+
+	ShaderSetPrivate(const Config &conf)
+	    : warmupNext(0),
+	      phase(Startup)
+	{
+#define SHADER_SET_PROGRAM(type, name) name = 0;
+		SHADER_SET_PROGRAMS
+#undef SHADER_SET_PROGRAM
+
+		memset(timing, 0, sizeof(timing));
+
+		for (size_t i = 0; i < conf.shaderWarmup.size(); ++i)
+		{
+			const std::string &name = conf.shaderWarmup[i];
+			size_t j;
+
+			for (j = 0; j < programNamesN; ++j)
+				if (name == programNames[j])
+					break;
+
+			if (j < programNamesN)
+				warmup.push_back(j);
+			else
+				Debug() << "Unknown shader in shaderWarmup:" << name;
+		}
+	}
+
+	~ShaderSetPrivate()
+	{
+#define SHADER_SET_PROGRAM(type, name) delete name;
+		SHADER_SET_PROGRAMS
+#undef SHADER_SET_PROGRAM
+	}
+
+	bool isCompiled(int program) const
+	{
+		switch (program)
+		{
+#define SHADER_SET_PROGRAM(type, name) case ShaderSet_##name : return name != 0;
+		SHADER_SET_PROGRAMS
+#undef SHADER_SET_PROGRAM
+		}
+
+		return true;
+	}
+
+	static double toMS(uint64_t ns)
+	{
+		return ns / 1000000.0;
+	}
+
+	uint64_t estimatedCompileNS() const
+	{
+		int count = 0;
+		uint64_t ns = 0;
+
+		for (int i = 0; i < PhaseCount; ++i)
+		{
+			count += timing[i].count;
+			ns += timing[i].ns;
+		}
+
+		return count > 0 ? ns / count : DEFAULT_COMPILE_NS;
+	}
+
+	template<class T>
+	T *compile(const char *name)
+	{
+		const Uint64 start = SDL_GetPerformanceCounter();
+
+		T *shader = new T;
+
+		const uint64_t ns = (SDL_GetPerformanceCounter() - start) * 1000000000 /
+		                    SDL_GetPerformanceFrequency();
+
+		timing[phase].count++;
+		timing[phase].ns += ns;
+
+		if (phase == OnDemand)
+			Debug() << "Shaders: compiled" << name << "on first use in" << toMS(ns) << "ms";
+
+		return shader;
+	}
+};
+
+static void requestProgram(ShaderSet &set, int program)
+{
+	switch (program)
+	{
+#define SHADER_SET_PROGRAM(type, name) case ShaderSet_##name : set.name(); break;
+	SHADER_SET_PROGRAMS
+#undef SHADER_SET_PROGRAM
+	}
+}
+
+ShaderSet::ShaderSet(const Config &conf)
+{
+	p = new ShaderSetPrivate(conf);
+}
+
+ShaderSet::~ShaderSet()
+{
+	delete p;
+}
+
+#define SHADER_SET_PROGRAM(type, name) \
+type &ShaderSet::name() \
+{ \
+	if (!p->name) \
+		p->name = p->compile<type>(#name); \
+	return *p->name; \
+}
+SHADER_SET_PROGRAMS
+#undef SHADER_SET_PROGRAM
+
+bool ShaderSet::idleWork(uint64_t budgetNs)
+{
+	while (p->warmupNext < p->warmup.size() &&
+	       p->isCompiled(p->warmup[p->warmupNext]))
+		++p->warmupNext;
+
+	if (p->warmupNext == p->warmup.size())
+		return shState->shaderCache().save();
+
+	if (budgetNs < p->estimatedCompileNS())
+		return false;
+
+	p->phase = ShaderSetPrivate::WarmUp;
+	requestProgram(*this, p->warmup[p->warmupNext++]);
+	p->phase = ShaderSetPrivate::OnDemand;
+
+	if (p->warmupNext == p->warmup.size())
+		Debug() << "Shaders: warm-up compiled" << p->timing[ShaderSetPrivate::WarmUp].count
+		        << "programs in" << ShaderSetPrivate::toMS(p->timing[ShaderSetPrivate::WarmUp].ns)
+		        << "ms of idle time";
+
+	return true;
+}
+
+void ShaderSet::reportStartup()
+{
+	if (p->phase != ShaderSetPrivate::Startup)
+		return;
+
+	int deferred = 0;
+
+	for (int i = 0; i < ShaderSetProgramCount; ++i)
+		if (!p->isCompiled(i))
+			++deferred;
+
+	Debug() << "Shaders: compiled" << p->timing[ShaderSetPrivate::Startup].count
+	        << "programs during startup in"
+	        << ShaderSetPrivate::toMS(p->timing[ShaderSetPrivate::Startup].ns)
+	        << "ms," << deferred << "deferred until first use";
+
+	p->phase = ShaderSetPrivate::OnDemand;
 }
@@ -26,6 +26,8 @@
 #include "gl-util.h"
 #include "glstate.h"
 
+#include <vector>
+
 class Shader
 {
 public:
@@ -36,7 +38,9 @@ public:
 	{
 		Position = 0,
 		TexCoord = 1,
-		Color = 2
+		Color = 2,
+		Tone = 3,
+		Effect = 4
 	};
 
 protected:
@@ -50,11 +54,35 @@ protected:
 	void initFromFile(const char *vertFile, const char *fragFile,
 	                  const char *programName);
 
-	static void setVec4Uniform(GLint location, const Vec4 &vec);
-	static void setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture);
+	/* Uniform values are part of the program object, so we
+	 * remember the last one set at each location and skip
+	 * setting it again */
+	void setUniform1i(GLint location, GLint value);
+	void setUniform1f(GLint location, GLfloat value);
+	void setUniform2f(GLint location, GLfloat x, GLfloat y);
+	void setUniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+	void setUniformMatrix4(GLint location, const GLfloat value[16]);
+
+	void setVec4Uniform(GLint location, const Vec4 &vec);
+	void setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture);
 
 	GLuint vertShader, fragShader;
 	GLuint program;
+
+private:
+	bool uniformChanged(GLint location, const void *value, size_t size);
+
+	struct UniformValue
+	{
+		GLfloat data[16];
+		bool valid;
+
+		UniformValue()
+		    : valid(false)
+		{}
+	};
+
+	std::vector<UniformValue> uniformCache;
 };
 
 class ShaderBase : public Shader
@@ -82,11 +110,12 @@ public:
 	void setTranslation(const Vec2i &value);
 	void setPixellation(int value);
 	void setAspectRatio(const Vec2 &value);
+	void setTexOffset(const Vec2i &value);
 
 protected:
 	void init();
 
-	GLint u_texSizeInv, u_translation, u_pixellation, u_aspectRatio;
+	GLint u_texSizeInv, u_translation, u_pixellation, u_aspectRatio, u_texOffset;
 };
 
 class FlatColorShader : public ShaderBase
@@ -190,6 +219,13 @@ private:
 	GLint u_spriteMat, u_tone, u_opacity, u_color, u_bushDepth, u_bushOpacity;
 };
 
+/* Batched sprites; all effect state is per vertex */
+class SpriteBatchShader : public ShaderBase
+{
+public:
+	SpriteBatchShader();
+};
+
 class PlaneShader : public ShaderBase
 {
 public:
@@ -284,9 +320,10 @@ public:
 	TilemapVXShader();
 
 	void setAniOffset(const Vec2 &value);
+	void setRing(const Vec2i &origin, const Vec2i &size);
 
 private:
-	GLint u_aniOffset;
+	GLint u_aniOffset, u_ringOrigin, u_ringSize;
 };
 
 /* Bitmap blit */
@@ -305,27 +342,74 @@ private:
 	GLint u_source, u_destination, u_subRect, u_opacity;
 };
 
-/* Global object containing all available shaders */
-struct ShaderSet
+/* Draws text with outline and/or shadow from
+ * the alpha channel of the plain text */
+class TextFxShader : public ShaderBase
 {
-	FlatColorShader flatColor;
-	SimpleShader simple;
-	SimpleColorShader simpleColor;
-	SimpleAlphaShader simpleAlpha;
-	SimpleSpriteShader simpleSprite;
-	AlphaSpriteShader alphaSprite;
-	SpriteShader sprite;
-	PlaneShader plane;
-	GrayShader gray;
-	TilemapShader tilemap;
-	FlashMapShader flashMap;
-	TransShader trans;
-	SimpleTransShader simpleTrans;
-	HueShader hue;
-	BltShader blt;
-	SimpleMatrixShader simpleMatrix;
-	BlurShader blur;
-	TilemapVXShader tilemapVX;
+public:
+	TextFxShader();
+
+	void setTextColor(const Vec4 &value);
+	void setOutlineColor(const Vec4 &value);
+	void setOutline(bool value);
+	void setShadow(bool value);
+
+private:
+	GLint u_textColor, u_outlineColor, u_outline, u_shadow;
+};
+
+#define SHADER_SET_PROGRAMS \
+	SHADER_SET_PROGRAM(FlatColorShader, flatColor) \
+	SHADER_SET_PROGRAM(SimpleShader, simple) \
+	SHADER_SET_PROGRAM(SimpleColorShader, simpleColor) \
+	SHADER_SET_PROGRAM(SimpleAlphaShader, simpleAlpha) \
+	SHADER_SET_PROGRAM(SimpleSpriteShader, simpleSprite) \
+	SHADER_SET_PROGRAM(AlphaSpriteShader, alphaSprite) \
+	SHADER_SET_PROGRAM(SpriteShader, sprite) \
+	SHADER_SET_PROGRAM(SpriteBatchShader, spriteBatch) \
+	SHADER_SET_PROGRAM(PlaneShader, plane) \
+	SHADER_SET_PROGRAM(GrayShader, gray) \
+	SHADER_SET_PROGRAM(TilemapShader, tilemap) \
+	SHADER_SET_PROGRAM(FlashMapShader, flashMap) \
+	SHADER_SET_PROGRAM(TransShader, trans) \
+	SHADER_SET_PROGRAM(SimpleTransShader, simpleTrans) \
+	SHADER_SET_PROGRAM(HueShader, hue) \
+	SHADER_SET_PROGRAM(BltShader, blt) \
+	SHADER_SET_PROGRAM(TextFxShader, textFx) \
+	SHADER_SET_PROGRAM(SimpleMatrixShader, simpleMatrix) \
+	SHADER_SET_PROGRAM(BlurShader, blur) \
+	SHADER_SET_PROGRAM(TilemapVXShader, tilemapVX)
+
+struct Config;
+struct ShaderSetPrivate;
+
+/* Global object containing all available shaders.
+ * Each one is compiled the first time it is requested;
+ * the ones named in Config::shaderWarmup are compiled
+ * ahead of time whenever there's idle time left in a frame */
+class ShaderSet
+{
+public:
+	ShaderSet(const Config &conf);
+	~ShaderSet();
+
+#define SHADER_SET_PROGRAM(type, name) type &name();
+	SHADER_SET_PROGRAMS
+#undef SHADER_SET_PROGRAM
+
+	/* Idle work: compiles the next shader on the warm-up list
+	 * if that is expected to fit within 'budgetNs', and writes
+	 * back the shader cache once there's nothing left to compile.
+	 * Returns true if it did anything */
+	bool idleWork(uint64_t budgetNs);
+
+	/* Logs the compile time spent so far, and how many
+	 * shaders were deferred. Call once the first frame
+	 * is on screen; later calls are ignored */
+	void reportStartup();
+
+private:
+	ShaderSetPrivate *p;
 };
 
 #endif // SHADER_H
@@ -0,0 +1,360 @@
+/*
+** shadercache.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "shadercache.h"
+
+#include "config.h"
+#include "boost-hash.h"
+#include "debugwriter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define CACHE_FILENAME "shadercache.mkxp"
+
+#define FORMAT_MAGIC 0x43534b4d /* "MKSC" */
+#define FORMAT_VER 1
+
+/* Arbitrary sanity limits for reading */
+#define MAX_ENTRIES 256
+#define MAX_NAME_LEN 256
+#define MAX_BINARY_SIZE (16 << 20)
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+struct Header
+{
+	uint32_t magic;
+	uint32_t formVer;
+	uint64_t driverHash;
+	uint32_t count;
+};
+
+/* Followed by the name and binary data */
+struct EntryHeader
+{
+	uint64_t sourceHash;
+	uint32_t binaryFormat;
+	uint32_t nameLen;
+	uint32_t binarySize;
+};
+
+struct ShaderCachePrivate
+{
+	struct Entry
+	{
+		uint64_t sourceHash;
+		GLenum binaryFormat;
+		std::vector<uint8_t> binary;
+	};
+
+	typedef BoostHash<std::string, Entry> EntryHash;
+
+	EntryHash entries;
+
+	/* Binary formats the driver accepts */
+	std::vector<GLint> formats;
+
+	std::string path;
+	uint64_t driverHash;
+
+	bool enabled;
+	bool dirty;
+
+	ShaderCachePrivate(const Config &conf)
+	    : driverHash(0),
+	      enabled(false),
+	      dirty(false)
+	{
+		if (!conf.shaderCache || conf.customDataPath.empty())
+			return;
+
+		if (!gl.GetProgramBinary || !gl.ProgramBinary)
+			return;
+
+		GLint formatCount = 0;
+		gl.GetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+
+		if (formatCount <= 0)
+			return;
+
+		formats.resize(formatCount);
+		gl.GetIntegerv(GL_PROGRAM_BINARY_FORMATS, &formats[0]);
+
+		const GLenum strings[] =
+		{
+			GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION
+		};
+
+		for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i)
+		{
+			const char *str = (const char*) gl.GetString(strings[i]);
+
+			if (str)
+				driverHash = ShaderCache::hash(str, strlen(str), driverHash);
+		}
+
+		path = conf.customDataPath + CACHE_FILENAME;
+		enabled = true;
+
+		if (!read())
+		{
+			/* Missing, outdated or broken; start from scratch
+			 * and replace the file on the next save */
+			entries = EntryHash();
+			dirty = true;
+		}
+	}
+
+	bool acceptsFormat(GLenum format) const
+	{
+		for (size_t i = 0; i < formats.size(); ++i)
+			if ((GLenum) formats[i] == format)
+				return true;
+
+		return false;
+	}
+
+#define READ(ptr, size, n) if (fread(ptr, size, n, f) < n) return false
+
+	bool readEntries(FILE *f)
+	{
+		Header hd;
+		READ(&hd, sizeof(hd), 1);
+
+		if (hd.magic != FORMAT_MAGIC || hd.formVer != FORMAT_VER)
+			return false;
+		if (hd.driverHash != driverHash)
+			return false;
+		if (hd.count > MAX_ENTRIES)
+			return false;
+
+		for (uint32_t i = 0; i < hd.count; ++i)
+		{
+			EntryHeader ehd;
+			READ(&ehd, sizeof(ehd), 1);
+
+			if (ehd.nameLen == 0 || ehd.nameLen > MAX_NAME_LEN)
+				return false;
+			if (ehd.binarySize == 0 || ehd.binarySize > MAX_BINARY_SIZE)
+				return false;
+
+			std::string name(ehd.nameLen, '\0');
+			READ(&name[0], 1, ehd.nameLen);
+
+			Entry &entry = entries[name];
+			entry.sourceHash = ehd.sourceHash;
+			entry.binaryFormat = ehd.binaryFormat;
+			entry.binary.resize(ehd.binarySize);
+			READ(&entry.binary[0], 1, ehd.binarySize);
+		}
+
+		return true;
+	}
+
+	bool read()
+	{
+		FILE *f = fopen(path.c_str(), "rb");
+
+		if (!f)
+			return false;
+
+		bool result = readEntries(f);
+		fclose(f);
+
+		return result;
+	}
+
+#undef READ
+
+#define WRITE(ptr, size, n) if (fwrite(ptr, size, n, f) < n) return false
+
+	bool writeEntries(FILE *f)
+	{
+		Header hd;
+		hd.magic = FORMAT_MAGIC;
+		hd.formVer = FORMAT_VER;
+		hd.driverHash = driverHash;
+		hd.count = 0;
+
+		EntryHash::const_iterator iter;
+		for (iter = entries.cbegin(); iter != entries.cend(); ++iter)
+			++hd.count;
+
+		WRITE(&hd, sizeof(hd), 1);
+
+		for (iter = entries.cbegin(); iter != entries.cend(); ++iter)
+		{
+			const std::string &name = iter->first;
+			const Entry &entry = iter->second;
+
+			EntryHeader ehd;
+			ehd.sourceHash = entry.sourceHash;
+			ehd.binaryFormat = entry.binaryFormat;
+			ehd.nameLen = name.size();
+			ehd.binarySize = entry.binary.size();
+
+			WRITE(&ehd, sizeof(ehd), 1);
+			WRITE(name.c_str(), 1, ehd.nameLen);
+			WRITE(&entry.binary[0], 1, ehd.binarySize);
+		}
+
+		return true;
+	}
+
+#undef WRITE
+
+	/* Writes to a temporary file that replaces the cache once
+	 * complete, so a crash or a second instance never sees (or
+	 * leaves behind) a partially written cache */
+	void write()
+	{
+		const std::string tmpPath = path + ".tmp";
+		FILE *f = fopen(tmpPath.c_str(), "wb");
+
+		if (!f)
+		{
+			Debug() << "Could not open shader cache for writing:" << tmpPath;
+			return;
+		}
+
+		bool result = writeEntries(f);
+
+		if (fclose(f) != 0)
+			result = false;
+
+		if (!result)
+		{
+			remove(tmpPath.c_str());
+			return;
+		}
+
+		if (rename(tmpPath.c_str(), path.c_str()) == 0)
+			return;
+
+		/* Windows won't rename over an existing file */
+		remove(path.c_str());
+
+		if (rename(tmpPath.c_str(), path.c_str()) != 0)
+		{
+			Debug() << "Could not replace shader cache:" << path;
+			remove(tmpPath.c_str());
+		}
+	}
+};
+
+ShaderCache::ShaderCache(const Config &conf)
+{
+	p = new ShaderCachePrivate(conf);
+}
+
+ShaderCache::~ShaderCache()
+{
+	delete p;
+}
+
+uint64_t ShaderCache::hash(const void *data, size_t size, uint64_t prev)
+{
+	const uint8_t *bytes = static_cast<const uint8_t*>(data);
+	uint64_t h = prev ? prev : FNV_OFFSET_BASIS;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		h ^= bytes[i];
+		h *= FNV_PRIME;
+	}
+
+	return h;
+}
+
+bool ShaderCache::load(GLuint program, const char *name, uint64_t sourceHash)
+{
+	if (!p->enabled || !p->entries.contains(name))
+		return false;
+
+	const ShaderCachePrivate::Entry &entry = p->entries[name];
+	GLint success = GL_FALSE;
+
+	/* Unknown formats would raise a GL error,
+	 * other rejections only fail the link */
+	if (entry.sourceHash == sourceHash && p->acceptsFormat(entry.binaryFormat))
+	{
+		gl.ProgramBinary(program, entry.binaryFormat,
+		                 &entry.binary[0], entry.binary.size());
+		gl.GetProgramiv(program, GL_LINK_STATUS, &success);
+	}
+
+	if (success)
+		return true;
+
+	p->entries.remove(name);
+	p->dirty = true;
+
+	return false;
+}
+
+void ShaderCache::prepare(GLuint program)
+{
+	if (p->enabled && gl.ProgramParameteri)
+		gl.ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ShaderCache::store(GLuint program, const char *name, uint64_t sourceHash)
+{
+	if (!p->enabled)
+		return;
+
+	GLint size = 0;
+	gl.GetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+
+	if (size <= 0 || size > MAX_BINARY_SIZE)
+		return;
+
+	ShaderCachePrivate::Entry entry;
+	entry.sourceHash = sourceHash;
+	entry.binaryFormat = 0;
+	entry.binary.resize(size);
+
+	GLsizei length = 0;
+	gl.GetProgramBinary(program, size, &length, &entry.binaryFormat, &entry.binary[0]);
+
+	if (length <= 0)
+		return;
+
+	entry.binary.resize(length);
+
+	p->entries[name] = entry;
+	p->dirty = true;
+}
+
+bool ShaderCache::save()
+{
+	if (!p->enabled || !p->dirty)
+		return false;
+
+	p->write();
+	p->dirty = false;
+
+	return true;
+}
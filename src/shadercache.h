@@ -0,0 +1,68 @@
+/*
+** shadercache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include "gl-fun.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Config;
+struct ShaderCachePrivate;
+
+/* Keeps linked program binaries (ARB_get_program_binary)
+ * in the user data directory, so shaders don't have to be
+ * compiled again on every startup. Entries are looked up by
+ * program name and a hash of their sources; the whole cache
+ * is thrown away once the GL driver (vendor, renderer or
+ * version) changes. Without driver support, every call
+ * is a no-op */
+class ShaderCache
+{
+public:
+	ShaderCache(const Config &conf);
+	~ShaderCache();
+
+	/* FNV-1a; chain calls by passing the previous result */
+	static uint64_t hash(const void *data, size_t size, uint64_t prev = 0);
+
+	/* Tries to restore 'program' from its cached binary.
+	 * On failure, the program is left unlinked and the entry
+	 * is dropped */
+	bool load(GLuint program, const char *name, uint64_t sourceHash);
+
+	/* Call before linking 'program' */
+	void prepare(GLuint program);
+
+	/* Call after successfully linking 'program' */
+	void store(GLuint program, const char *name, uint64_t sourceHash);
+
+	/* Writes the cache back if anything changed.
+	 * Returns true if it did */
+	bool save();
+
+private:
+	ShaderCachePrivate *p;
+};
+
+#endif // SHADERCACHE_H
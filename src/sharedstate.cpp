@@ -37,6 +37,17 @@
 #include "binding.h"
 #include "exception.h"
 #include "sharedmidistate.h"
+#include "perfstats.h"
+#include "spritebatch.h"
+#include "bitmapatlas.h"
+#include "streambuffer.h"
+#include "texuploader.h"
+#include "shadercache.h"
+#include "imagedecoder.h"
+#include "imagecache.h"
+#include "glyphatlas.h"
+#include "textcache.h"
+#include "tileatlascache.h"
 
 #include <unistd.h>
 #include <stdio.h>
@@ -45,6 +56,9 @@
 SharedState *SharedState::instance = 0;
 int SharedState::rgssVersion = 0;
 static GlobalIBO *_globalIBO = 0;
+static StreamBuffer *_streamBuffer = 0;
+static TexUploader *_texUploader = 0;
+static ShaderCache *_shaderCache = 0;
 
 static const char *gameArchExt()
 {
@@ -92,10 +106,17 @@ struct SharedStatePrivate
 
 	TEXFBO gpTexFBO;
 
-	TEXFBO atlasTex;
-
 	Quad gpQuad;
 
+	PerfStats perfStats;
+	SpriteBatch spriteBatch;
+	BitmapAtlas bitmapAtlas;
+	ImageDecoder imageDecoder;
+	ImageCache imageCache;
+	GlyphAtlas glyphAtlas;
+	TextCache textCache;
+	TileAtlasCache tileAtlasCache;
+
 	unsigned int stampCounter;
 
 	SharedStatePrivate(RGSSThreadData *threadData)
@@ -110,13 +131,16 @@ struct SharedStatePrivate
 	      input(*threadData),
 	      audio(*threadData),
 	      _glState(threadData->config),
+	      shaders(threadData->config),
 	      fontState(threadData->config),
+	      spriteBatch(threadData->config.spriteBatching),
+	      bitmapAtlas(threadData->config),
+	      imageDecoder(fileSystem, threadData->config),
+	      imageCache(threadData->config),
+	      textCache(threadData->config),
+	      tileAtlasCache(threadData->config),
 	      stampCounter(0)
 	{
-		/* Shaders have been compiled in ShaderSet's constructor */
-		if (gl.ReleaseShaderCompiler)
-			gl.ReleaseShaderCompiler();
-
 		std::string archPath = config.execName + gameArchExt();
 
 		/* Check if a game archive exists */
@@ -162,21 +186,25 @@ struct SharedStatePrivate
 	{
 		TEX::del(globalTex);
 		TEXFBO::fini(gpTexFBO);
-		TEXFBO::fini(atlasTex);
 	}
 };
 
 void SharedState::initInstance(RGSSThreadData *threadData)
 {
 	/* This section is tricky because of dependencies:
-	 * SharedState depends on GlobalIBO existing,
-	 * Font depends on SharedState existing */
+	 * SharedState depends on GlobalIBO, StreamBuffer, TexUploader and
+	 * ShaderCache
+	 * existing, Font depends on SharedState existing */
 
 	rgssVersion = threadData->config.rgssVersion;
     
 	_globalIBO = new GlobalIBO();
 	_globalIBO->ensureSize(1);
 
+	_streamBuffer = new StreamBuffer();
+	_texUploader = new TexUploader(threadData->config);
+	_shaderCache = new ShaderCache(threadData->config);
+
 	SharedState::instance = 0;
 	Font *defaultFont = 0;
 
@@ -189,6 +217,9 @@ void SharedState::initInstance(RGSSThreadData *threadData)
 	catch (const Exception &exc)
 	{
 		delete _globalIBO;
+		delete _streamBuffer;
+		delete _texUploader;
+		delete _shaderCache;
 		delete SharedState::instance;
 		delete defaultFont;
 
@@ -205,6 +236,12 @@ void SharedState::finiInstance()
 	delete SharedState::instance;
 
 	delete _globalIBO;
+	delete _streamBuffer;
+	delete _texUploader;
+
+	/* Shaders compiled since the last idle time */
+	_shaderCache->save();
+	delete _shaderCache;
 }
 
 void SharedState::setScreen(Scene &screen)
@@ -234,6 +271,14 @@ GSATT(TexPool&, texPool)
 GSATT(Quad&, gpQuad)
 GSATT(SharedFontState&, fontState)
 GSATT(SharedMidiState&, midiState)
+GSATT(PerfStats&, perfStats)
+GSATT(SpriteBatch&, spriteBatch)
+GSATT(BitmapAtlas&, bitmapAtlas)
+GSATT(ImageDecoder&, imageDecoder)
+GSATT(ImageCache&, imageCache)
+GSATT(GlyphAtlas&, glyphAtlas)
+GSATT(TextCache&, textCache)
+GSATT(TileAtlasCache&, tileAtlasCache)
 
 void SharedState::setBindingData(void *data)
 {
@@ -250,6 +295,21 @@ GlobalIBO &SharedState::globalIBO()
 	return *_globalIBO;
 }
 
+StreamBuffer &SharedState::streamBuffer()
+{
+	return *_streamBuffer;
+}
+
+TexUploader &SharedState::texUploader()
+{
+	return *_texUploader;
+}
+
+ShaderCache &SharedState::shaderCache()
+{
+	return *_shaderCache;
+}
+
 void SharedState::bindTex()
 {
 	TEX::bind(p->globalTex);
@@ -303,36 +363,6 @@ TEXFBO &SharedState::gpTexFBO(int minW, int minH)
 	return p->gpTexFBO;
 }
 
-void SharedState::requestAtlasTex(int w, int h, TEXFBO &out)
-{
-	TEXFBO tex;
-
-	if (w == p->atlasTex.width && h == p->atlasTex.height)
-	{
-		tex = p->atlasTex;
-		p->atlasTex = TEXFBO();
-	}
-	else
-	{
-		TEXFBO::init(tex);
-		TEXFBO::allocEmpty(tex, w, h);
-		TEXFBO::linkFBO(tex);
-	}
-
-	out = tex;
-}
-
-void SharedState::releaseAtlasTex(TEXFBO &tex)
-{
-	/* No point in caching an invalid object */
-	if (tex.tex == TEX::ID(0))
-		return;
-
-	TEXFBO::fini(p->atlasTex);
-
-	p->atlasTex = tex;
-}
-
 void SharedState::checkShutdown()
 {
 	if (!p->rtData.rqTerm)
@@ -34,9 +34,9 @@ struct GlobalIBO;
 struct SDL_Window;
 struct TEXFBO;
 struct Quad;
-struct ShaderSet;
 
 class Scene;
+class ShaderSet;
 class FileSystem;
 class EventThread;
 class Graphics;
@@ -46,6 +46,17 @@ class GLState;
 class TexPool;
 class Font;
 class SharedFontState;
+class PerfStats;
+class SpriteBatch;
+class BitmapAtlas;
+class StreamBuffer;
+class TexUploader;
+class ShaderCache;
+class ImageDecoder;
+class ImageCache;
+class GlyphAtlas;
+class TextCache;
+class TileAtlasCache;
 struct GlobalIBO;
 struct Config;
 struct Vec2i;
@@ -81,6 +92,15 @@ struct SharedState
 	Font &defaultFont() const;
 	SharedMidiState &midiState() const;
 
+	PerfStats &perfStats() const;
+	SpriteBatch &spriteBatch() const;
+	BitmapAtlas &bitmapAtlas() const;
+	ImageDecoder &imageDecoder() const;
+	ImageCache &imageCache() const;
+	GlyphAtlas &glyphAtlas() const;
+	TextCache &textCache() const;
+	TileAtlasCache &tileAtlasCache() const;
+
 	sigc::signal<void> prepareDraw;
 
 	unsigned int genTimeStamp();
@@ -90,6 +110,15 @@ struct SharedState
 	void ensureQuadIBO(size_t minSize);
 	GlobalIBO &globalIBO();
 
+	/* Shared buffer for dynamic vertex data */
+	StreamBuffer &streamBuffer();
+
+	/* Staged (asynchronous) texture uploads */
+	TexUploader &texUploader();
+
+	/* Program binaries from earlier runs */
+	ShaderCache &shaderCache();
+
 	/* Global general purpose texture */
 	void bindTex();
 	void ensureTexSize(int minW, int minH, Vec2i &currentSizeOut);
@@ -98,11 +127,6 @@ struct SharedState
 
 	Quad &gpQuad() const;
 
-	/* Basically just a simple "TexPool"
-	 * replacement for Tilemap atlas use */
-	void requestAtlasTex(int w, int h, TEXFBO &out);
-	void releaseAtlasTex(TEXFBO &tex);
-
 	/* Checks EventThread's shutdown request flag and if set,
 	 * requests the binding to terminate. In this case, this
 	 * function will most likely not return */
@@ -33,12 +33,16 @@
 #include "shader.h"
 #include "glstate.h"
 #include "quadarray.h"
+#include "spritebatch.h"
 
 #include <math.h>
 #ifndef M_PI
 # define M_PI 3.14159265358979323846
 #endif
 
+#include <float.h>
+#include <algorithm>
+
 #include <SDL_rect.h>
 
 #include <sigc++/connection.h>
@@ -60,8 +64,8 @@ struct SpritePrivate
 	NormValue opacity;
 	BlendType blendType;
 
+	/* Scene rectangle in screen space */
 	IntRect sceneRect;
-	Vec2i sceneOrig;
 
 	/* Would this sprite be visible on
 	 * the screen if drawn? */
@@ -84,6 +88,8 @@ struct SpritePrivate
 		/* qArray needs updating */
 		bool dirty;
 		SimpleQuadArray qArray;
+		/* Local space bounding box of qArray */
+		FloatRect bounds;
 	} wave;
 
 	EtcTemps tmp;
@@ -104,8 +110,6 @@ struct SpritePrivate
 	      tone(&tmp.tone)
 
 	{
-		sceneRect.x = sceneRect.y = 0;
-
 		updateSrcRectCon();
 
 		prepareCon = shState->prepareDraw.connect
@@ -139,6 +143,60 @@ struct SpritePrivate
 		efBushDepth = 1.0f - texBushDepth / bitmap->height();
 	}
 
+	/* Effective bush depth relative to a texture holding
+	 * the bitmap at 'texRect', 'texHeight' pixels high */
+	float texBushDepth(const IntRect &texRect, int texHeight) const
+	{
+		return (texRect.y + efBushDepth * texRect.h) / texHeight;
+	}
+
+	/* Relative to the backing texture, which
+	 * differs for atlas residents */
+	float atlasBushDepth() const
+	{
+		return texBushDepth(bitmap->texRect(), bitmap->texSize().y);
+	}
+
+	/* Mega bitmaps are spread over several textures, so
+	 * each is drawn with the part of the sprite it covers.
+	 * Wave effects aren't applied to these */
+	void drawMegaTiles(ShaderBase &shader, SpriteShader *bushShader)
+	{
+		const int bmW = bitmap->width();
+		const int bmH = bitmap->height();
+
+		/* Same clamping as in onSrcRectChange() */
+		IntRect src = srcRect->toIntRect();
+		src.w = clamp<int>(src.w, 0, bmW-src.x);
+		src.h = clamp<int>(src.h, 0, bmH-src.y);
+
+		Quad &tileQuad = shState->gpQuad();
+
+		for (int i = 0; i < bitmap->megaTileCount(); ++i)
+		{
+			const IntRect tile = bitmap->megaTileRect(i);
+			IntRect part;
+
+			if (!SDL_IntersectRect(&src, &tile, &part))
+				continue;
+
+			FloatRect pos(part.x - src.x, part.y - src.y, part.w, part.h);
+
+			if (mirrored)
+				pos.x = src.w - pos.x - pos.w;
+
+			tileQuad.setTexPosRect(mirrored ? FloatRect(part).hFlipped() : FloatRect(part), pos);
+
+			bitmap->bindMegaTile(shader, i);
+
+			if (bushShader)
+				bushShader->setBushDepth(texBushDepth(IntRect(-tile.x, -tile.y, bmW, bmH),
+				                                      tile.h));
+
+			tileQuad.draw();
+		}
+	}
+
 	void onSrcRectChange()
 	{
 		FloatRect rect = srcRect->toFloatRect();
@@ -179,31 +237,58 @@ struct SpritePrivate
 		if (!opacity)
 			return;
 
-		if (wave.active)
-		{
-			/* Don't do expensive wave bounding box
-			 * calculations */
-			isVisible = true;
+		const FloatRect local = wave.active ? wave.bounds : vertexBounds(quad.vert, 4);
+
+		if (local.w <= 0 || local.h <= 0)
 			return;
-		}
 
-		/* Compare sprite bounding box against the scene */
+		/* Compare the bounding box of the transformed sprite
+		 * against the scene. As the transform is affine, the
+		 * corners of the local box are all we need */
+		const float *m = trans.getMatrix();
+		const Vec2 corners[] =
+		{
+			local.topLeft(), local.topRight(),
+			local.bottomLeft(), local.bottomRight()
+		};
+
+		float minX = FLT_MAX, minY = FLT_MAX;
+		float maxX = -FLT_MAX, maxY = -FLT_MAX;
 
-		/* If sprite is zoomed/rotated, just opt out for now
-		 * for simplicity's sake */
-		const Vec2 &scale = trans.getScale();
-		if (scale.x != 1 || scale.y != 1 || trans.getRotation() != 0)
+		for (size_t i = 0; i < ARRAY_SIZE(corners); ++i)
 		{
-			isVisible = true;
-			return;
+			const Vec2 &c = corners[i];
+			const float x = m[0] * c.x + m[4] * c.y + m[12];
+			const float y = m[1] * c.x + m[5] * c.y + m[13];
+
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x);
+			minY = std::min(minY, y);
+			maxY = std::max(maxY, y);
 		}
 
-		IntRect self;
-		self.setPos(trans.getPositionI() - (trans.getOriginI() + sceneOrig));
-		self.w = bitmap->width();
-		self.h = bitmap->height();
+		isVisible = (minX < sceneRect.x + sceneRect.w && maxX > sceneRect.x &&
+		             minY < sceneRect.y + sceneRect.h && maxY > sceneRect.y);
+	}
+
+	template<typename VertexType>
+	static FloatRect vertexBounds(const VertexType *vert, size_t count)
+	{
+		if (count == 0)
+			return FloatRect();
+
+		Vec2 min = vert[0].pos;
+		Vec2 max = vert[0].pos;
+
+		for (size_t i = 1; i < count; ++i)
+		{
+			min.x = std::min(min.x, vert[i].pos.x);
+			min.y = std::min(min.y, vert[i].pos.y);
+			max.x = std::max(max.x, vert[i].pos.x);
+			max.y = std::max(max.y, vert[i].pos.y);
+		}
 
-		isVisible = SDL_HasIntersection(&self, &sceneRect);
+		return FloatRect(min.x, min.y, max.x - min.x, max.y - min.y);
 	}
 	/*	
 	*	Horizontal wave chunk emission
@@ -498,6 +583,11 @@ struct SpritePrivate
 		{
 			updateWave();
 			wave.dirty = false;
+
+			/* Exact for all wave modes, and only
+			 * recomputed when the wave changes */
+			const std::vector<SVertex> &vert = wave.qArray.vertices;
+			wave.bounds = vert.empty() ? FloatRect() : vertexBounds(&vert[0], vert.size());
 		}
 
 		updateVisibility();
@@ -536,8 +626,9 @@ DEF_ATTR_RD_SIMPLE(Sprite, WavePhase,  float,   p->wave.phase)
 DEF_ATTR_RD_SIMPLE(Sprite, WaveMode,   int,     p->wave.mode)
 DEF_ATTR_RD_SIMPLE(Sprite, WaveSize,   int  ,   p->wave.size)
 
-DEF_ATTR_SIMPLE(Sprite, BushOpacity, int,     p->bushOpacity)
-DEF_ATTR_SIMPLE(Sprite, Opacity,     int,     p->opacity)
+DEF_ATTR_RD_SIMPLE(Sprite, BushOpacity, int,     p->bushOpacity)
+DEF_ATTR_RD_SIMPLE(Sprite, Opacity,     int,     p->opacity)
+
 DEF_ATTR_SIMPLE(Sprite, SrcRect,     Rect&,  *p->srcRect)
 DEF_ATTR_SIMPLE(Sprite, Color,       Color&, *p->color)
 DEF_ATTR_SIMPLE(Sprite, Tone,        Tone&,  *p->tone)
@@ -550,12 +641,11 @@ void Sprite::setBitmap(Bitmap *bitmap)
 		return;
 
 	p->bitmap = bitmap;
+	Scene::markDirty();
 
 	if (nullOrDisposed(bitmap))
 		return;
 
-	bitmap->ensureNonMega();
-
 	*p->srcRect = bitmap->rect();
 	p->onSrcRectChange();
 	p->quad.setPosRect(p->srcRect->toFloatRect());
@@ -571,6 +661,7 @@ void Sprite::setX(int value)
 		return;
 
 	p->trans.setPosition(Vec2(value, getY()));
+	Scene::markDirty();
 }
 
 void Sprite::setY(int value)
@@ -581,6 +672,7 @@ void Sprite::setY(int value)
 		return;
 
 	p->trans.setPosition(Vec2(getX(), value));
+	Scene::markDirty();
 
 	if (rgssVer >= 2)
 	{
@@ -597,6 +689,7 @@ void Sprite::setOX(int value)
 		return;
 
 	p->trans.setOrigin(Vec2(value, getOY()));
+	Scene::markDirty();
 }
 
 void Sprite::setOY(int value)
@@ -607,6 +700,7 @@ void Sprite::setOY(int value)
 		return;
 
 	p->trans.setOrigin(Vec2(getOX(), value));
+	Scene::markDirty();
 }
 
 void Sprite::setZoomX(float value)
@@ -617,6 +711,7 @@ void Sprite::setZoomX(float value)
 		return;
 
 	p->trans.setScale(Vec2(value, getZoomY()));
+	Scene::markDirty();
 }
 
 void Sprite::setZoomY(float value)
@@ -628,6 +723,7 @@ void Sprite::setZoomY(float value)
 
 	p->trans.setScale(Vec2(getZoomX(), value));
 	p->recomputeBushDepth();
+	Scene::markDirty();
 
 	if (rgssVer >= 2)
 		p->wave.dirty = true;
@@ -641,6 +737,7 @@ void Sprite::setAngle(float value)
 		return;
 
 	p->trans.setRotation(value);
+	Scene::markDirty();
 }
 
 void Sprite::setMirror(bool mirrored)
@@ -652,6 +749,8 @@ void Sprite::setMirror(bool mirrored)
 
 	p->mirrored = mirrored;
 	p->onSrcRectChange();
+
+	Scene::markDirty();
 }
 
 void Sprite::setBushDepth(int value)
@@ -663,25 +762,57 @@ void Sprite::setBushDepth(int value)
 
 	p->bushDepth = value;
 	p->recomputeBushDepth();
+
+	Scene::markDirty();
+}
+
+void Sprite::setBushOpacity(int value)
+{
+	guardDisposed();
+
+	if (p->bushOpacity == value)
+		return;
+
+	p->bushOpacity = value;
+	Scene::markDirty();
+}
+
+void Sprite::setOpacity(int value)
+{
+	guardDisposed();
+
+	if (p->opacity == value)
+		return;
+
+	p->opacity = value;
+	Scene::markDirty();
 }
 
 void Sprite::setBlendType(int type)
 {
 	guardDisposed();
 
+	BlendType value;
+
 	switch (type)
 	{
 	default :
 	case BlendNormal :
-		p->blendType = BlendNormal;
-		return;
+		value = BlendNormal;
+		break;
 	case BlendAddition :
-		p->blendType = BlendAddition;
-		return;
+		value = BlendAddition;
+		break;
 	case BlendSubstraction :
-		p->blendType = BlendSubstraction;
-		return;
+		value = BlendSubstraction;
+		break;
 	}
+
+	if (p->blendType == value)
+		return;
+
+	p->blendType = value;
+	Scene::markDirty();
 }
 
 #define DEF_WAVE_SETTER(Name, name, type) \
@@ -692,6 +823,7 @@ void Sprite::setBlendType(int type)
 			return; \
 		p->wave.name = value; \
 		p->wave.dirty = true; \
+		Scene::markDirty(); \
 	}
 
 DEF_WAVE_SETTER(Amp,    amp,    int)
@@ -721,6 +853,10 @@ void Sprite::update()
 
 	p->wave.phase += p->wave.speed / 180;
 	p->wave.dirty = true;
+
+	/* Only an active wave actually animates */
+	if (p->wave.amp != 0 && p->wave.speed != 0)
+		Scene::markDirty();
 }
 
 /* SceneElement */
@@ -733,6 +869,7 @@ void Sprite::draw()
 		return;
 
 	ShaderBase *base;
+	SpriteShader *bushShader = 0;
 
 	bool renderEffect = p->color->hasEffect() ||
 	                    p->tone->hasEffect()  ||
@@ -741,7 +878,7 @@ void Sprite::draw()
 
 	if (renderEffect)
 	{
-		SpriteShader &shader = shState->shaders().sprite;
+		SpriteShader &shader = shState->shaders().sprite();
 
 		shader.bind();
 		shader.applyViewportProj();
@@ -749,7 +886,7 @@ void Sprite::draw()
 
 		shader.setTone(p->tone->norm);
 		shader.setOpacity(p->opacity.norm);
-		shader.setBushDepth(p->efBushDepth);
+		shader.setBushDepth(p->atlasBushDepth());
 		shader.setBushOpacity(p->bushOpacity.norm);
 
 		/* When both flashing and effective color are set,
@@ -760,10 +897,11 @@ void Sprite::draw()
 		shader.setColor(*blend);
 
 		base = &shader;
+		bushShader = &shader;
 	}
 	else if (p->opacity != 255)
 	{
-		AlphaSpriteShader &shader = shState->shaders().alphaSprite;
+		AlphaSpriteShader &shader = shState->shaders().alphaSprite();
 		shader.bind();
 
 		shader.setSpriteMat(p->trans.getMatrix());
@@ -773,7 +911,7 @@ void Sprite::draw()
 	}
 	else
 	{
-		SimpleSpriteShader &shader = shState->shaders().simpleSprite;
+		SimpleSpriteShader &shader = shState->shaders().simpleSprite();
 		shader.bind();
 
 		shader.setSpriteMat(p->trans.getMatrix());
@@ -783,24 +921,63 @@ void Sprite::draw()
 
 	glState.blendMode.pushSet(p->blendType);
 
-	p->bitmap->bindTex(*base);
-
-	if (p->wave.active)
-		p->wave.qArray.draw();
+	if (p->bitmap->isMega())
+	{
+		p->drawMegaTiles(*base, bushShader);
+	}
 	else
-		p->quad.draw();
+	{
+		p->bitmap->bindAtlasTex(*base);
+
+		if (p->wave.active)
+			p->wave.qArray.draw();
+		else
+			p->quad.draw();
+	}
 
 	glState.blendMode.pop();
 }
 
+bool Sprite::isCulled()
+{
+	return !p->isVisible;
+}
+
+bool Sprite::batch(SpriteBatch &batch)
+{
+	/* Wave effects emit a varying number of quads
+	 * and take the regular path */
+	if (!batch.isEnabled() || p->wave.active)
+		return false;
+
+	/* Nothing to draw, but don't break up the batch either */
+	if (!p->isVisible || emptyFlashFlag)
+		return true;
+
+	/* Mega bitmaps need a draw per tile */
+	if (p->bitmap->isMega())
+		return false;
+
+	const Vec4 *blend = (flashing && flashColor.w > p->color->norm.w) ?
+		                 &flashColor : &p->color->norm;
+
+	/* Neutral bush values make the shader a no-op there */
+	const bool bush = p->bushDepth != 0;
+
+	batch.append(p->bitmap, p->blendType, p->quad.vert, p->trans.getMatrix(),
+	             *blend, p->tone->norm, p->opacity.norm,
+	             bush ? p->atlasBushDepth() : 0, bush ? p->bushOpacity.norm : 1);
+
+	return true;
+}
+
 void Sprite::onGeometryChange(const Scene::Geometry &geo)
 {
 	/* Offset at which the sprite will be drawn
 	 * relative to screen origin */
 	p->trans.setGlobalOffset(geo.offset());
 
-	p->sceneRect.setSize(geo.rect.size());
-	p->sceneOrig = geo.orig;
+	p->sceneRect = geo.rect;
 }
 
 void Sprite::releaseResources()
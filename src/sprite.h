@@ -75,6 +75,8 @@ private:
 	SpritePrivate *p;
 
 	void draw();
+	bool isCulled();
+	bool batch(SpriteBatch &batch);
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
@@ -0,0 +1,129 @@
+/*
+** spritebatch.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "spritebatch.h"
+
+#include "sharedstate.h"
+#include "bitmap.h"
+#include "glstate.h"
+#include "shader.h"
+#include "quadarray.h"
+#include "perfstats.h"
+
+/* Keeps us well within the range of the 16 bit global IBO */
+#define MAX_BATCH_QUADS 2048
+
+struct SpriteBatchPrivate
+{
+	QuadArray<SpriteVertex> qArray;
+
+	/* State shared by all pending sprites */
+	Bitmap *bitmap;
+	BlendType blendType;
+
+	bool enabled;
+
+	SpriteBatchPrivate(bool enabled)
+	    : bitmap(0),
+	      blendType(BlendNormal),
+	      enabled(enabled)
+	{
+		qArray.vertices.reserve(MAX_BATCH_QUADS * 4);
+	}
+};
+
+SpriteBatch::SpriteBatch(bool enabled)
+{
+	p = new SpriteBatchPrivate(enabled);
+}
+
+SpriteBatch::~SpriteBatch()
+{
+	delete p;
+}
+
+bool SpriteBatch::isEnabled() const
+{
+	return p->enabled;
+}
+
+void SpriteBatch::append(Bitmap *bitmap, BlendType blendType,
+                         const Vertex quad[4], const float matrix[16],
+                         const Vec4 &color, const Vec4 &tone,
+                         float opacity, float bushDepth, float bushOpacity)
+{
+	const size_t count = p->qArray.count();
+
+	if (count > 0 && (!bitmap->sharesTex(*p->bitmap) ||
+	                  blendType != p->blendType ||
+	                  count == MAX_BATCH_QUADS))
+		flush();
+
+	p->bitmap = bitmap;
+	p->blendType = blendType;
+
+	const size_t i = p->qArray.count();
+	p->qArray.resize(i+1);
+
+	SpriteVertex *vert = &p->qArray.vertices[i*4];
+	const Vec4 effect(opacity, bushDepth, bushOpacity, 0);
+	const Vec2i texOffset = bitmap->texRect().pos();
+
+	for (int j = 0; j < 4; ++j)
+	{
+		const Vec2 &pos = quad[j].pos;
+
+		/* Equivalent of 'spriteMat * vec4(pos, 0, 1)' */
+		vert[j].pos = Vec2(matrix[0] * pos.x + matrix[4] * pos.y + matrix[12],
+		                   matrix[1] * pos.x + matrix[5] * pos.y + matrix[13]);
+		vert[j].texPos = Vec2(quad[j].texPos.x + texOffset.x,
+		                      quad[j].texPos.y + texOffset.y);
+		vert[j].color = color;
+		vert[j].tone = tone;
+		vert[j].effect = effect;
+	}
+
+	shState->perfStats().add(PerfStats::BatchedSprites);
+}
+
+void SpriteBatch::flush()
+{
+	if (p->qArray.count() == 0)
+		return;
+
+	p->qArray.commit();
+
+	SpriteBatchShader &shader = shState->shaders().spriteBatch();
+	shader.bind();
+	shader.applyViewportProj();
+
+	glState.blendMode.pushSet(p->blendType);
+
+	p->bitmap->bindAtlasTex(shader);
+	p->qArray.draw();
+
+	glState.blendMode.pop();
+
+	shState->perfStats().add(PerfStats::SpriteBatches);
+
+	p->qArray.clear();
+	p->bitmap = 0;
+}
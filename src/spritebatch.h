@@ -0,0 +1,62 @@
+/*
+** spritebatch.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPRITEBATCH_H
+#define SPRITEBATCH_H
+
+#include "etc.h"
+#include "etc-internal.h"
+
+class Bitmap;
+struct Vertex;
+struct SpriteBatchPrivate;
+
+/* Collects consecutive sprites that sample the same
+ * texture (bitmap or atlas page) with the same blend
+ * mode, and draws them with a single call.
+ * Scene::composite flushes the batch before any element
+ * that can't be batched is drawn, so the resulting draw
+ * order is left untouched */
+class SpriteBatch
+{
+public:
+	SpriteBatch(bool enabled);
+	~SpriteBatch();
+
+	bool isEnabled() const;
+
+	/* 'quad' holds the untransformed sprite vertices, which
+	 * are run through 'matrix' on the CPU. 'bushDepth' is
+	 * relative to the backing texture. If the sprite can't
+	 * join the pending batch, that one is flushed first */
+	void append(Bitmap *bitmap, BlendType blendType,
+	            const Vertex quad[4], const float matrix[16],
+	            const Vec4 &color, const Vec4 &tone,
+	            float opacity, float bushDepth, float bushOpacity);
+
+	/* Draws all pending sprites (if any) */
+	void flush();
+
+private:
+	SpriteBatchPrivate *p;
+};
+
+#endif // SPRITEBATCH_H
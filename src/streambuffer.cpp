@@ -0,0 +1,260 @@
+/*
+** streambuffer.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "streambuffer.h"
+
+#include "gl-fun.h"
+#include "sharedstate.h"
+#include "perfstats.h"
+#include "debugwriter.h"
+
+#include <string.h>
+#include <stdint.h>
+
+/* Size of one segment, which is the unit the buffer
+ * wraps around in */
+#define SEGMENT_SIZE (4 << 20)
+
+/* Persistently mapped buffers are split into this many
+ * segments, so we only ever wait on a fence that was
+ * placed two segments ago (ie. usually long signaled) */
+#define MAPPED_SEGMENTS 3
+
+/* Keeps attribute offsets suitably aligned
+ * for any vertex type */
+#define UPLOAD_ALIGN 16
+
+struct StreamBufferPrivate
+{
+	enum Mode
+	{
+		Persistent,
+		MapRange,
+		SubData
+	};
+
+	VBO::ID vbo;
+	Mode mode;
+
+	int segmentCount;
+	int segment;
+
+	/* Write position, absolute within the buffer */
+	GLintptr head;
+
+	unsigned int epoch;
+
+	uint8_t *mapping;
+	_GLsync fences[MAPPED_SEGMENTS];
+
+	StreamBufferPrivate()
+	    : segmentCount(1),
+	      segment(0),
+	      head(0),
+	      epoch(1),
+	      mapping(0)
+	{
+		for (int i = 0; i < MAPPED_SEGMENTS; ++i)
+			fences[i] = 0;
+
+		vbo = VBO::gen();
+		VBO::bind(vbo);
+
+		if (gl.BufferStorage && initPersistent())
+			mode = Persistent;
+		else if (gl.MapBufferRange && gl.UnmapBuffer)
+			mode = MapRange;
+		else
+			mode = SubData;
+
+		if (mode != Persistent)
+			VBO::allocEmpty(SEGMENT_SIZE, GL_STREAM_DRAW);
+
+		VBO::unbind();
+	}
+
+	~StreamBufferPrivate()
+	{
+		for (int i = 0; i < MAPPED_SEGMENTS; ++i)
+			if (fences[i])
+				gl.DeleteSync(fences[i]);
+
+		if (mapping)
+		{
+			VBO::bind(vbo);
+			gl.UnmapBuffer(GL_ARRAY_BUFFER);
+			VBO::unbind();
+		}
+
+		VBO::del(vbo);
+	}
+
+	bool initPersistent()
+	{
+		const GLbitfield flags =
+			GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr size = SEGMENT_SIZE * MAPPED_SEGMENTS;
+
+		gl.BufferStorage(GL_ARRAY_BUFFER, size, 0, flags);
+		mapping = (uint8_t*) gl.MapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+
+		if (mapping)
+		{
+			segmentCount = MAPPED_SEGMENTS;
+			return true;
+		}
+
+		Debug() << "Persistent buffer mapping failed, falling back";
+
+		/* Immutable storage can't be respecified, so
+		 * start over with a fresh buffer */
+		VBO::del(vbo);
+		vbo = VBO::gen();
+		VBO::bind(vbo);
+
+		return false;
+	}
+
+	GLintptr segmentEnd() const
+	{
+		return (GLintptr) (segment + 1) * SEGMENT_SIZE;
+	}
+
+	void wrap()
+	{
+		if (mode == Persistent)
+		{
+			/* Everything drawn from the current segment has
+			 * been submitted by now (older epochs are never
+			 * drawn from), so fence it off */
+			fences[segment] = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+			segment = (segment + 1) % segmentCount;
+
+			if (fences[segment])
+			{
+				gl.ClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT,
+				                  FENCE_TIMEOUT_NS);
+				gl.DeleteSync(fences[segment]);
+				fences[segment] = 0;
+			}
+		}
+		else
+		{
+			/* Orphan the old storage; the driver keeps
+			 * it alive until the GPU is done with it */
+			VBO::allocEmpty(SEGMENT_SIZE, GL_STREAM_DRAW);
+		}
+
+		head = (GLintptr) segment * SEGMENT_SIZE;
+		++epoch;
+
+		shState->perfStats().add(PerfStats::StreamWraps);
+	}
+
+	void write(GLintptr offset, const void *data, GLsizeiptr size)
+	{
+		switch (mode)
+		{
+		case Persistent :
+			memcpy(mapping + offset, data, size);
+			return;
+
+		case MapRange :
+		{
+			/* We never write to a range twice within an
+			 * epoch, so there is nothing to synchronize */
+			const GLbitfield access = GL_MAP_WRITE_BIT |
+			                          GL_MAP_INVALIDATE_RANGE_BIT |
+			                          GL_MAP_UNSYNCHRONIZED_BIT;
+
+			void *dst = gl.MapBufferRange(GL_ARRAY_BUFFER, offset, size, access);
+
+			if (dst)
+			{
+				memcpy(dst, data, size);
+				gl.UnmapBuffer(GL_ARRAY_BUFFER);
+				return;
+			}
+
+			break;
+		}
+
+		case SubData :
+			break;
+		}
+
+		VBO::uploadSubData(offset, size, data);
+	}
+};
+
+StreamBuffer::StreamBuffer()
+{
+	p = new StreamBufferPrivate;
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	delete p;
+}
+
+VBO::ID StreamBuffer::vbo() const
+{
+	return p->vbo;
+}
+
+GLsizeiptr StreamBuffer::maxUpload() const
+{
+	/* Leave room for everything else in a segment
+	 * so single large uploads can't thrash it */
+	return SEGMENT_SIZE / 4;
+}
+
+StreamRegion StreamBuffer::upload(const void *data, GLsizeiptr size)
+{
+	VBO::bind(p->vbo);
+
+	GLintptr offset = (p->head + UPLOAD_ALIGN - 1) & ~(GLintptr) (UPLOAD_ALIGN - 1);
+
+	if (offset + size > p->segmentEnd())
+	{
+		p->wrap();
+		offset = p->head;
+	}
+
+	p->write(offset, data, size);
+	p->head = offset + size;
+
+	VBO::unbind();
+
+	shState->perfStats().add(PerfStats::StreamUploadBytes, size);
+
+	StreamRegion region;
+	region.offset = offset;
+	region.epoch = p->epoch;
+
+	return region;
+}
+
+bool StreamBuffer::holds(const StreamRegion &region) const
+{
+	return region.epoch == p->epoch;
+}
@@ -0,0 +1,73 @@
+/*
+** streambuffer.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include "gl-util.h"
+
+struct StreamBufferPrivate;
+
+/* Location of uploaded data inside the stream buffer */
+struct StreamRegion
+{
+	GLintptr offset;
+	unsigned int epoch;
+
+	StreamRegion()
+	    : offset(0),
+	      epoch(0)
+	{}
+};
+
+/* A large vertex buffer shared by all dynamic geometry.
+ * Uploads are appended one after another; once the buffer
+ * runs full, it starts over with fresh storage and a new
+ * "epoch". Data from older epochs can't be drawn from
+ * anymore and has to be uploaded again.
+ *
+ * Depending on what the driver offers, the buffer is either
+ * persistently mapped (ARB_buffer_storage), written through
+ * unsynchronized mappings (ARB_map_buffer_range) or filled
+ * with plain glBufferSubData (GL 2.x / GLES 2). The mapped
+ * buffer is split into segments guarded by fences, the other
+ * two orphan their old storage when wrapping around */
+class StreamBuffer
+{
+public:
+	StreamBuffer();
+	~StreamBuffer();
+
+	VBO::ID vbo() const;
+
+	/* Largest amount of data a single upload may have */
+	GLsizeiptr maxUpload() const;
+
+	StreamRegion upload(const void *data, GLsizeiptr size);
+
+	/* Whether the data of 'region' can still be drawn from */
+	bool holds(const StreamRegion &region) const;
+
+private:
+	StreamBufferPrivate *p;
+};
+
+#endif // STREAMBUFFER_H
@@ -26,19 +26,28 @@
 
 #include "serial-util.h"
 #include "exception.h"
+#include "sharedstate.h"
+#include "scene.h"
 #include "util.h"
 
 /* Init normally */
 Table::Table(int x, int y /*= 1*/, int z /*= 1*/)
     : xs(x), ys(y), zs(z),
-      data(x*y*z)
+      data(x*y*z),
+      dirty(false)
 {}
 
 Table::Table(const Table &other)
     : xs(other.xs), ys(other.ys), zs(other.zs),
-      data(other.data)
+      data(other.data),
+      dirty(false)
 {}
 
+Table::~Table()
+{
+	flushCon.disconnect();
+}
+
 int16_t Table::get(int x, int y, int z) const
 {
 	return data[xs*ys*z + xs*y + x];
@@ -55,7 +64,7 @@ void Table::set(int16_t value, int x, int y, int z)
 
 	data[xs*ys*z + xs*y + x] = value;
 
-	modified();
+	markModified(x, y, 1, 1);
 }
 
 void Table::resize(int x, int y, int z)
@@ -76,7 +85,7 @@ void Table::resize(int x, int y, int z)
 	ys = y;
 	zs = z;
 
-	return;
+	markModified(0, 0, xs, ys);
 }
 
 void Table::resize(int x, int y)
@@ -89,6 +98,47 @@ void Table::resize(int x)
 	resize(x, ys, zs);
 }
 
+void Table::flushModified()
+{
+	if (!dirty)
+		return;
+
+	dirty = false;
+	flushCon.disconnect();
+
+	/* Listeners might write to the table again */
+	const IntRect rect = dirtyRect;
+	modified(rect);
+}
+
+void Table::markModified(int x, int y, int w, int h)
+{
+	/* Plain script data tables have nobody to tell */
+	if (modified.empty())
+		return;
+
+	if (!dirty)
+	{
+		dirtyRect = IntRect(x, y, w, h);
+		dirty = true;
+
+		flushCon = shState->prepareDraw.connect
+		        (sigc::mem_fun(this, &Table::flushModified));
+	}
+	else
+	{
+		const int x1 = std::min(dirtyRect.x, x);
+		const int y1 = std::min(dirtyRect.y, y);
+		const int x2 = std::max(dirtyRect.x + dirtyRect.w, x + w);
+		const int y2 = std::max(dirtyRect.y + dirtyRect.h, y + h);
+
+		dirtyRect = IntRect(x1, y1, x2 - x1, y2 - y1);
+	}
+
+	/* Make sure there is a next frame to flush in */
+	Scene::markDirty();
+}
+
 /* Serializable */
 int Table::serialSize() const
 {
@@ -23,9 +23,11 @@
 #define TABLE_H
 
 #include "serializable.h"
+#include "etc-internal.h"
 
 #include <stdint.h>
 #include <sigc++/signal.h>
+#include <sigc++/connection.h>
 #include <vector>
 
 class Table : public Serializable
@@ -34,7 +36,7 @@ public:
 	Table(int x, int y = 1, int z = 1);
 	/* Clone constructor */
 	Table(const Table &other);
-	virtual ~Table() {}
+	virtual ~Table();
 
 	int xSize() const { return xs; }
 	int ySize() const { return ys; }
@@ -62,11 +64,25 @@ public:
 		return data[xs*ys*z + xs*y + x];
 	}
 
-	sigc::signal<void> modified;
+	/* Emits a pending 'modified' right away, so
+	 * listeners can catch up before drawing */
+	void flushModified();
+
+	/* Emitted at most once per frame (in prepareDraw at the
+	 * latest) with the bounding box of all cells written since
+	 * the last emission. The z axis isn't tracked */
+	sigc::signal<void, const IntRect&> modified;
 
 private:
+	void markModified(int x, int y, int w, int h);
+
 	int xs, ys, zs;
 	std::vector<int16_t> data;
+
+	/* Written cells not yet announced via 'modified' */
+	IntRect dirtyRect;
+	bool dirty;
+	sigc::connection flushCon;
 };
 
 #endif // TABLE_H
@@ -0,0 +1,222 @@
+/*
+** textcache.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "textcache.h"
+
+#include "config.h"
+#include "sharedstate.h"
+#include "texpool.h"
+#include "perfstats.h"
+#include "lru-cache.h"
+
+#include <SDL_ttf.h>
+
+#include <vector>
+
+/* Metrics are small, so these are limited by count */
+#define MAX_SIZES 4096
+
+TextCache::Key::Key(_TTF_Font *font, const char *str,
+                    const Vec4 &color, const Vec4 &outColor,
+                    bool outline, bool shadow)
+    : font(font),
+      style(TTF_GetFontStyle(font)),
+      outline(outline),
+      shadow(shadow),
+      color(color),
+      outColor(outline ? outColor : Vec4()),
+      str(str)
+{}
+
+TextCache::Key::Key(_TTF_Font *font, const char *str)
+    : font(font),
+      style(TTF_GetFontStyle(font)),
+      outline(false),
+      shadow(false),
+      str(str)
+{}
+
+bool TextCache::Key::operator==(const Key &o) const
+{
+	return font == o.font && style == o.style &&
+	       outline == o.outline && shadow == o.shadow &&
+	       color == o.color && outColor == o.outColor &&
+	       str == o.str;
+}
+
+static size_t hash_value(const TextCache::Key &key)
+{
+	size_t seed = 0;
+	boost::hash_combine(seed, key.font);
+	boost::hash_combine(seed, key.style);
+	boost::hash_combine(seed, key.outline);
+	boost::hash_combine(seed, key.shadow);
+	boost::hash_combine(seed, key.color.x);
+	boost::hash_combine(seed, key.color.y);
+	boost::hash_combine(seed, key.color.z);
+	boost::hash_combine(seed, key.color.w);
+	boost::hash_combine(seed, key.outColor.x);
+	boost::hash_combine(seed, key.outColor.y);
+	boost::hash_combine(seed, key.outColor.z);
+	boost::hash_combine(seed, key.outColor.w);
+	boost::hash_combine(seed, key.str);
+
+	return seed;
+}
+
+struct TextCachePrivate
+{
+	typedef LruCache<TextCache::Key, TextCache::Line> LineCache;
+	typedef LruCache<TextCache::Key, Vec2i> SizeCache;
+
+	LineCache lines;
+	SizeCache sizes;
+
+	const size_t budget;
+
+	TextCachePrivate(const Config &conf)
+	    : budget((size_t) conf.textCacheSize << 20)
+	{}
+
+	~TextCachePrivate()
+	{
+		LineCache::const_iterator iter;
+		for (iter = lines.begin(); iter != lines.end(); ++iter)
+			TEXFBO::fini(lines[*iter].tex);
+	}
+
+	static size_t lineBytes(const TextCache::Line &line)
+	{
+		return (size_t) line.tex.width * line.tex.height * 4;
+	}
+
+	void removeLine(const TextCache::Key &key)
+	{
+		TextCache::Line line = lines.remove(key);
+		shState->texPool().release(line.tex);
+	}
+
+	void updateStats()
+	{
+		shState->perfStats().set(PerfStats::TextCacheBytes, lines.bytes());
+	}
+};
+
+TextCache::TextCache(const Config &conf)
+{
+	p = new TextCachePrivate(conf);
+}
+
+TextCache::~TextCache()
+{
+	delete p;
+}
+
+bool TextCache::lookup(const Key &key, Line &out)
+{
+	if (p->budget == 0)
+		return false;
+
+	if (!p->lines.contains(key))
+	{
+		shState->perfStats().add(PerfStats::TextCacheMisses);
+		return false;
+	}
+
+	shState->perfStats().add(PerfStats::TextCacheHits);
+
+	out = p->lines.touch(key);
+
+	return true;
+}
+
+bool TextCache::store(const Key &key, const Line &line)
+{
+	const size_t size = TextCachePrivate::lineBytes(line);
+
+	if (size > p->budget)
+		return false;
+
+	if (p->lines.contains(key))
+		p->removeLine(key);
+
+	while (p->lines.bytes() + size > p->budget)
+	{
+		p->removeLine(p->lines.oldest());
+		shState->perfStats().add(PerfStats::TextCacheEvictions);
+	}
+
+	p->lines.insert(key, line, size);
+
+	p->updateStats();
+
+	return true;
+}
+
+bool TextCache::lookupSize(const Key &key, Vec2i &out)
+{
+	if (!p->sizes.contains(key))
+	{
+		shState->perfStats().add(PerfStats::TextSizeMisses);
+		return false;
+	}
+
+	shState->perfStats().add(PerfStats::TextSizeHits);
+
+	out = p->sizes.touch(key);
+
+	return true;
+}
+
+void TextCache::storeSize(const Key &key, const Vec2i &size)
+{
+	if (p->sizes.contains(key))
+		p->sizes.remove(key);
+
+	if (p->sizes.count() >= MAX_SIZES)
+		p->sizes.remove(p->sizes.oldest());
+
+	p->sizes.insert(key, size);
+}
+
+void TextCache::invalidate(_TTF_Font *font)
+{
+	std::vector<Key> doomed;
+
+	TextCachePrivate::LineCache::const_iterator iter;
+	for (iter = p->lines.begin(); iter != p->lines.end(); ++iter)
+		if (iter->font == font)
+			doomed.push_back(*iter);
+
+	for (size_t i = 0; i < doomed.size(); ++i)
+		p->removeLine(doomed[i]);
+
+	doomed.clear();
+
+	for (iter = p->sizes.begin(); iter != p->sizes.end(); ++iter)
+		if (iter->font == font)
+			doomed.push_back(*iter);
+
+	for (size_t i = 0; i < doomed.size(); ++i)
+		p->sizes.remove(doomed[i]);
+
+	p->updateStats();
+}
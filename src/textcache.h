@@ -0,0 +1,108 @@
+/*
+** textcache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTCACHE_H
+#define TEXTCACHE_H
+
+#include "gl-util.h"
+#include "etc-internal.h"
+
+#include <string>
+
+struct _TTF_Font;
+struct Config;
+struct TextCachePrivate;
+
+/* Remembers recently drawn lines of text as finished textures,
+ * so drawing the same string with the same font and colors
+ * again (eg. on every window refresh) only costs a blit. Least
+ * recently used lines are handed back to the texture pool once
+ * the configured memory budget is exceeded.
+ *
+ * Also keeps the metrics of recently measured strings around.
+ *
+ * Fonts are identified by their SDL_ttf handle (which implies
+ * face and size) together with the handle's style, so every
+ * handle that goes away must be passed to invalidate() */
+class TextCache
+{
+public:
+	struct Key
+	{
+		_TTF_Font *font;
+		int style;
+
+		bool outline;
+		bool shadow;
+
+		Vec4 color;
+		/* Only set with 'outline' */
+		Vec4 outColor;
+
+		std::string str;
+
+		/* Key for drawing 'str', using the current style of 'font' */
+		Key(_TTF_Font *font, const char *str,
+		    const Vec4 &color, const Vec4 &outColor,
+		    bool outline, bool shadow);
+
+		/* Key for measuring 'str' */
+		Key(_TTF_Font *font, const char *str);
+
+		bool operator==(const Key &o) const;
+	};
+
+	struct Line
+	{
+		/* Holds the text (with outline and shadow)
+		 * in its entirety, from the origin */
+		TEXFBO tex;
+
+		/* Height of the text without outline and shadow */
+		int rawHeight;
+
+		/* To be applied when blending the texture
+		 * onto a bitmap */
+		float opacity;
+	};
+
+	TextCache(const Config &conf);
+	~TextCache();
+
+	/* On success, 'out' remains owned by the cache;
+	 * it stays valid until the next store() */
+	bool lookup(const Key &key, Line &out);
+
+	/* Takes ownership of 'line' unless this returns
+	 * false (cache disabled, or the line doesn't fit) */
+	bool store(const Key &key, const Line &line);
+
+	bool lookupSize(const Key &key, Vec2i &out);
+	void storeSize(const Key &key, const Vec2i &size);
+
+	/* Drops everything drawn or measured with 'font' */
+	void invalidate(_TTF_Font *font);
+
+private:
+	TextCachePrivate *p;
+};
+
+#endif // TEXTCACHE_H
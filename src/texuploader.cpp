@@ -0,0 +1,321 @@
+/*
+** texuploader.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "texuploader.h"
+
+#include "gl-fun.h"
+#include "config.h"
+#include "sharedstate.h"
+#include "perfstats.h"
+#include "debugwriter.h"
+
+#include <deque>
+#include <string.h>
+#include <stdint.h>
+
+/* Size of the staging ring */
+#define RING_SIZE (16 << 20)
+
+/* Larger uploads would force waiting on most of the ring,
+ * so they go the direct route */
+#define MAX_STAGED (RING_SIZE / 2)
+
+/* For tiny uploads (eg. set_pixel), the extra
+ * mapping costs more than it saves */
+#define MIN_STAGED (4 << 10)
+
+/* Unpack offsets must be pixel aligned; keep
+ * them friendly to DMA engines too */
+#define UPLOAD_ALIGN 256
+
+struct InFlight
+{
+	_GLsync fence;
+	GLintptr start, end;
+};
+
+struct TexUploaderPrivate
+{
+	bool enabled;
+	bool fenced;
+
+	PBO::ID pbo;
+
+	/* Write position in the ring */
+	GLintptr head;
+
+	/* Oldest first */
+	std::deque<InFlight> inFlight;
+
+	TexUploaderPrivate(const Config &conf)
+	    : enabled(false),
+	      fenced(false),
+	      pbo(0),
+	      head(0)
+	{
+		if (!conf.asyncTexUploads)
+			return;
+
+		if (!gl.pixel_buffer || !gl.MapBufferRange || !gl.UnmapBuffer)
+		{
+			Debug() << "Pixel buffer objects unavailable, uploading textures directly";
+			return;
+		}
+
+		enabled = true;
+		fenced = (gl.FenceSync != 0);
+
+		pbo = PBO::gen();
+		PBO::bind(pbo);
+		PBO::allocEmpty(RING_SIZE, GL_STREAM_DRAW);
+		PBO::unbind();
+	}
+
+	~TexUploaderPrivate()
+	{
+		while (!inFlight.empty())
+			popFence();
+
+		if (enabled)
+			PBO::del(pbo);
+	}
+
+	bool canStage(GLsizeiptr size) const
+	{
+		return enabled && size >= MIN_STAGED && size <= MAX_STAGED;
+	}
+
+	void popFence()
+	{
+		gl.DeleteSync(inFlight.front().fence);
+		inFlight.pop_front();
+	}
+
+	/* Drops fences the GPU is already past */
+	void pollFences()
+	{
+		while (!inFlight.empty())
+		{
+			GLenum res = gl.ClientWaitSync(inFlight.front().fence, 0, 0);
+
+			if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+				break;
+
+			popFence();
+		}
+	}
+
+	/* Waits until the GPU no longer reads from [start, end).
+	 * After an early wrap, uploads of this lap can sit behind
+	 * older ones of the previous lap that don't overlap, so all
+	 * of them are checked. Fences signal in order, so waiting on
+	 * the newest overlapping one covers everything before it */
+	void waitRange(GLintptr start, GLintptr end)
+	{
+		size_t count = 0;
+
+		for (size_t i = 0; i < inFlight.size(); ++i)
+		{
+			const InFlight &f = inFlight[i];
+
+			if (f.end > start && f.start < end)
+				count = i + 1;
+		}
+
+		if (count == 0)
+			return;
+
+		GLenum res = gl.ClientWaitSync(inFlight[count-1].fence,
+		                               GL_SYNC_FLUSH_COMMANDS_BIT,
+		                               FENCE_TIMEOUT_NS);
+
+		if (res != GL_ALREADY_SIGNALED)
+			shState->perfStats().add(PerfStats::TexUploadStalls);
+
+		while (count--)
+			popFence();
+	}
+
+	/* Copies 'rows' rows of 'rowBytes' each, 'pitch' bytes
+	 * apart in 'src', into staging memory. On success, the
+	 * PBO is left bound for the texture upload to source
+	 * from 'offset', which must be followed by finish() */
+	bool stage(const uint8_t *src, size_t rowBytes, size_t pitch, int rows,
+	           GLintptr &offset)
+	{
+		const GLsizeiptr size = rowBytes * rows;
+
+		PBO::bind(pbo);
+
+		offset = (head + UPLOAD_ALIGN - 1) & ~(GLintptr) (UPLOAD_ALIGN - 1);
+
+		if (offset + size > RING_SIZE)
+		{
+			offset = 0;
+
+			/* Without fences, orphan the old storage; the
+			 * driver keeps it alive until the GPU is done */
+			if (!fenced)
+				PBO::allocEmpty(RING_SIZE, GL_STREAM_DRAW);
+		}
+
+		if (fenced)
+		{
+			pollFences();
+			waitRange(offset, offset + size);
+		}
+
+		/* Ranges are never rewritten while in flight,
+		 * so there is nothing for the driver to sync */
+		const GLbitfield access = GL_MAP_WRITE_BIT |
+		                          GL_MAP_INVALIDATE_RANGE_BIT |
+		                          GL_MAP_UNSYNCHRONIZED_BIT;
+
+		uint8_t *dst = (uint8_t*) gl.MapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+		                                            offset, size, access);
+
+		if (!dst)
+		{
+			PBO::unbind();
+			return false;
+		}
+
+		if (pitch == rowBytes)
+		{
+			memcpy(dst, src, size);
+		}
+		else
+		{
+			for (int i = 0; i < rows; ++i)
+				memcpy(dst + i * rowBytes, src + i * pitch, rowBytes);
+		}
+
+		head = offset + size;
+
+		/* Contents are undefined if this fails
+		 * (eg. on a mode switch), so don't use them */
+		if (!gl.UnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+		{
+			PBO::unbind();
+			return false;
+		}
+
+		return true;
+	}
+
+	void finish(GLintptr offset, GLsizeiptr size)
+	{
+		if (fenced)
+		{
+			InFlight f;
+			f.fence = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			f.start = offset;
+			f.end = offset + size;
+
+			inFlight.push_back(f);
+		}
+
+		PBO::unbind();
+
+		shState->perfStats().add(PerfStats::TexUploadStagedBytes, size);
+	}
+};
+
+TexUploader::TexUploader(const Config &conf)
+{
+	p = new TexUploaderPrivate(conf);
+}
+
+TexUploader::~TexUploader()
+{
+	delete p;
+}
+
+bool TexUploader::staging() const
+{
+	return p->enabled;
+}
+
+void TexUploader::image(GLsizei width, GLsizei height, const void *data, GLenum format)
+{
+	const size_t rowBytes = width * BYTES_PER_PIXEL;
+	const GLsizeiptr size = rowBytes * height;
+	GLintptr offset;
+
+	shState->perfStats().add(PerfStats::TexUploadBytes, size);
+
+	if (data && p->canStage(size) &&
+	    p->stage((const uint8_t*) data, rowBytes, rowBytes, height, offset))
+	{
+		TEX::uploadImage(width, height, (const void*) offset, format);
+		p->finish(offset, size);
+
+		return;
+	}
+
+	TEX::uploadImage(width, height, data, format);
+}
+
+void TexUploader::subImage(GLint x, GLint y, GLsizei width, GLsizei height,
+                           const void *data, GLenum format)
+{
+	const size_t rowBytes = width * BYTES_PER_PIXEL;
+	const GLsizeiptr size = rowBytes * height;
+	GLintptr offset;
+
+	shState->perfStats().add(PerfStats::TexUploadBytes, size);
+
+	if (p->canStage(size) &&
+	    p->stage((const uint8_t*) data, rowBytes, rowBytes, height, offset))
+	{
+		TEX::uploadSubImage(x, y, width, height, (const void*) offset, format);
+		p->finish(offset, size);
+
+		return;
+	}
+
+	TEX::uploadSubImage(x, y, width, height, data, format);
+}
+
+bool TexUploader::subRect(GLint srcW, GLint srcX, GLint srcY,
+                          GLint dstX, GLint dstY, GLsizei width, GLsizei height,
+                          const void *data, GLenum format)
+{
+	const size_t rowBytes = width * BYTES_PER_PIXEL;
+	const size_t pitch = srcW * BYTES_PER_PIXEL;
+	const GLsizeiptr size = rowBytes * height;
+	GLintptr offset;
+
+	if (!p->canStage(size))
+		return false;
+
+	const uint8_t *src = (const uint8_t*) data + srcY * pitch + srcX * BYTES_PER_PIXEL;
+
+	if (!p->stage(src, rowBytes, pitch, height, offset))
+		return false;
+
+	TEX::uploadSubImage(dstX, dstY, width, height, (const void*) offset, format);
+	p->finish(offset, size);
+
+	shState->perfStats().add(PerfStats::TexUploadBytes, size);
+
+	return true;
+}
@@ -0,0 +1,74 @@
+/*
+** texuploader.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXUPLOADER_H
+#define TEXUPLOADER_H
+
+#include "gl-util.h"
+
+struct TexUploaderPrivate;
+struct Config;
+
+/* Uploads client memory pixels into the currently bound
+ * texture. Where possible, the pixels are first copied into
+ * a staging pixel buffer object, so the texture upload itself
+ * is carried out by the GPU asynchronously instead of the
+ * driver copying the data before the call returns.
+ *
+ * Staging memory is one ring shared by all uploads. With
+ * ARB_sync, every upload is fenced and its range is only
+ * reused once the GPU is done reading it; without, the ring
+ * orphans its storage when wrapping around. On GL versions
+ * without pixel buffer objects or buffer mapping (and for
+ * tiny or huge uploads), the pixels go straight to
+ * glTex(Sub)Image2D like before.
+ *
+ * All pixel data is expected to be 4 bytes per pixel */
+class TexUploader
+{
+public:
+	TexUploader(const Config &conf);
+	~TexUploader();
+
+	/* Whether staging buffers are in use at all */
+	bool staging() const;
+
+	/* Equivalent to TEX::uploadImage() */
+	void image(GLsizei width, GLsizei height, const void *data, GLenum format);
+
+	/* Equivalent to TEX::uploadSubImage() */
+	void subImage(GLint x, GLint y, GLsizei width, GLsizei height,
+	              const void *data, GLenum format);
+
+	/* Uploads the (srcX, srcY, width, height) rectangle out of
+	 * pixel rows that are 'srcW' pixels wide. The rows are
+	 * packed while staging, so this doesn't need
+	 * EXT_unpack_subimage. Returns false if the upload
+	 * can't be staged, in which case nothing is done */
+	bool subRect(GLint srcW, GLint srcX, GLint srcY,
+	             GLint dstX, GLint dstY, GLsizei width, GLsizei height,
+	             const void *data, GLenum format);
+
+private:
+	TexUploaderPrivate *p;
+};
+
+#endif // TEXUPLOADER_H
@@ -0,0 +1,194 @@
+/*
+** tileatlascache.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tileatlascache.h"
+
+#include "config.h"
+#include "bitmap.h"
+#include "sharedstate.h"
+#include "perfstats.h"
+#include "lru-cache.h"
+
+TileAtlasCache::Key::Key(Layout layout)
+    : layout(layout)
+{}
+
+void TileAtlasCache::Key::add(Bitmap *bitmap)
+{
+	stamps.push_back(nullOrDisposed(bitmap) ? 0 : bitmap->contentStamp());
+}
+
+bool TileAtlasCache::Key::operator==(const Key &o) const
+{
+	return layout == o.layout && stamps == o.stamps;
+}
+
+static size_t hash_value(const TileAtlasCache::Key &key)
+{
+	size_t seed = 0;
+	boost::hash_combine(seed, (int) key.layout);
+	boost::hash_range(seed, key.stamps.begin(), key.stamps.end());
+
+	return seed;
+}
+
+struct TileAtlasCachePrivate
+{
+	struct Entry
+	{
+		TEXFBO tex;
+
+		/* Tilemaps currently drawing with this atlas;
+		 * only unused entries can be dropped */
+		int users;
+	};
+
+	typedef LruCache<TileAtlasCache::Key, Entry> AtlasCache;
+
+	AtlasCache atlases;
+
+	const size_t budget;
+
+	/* Texture of the last dropped entry */
+	TEXFBO spare;
+
+	TileAtlasCachePrivate(const Config &conf)
+	    : budget((size_t) conf.tileAtlasCacheSize << 20)
+	{}
+
+	~TileAtlasCachePrivate()
+	{
+		AtlasCache::const_iterator iter;
+		for (iter = atlases.begin(); iter != atlases.end(); ++iter)
+			TEXFBO::fini(atlases[*iter].tex);
+
+		TEXFBO::fini(spare);
+	}
+
+	static size_t texBytes(const TEXFBO &tex)
+	{
+		return (size_t) tex.width * tex.height * 4;
+	}
+
+	void remove(const TileAtlasCache::Key &key)
+	{
+		TEXFBO::fini(spare);
+		spare = atlases.remove(key).tex;
+	}
+
+	/* Drops unused entries until we're within budget */
+	void trim()
+	{
+		AtlasCache::const_iterator iter = atlases.end();
+
+		while (atlases.bytes() > budget && iter != atlases.begin())
+		{
+			AtlasCache::const_iterator victim = --iter;
+
+			if (atlases[*victim].users > 0)
+				continue;
+
+			/* Step past it, so 'iter' survives the removal */
+			++iter;
+			remove(*victim);
+		}
+
+		updateStats();
+	}
+
+	void updateStats()
+	{
+		shState->perfStats().set(PerfStats::TileAtlasCacheBytes, atlases.bytes());
+	}
+};
+
+TileAtlasCache::TileAtlasCache(const Config &conf)
+{
+	p = new TileAtlasCachePrivate(conf);
+}
+
+TileAtlasCache::~TileAtlasCache()
+{
+	delete p;
+}
+
+bool TileAtlasCache::acquire(const Key &key, int w, int h, TEXFBO &out)
+{
+	if (p->atlases.contains(key))
+	{
+		TileAtlasCachePrivate::Entry &entry = p->atlases.touch(key);
+		++entry.users;
+
+		shState->perfStats().add(PerfStats::TileAtlasCacheHits);
+
+		out = entry.tex;
+
+		return true;
+	}
+
+	shState->perfStats().add(PerfStats::TileAtlasCacheMisses);
+
+	TileAtlasCachePrivate::Entry entry;
+
+	if (w == p->spare.width && h == p->spare.height)
+	{
+		entry.tex = p->spare;
+		p->spare = TEXFBO();
+	}
+	else
+	{
+		TEXFBO::init(entry.tex);
+		TEXFBO::allocEmpty(entry.tex, w, h);
+		TEXFBO::linkFBO(entry.tex);
+	}
+
+	entry.users = 1;
+
+	p->atlases.insert(key, entry, TileAtlasCachePrivate::texBytes(entry.tex));
+
+	p->trim();
+
+	out = entry.tex;
+
+	return false;
+}
+
+void TileAtlasCache::release(const Key &key)
+{
+	if (!p->atlases.contains(key))
+		return;
+
+	if (--p->atlases[key].users == 0)
+		p->trim();
+}
+
+bool TileAtlasCache::rekey(const Key &oldKey, const Key &newKey)
+{
+	if (!p->atlases.contains(oldKey) || p->atlases.contains(newKey))
+		return false;
+
+	if (p->atlases[oldKey].users != 1)
+		return false;
+
+	p->atlases.rekey(oldKey, newKey);
+
+	return true;
+}
@@ -0,0 +1,88 @@
+/*
+** tileatlascache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILEATLASCACHE_H
+#define TILEATLASCACHE_H
+
+#include "gl-util.h"
+
+#include <vector>
+
+class Bitmap;
+struct Config;
+struct TileAtlasCachePrivate;
+
+/* Keeps the atlases assembled by tilemaps alive after their
+ * last user lets go of them, so a tilemap set up with the same
+ * tileset and autotiles again (eg. after a map transfer) can
+ * skip the blitting entirely. Atlases are identified by the
+ * content stamps of the bitmaps they were built from, so any
+ * modification to those makes the old atlas unreachable.
+ * Unused atlases are dropped, least recently used first, once
+ * the configured video memory budget is exceeded; the last
+ * one dropped is held on to as a blank texture to build the
+ * next atlas of the same size in */
+class TileAtlasCache
+{
+public:
+	enum Layout
+	{
+		XP,
+		VX
+	};
+
+	struct Key
+	{
+		Layout layout;
+
+		/* Null or disposed bitmaps are stored as 0 */
+		std::vector<unsigned int> stamps;
+
+		Key(Layout layout = XP);
+
+		/* Bitmaps have to be added in atlas order */
+		void add(Bitmap *bitmap);
+
+		bool operator==(const Key &o) const;
+		bool operator!=(const Key &o) const { return !(*this == o); }
+	};
+
+	TileAtlasCache(const Config &conf);
+	~TileAtlasCache();
+
+	/* Hands out the 'w' x 'h' atlas for 'key', allocating it if
+	 * needed. Returns true if its contents are ready to use,
+	 * false if the caller has to build them. Every acquire()
+	 * has to be paired with a release() of the same key */
+	bool acquire(const Key &key, int w, int h, TEXFBO &out);
+	void release(const Key &key);
+
+	/* Moves the atlas of 'oldKey' to 'newKey', so the caller can
+	 * update it in place instead of building a new one. Only
+	 * succeeds if the caller is its only user, and no atlas for
+	 * 'newKey' exists yet */
+	bool rekey(const Key &oldKey, const Key &newKey);
+
+private:
+	TileAtlasCachePrivate *p;
+};
+
+#endif // TILEATLASCACHE_H
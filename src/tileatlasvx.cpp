@@ -30,6 +30,7 @@
 #include "sharedstate.h"
 #include "glstate.h"
 #include "texpool.h"
+#include "texuploader.h"
 #include "util.h"
 
 #include <assert.h>
@@ -187,6 +188,26 @@ static elementsN(blitsC);
 static elementsN(blitsD);
 static elementsN(blitsE);
 
+struct PartBlits
+{
+	const Blit *blits;
+	size_t n;
+};
+
+/* Indexed by bitmap */
+static const PartBlits partBlits[BM_COUNT] =
+{
+	{ blitsA1, blitsA1N },
+	{ blitsA2, blitsA2N },
+	{ blitsA3, blitsA3N },
+	{ blitsA4, blitsA4N },
+	{ blitsA5, blitsA5N },
+	{ blitsB,  blitsBN  },
+	{ blitsC,  blitsCN  },
+	{ blitsD,  blitsDN  },
+	{ blitsE,  blitsEN  }
+};
+
 /* 'Waterfall' autotiles atlas origin */
 static const Vec2i AEPartsDst[] =
 {
@@ -256,6 +277,16 @@ createShadowSet()
 	return surf;
 }
 
+static SDL_Surface *
+shadowSet()
+{
+	/* Never changes, so it's only assembled once
+	 * (and kept until exit) */
+	static SDL_Surface *surf = createShadowSet();
+
+	return surf;
+}
+
 static void doBlit(Bitmap *bm, const IntRect &src, const Vec2i &dst)
 {
 	/* Translate tile to pixel units */
@@ -266,7 +297,15 @@ static void doBlit(Bitmap *bm, const IntRect &src, const Vec2i &dst)
 	if (!SDL_IntersectRect(&_src, &bmr, &_src))
 		return;
 
-	GLMeta::blitRectangle(_src, _dst);
+	bm->blitTo(_src, _dst);
+}
+
+static void blitPart(Bitmap *bm, int part)
+{
+	const PartBlits &pb = partBlits[part];
+
+	for (size_t i = 0; i < pb.n; ++i)
+		doBlit(bm, pb.blits[i].src, pb.blits[i].dst);
 }
 
 void build(TEXFBO &tf, Bitmap *bitmaps[BM_COUNT])
@@ -281,37 +320,47 @@ void build(TEXFBO &tf, Bitmap *bitmaps[BM_COUNT])
 
 	if (rgssVer >= 3)
 	{
-		SDL_Surface *shadow = createShadowSet();
+		SDL_Surface *shadow = shadowSet();
 		TEX::bind(tf.tex);
-		TEX::uploadSubImage(shadowArea.x*32, shadowArea.y*32,
-							shadow->w, shadow->h, shadow->pixels, GL_RGBA);
-		SDL_FreeSurface(shadow);
+		shState->texUploader().subImage(shadowArea.x*32, shadowArea.y*32,
+		                                shadow->w, shadow->h, shadow->pixels, GL_RGBA);
 	}
 
-	Bitmap *bm;
-#define EXEC_BLITS(part) \
-	if (!nullOrDisposed(bm = bitmaps[BM_##part])) \
-	{ \
-		GLMeta::blitSource(bm->getGLTypes(), 1); \
-		for (size_t i = 0; i < blits##part##N; ++i) \
-		{\
-			const IntRect &src = blits##part[i].src; \
-			const Vec2i &dst = blits##part[i].dst; \
-			doBlit(bm, src, dst); \
-		} \
+	for (int i = 0; i < BM_COUNT; ++i)
+		if (!nullOrDisposed(bitmaps[i]))
+			blitPart(bitmaps[i], i);
+
+	GLMeta::blitEnd();
+}
+
+void rebuildPart(TEXFBO &tf, Bitmap *bitmap, int part)
+{
+	assert(tf.width == ATLASVX_W && tf.height == ATLASVX_H);
+
+	const PartBlits &pb = partBlits[part];
+
+	GLMeta::blitBegin(tf);
+
+	/* Clear the full destination areas, as the
+	 * previous bitmap might have been larger */
+	glState.clearColor.pushSet(Vec4());
+	glState.scissorTest.pushSet(true);
+
+	for (size_t i = 0; i < pb.n; ++i)
+	{
+		const Blit &blit = pb.blits[i];
+
+		glState.scissorBox.pushSet(IntRect(blit.dst.x*32, blit.dst.y*32,
+		                                   blit.src.w*32, blit.src.h*32));
+		FBO::clear();
+		glState.scissorBox.pop();
 	}
 
-	EXEC_BLITS(A1);
-	EXEC_BLITS(A2);
-	EXEC_BLITS(A3);
-	EXEC_BLITS(A4);
-	EXEC_BLITS(A5);
-	EXEC_BLITS(B);
-	EXEC_BLITS(C);
-	EXEC_BLITS(D);
-	EXEC_BLITS(E);
+	glState.scissorTest.pop();
+	glState.clearColor.pop();
 
-#undef EXEC_BLITS
+	if (!nullOrDisposed(bitmap))
+		blitPart(bitmap, part);
 
 	GLMeta::blitEnd();
 }
@@ -603,27 +652,6 @@ onTile(Reader &reader, int16_t tileID,
 	}
 }
 
-static void
-readLayer(Reader &reader, const Table &data,
-          const Table *flags, int ox, int oy, int w, int h, int z)
-{
-	/* The table autotile pattern (A2) has two quads (table
-	 * legs, etc.) which extend over the tile below. We process
-	 * the tiles in rows from bottom to top so the table extents
-	 * are added after the tile below and drawn over it. */
-
-	for (int y = h-1; y >= 0; --y)
-		for (int x = 0; x < w; ++x)
-		{
-			int16_t tileID = tableGetWrapped(data, x+ox, y+oy, z);
-
-			if (tileID <= 0)
-				continue;
-
-			onTile(reader, tileID, x, y, flags);
-		}
-}
-
 static void
 onShadowTile(Reader &reader, int8_t value,
              int x, int y)
@@ -639,28 +667,28 @@ onShadowTile(Reader &reader, int8_t value,
 	reader.onQuads(&tex, &pos, 1, false);
 }
 
-static void
-readShadowLayer(Reader &reader, const Table &data,
-                int ox, int oy, int w, int h)
+void readCell(Reader &reader, const Table &data,
+              const Table *flags, int x, int y, int pass)
 {
-	for (int y = 0; y < h; ++y)
-		for (int x = 0; x < w; ++x)
+	if (pass == PASS_SHADOW)
+	{
+		if (rgssVer >= 3)
 		{
-			int16_t value = tableGetWrapped(data, x+ox, y+oy, 3);
-			onShadowTile(reader, value & 0xF, x, y);
+			int16_t value = tableGetWrapped(data, x, y, 3);
+			onShadowTile(reader, value & 0xF, 0, 0);
 		}
-}
 
-void readTiles(Reader &reader, const Table &data,
-               const Table *flags, int ox, int oy, int w, int h)
-{
-	for (int i = 0; i < 2; ++i)
-		readLayer(reader, data, flags, ox, oy, w, h, i);
+		return;
+	}
 
-	if (rgssVer >= 3)
-		readShadowLayer(reader, data, ox, oy, w, h);
+	/* Layer 2 is read after the shadows */
+	int z = (pass == PASS_LAYER2) ? 2 : pass;
+	int16_t tileID = tableGetWrapped(data, x, y, z);
+
+	if (tileID <= 0)
+		return;
 
-	readLayer(reader, data, flags, ox, oy, w, h, 2);
+	onTile(reader, tileID, 0, 0, flags);
 }
 
 }
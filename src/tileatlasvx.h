@@ -48,6 +48,17 @@ enum
 	BM_COUNT
 };
 
+/* Read passes of a map cell, in draw order */
+enum
+{
+	PASS_LAYER0 = 0,
+	PASS_LAYER1 = 1,
+	PASS_SHADOW = 2,
+	PASS_LAYER2 = 3,
+
+	PASS_COUNT
+};
+
 namespace TileAtlasVX
 {
 struct Reader
@@ -58,8 +69,14 @@ struct Reader
 
 void build(TEXFBO &tf, Bitmap *bitmaps[BM_COUNT]);
 
-void readTiles(Reader &reader, const Table &data,
-               const Table *flags, int ox, int oy, int w, int h);
+/* Redoes the areas of an atlas made by build()
+ * that hold bitmap 'part' (BM_*) */
+void rebuildPart(TEXFBO &tf, Bitmap *bitmap, int part);
+
+/* Reads one pass of map cell (x, y), which wraps around
+ * the map edges. Quads are positioned relative to the cell */
+void readCell(Reader &reader, const Table &data,
+              const Table *flags, int x, int y, int pass);
 }
 
 #endif // TILEATLASVX_H
@@ -31,10 +31,12 @@
 #include "shader.h"
 #include "vertex.h"
 #include "quad.h"
+#include "scene.h"
 #include "etc-internal.h"
 
 #include <stdint.h>
 #include <assert.h>
+#include <algorithm>
 #include <vector>
 
 #include <sigc++/connection.h>
@@ -61,6 +63,36 @@ tableGetWrapped(const Table &t, int x, int y, int z = 0)
 	             z);
 }
 
+/* Whether tile x/y of a map wrapping around
+ * table 't' lies in 'rect' (in table coordinates) */
+static inline bool
+wrappedTileIn(const IntRect &rect, const Table &t, int x, int y)
+{
+	x = wrap(x, t.xSize());
+	y = wrap(y, t.ySize());
+
+	return (x >= rect.x && x < rect.x + rect.w &&
+	        y >= rect.y && y < rect.y + rect.h);
+}
+
+/* Bounding box of two rects, ignoring empty ones */
+static inline IntRect
+rectUnion(const IntRect &a, const IntRect &b)
+{
+	if (a.w <= 0 || a.h <= 0)
+		return b;
+
+	if (b.w <= 0 || b.h <= 0)
+		return a;
+
+	const int x1 = std::min(a.x, b.x);
+	const int y1 = std::min(a.y, b.y);
+	const int x2 = std::max(a.x + a.w, b.x + b.w);
+	const int y2 = std::max(a.y + a.h, b.y + b.h);
+
+	return IntRect(x1, y1, x2 - x1, y2 - y1);
+}
+
 /* Calculate the tile x/y on which this pixel x/y lies */
 static inline Vec2i
 getTilePos(const Vec2i &pixelPos)
@@ -115,7 +147,8 @@ struct FlashMap
 	FlashMap()
 		: dirty(false),
 	      data(0),
-	      allocQuads(0)
+	      allocQuads(0),
+	      liveQuads(0)
 	{
 		vao.vbo = VBO::gen();
 		vao.ibo = shState->globalIBO().ibo;
@@ -143,28 +176,43 @@ struct FlashMap
 
 		data = value;
 		dataCon.disconnect();
-		dirty = true;
+		setDirty();
 
 		if (!data)
 			return;
 
 		dataCon = data->modified.connect
-			(sigc::mem_fun(this, &FlashMap::setDirty));
+			(sigc::mem_fun(this, &FlashMap::onDataModified));
 	}
 
 	void setViewport(const IntRect &value)
 	{
 		viewp = value;
-		dirty = true;
+		setDirty();
+	}
+
+	/* Whether there are any flashing tiles to animate */
+	bool isActive() const
+	{
+		return data && (dirty || liveQuads > 0);
 	}
 
 	void prepare()
 	{
-		if (!dirty)
-			return;
+		if (data)
+			data->flushModified();
+
+		if (dirty)
+		{
+			rebuildBuffer();
+			dirty = false;
+		}
+		else if (modifiedRect.w > 0)
+		{
+			patchBuffer();
+		}
 
-		rebuildBuffer();
-		dirty = false;
+		modifiedRect = IntRect();
 	}
 
 	void draw(float alpha, const Vec2i &trans)
@@ -177,7 +225,7 @@ struct FlashMap
 		GLMeta::vaoBind(vao);
 		glState.blendMode.pushSet(BlendAddition);
 
-		FlashMapShader &shader = shState->shaders().flashMap;
+		FlashMapShader &shader = shState->shaders().flashMap();
 		shader.bind();
 		shader.applyViewportProj();
 		shader.setAlpha(alpha);
@@ -194,6 +242,13 @@ private:
 	void setDirty()
 	{
 		dirty = true;
+		Scene::markDirty();
+	}
+
+	void onDataModified(const IntRect &rect)
+	{
+		modifiedRect = rectUnion(modifiedRect, rect);
+		Scene::markDirty();
 	}
 
 	size_t quadCount() const
@@ -219,9 +274,20 @@ private:
 		return true;
 	}
 
+	void setQuad(size_t quad, int x, int y, const Vec4 &color)
+	{
+		FloatRect posRect(x*32, y*32, 32, 32);
+
+		Quad::setPosRect(&vertices[quad*4], posRect);
+		Quad::setColor(&vertices[quad*4], color);
+	}
+
 	void rebuildBuffer()
 	{
 		vertices.clear();
+		freeQuads.clear();
+		cellQuads.assign(viewp.w * viewp.h, -1);
+		liveQuads = 0;
 
 		if (!data)
 			return;
@@ -234,16 +300,13 @@ private:
 				if (!sampleFlashColor(color, x+viewp.x, y+viewp.y))
 					continue;
 
-				FloatRect posRect(x*32, y*32, 32, 32);
-
-				CVertex v[4];
-				Quad::setPosRect(v, posRect);
-				Quad::setColor(v, color);
-
-				for (size_t i = 0; i < 4; ++i)
-					vertices.push_back(v[i]);
+				cellQuads[y*viewp.w + x] = quadCount();
+				vertices.resize(vertices.size() + 4);
+				setQuad(quadCount() - 1, x, y, color);
 			}
 
+		liveQuads = quadCount();
+
 		if (vertices.size() == 0)
 			return;
 
@@ -263,16 +326,89 @@ private:
 		shState->ensureQuadIBO(quadCount());
 	}
 
+	/* Rewrites the quads of modified cells in place. Cleared
+	 * cells leave degenerate holes which new ones fill up */
+	void patchBuffer()
+	{
+		size_t first = quadCount();
+		size_t last = 0;
+
+		for (int y = 0; y < viewp.h; ++y)
+			for (int x = 0; x < viewp.w; ++x)
+			{
+				if (!wrappedTileIn(modifiedRect, *data, x+viewp.x, y+viewp.y))
+					continue;
+
+				Vec4 color;
+				bool flashing = sampleFlashColor(color, x+viewp.x, y+viewp.y);
+				int &quad = cellQuads[y*viewp.w + x];
+
+				if (!flashing && quad < 0)
+					continue;
+
+				if (!flashing)
+				{
+					CVertex hole[4];
+					std::copy(hole, hole+4, &vertices[quad*4]);
+
+					freeQuads.push_back(quad);
+					--liveQuads;
+				}
+				else if (quad >= 0)
+				{
+					setQuad(quad, x, y, color);
+				}
+				else
+				{
+					/* Out of room, start over */
+					if (freeQuads.empty())
+					{
+						rebuildBuffer();
+						return;
+					}
+
+					quad = freeQuads.back();
+					freeQuads.pop_back();
+					++liveQuads;
+
+					setQuad(quad, x, y, color);
+				}
+
+				first = std::min(first, (size_t) quad);
+				last = std::max(last, (size_t) quad + 1);
+
+				if (!flashing)
+					quad = -1;
+			}
+
+		if (first >= last)
+			return;
+
+		VBO::bind(vao.vbo);
+		VBO::uploadSubData(sizeof(CVertex) * first * 4,
+		                   sizeof(CVertex) * (last - first) * 4, &vertices[first*4]);
+		VBO::unbind();
+	}
+
 	bool dirty;
 
 	Table *data;
 	sigc::connection dataCon;
 
+	/* Cells of 'data' modified since the last prepare */
+	IntRect modifiedRect;
+
 	IntRect viewp;
 
 	GLMeta::VAO vao;
 	size_t allocQuads;
 	std::vector<CVertex> vertices;
+
+	/* Quad of each viewport cell (-1 if not flashing),
+	 * and the quads left over by cleared cells */
+	std::vector<int> cellQuads;
+	std::vector<int> freeQuads;
+	size_t liveQuads;
 };
 
 #endif // TILEMAPCOMMON_H
@@ -38,6 +38,8 @@
 #include "vertex.h"
 #include "tileatlas.h"
 #include "tilemap-common.h"
+#include "tileatlascache.h"
+#include "perfstats.h"
 
 #include <sigc++/connection.h>
 
@@ -63,11 +65,12 @@ static const int atAreaH = autotileH * autotileCount;
 
 static const int tsLaneW = tilesetW / 2;
 
-/* Map viewport size */
-static const int viewpW = 21;
-static const int viewpH = 16;
+/* Map chunk size (in tiles) */
+static const int chunkSize = 16;
 
-static const size_t zlayersMax = viewpH + 5;
+/* Tiles of priority up to 5 reach this many
+ * zlayers past the top row of their chunk */
+static const int chunkLayers = chunkSize + 5;
 
 /* Vocabulary:
  *
@@ -76,7 +79,9 @@ static const size_t zlayersMax = viewpH + 5;
  *   be drawn from one texture (for performance reasons).
  *   This means that we have to watch the 'modified' signals
  *   of all Bitmaps that make up the atlas, and update it
- *   as required during runtime.
+ *   as required during runtime. Finished atlases are shared
+ *   through the TileAtlasCache, and a change to autotiles only
+ *   redoes their area of the atlas.
  *   The atlas is tightly packed, with the autotiles located
  *   in the top left corener and the tileset image filing the
  *   remaining open space (below the autotiles as well as
@@ -145,12 +150,22 @@ static const size_t zlayersMax = viewpH + 5;
  *   (lowest z) to the bottom part (highest z).
  *   Objects that would end up on the same zlayer are eg. trees.
  *
+ * Chunks:
+ *   The map is cut into blocks of chunkSize x chunkSize tiles,
+ *   each of which keeps its ground and zlayer vertices in its
+ *   own GPU buffer. A chunk is built the first time it becomes
+ *   visible and then kept until the map data, the priorities
+ *   or the atlas size change. Zlayers are stored per chunk in
+ *   row order, so a range of zlayers is always one draw call
+ *   per chunk.
+ *
  * Map viewport:
- *   This rectangle describes the subregion of the map that is
- *   actually translated to vertices and stored on the GPU ready
- *   for rendering. Whenever, ox/oy are modified, its position is
- *   adjusted if necessary and the data is regenerated. Its size
- *   is fixed. This is NOT related to the RGSS Viewport class!
+ *   This rectangle describes the subregion of the map (in tiles)
+ *   that is currently visible. Whenever ox/oy or the scene size
+ *   are modified, its position and size are adjusted, and the
+ *   chunks covering it are collected for drawing. As the map
+ *   wraps around, the same chunk can be drawn at multiple
+ *   positions. This is NOT related to the RGSS Viewport class!
  *
  */
 
@@ -178,17 +193,99 @@ static const uint8_t flashAlpha[] =
 
 static elementsN(flashAlpha);
 
+struct TileChunk
+{
+	GLMeta::VAO vao;
+	VBO::ID vbo;
+	size_t allocQuads;
+
+	/* Base quad indices in the chunk buffer. Layer 0 holds
+	 * the ground tiles, layer n+1 holds zlayer n */
+	size_t bases[chunkLayers+2];
+
+	TileChunk()
+	    : vbo(0),
+	      allocQuads(0)
+	{
+		memset(bases, 0, sizeof(bases));
+	}
+
+	~TileChunk()
+	{
+		if (!vbo)
+			return;
+
+		GLMeta::vaoFini(vao);
+		VBO::del(vbo);
+	}
+
+	size_t quadCount() const
+	{
+		return bases[chunkLayers+1];
+	}
+
+	size_t groundSize() const
+	{
+		return bases[1];
+	}
+
+	size_t zlayerSize(int layer) const
+	{
+		if (layer < 0 || layer >= chunkLayers)
+			return 0;
+
+		return bases[layer+2] - bases[layer+1];
+	}
+
+	/* Draws layers [first, last) in one call */
+	void draw(int first, int last) const
+	{
+		GLsizei count = (bases[last] - bases[first]) * 6;
+		GLintptr offset = bases[first] * sizeof(index_t) * 6;
+
+		gl.DrawElements(GL_TRIANGLES, count, _GL_INDEX_TYPE, (GLvoid*) offset);
+	}
+};
+
+/* A chunk placed at one position of the map viewport */
+struct ChunkInstance
+{
+	TileChunk *chunk;
+
+	/* Unwrapped map position of the chunk's top left tile */
+	Vec2i pos;
+};
+
+/* Collects the chunks covering tiles [start, start+length) of
+ * a wrapping map axis 'mapSize' tiles long, as pairs of
+ * (chunk index, unwrapped tile position of the chunk) */
+static void chunkSpans(int start, int length, int mapSize,
+                       std::vector<Vec2i> &spans)
+{
+	spans.clear();
+
+	if (mapSize <= 0)
+		return;
+
+	const int end = start + length;
+
+	for (int t = start; t < end;)
+	{
+		int index = wrap(t, mapSize) / chunkSize;
+		int pos = t - wrap(t, mapSize) + index * chunkSize;
+
+		spans.push_back(Vec2i(index, pos));
+		t = pos + std::min(chunkSize, mapSize - index * chunkSize);
+	}
+}
+
 struct GroundLayer : public ViewportElement
 {
-	GLsizei vboCount;
 	TilemapPrivate *p;
 
 	GroundLayer(TilemapPrivate *p, Viewport *viewport);
 
-	void updateVboCount();
-
 	void draw();
-	void drawInt();
 
 	void onGeometryChange(const Scene::Geometry &geo);
 
@@ -197,9 +294,8 @@ struct GroundLayer : public ViewportElement
 
 struct ZLayer : public ViewportElement
 {
-	size_t index;
-	GLintptr vboOffset;
-	GLsizei vboCount;
+	/* Unwrapped map row of this zlayer */
+	int index;
 	TilemapPrivate *p;
 
 	/* If this layer is part of a batch and not
@@ -207,20 +303,19 @@ struct ZLayer : public ViewportElement
 	bool batchedFlag;
 
 	/* If this layer is a batch head, this variable
-	 * holds the element count of the entire batch */
-	GLsizei vboBatchCount;
+	 * holds the row after the last layer of the batch */
+	int batchEnd;
 
 	ZLayer(TilemapPrivate *p, Viewport *viewport);
 
 	void setIndex(int value);
 
 	void draw();
-	void drawInt();
 
 	static int calculateZ(TilemapPrivate *p, int index);
 
 	void initUpdateZ();
-	void finiUpdateZ(ZLayer *prev);
+	void finiUpdateZ();
 
 	ABOUT_TO_ACCESS_NOOP
 };
@@ -244,6 +339,11 @@ struct TilemapPrivate
 	struct {
 		TEXFBO gl;
 
+		/* What 'gl' was built from; only
+		 * valid while 'gl' is held */
+		TileAtlasCache::Key key;
+		Bitmap *autotiles[autotileCount];
+
 		Vec2i size;
 
 		/* Effective tileset height,
@@ -256,26 +356,39 @@ struct TilemapPrivate
 
 		/* Indices of animated autotiles */
 		std::vector<uint8_t> animatedATs;
+
+		/* Static autotiles were laid out
+		 * for animation (ie. 4 times) */
+		bool animated;
 	} atlas;
 
-	/* Map viewport position */
+	/* Map viewport position and size */
 	Vec2i viewpPos;
+	Vec2i viewpSize;
 
-	/* Ground layer vertices */
+	/* Ground layer vertices of the chunk being built */
 	SVVector groundVert;
 
-	/* ZLayer vertices */
-	SVVector zlayerVert[zlayersMax];
+	/* ZLayer vertices of the chunk being built */
+	SVVector zlayerVert[chunkLayers];
+
+	/* Cached map geometry */
+	struct
+	{
+		/* Row major, null until first visible */
+		std::vector<TileChunk*> data;
+		Vec2i count;
+
+		/* Map size the chunks were cut for */
+		int mapW, mapH, mapD;
 
-	/* Base quad indices of each zlayer
-	 * in the shared buffer */
-	size_t zlayerBases[zlayersMax+1];
+		/* Chunks covering the map viewport */
+		std::vector<ChunkInstance> visible;
+		size_t groundQuads;
+	} chunks;
 
-	/* Shared buffers for all tiles */
 	struct
 	{
-		GLMeta::VAO vao;
-		VBO::ID vbo;
 		bool animated;
 
 		/* Animation state */
@@ -290,20 +403,22 @@ struct TilemapPrivate
 	struct
 	{
 		GroundLayer *ground;
-		ZLayer* zlayers[zlayersMax];
+		std::vector<ZLayer*> zlayers;
 		/* Used layers out of 'zlayers' (rest is hidden) */
 		size_t activeLayers;
 		Scene::Geometry sceneGeo;
 	} elem;
 
-	/* Affected by: autotiles, tileset */
-	bool atlasSizeDirty;
-	/* Affected by: autotiles(.changed), tileset(.changed), allocateAtlas */
+	/* Affected by: autotiles(.changed, .disposed), tileset(.changed) */
 	bool atlasDirty;
-	/* Affected by: mapData(.changed), priorities(.changed) */
+	/* Affected by: mapData, priorities(.changed) */
 	bool buffersDirty;
-	/* Affected by: ox, oy */
+	/* Affected by: mapData(.changed), holds the modified cells */
+	IntRect modifiedCells;
+	/* Affected by: ox, oy, scene geometry */
 	bool mapViewportDirty;
+	/* Affected by: mapViewport, buffers */
+	bool visibleChunksDirty;
 	/* Affected by: oy */
 	bool zOrderDirty;
 
@@ -329,35 +444,29 @@ struct TilemapPrivate
 	      priorities(0),
 	      visible(true),
 	      flashAlphaIdx(0),
-	      atlasSizeDirty(false),
 	      atlasDirty(false),
 	      buffersDirty(false),
 	      mapViewportDirty(false),
+	      visibleChunksDirty(false),
 	      zOrderDirty(false),
 	      tilemapReady(false)
 	{
 		memset(autotiles, 0, sizeof(autotiles));
+		memset(atlas.autotiles, 0, sizeof(atlas.autotiles));
 
 		atlas.animatedATs.reserve(autotileCount);
 		atlas.efTilesetH = 0;
+		atlas.animated = false;
 
 		tiles.animated = false;
 		tiles.frameIdx = 0;
 		tiles.aniIdx = 0;
 
-		/* Init tile buffers */
-		tiles.vbo = VBO::gen();
-
-		GLMeta::vaoFillInVertexData<SVertex>(tiles.vao);
-		tiles.vao.vbo = tiles.vbo;
-		tiles.vao.ibo = shState->globalIBO().ibo;
-
-		GLMeta::vaoInit(tiles.vao);
+		chunks.mapW = chunks.mapH = chunks.mapD = 0;
+		chunks.groundQuads = 0;
 
 		elem.ground = new GroundLayer(this, viewport);
-
-		for (size_t i = 0; i < zlayersMax; ++i)
-			elem.zlayers[i] = new ZLayer(this, viewport);
+		elem.activeLayers = 0;
 
 		prepareCon = shState->prepareDraw.connect
 		        (sigc::mem_fun(this, &TilemapPrivate::prepare));
@@ -369,14 +478,14 @@ struct TilemapPrivate
 	{
 		/* Destroy elements */
 		delete elem.ground;
-		for (size_t i = 0; i < zlayersMax; ++i)
+		for (size_t i = 0; i < elem.zlayers.size(); ++i)
 			delete elem.zlayers[i];
 
-		shState->releaseAtlasTex(atlas.gl);
+		if (atlas.gl.tex != TEX::ID(0))
+			shState->tileAtlasCache().release(atlas.key);
 
 		/* Destroy tile buffers */
-		GLMeta::vaoFini(tiles.vao);
-		VBO::del(tiles.vbo);
+		clearChunks();
 
 		/* Disconnect signal handlers */
 		tilesetCon.disconnect();
@@ -393,7 +502,7 @@ struct TilemapPrivate
 
 	void updateFlashMapViewport()
 	{
-		flashMap.setViewport(IntRect(viewpPos, Vec2i(viewpW, viewpH)));
+		flashMap.setViewport(IntRect(viewpPos, viewpSize));
 	}
 
 	void updateAtlasInfo()
@@ -421,15 +530,13 @@ struct TilemapPrivate
 		std::vector<uint8_t> &animatedATs = atlas.animatedATs;
 
 		usableATs.clear();
+		animatedATs.clear();
 
 		for (int i = 0; i < autotileCount; ++i)
 		{
 			if (nullOrDisposed(autotiles[i]))
 				continue;
 
-			if (autotiles[i]->megaSurface())
-				continue;
-
 			usableATs.push_back(i);
 
 			if (autotiles[i]->width() > autotileW)
@@ -445,19 +552,28 @@ struct TilemapPrivate
 		mapViewportDirty = true;
 	}
 
-	void invalidateAtlasSize()
-	{
-		atlasSizeDirty = true;
-	}
-
-	void invalidateAtlasContents()
+	void invalidateAtlas()
 	{
 		atlasDirty = true;
+		Scene::markDirty();
 	}
 
 	void invalidateBuffers()
 	{
 		buffersDirty = true;
+		Scene::markDirty();
+	}
+
+	void onMapDataModified(const IntRect &rect)
+	{
+		modifiedCells = rectUnion(modifiedCells, rect);
+		Scene::markDirty();
+	}
+
+	/* Every tile could be using a modified priority */
+	void onPrioritiesModified(const IntRect &)
+	{
+		invalidateBuffers();
 	}
 
 	/* Checks for the minimum amount of data needed to display */
@@ -472,23 +588,90 @@ struct TilemapPrivate
 		return true;
 	}
 
-	/* Allocates correctly sized TexFBO for atlas */
-	void allocateAtlas()
+	/* Swaps in the atlas matching the current tileset and
+	 * autotiles, taking it from the cache if possible */
+	void updateAtlas()
 	{
+		const Vec2i oldSize = atlas.size;
+		const int oldEfTilesetH = atlas.efTilesetH;
+
 		updateAtlasInfo();
+		updateAutotileInfo();
 
-		/* Aquire atlas tex */
-		shState->releaseAtlasTex(atlas.gl);
-		shState->requestAtlasTex(atlas.size.x, atlas.size.y, atlas.gl);
+		TileAtlasCache &cache = shState->tileAtlasCache();
 
-		atlasDirty = true;
+		TileAtlasCache::Key key(TileAtlasCache::XP);
+		key.add(tileset);
+		for (int i = 0; i < autotileCount; ++i)
+			key.add(autotiles[i]);
+
+		if (atlas.gl.tex != TEX::ID(0))
+		{
+			if (key == atlas.key)
+				return;
+
+			/* If autotiles were only modified (not replaced, as
+			 * the old set might be needed again), and nobody
+			 * else is using our atlas, just redo their parts */
+			bool modifiedOnly = key.stamps[0] == atlas.key.stamps[0] &&
+			                    tiles.animated == atlas.animated;
+
+			for (int i = 0; i < autotileCount; ++i)
+				if (key.stamps[i+1] != atlas.key.stamps[i+1] &&
+				    autotiles[i] != atlas.autotiles[i])
+					modifiedOnly = false;
+
+			if (modifiedOnly && cache.rekey(atlas.key, key))
+			{
+				for (int i = 0; i < autotileCount; ++i)
+					if (key.stamps[i+1] != atlas.key.stamps[i+1])
+						rebuildAutotile(i);
+
+				atlas.key = key;
+
+				return;
+			}
+
+			cache.release(atlas.key);
+		}
+
+		if (!cache.acquire(key, atlas.size.x, atlas.size.y, atlas.gl))
+			buildAtlas();
+
+		atlas.key = key;
+		memcpy(atlas.autotiles, autotiles, sizeof(autotiles));
+		atlas.animated = tiles.animated;
+
+		/* Tileset texcoords depend on the atlas height */
+		if (atlas.size != oldSize || atlas.efTilesetH != oldEfTilesetH)
+			buffersDirty = true;
+	}
+
+	void blitAutotile(int atInd)
+	{
+		Bitmap *autotile = autotiles[atInd];
+
+		int blitW = std::min(autotile->width(), atAreaW);
+		int blitH = std::min(autotile->height(), atAreaH);
+
+		if (blitW <= autotileW && tiles.animated)
+		{
+			/* Static autotile */
+			for (int j = 0; j < 4; ++j)
+				autotile->blitTo(IntRect(0, 0, blitW, blitH),
+				                 Vec2i(autotileW*j, atInd*autotileH));
+		}
+		else
+		{
+			/* Animated autotile */
+			autotile->blitTo(IntRect(0, 0, blitW, blitH),
+			                 Vec2i(0, atInd*autotileH));
+		}
 	}
 
 	/* Assembles atlas from tileset and autotile bitmaps */
 	void buildAtlas()
 	{
-		updateAutotileInfo();
-
 		TileAtlas::BlitVec blits = TileAtlas::calcBlits(atlas.efTilesetH, atlas.size);
 
 		/* Clear atlas */
@@ -505,106 +688,40 @@ struct TilemapPrivate
 
 		/* Blit autotiles */
 		for (size_t i = 0; i < atlas.usableATs.size(); ++i)
-		{
-			const uint8_t atInd = atlas.usableATs[i];
-			Bitmap *autotile = autotiles[atInd];
-
-			int blitW = std::min(autotile->width(), atAreaW);
-			int blitH = std::min(autotile->height(), atAreaH);
+			blitAutotile(atlas.usableATs[i]);
 
-			GLMeta::blitSource(autotile->getGLTypes(), 1);
+		/* Blit tileset (mega ones tile by tile) */
+		for (size_t i = 0; i < blits.size(); ++i)
+		{
+			const TileAtlas::Blit &blitOp = blits[i];
 
-			if (blitW <= autotileW && tiles.animated)
-			{
-				/* Static autotile */
-				for (int j = 0; j < 4; ++j)
-					GLMeta::blitRectangle(IntRect(0, 0, blitW, blitH),
-					                      Vec2i(autotileW*j, atInd*autotileH));
-			}
-			else
-			{
-				/* Animated autotile */
-				GLMeta::blitRectangle(IntRect(0, 0, blitW, blitH),
-				                      Vec2i(0, atInd*autotileH));
-			}
+			tileset->blitTo(IntRect(blitOp.src.x, blitOp.src.y, tsLaneW, blitOp.h),
+			                blitOp.dst);
 		}
 
 		GLMeta::blitEnd();
+	}
 
-		/* Blit tileset */
-		if (tileset->megaSurface())
-		{
-			/* Mega surface tileset */
-			SDL_Surface *tsSurf = tileset->megaSurface();
-
-			if (shState->config().subImageFix)
-			{
-				/* Implementation for broken GL drivers */
-				FBO::bind(atlas.gl.fbo);
-				glState.blend.pushSet(false);
-				glState.viewport.pushSet(IntRect(0, 0, atlas.size.x, atlas.size.y));
-
-				SimpleShader &shader = shState->shaders().simple;
-				shader.bind();
-				shader.applyViewportProj();
-				shader.setTranslation(Vec2i());
-
-				Quad &quad = shState->gpQuad();
-
-				for (size_t i = 0; i < blits.size(); ++i)
-				{
-					const TileAtlas::Blit &blitOp = blits[i];
-
-					Vec2i texSize;
-					shState->ensureTexSize(tsLaneW, blitOp.h, texSize);
-					shState->bindTex();
-					GLMeta::subRectImageUpload(tsSurf->w, blitOp.src.x, blitOp.src.y,
-					                           0, 0, tsLaneW, blitOp.h, tsSurf, GL_RGBA);
-
-					shader.setTexSize(texSize);
-					quad.setTexRect(FloatRect(0, 0, tsLaneW, blitOp.h));
-					quad.setPosRect(FloatRect(blitOp.dst.x, blitOp.dst.y, tsLaneW, blitOp.h));
-
-					quad.draw();
-				}
-
-				GLMeta::subRectImageEnd();
-				glState.viewport.pop();
-				glState.blend.pop();
-			}
-			else
-			{
-				/* Clean implementation */
-				TEX::bind(atlas.gl.tex);
-
-				for (size_t i = 0; i < blits.size(); ++i)
-				{
-					const TileAtlas::Blit &blitOp = blits[i];
-
-					GLMeta::subRectImageUpload(tsSurf->w, blitOp.src.x, blitOp.src.y,
-					                           blitOp.dst.x, blitOp.dst.y, tsLaneW, blitOp.h, tsSurf, GL_RGBA);
-				}
-
-				GLMeta::subRectImageEnd();
-			}
+	/* Replaces the area of one autotile in the atlas */
+	void rebuildAutotile(int atInd)
+	{
+		FBO::bind(atlas.gl.fbo);
+		glState.clearColor.pushSet(Vec4());
+		glState.scissorTest.pushSet(true);
+		glState.scissorBox.pushSet(IntRect(0, atInd*autotileH, atAreaW, autotileH));
 
-		}
-		else
-		{
-			/* Regular tileset */
-			GLMeta::blitBegin(atlas.gl);
-			GLMeta::blitSource(tileset->getGLTypes(), 1);
+		FBO::clear();
 
-			for (size_t i = 0; i < blits.size(); ++i)
-			{
-				const TileAtlas::Blit &blitOp = blits[i];
+		glState.scissorBox.pop();
+		glState.scissorTest.pop();
+		glState.clearColor.pop();
 
-				GLMeta::blitRectangle(IntRect(blitOp.src.x, blitOp.src.y, tsLaneW, blitOp.h),
-				                      blitOp.dst);
-			}
+		if (nullOrDisposed(autotiles[atInd]))
+			return;
 
-			GLMeta::blitEnd();
-		}
+		GLMeta::blitBegin(atlas.gl);
+		blitAutotile(atInd);
+		GLMeta::blitEnd();
 	}
 
 	int samplePriority(int tileInd)
@@ -652,10 +769,9 @@ struct TilemapPrivate
 		}
 	}
 
-	void handleTile(int x, int y, int z)
+	void handleTile(const Vec2i &base, int x, int y, int z)
 	{
-		int tileInd =
-			tableGetWrapped(*mapData, x + viewpPos.x, y + viewpPos.y, z);
+		int tileInd = mapData->at(base.x + x, base.y + y, z);
 
 		/* Check for empty space */
 		if (tileInd < 48)
@@ -706,18 +822,26 @@ struct TilemapPrivate
 	{
 		groundVert.clear();
 
-		for (size_t i = 0; i < zlayersMax; ++i)
+		for (int i = 0; i < chunkLayers; ++i)
 			zlayerVert[i].clear();
 	}
 
-	void buildQuadArray()
+	/* Builds the vertices of one chunk, relative
+	 * to the chunk's top left tile */
+	void buildQuadArray(int chunkX, int chunkY)
 	{
 		clearQuadArrays();
 
-		for (int x = 0; x < viewpW; ++x)
-			for (int y = 0; y < viewpH; ++y)
+		const Vec2i base(chunkX * chunkSize, chunkY * chunkSize);
+		const int w = std::min(chunkSize, mapData->xSize() - base.x);
+		const int h = std::min(chunkSize, mapData->ySize() - base.y);
+
+		for (int x = 0; x < w; ++x)
+			for (int y = 0; y < h; ++y)
 				for (int z = 0; z < mapData->zSize(); ++z)
-					handleTile(x, y, z);
+					handleTile(base, x, y, z);
+
+		shState->perfStats().add(PerfStats::TilemapTilesBuilt, w * h);
 	}
 
 	static size_t quadDataSize(size_t quadCount)
@@ -725,37 +849,51 @@ struct TilemapPrivate
 		return quadCount * sizeof(SVertex) * 4;
 	}
 
-	size_t zlayerSize(size_t index)
+	void uploadBuffers(TileChunk &chunk)
 	{
-		return zlayerBases[index+1] - zlayerBases[index];
-	}
-
-	void uploadBuffers()
-	{
-		/* Calculate total quad count */
-		size_t groundQuadCount = groundVert.size() / 4;
-		size_t quadCount = groundQuadCount;
+		/* Calculate layer bases */
+		size_t quadCount = groundVert.size() / 4;
+		chunk.bases[1] = quadCount;
 
-		for (size_t i = 0; i < zlayersMax; ++i)
+		for (int i = 0; i < chunkLayers; ++i)
 		{
-			zlayerBases[i] = quadCount;
 			quadCount += zlayerVert[i].size() / 4;
+			chunk.bases[i+2] = quadCount;
+		}
+
+		/* Empty chunks never get drawn */
+		if (quadCount == 0)
+			return;
+
+		if (!chunk.vbo)
+		{
+			chunk.vbo = VBO::gen();
+
+			GLMeta::vaoFillInVertexData<SVertex>(chunk.vao);
+			chunk.vao.vbo = chunk.vbo;
+			chunk.vao.ibo = shState->globalIBO().ibo;
+
+			GLMeta::vaoInit(chunk.vao);
 		}
 
-		zlayerBases[zlayersMax] = quadCount;
+		VBO::bind(chunk.vbo);
 
-		VBO::bind(tiles.vbo);
-		VBO::allocEmpty(quadDataSize(quadCount));
+		/* Rebuilt chunks are rewritten in place if they fit */
+		if (quadCount > chunk.allocQuads)
+		{
+			VBO::allocEmpty(quadDataSize(quadCount));
+			chunk.allocQuads = quadCount;
+		}
 
-		VBO::uploadSubData(0, quadDataSize(groundQuadCount), dataPtr(groundVert));
+		VBO::uploadSubData(0, quadDataSize(chunk.groundSize()), dataPtr(groundVert));
 
-		for (size_t i = 0; i < zlayersMax; ++i)
+		for (int i = 0; i < chunkLayers; ++i)
 		{
 			if (zlayerVert[i].empty())
 				continue;
 
-			VBO::uploadSubData(quadDataSize(zlayerBases[i]),
-			                   quadDataSize(zlayerSize(i)), dataPtr(zlayerVert[i]));
+			VBO::uploadSubData(quadDataSize(chunk.bases[i+1]),
+			                   quadDataSize(chunk.zlayerSize(i)), dataPtr(zlayerVert[i]));
 		}
 
 		VBO::unbind();
@@ -764,18 +902,139 @@ struct TilemapPrivate
 		shState->ensureQuadIBO(quadCount);
 	}
 
+	TileChunk *buildChunk(int chunkX, int chunkY)
+	{
+		buildQuadArray(chunkX, chunkY);
+
+		TileChunk *chunk = new TileChunk;
+		uploadBuffers(*chunk);
+
+		return chunk;
+	}
+
+	/* Rebuilds the already built chunks touching the
+	 * modified cells, leaving all others untouched */
+	void updateModifiedChunks()
+	{
+		const IntRect &rect = modifiedCells;
+
+		const int x1 = std::max(rect.x / chunkSize, 0);
+		const int y1 = std::max(rect.y / chunkSize, 0);
+		const int x2 = std::min((rect.x + rect.w - 1) / chunkSize + 1, chunks.count.x);
+		const int y2 = std::min((rect.y + rect.h - 1) / chunkSize + 1, chunks.count.y);
+
+		for (int y = y1; y < y2; ++y)
+			for (int x = x1; x < x2; ++x)
+			{
+				TileChunk *chunk = chunks.data[y * chunks.count.x + x];
+
+				if (!chunk)
+					continue;
+
+				buildQuadArray(x, y);
+				uploadBuffers(*chunk);
+			}
+	}
+
+	void clearChunks()
+	{
+		for (size_t i = 0; i < chunks.data.size(); ++i)
+			delete chunks.data[i];
+
+		chunks.data.clear();
+		chunks.visible.clear();
+		chunks.groundQuads = 0;
+	}
+
+	/* Drops all cached geometry and cuts the
+	 * chunk grid for the current map size */
+	void resetChunks()
+	{
+		clearChunks();
+
+		chunks.mapW = mapData->xSize();
+		chunks.mapH = mapData->ySize();
+		chunks.mapD = mapData->zSize();
+
+		chunks.count = Vec2i((chunks.mapW + chunkSize - 1) / chunkSize,
+		                     (chunks.mapH + chunkSize - 1) / chunkSize);
+
+		chunks.data.resize(chunks.count.x * chunks.count.y, 0);
+	}
+
+	void updateVisibleChunks()
+	{
+		std::vector<Vec2i> spansX, spansY;
+		chunkSpans(viewpPos.x, viewpSize.x, chunks.mapW, spansX);
+		chunkSpans(viewpPos.y, viewpSize.y, chunks.mapH, spansY);
+
+		chunks.visible.clear();
+		chunks.groundQuads = 0;
+
+		for (size_t j = 0; j < spansY.size(); ++j)
+			for (size_t i = 0; i < spansX.size(); ++i)
+			{
+				TileChunk *&chunk =
+					chunks.data[spansY[j].x * chunks.count.x + spansX[i].x];
+
+				if (!chunk)
+					chunk = buildChunk(spansX[i].x, spansY[j].x);
+
+				if (chunk->quadCount() == 0)
+					continue;
+
+				ChunkInstance inst = { chunk, Vec2i(spansX[i].y, spansY[j].y) };
+				chunks.visible.push_back(inst);
+				chunks.groundQuads += chunk->groundSize();
+			}
+	}
+
+	/* Draws layers [first, last) of a visible chunk */
+	void drawChunk(ShaderBase &shader, const ChunkInstance &inst,
+	               int first, int last)
+	{
+		const TileChunk &chunk = *inst.chunk;
+
+		if (chunk.bases[last] == chunk.bases[first])
+			return;
+
+		GLMeta::vaoBind(inst.chunk->vao);
+
+		shader.setTranslation(dispPos + (inst.pos - viewpPos) * 32);
+		chunk.draw(first, last);
+
+		GLMeta::vaoUnbind(inst.chunk->vao);
+	}
+
+	/* Draws the zlayers of rows [firstRow, lastRow) */
+	void drawZLayers(ShaderBase &shader, int firstRow, int lastRow)
+	{
+		for (size_t i = 0; i < chunks.visible.size(); ++i)
+		{
+			const ChunkInstance &inst = chunks.visible[i];
+
+			int first = std::max(firstRow - inst.pos.y, 0);
+			int last = std::min(lastRow - inst.pos.y, chunkLayers);
+
+			if (first >= last)
+				continue;
+
+			drawChunk(shader, inst, first+1, last+1);
+		}
+	}
+
 	void bindShader(ShaderBase *&shaderVar)
 	{
 		if (tiles.animated)
 		{
-			TilemapShader &tilemapShader = shState->shaders().tilemap;
+			TilemapShader &tilemapShader = shState->shaders().tilemap();
 			tilemapShader.bind();
 			tilemapShader.setAniIndex(tiles.frameIdx);
 			shaderVar = &tilemapShader;
 		}
 		else
 		{
-			shaderVar = &shState->shaders().simple;
+			shaderVar = &shState->shaders().simple();
 			shaderVar->bind();
 		}
 
@@ -790,9 +1049,12 @@ struct TilemapPrivate
 
 	void updateActiveElements(std::vector<int> &zlayerInd)
 	{
-		elem.ground->updateVboCount();
+		elem.ground->setVisible(visible);
+
+		while (elem.zlayers.size() < zlayerInd.size())
+			elem.zlayers.push_back(new ZLayer(this, viewport));
 
-		for (size_t i = 0; i < zlayersMax; ++i)
+		for (size_t i = 0; i < elem.zlayers.size(); ++i)
 		{
 			if (i < zlayerInd.size())
 			{
@@ -813,9 +1075,19 @@ struct TilemapPrivate
 		/* Only allocate elements for non-emtpy zlayers */
 		std::vector<int> zlayerInd;
 
-		for (size_t i = 0; i < zlayersMax; ++i)
-			if (zlayerVert[i].size() > 0)
-				zlayerInd.push_back(i);
+		const int lastRow = viewpPos.y + viewpSize.y + 5;
+
+		for (int row = viewpPos.y; row < lastRow; ++row)
+			for (size_t i = 0; i < chunks.visible.size(); ++i)
+			{
+				const ChunkInstance &inst = chunks.visible[i];
+
+				if (inst.chunk->zlayerSize(row - inst.pos.y) > 0)
+				{
+					zlayerInd.push_back(row);
+					break;
+				}
+			}
 
 		updateActiveElements(zlayerInd);
 		elem.activeLayers = zlayerInd.size();
@@ -826,7 +1098,7 @@ struct TilemapPrivate
 	{
 		elem.ground->setVisible(false);
 
-		for (size_t i = 0; i < zlayersMax; ++i)
+		for (size_t i = 0; i < elem.zlayers.size(); ++i)
 			elem.zlayers[i]->setVisible(false);
 	}
 
@@ -838,21 +1110,14 @@ struct TilemapPrivate
 		for (size_t i = 0; i < elem.activeLayers; ++i)
 			elem.zlayers[i]->initUpdateZ();
 
-		ZLayer *prev = elem.zlayers[0];
-		prev->finiUpdateZ(0);
-
-		for (size_t i = 1; i < elem.activeLayers; ++i)
-		{
-			ZLayer *layer = elem.zlayers[i];
-			layer->finiUpdateZ(prev);
-			prev = layer;
-		}
+		for (size_t i = 0; i < elem.activeLayers; ++i)
+			elem.zlayers[i]->finiUpdateZ();
 	}
 
 	/* When there are two or more zlayers with no other
 	 * elements between them in the scene list, we can
-	 * render them in a batch (as the zlayer data itself
-	 * is ordered sequentially in VRAM). Every frame, we
+	 * render them in a batch (as the zlayer data of each
+	 * chunk is ordered sequentially in VRAM). Every frame, we
 	 * scan the scene list for such sequential layers and
 	 * batch them up for drawing. The first layer of the batch
 	 * (the "batch head") executes the draw call, all others
@@ -860,14 +1125,14 @@ struct TilemapPrivate
 	 * single sized batches are possible. */
 	void prepareZLayerBatches()
 	{
-		ZLayer *const *zlayers = elem.zlayers;
+		ZLayer *const *zlayers = dataPtr(elem.zlayers);
 
 		for (size_t i = 0; i < elem.activeLayers; ++i)
 		{
 			ZLayer *batchHead = zlayers[i];
 			batchHead->batchedFlag = false;
 
-			GLsizei vboBatchCount = batchHead->vboCount;
+			int batchEnd = batchHead->index + 1;
 			IntruListLink<SceneElement> *iter = &batchHead->link;
 
 			for (i = i+1; i < elem.activeLayers; ++i)
@@ -881,11 +1146,11 @@ struct TilemapPrivate
 				if (iter != &layer->link)
 					break;
 
-				vboBatchCount += layer->vboCount;
+				batchEnd = layer->index + 1;
 				layer->batchedFlag = true;
 			}
 
-			batchHead->vboBatchCount = vboBatchCount;
+			batchHead->batchEnd = batchEnd;
 			--i;
 		}
 	}
@@ -895,10 +1160,16 @@ struct TilemapPrivate
 		const Vec2i combOrigin = origin + elem.sceneGeo.orig;
 		const Vec2i mvpPos = getTilePos(combOrigin);
 
-		if (mvpPos != viewpPos)
+		/* One extra tile for partially visible edges */
+		const IntRect &sceneRect = elem.sceneGeo.rect;
+		const Vec2i mvpSize((sceneRect.w + 31) / 32 + 1,
+		                    (sceneRect.h + 31) / 32 + 1);
+
+		if (mvpPos != viewpPos || mvpSize != viewpSize)
 		{
 			viewpPos = mvpPos;
-			buffersDirty = true;
+			viewpSize = mvpSize;
+			visibleChunksDirty = true;
 			updateFlashMapViewport();
 		}
 
@@ -916,15 +1187,15 @@ struct TilemapPrivate
 			return;
 		}
 
-		if (atlasSizeDirty)
-		{
-			allocateAtlas();
-			atlasSizeDirty = false;
-		}
+		/* Catch up on table writes of this frame */
+		mapData->flushModified();
+
+		if (priorities)
+			priorities->flushModified();
 
 		if (atlasDirty)
 		{
-			buildAtlas();
+			updateAtlas();
 			atlasDirty = false;
 		}
 
@@ -936,11 +1207,31 @@ struct TilemapPrivate
 
 		if (buffersDirty)
 		{
-			buildQuadArray();
-			uploadBuffers();
-			updateSceneElements();
+			resetChunks();
+			visibleChunksDirty = true;
 			buffersDirty = false;
 		}
+		else if (modifiedCells.w > 0)
+		{
+			/* Resizes need a new chunk grid */
+			if (chunks.mapW != mapData->xSize() ||
+			    chunks.mapH != mapData->ySize() ||
+			    chunks.mapD != mapData->zSize())
+				resetChunks();
+			else
+				updateModifiedChunks();
+
+			visibleChunksDirty = true;
+		}
+
+		modifiedCells = IntRect();
+
+		if (visibleChunksDirty)
+		{
+			updateVisibleChunks();
+			updateSceneElements();
+			visibleChunksDirty = false;
+		}
 
 		flashMap.prepare();
 
@@ -958,20 +1249,14 @@ struct TilemapPrivate
 
 GroundLayer::GroundLayer(TilemapPrivate *p, Viewport *viewport)
     : ViewportElement(viewport, 0),
-      vboCount(0),
       p(p)
 {
 	onGeometryChange(scene->getGeometry());
 }
 
-void GroundLayer::updateVboCount()
-{
-	vboCount = p->zlayerBases[0] * 6;
-}
-
 void GroundLayer::draw()
 {
-	if (p->groundVert.size() == 0)
+	if (p->chunks.groundQuads == 0)
 		return;
 
 	ShaderBase *shader;
@@ -979,21 +1264,12 @@ void GroundLayer::draw()
 	p->bindShader(shader);
 	p->bindAtlas(*shader);
 
-	GLMeta::vaoBind(p->tiles.vao);
-
-	shader->setTranslation(p->dispPos);
-	drawInt();
-
-	GLMeta::vaoUnbind(p->tiles.vao);
+	for (size_t i = 0; i < p->chunks.visible.size(); ++i)
+		p->drawChunk(*shader, p->chunks.visible[i], 0, 1);
 
 	p->flashMap.draw(flashAlpha[p->flashAlphaIdx] / 255.f, p->dispPos);
 }
 
-void GroundLayer::drawInt()
-{
-	gl.DrawElements(GL_TRIANGLES, vboCount, _GL_INDEX_TYPE, (GLvoid*) 0);
-}
-
 void GroundLayer::onGeometryChange(const Scene::Geometry &geo)
 {
 	p->updateSceneGeometry(geo);
@@ -1002,10 +1278,9 @@ void GroundLayer::onGeometryChange(const Scene::Geometry &geo)
 ZLayer::ZLayer(TilemapPrivate *p, Viewport *viewport)
     : ViewportElement(viewport, 0),
       index(0),
-      vboOffset(0),
-      vboCount(0),
       p(p),
-      vboBatchCount(0)
+      batchedFlag(false),
+      batchEnd(0)
 {}
 
 void ZLayer::setIndex(int value)
@@ -1014,9 +1289,6 @@ void ZLayer::setIndex(int value)
 
 	z = calculateZ(p, index);
 	scene->reinsert(*this);
-
-	vboOffset = p->zlayerBases[index] * sizeof(index_t) * 6;
-	vboCount = p->zlayerSize(index) * 6;
 }
 
 void ZLayer::draw()
@@ -1029,22 +1301,12 @@ void ZLayer::draw()
 	p->bindShader(shader);
 	p->bindAtlas(*shader);
 
-	GLMeta::vaoBind(p->tiles.vao);
-
-	shader->setTranslation(p->dispPos);
-	drawInt();
-
-	GLMeta::vaoUnbind(p->tiles.vao);
-}
-
-void ZLayer::drawInt()
-{
-	gl.DrawElements(GL_TRIANGLES, vboBatchCount, _GL_INDEX_TYPE, (GLvoid*) vboOffset);
+	p->drawZLayers(*shader, index, batchEnd);
 }
 
 int ZLayer::calculateZ(TilemapPrivate *p, int index)
 {
-	return 32 * (index + p->viewpPos.y + 1) - p->origin.y;
+	return 32 * (index + 1) - p->origin.y;
 }
 
 void ZLayer::initUpdateZ()
@@ -1052,14 +1314,11 @@ void ZLayer::initUpdateZ()
 	unlink();
 }
 
-void ZLayer::finiUpdateZ(ZLayer *prev)
+void ZLayer::finiUpdateZ()
 {
 	z = calculateZ(p, index);
 
-	if (prev)
-		scene->insertAfter(*this, *prev);
-	else
-		scene->insert(*this);
+	scene->insert(*this);
 }
 
 void Tilemap::Autotiles::set(int i, Bitmap *bitmap)
@@ -1075,15 +1334,15 @@ void Tilemap::Autotiles::set(int i, Bitmap *bitmap)
 
 	p->autotiles[i] = bitmap;
 
-	p->invalidateAtlasContents();
+	p->invalidateAtlas();
 
 	p->autotilesCon[i].disconnect();
 	p->autotilesCon[i] = bitmap->modified.connect
-	        (sigc::mem_fun(p, &TilemapPrivate::invalidateAtlasContents));
+	        (sigc::mem_fun(p, &TilemapPrivate::invalidateAtlas));
 
 	p->autotilesDispCon[i].disconnect();
 	p->autotilesDispCon[i] = bitmap->wasDisposed.connect
-	        (sigc::mem_fun(p, &TilemapPrivate::invalidateAtlasContents));
+	        (sigc::mem_fun(p, &TilemapPrivate::invalidateAtlas));
 
 	p->updateAutotileInfo();
 }
@@ -1121,11 +1380,21 @@ void Tilemap::update()
 	if (++p->flashAlphaIdx >= flashAlphaN)
 		p->flashAlphaIdx = 0;
 
+	if (p->flashMap.isActive())
+		Scene::markDirty();
+
 	/* Animate autotiles */
 	if (!p->tiles.animated)
 		return;
 
-	p->tiles.frameIdx = atAnimation[p->tiles.aniIdx];
+	const uint8_t frameIdx = atAnimation[p->tiles.aniIdx];
+
+	/* Autotile frames only advance every few updates */
+	if (p->tiles.frameIdx != frameIdx)
+	{
+		p->tiles.frameIdx = frameIdx;
+		Scene::markDirty();
+	}
 
 	if (++p->tiles.aniIdx >= atAnimationN)
 		p->tiles.aniIdx = 0;
@@ -1155,14 +1424,15 @@ void Tilemap::setTileset(Bitmap *value)
 		return;
 
 	p->tileset = value;
+	Scene::markDirty();
 
 	if (!value)
 		return;
 
-	p->invalidateAtlasSize();
+	p->invalidateAtlas();
 	p->tilesetCon.disconnect();
 	p->tilesetCon = value->modified.connect
-	        (sigc::mem_fun(p, &TilemapPrivate::invalidateAtlasSize));
+	        (sigc::mem_fun(p, &TilemapPrivate::invalidateAtlas));
 
 	p->updateAtlasInfo();
 }
@@ -1175,6 +1445,7 @@ void Tilemap::setMapData(Table *value)
 		return;
 
 	p->mapData = value;
+	Scene::markDirty();
 
 	if (!value)
 		return;
@@ -1182,7 +1453,7 @@ void Tilemap::setMapData(Table *value)
 	p->invalidateBuffers();
 	p->mapDataCon.disconnect();
 	p->mapDataCon = value->modified.connect
-	        (sigc::mem_fun(p, &TilemapPrivate::invalidateBuffers));
+	        (sigc::mem_fun(p, &TilemapPrivate::onMapDataModified));
 }
 
 void Tilemap::setFlashData(Table *value)
@@ -1200,6 +1471,7 @@ void Tilemap::setPriorities(Table *value)
 		return;
 
 	p->priorities = value;
+	Scene::markDirty();
 
 	if (!value)
 		return;
@@ -1207,7 +1479,7 @@ void Tilemap::setPriorities(Table *value)
 	p->invalidateBuffers();
 	p->prioritiesCon.disconnect();
 	p->prioritiesCon = value->modified.connect
-	        (sigc::mem_fun(p, &TilemapPrivate::invalidateBuffers));
+	        (sigc::mem_fun(p, &TilemapPrivate::onPrioritiesModified));
 }
 
 void Tilemap::setVisible(bool value)
@@ -1218,6 +1490,7 @@ void Tilemap::setVisible(bool value)
 		return;
 
 	p->visible = value;
+	Scene::markDirty();
 
 	if (!p->tilemapReady)
 		return;
@@ -1236,6 +1509,8 @@ void Tilemap::setOX(int value)
 
 	p->origin.x = value;
 	p->mapViewportDirty = true;
+
+	Scene::markDirty();
 }
 
 void Tilemap::setOY(int value)
@@ -1248,6 +1523,8 @@ void Tilemap::setOY(int value)
 	p->origin.y = value;
 	p->zOrderDirty = true;
 	p->mapViewportDirty = true;
+
+	Scene::markDirty();
 }
 
 void Tilemap::releaseResources()
@@ -34,8 +34,11 @@
 #include "quadarray.h"
 #include "shader.h"
 #include "tilemap-common.h"
+#include "tileatlascache.h"
+#include "perfstats.h"
 
 #include <vector>
+#include <algorithm>
 #include <sigc++/connection.h>
 
 /* Flash tiles pulsing opacity */
@@ -51,6 +54,28 @@ static const uint8_t flashAlpha[] =
 
 static elementsN(flashAlpha);
 
+/* Vertex positions are stored as (ring slot * slotSpacing
+ * + position inside the slot), see tilemapvx.vert */
+static const int slotSpacing = 128;
+
+/* Ring buffer:
+ *   Every tile of the map viewport owns a fixed slot in the
+ *   vertex buffer, picked by wrapping its map position around
+ *   the viewport size. When the viewport scrolls, only the newly
+ *   exposed rows/columns are read into the slots of the ones that
+ *   scrolled out, and the vertex shader rotates the ring back
+ *   into place.
+ *
+ *   Each slot holds a fixed number of quads per read pass (the
+ *   maximum any tile of the viewport needs), unused ones being
+ *   degenerate. Ground quads are stored pass by pass, and within
+ *   a pass in bottom to top row order, as the table autotile legs
+ *   extend over the tile below and have to be drawn after it.
+ *   Because the ring rotates, a pass is drawn in two parts split
+ *   at the ring row of the viewport's top row. Above quads never
+ *   leave their tile, so they are stored tile by tile instead.
+ */
+
 struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 {
 	Bitmap *bitmaps[BM_COUNT];
@@ -65,17 +90,64 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	Vec2i dispPos;
 	Scene::Geometry sceneGeo;
 
+	/* Quads of the tile being read */
 	std::vector<SVertex> groundVert;
 	std::vector<SVertex> aboveVert;
 
+	/* Where each ground pass and the above
+	 * quads of the tile read last end */
+	size_t tileEnds[TileAtlasVX::PASS_COUNT+1];
+
 	TEXFBO atlas;
+
+	/* What 'atlas' was built from; only
+	 * valid while 'atlas' is held */
+	TileAtlasCache::Key atlasKey;
+	Bitmap *atlasBitmaps[BM_COUNT];
+
 	VBO::ID vbo;
 	GLMeta::VAO vao;
 
 	size_t allocQuads;
 
-	size_t groundQuads;
-	size_t aboveQuads;
+	struct
+	{
+		/* Equal to the map viewport size */
+		Vec2i size;
+
+		/* Map viewport position the contents match */
+		Vec2i pos;
+
+		/* Quads per slot of each ground pass
+		 * and of the above layer */
+		size_t groundCap[TileAtlasVX::PASS_COUNT];
+		size_t aboveCap;
+
+		/* Largest quad counts seen while writing */
+		size_t groundNeed[TileAtlasVX::PASS_COUNT];
+		size_t aboveNeed;
+
+		/* Base quads of each ground pass,
+		 * the last one is the above layer */
+		size_t bases[TileAtlasVX::PASS_COUNT+1];
+		size_t quadCount;
+
+		/* CPU side copy of the buffer */
+		std::vector<SVertex> vert;
+
+		/* All tiles read by a rebuild, held until the
+		 * slot capacities are known, and their ends */
+		std::vector<SVertex> readVert;
+		std::vector<size_t> readEnds;
+
+		/* Written slot column span of each ring
+		 * row, uploaded in the next prepare */
+		std::vector<Vec2i> dirtySpans;
+		bool spansDirty;
+
+		/* Contents match the map viewport */
+		bool valid;
+	} ring;
 
 	uint16_t frameIdx;
 	Vec2 aniOffset;
@@ -87,6 +159,9 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	bool buffersDirty;
 	bool mapViewportDirty;
 
+	/* Cells of 'mapData' modified since the last prepare */
+	IntRect modifiedCells;
+
 	sigc::connection mapDataCon;
 	sigc::connection flagsCon;
 
@@ -119,8 +194,6 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	      mapData(0),
 	      flags(0),
 	      allocQuads(0),
-	      groundQuads(0),
-	      aboveQuads(0),
 	      frameIdx(0),
 	      flashAlphaIdx(0),
 	      atlasDirty(true),
@@ -129,8 +202,13 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	      above(this, viewport)
 	{
 		memset(bitmaps, 0, sizeof(bitmaps));
+		memset(atlasBitmaps, 0, sizeof(atlasBitmaps));
 
-		shState->requestAtlasTex(ATLASVX_W, ATLASVX_H, atlas);
+		ring.quadCount = 0;
+		memset(ring.bases, 0, sizeof(ring.bases));
+		ring.valid = false;
+		ring.spansDirty = false;
+		resetRingCaps();
 
 		vbo = VBO::gen();
 
@@ -150,7 +228,8 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		GLMeta::vaoFini(vao);
 		VBO::del(vbo);
 
-		shState->releaseAtlasTex(atlas);
+		if (atlas.tex != TEX::ID(0))
+			shState->tileAtlasCache().release(atlasKey);
 
 		prepareCon.disconnect();
 
@@ -167,16 +246,71 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	void invalidateAtlas()
 	{
 		atlasDirty = true;
+		Scene::markDirty();
 	}
 
 	void invalidateBuffers()
 	{
 		buffersDirty = true;
+		Scene::markDirty();
+	}
+
+	void onMapDataModified(const IntRect &rect)
+	{
+		modifiedCells = rectUnion(modifiedCells, rect);
+		Scene::markDirty();
+	}
+
+	/* Every tile could be using a modified flag */
+	void onFlagsModified(const IntRect &)
+	{
+		invalidateBuffers();
 	}
 
-	void rebuildAtlas()
+	/* Swaps in the atlas matching the current bitmaps,
+	 * taking it from the cache if possible */
+	void updateAtlas()
 	{
-		TileAtlasVX::build(atlas, bitmaps);
+		TileAtlasCache &cache = shState->tileAtlasCache();
+
+		TileAtlasCache::Key key(TileAtlasCache::VX);
+		for (int i = 0; i < BM_COUNT; ++i)
+			key.add(bitmaps[i]);
+
+		if (atlas.tex != TEX::ID(0))
+		{
+			if (key == atlasKey)
+				return;
+
+			/* If bitmaps were only modified (not replaced, as
+			 * the old set might be needed again), and nobody
+			 * else is using our atlas, just redo their parts */
+			bool modifiedOnly = true;
+
+			for (int i = 0; i < BM_COUNT; ++i)
+				if (key.stamps[i] != atlasKey.stamps[i] &&
+				    bitmaps[i] != atlasBitmaps[i])
+					modifiedOnly = false;
+
+			if (modifiedOnly && cache.rekey(atlasKey, key))
+			{
+				for (int i = 0; i < BM_COUNT; ++i)
+					if (key.stamps[i] != atlasKey.stamps[i])
+						TileAtlasVX::rebuildPart(atlas, bitmaps[i], i);
+
+				atlasKey = key;
+
+				return;
+			}
+
+			cache.release(atlasKey);
+		}
+
+		if (!cache.acquire(key, ATLASVX_W, ATLASVX_H, atlas))
+			TileAtlasVX::build(atlas, bitmaps);
+
+		atlasKey = key;
+		memcpy(atlasBitmaps, bitmaps, sizeof(bitmaps));
 	}
 
 	void updateMapViewport()
@@ -200,7 +334,6 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		{
 			mapViewp = newMvp;
 			flashMap.setViewport(newMvp);
-			buffersDirty = true;
 		}
 
 		dispPos = sceneGeo.rect.pos() - wrap(combOrigin, 32) - Vec2i(0, 32);
@@ -211,35 +344,335 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		return quads * 4 * sizeof(SVertex);
 	}
 
-	void rebuildBuffers()
+	void resetRingCaps()
 	{
-		if (!mapData)
+		for (size_t i = 0; i < TileAtlasVX::PASS_COUNT; ++i)
+			ring.groundCap[i] = 0;
+
+		ring.aboveCap = 0;
+	}
+
+	/* Grows the slot capacities to what the last written
+	 * tiles needed. Returns true if any of them changed */
+	bool growRingCaps()
+	{
+		bool grown = false;
+
+		for (size_t i = 0; i < TileAtlasVX::PASS_COUNT; ++i)
+			if (ring.groundNeed[i] > ring.groundCap[i])
+			{
+				ring.groundCap[i] = ring.groundNeed[i];
+				grown = true;
+			}
+
+		if (ring.aboveNeed > ring.aboveCap)
+		{
+			ring.aboveCap = ring.aboveNeed;
+			grown = true;
+		}
+
+		return grown;
+	}
+
+	void layoutRing()
+	{
+		const size_t slots = ring.size.x * ring.size.y;
+		size_t quads = 0;
+
+		for (size_t i = 0; i < TileAtlasVX::PASS_COUNT; ++i)
+		{
+			ring.bases[i] = quads;
+			quads += slots * ring.groundCap[i];
+		}
+
+		ring.bases[TileAtlasVX::PASS_COUNT] = quads;
+		ring.quadCount = quads + slots * ring.aboveCap;
+
+		ring.vert.assign(ring.quadCount * 4, SVertex());
+
+		for (size_t i = 0; i < TileAtlasVX::PASS_COUNT; ++i)
+			ring.groundNeed[i] = 0;
+
+		ring.aboveNeed = 0;
+	}
+
+	/* Copies 'count' vertices into a slot and pads
+	 * it with degenerate quads. Quads that don't
+	 * fit are only recorded in 'need' */
+	void storeQuads(const SVertex *vert, size_t count, size_t base,
+	                size_t cap, size_t &need, const Vec2i &slot)
+	{
+		const size_t quads = count / 4;
+		need = std::max(need, quads);
+
+		if (quads > cap || cap == 0)
 			return;
 
+		SVertex *dst = &ring.vert[base*4];
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			dst[i] = vert[i];
+			dst[i].pos.x += slot.x * slotSpacing;
+			dst[i].pos.y += slot.y * slotSpacing;
+		}
+
+		for (size_t i = count; i < cap*4; ++i)
+			dst[i] = SVertex();
+	}
+
+	/* Reads all passes of map tile (x, y) into 'groundVert',
+	 * back to back and followed by the above quads */
+	void readTile(int x, int y)
+	{
 		groundVert.clear();
 		aboveVert.clear();
 
-		TileAtlasVX::readTiles(*this, *mapData, flags,
-		                       mapViewp.x, mapViewp.y, mapViewp.w, mapViewp.h);
+		for (int i = 0; i < TileAtlasVX::PASS_COUNT; ++i)
+		{
+			TileAtlasVX::readCell(*this, *mapData, flags, x, y, i);
+			tileEnds[i] = groundVert.size();
+		}
+
+		groundVert.insert(groundVert.end(), aboveVert.begin(), aboveVert.end());
+		tileEnds[TileAtlasVX::PASS_COUNT] = groundVert.size();
+
+		shState->perfStats().add(PerfStats::TilemapTilesBuilt);
+	}
+
+	/* Stores quads laid out like readTile() leaves them
+	 * into the ring slot of map tile (x, y) */
+	void storeTile(int x, int y, const SVertex *vert, const size_t *ends)
+	{
+		const Vec2i slot(wrap(x, ring.size.x), wrap(y, ring.size.y));
+		const int rowInd = (ring.size.y - 1 - slot.y) * ring.size.x + slot.x;
+
+		size_t start = 0;
+
+		for (int i = 0; i < TileAtlasVX::PASS_COUNT; ++i)
+		{
+			const size_t cap = ring.groundCap[i];
+			storeQuads(vert + start, ends[i] - start, ring.bases[i] + rowInd * cap,
+			           cap, ring.groundNeed[i], slot);
+
+			start = ends[i];
+		}
+
+		const size_t cap = ring.aboveCap;
+		const int tileInd = slot.y * ring.size.x + slot.x;
+		storeQuads(vert + start, ends[TileAtlasVX::PASS_COUNT] - start,
+		           ring.bases[TileAtlasVX::PASS_COUNT] + tileInd * cap,
+		           cap, ring.aboveNeed, slot);
+
+		Vec2i &span = ring.dirtySpans[slot.y];
+		span.x = std::min(span.x, slot.x);
+		span.y = std::max(span.y, slot.x + 1);
+		ring.spansDirty = true;
+	}
+
+	/* Reads map tile (x, y) into its ring slot */
+	void writeTile(int x, int y)
+	{
+		readTile(x, y);
+		storeTile(x, y, dataPtr(groundVert), tileEnds);
+	}
+
+	void clearDirtySpans()
+	{
+		ring.dirtySpans.assign(ring.size.y, Vec2i(ring.size.x, 0));
+		ring.spansDirty = false;
+	}
+
+	/* Reads the entire map viewport into the ring. Every
+	 * tile is read once, and the slot capacities are grown
+	 * to fit the largest ones before storing them */
+	void rebuildRing()
+	{
+		ring.size = mapViewp.size();
+		ring.pos = mapViewp.pos();
+
+		const int PC = TileAtlasVX::PASS_COUNT;
+
+		ring.readVert.clear();
+		ring.readEnds.clear();
+
+		for (int i = 0; i < PC; ++i)
+			ring.groundNeed[i] = 0;
+
+		ring.aboveNeed = 0;
+
+		for (int y = 0; y < ring.size.y; ++y)
+			for (int x = 0; x < ring.size.x; ++x)
+			{
+				readTile(ring.pos.x + x, ring.pos.y + y);
+
+				size_t start = 0;
+
+				for (int i = 0; i <= PC; ++i)
+				{
+					const size_t quads = (tileEnds[i] - start) / 4;
+
+					if (i < PC)
+						ring.groundNeed[i] = std::max(ring.groundNeed[i], quads);
+					else
+						ring.aboveNeed = std::max(ring.aboveNeed, quads);
+
+					ring.readEnds.push_back(ring.readVert.size() + tileEnds[i]);
+					start = tileEnds[i];
+				}
+
+				ring.readVert.insert(ring.readVert.end(),
+				                     groundVert.begin(), groundVert.end());
+			}
 
-		groundQuads = groundVert.size() / 4;
-		aboveQuads = aboveVert.size() / 4;
-		size_t totalQuads = groundQuads + aboveQuads;
+		growRingCaps();
+		layoutRing();
+		clearDirtySpans();
+
+		size_t ends[PC+1];
+		size_t start = 0;
+
+		for (int y = 0; y < ring.size.y; ++y)
+			for (int x = 0; x < ring.size.x; ++x)
+			{
+				const size_t *readEnds = &ring.readEnds[(y * ring.size.x + x) * (PC+1)];
+
+				for (int i = 0; i <= PC; ++i)
+					ends[i] = readEnds[i] - start;
+
+				storeTile(ring.pos.x + x, ring.pos.y + y,
+				          dataPtr(ring.readVert) + start, ends);
+
+				start = readEnds[PC];
+			}
 
 		VBO::bind(vbo);
 
-		if (totalQuads > allocQuads)
+		if (ring.quadCount > allocQuads)
 		{
-			VBO::allocEmpty(quadBytes(totalQuads), GL_DYNAMIC_DRAW);
-			allocQuads = totalQuads;
+			VBO::allocEmpty(quadBytes(ring.quadCount), GL_DYNAMIC_DRAW);
+			allocQuads = ring.quadCount;
 		}
 
-		VBO::uploadSubData(0, quadBytes(groundQuads), dataPtr(groundVert));
-		VBO::uploadSubData(quadBytes(groundQuads), quadBytes(aboveQuads), dataPtr(aboveVert));
+		VBO::uploadSubData(0, quadBytes(ring.quadCount), dataPtr(ring.vert));
+
+		VBO::unbind();
+
+		shState->ensureQuadIBO(ring.quadCount);
+
+		clearDirtySpans();
+		ring.valid = true;
+	}
+
+	void uploadQuads(size_t first, size_t count)
+	{
+		VBO::uploadSubData(quadBytes(first), quadBytes(count),
+		                   &ring.vert[first*4]);
+	}
+
+	void uploadDirtySpans()
+	{
+		if (!ring.spansDirty)
+			return;
+
+		VBO::bind(vbo);
+
+		for (int y = 0; y < ring.size.y; ++y)
+		{
+			const Vec2i &span = ring.dirtySpans[y];
+
+			if (span.x >= span.y)
+				continue;
+
+			const int rowInd = (ring.size.y - 1 - y) * ring.size.x;
+
+			for (size_t i = 0; i < TileAtlasVX::PASS_COUNT; ++i)
+			{
+				const size_t cap = ring.groundCap[i];
+
+				if (cap > 0)
+					uploadQuads(ring.bases[i] + (rowInd + span.x) * cap,
+					            (span.y - span.x) * cap);
+			}
+
+			const size_t cap = ring.aboveCap;
+
+			if (cap > 0)
+				uploadQuads(ring.bases[TileAtlasVX::PASS_COUNT] +
+				            (y * ring.size.x + span.x) * cap,
+				            (span.y - span.x) * cap);
+		}
 
 		VBO::unbind();
 
-		shState->ensureQuadIBO(totalQuads);
+		clearDirtySpans();
+	}
+
+	/* Moves the ring to the map viewport position,
+	 * reading only the newly exposed tiles */
+	void scrollRing()
+	{
+		const Vec2i oldPos = ring.pos;
+		const Vec2i newPos = mapViewp.pos();
+		const Vec2i &size = ring.size;
+
+		if (abs(newPos.x - oldPos.x) >= size.x || abs(newPos.y - oldPos.y) >= size.y)
+		{
+			rebuildRing();
+			return;
+		}
+
+		ring.pos = newPos;
+
+		/* Exposed columns, over all rows */
+		int colStart = newPos.x < oldPos.x ? newPos.x : oldPos.x + size.x;
+		int colEnd = newPos.x < oldPos.x ? oldPos.x : newPos.x + size.x;
+
+		for (int y = newPos.y; y < newPos.y + size.y; ++y)
+			for (int x = colStart; x < colEnd; ++x)
+				writeTile(x, y);
+
+		/* Exposed rows, over the remaining columns */
+		int rowStart = newPos.y < oldPos.y ? newPos.y : oldPos.y + size.y;
+		int rowEnd = newPos.y < oldPos.y ? oldPos.y : newPos.y + size.y;
+
+		int keptStart = std::max(oldPos.x, newPos.x);
+		int keptEnd = std::min(oldPos.x, newPos.x) + size.x;
+
+		for (int y = rowStart; y < rowEnd; ++y)
+			for (int x = keptStart; x < keptEnd; ++x)
+				writeTile(x, y);
+	}
+
+	/* Rereads the ring tiles of modified map cells */
+	void patchRing()
+	{
+		for (int y = ring.pos.y; y < ring.pos.y + ring.size.y; ++y)
+			for (int x = ring.pos.x; x < ring.pos.x + ring.size.x; ++x)
+				if (wrappedTileIn(modifiedCells, *mapData, x, y))
+					writeTile(x, y);
+	}
+
+	void updateBuffers()
+	{
+		if (!ring.valid || ring.size != mapViewp.size())
+		{
+			rebuildRing();
+			return;
+		}
+
+		if (ring.pos != mapViewp.pos())
+			scrollRing();
+
+		if (modifiedCells.w > 0)
+			patchRing();
+
+		/* A tile needing more quads than its slots offer
+		 * means the layout has to be redone */
+		if (growRingCaps())
+			rebuildRing();
+		else
+			uploadDirtySpans();
 	}
 
 	void prepare()
@@ -247,9 +680,15 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		if (!mapData)
 			return;
 
+		/* Catch up on table writes of this frame */
+		mapData->flushModified();
+
+		if (flags)
+			flags->flushModified();
+
 		if (atlasDirty)
 		{
-			rebuildAtlas();
+			updateAtlas();
 			atlasDirty = false;
 		}
 
@@ -261,10 +700,14 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 
 		if (buffersDirty)
 		{
-			rebuildBuffers();
+			resetRingCaps();
+			ring.valid = false;
 			buffersDirty = false;
 		}
 
+		updateBuffers();
+		modifiedCells = IntRect();
+
 		flashMap.prepare();
 	}
 
@@ -283,57 +726,71 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		drawFlashLayer();
 	}
 
-	void drawGround()
+	void bindShader(const Vec2 &tileAniOffset)
+	{
+		TilemapVXShader &shader = shState->shaders().tilemapVX();
+		shader.bind();
+		shader.setAniOffset(tileAniOffset);
+		shader.setRing(wrap(ring.pos, ring.size), ring.size);
+
+		shader.setTexSize(Vec2i(atlas.width, atlas.height));
+		shader.applyViewportProj();
+		shader.setTranslation(dispPos);
+
+		TEX::bind(atlas.tex);
+	}
+
+	static void drawQuads(size_t first, size_t count)
 	{
-		if (groundQuads == 0)
+		if (count == 0)
 			return;
 
-		ShaderBase *shader;
+		gl.DrawElements(GL_TRIANGLES, count*6, _GL_INDEX_TYPE,
+		                (GLvoid*) (first*6*sizeof(index_t)));
+	}
 
-		if (!nullOrDisposed(bitmaps[BM_A1]))
-		{
-			/* Animated tileset */
-			TilemapVXShader &tmShader = shState->shaders().tilemapVX;
-			tmShader.bind();
-			tmShader.setAniOffset(aniOffset);
+	void drawGround()
+	{
+		if (ring.bases[TileAtlasVX::PASS_COUNT] == 0)
+			return;
 
-			shader = &tmShader;
-		}
+		/* Static tilesets have nothing to animate */
+		if (!nullOrDisposed(bitmaps[BM_A1]))
+			bindShader(aniOffset);
 		else
-		{
-			/* Static tileset */
-			shader = &shState->shaders().simple;
-			shader->bind();
-		}
-
-		shader->setTexSize(Vec2i(atlas.width, atlas.height));
-		shader->applyViewportProj();
-		shader->setTranslation(dispPos);
+			bindShader(Vec2());
 
-		TEX::bind(atlas.tex);
 		GLMeta::vaoBind(vao);
 
-		gl.DrawElements(GL_TRIANGLES, groundQuads*6, _GL_INDEX_TYPE, 0);
+		/* Ring row of the bottom viewport row, in
+		 * bottom to top storage order */
+		const int bottomInd = ring.size.y - wrap(ring.pos.y, ring.size.y);
+		const size_t rowTiles = ring.size.x;
+
+		for (size_t i = 0; i < TileAtlasVX::PASS_COUNT; ++i)
+		{
+			const size_t cap = ring.groundCap[i];
+			const size_t base = ring.bases[i];
+
+			drawQuads(base + bottomInd * rowTiles * cap,
+			          (ring.size.y - bottomInd) * rowTiles * cap);
+			drawQuads(base, bottomInd * rowTiles * cap);
+		}
 
 		GLMeta::vaoUnbind(vao);
 	}
 
 	void drawAbove()
 	{
-		if (aboveQuads == 0)
+		if (ring.aboveCap == 0)
 			return;
 
-		SimpleShader &shader = shState->shaders().simple;
-		shader.bind();
-		shader.setTexSize(Vec2i(atlas.width, atlas.height));
-		shader.applyViewportProj();
-		shader.setTranslation(dispPos);
+		bindShader(Vec2());
 
-		TEX::bind(atlas.tex);
 		GLMeta::vaoBind(vao);
 
-		gl.DrawElements(GL_TRIANGLES, aboveQuads*6, _GL_INDEX_TYPE,
-		                (GLvoid*) (groundQuads*6*sizeof(index_t)));
+		const size_t base = ring.bases[TileAtlasVX::PASS_COUNT];
+		drawQuads(base, ring.quadCount - base);
 
 		GLMeta::vaoUnbind(vao);
 	}
@@ -350,7 +807,6 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	{
 		sceneGeo = geo;
 
-		buffersDirty = true;
 		mapViewportDirty = true;
 	}
 
@@ -379,7 +835,7 @@ void TilemapVX::BitmapArray::set(int i, Bitmap *bitmap)
 		return;
 
 	p->bitmaps[i] = bitmap;
-	p->atlasDirty = true;
+	p->invalidateAtlas();
 
 	p->bmChangedCons[i].disconnect();
 	p->bmChangedCons[i] = bitmap->modified.connect
@@ -428,11 +884,21 @@ void TilemapVX::update()
 	uint8_t aniIdxA = aniIndicesA[p->frameIdx / 30];
 	uint8_t aniIdxC = aniIndicesC[p->frameIdx / 30];
 
-	p->aniOffset = Vec2(aniIdxA * 2 * 32, aniIdxC * 32);
+	const Vec2 aniOffset(aniIdxA * 2 * 32, aniIdxC * 32);
+
+	/* Tile frames only advance every 30 updates */
+	if (!(p->aniOffset == aniOffset))
+	{
+		p->aniOffset = aniOffset;
+		Scene::markDirty();
+	}
 
 	/* Animate flash */
 	if (++p->flashAlphaIdx >= flashAlphaN)
 		p->flashAlphaIdx = 0;
+
+	if (p->flashMap.isActive())
+		Scene::markDirty();
 }
 
 TilemapVX::BitmapArray &TilemapVX::getBitmapArray()
@@ -478,11 +944,11 @@ void TilemapVX::setMapData(Table *value)
 		return;
 
 	p->mapData = value;
-	p->buffersDirty = true;
+	p->invalidateBuffers();
 
 	p->mapDataCon.disconnect();
 	p->mapDataCon = value->modified.connect
-		(sigc::mem_fun(p, &TilemapVXPrivate::invalidateBuffers));
+		(sigc::mem_fun(p, &TilemapVXPrivate::onMapDataModified));
 }
 
 void TilemapVX::setFlashData(Table *value)
@@ -500,11 +966,11 @@ void TilemapVX::setFlags(Table *value)
 		return;
 
 	p->flags = value;
-	p->buffersDirty = true;
+	p->invalidateBuffers();
 
 	p->flagsCon.disconnect();
 	p->flagsCon = value->modified.connect
-		(sigc::mem_fun(p, &TilemapVXPrivate::invalidateBuffers));
+		(sigc::mem_fun(p, &TilemapVXPrivate::onFlagsModified));
 }
 
 void TilemapVX::setVisible(bool value)
@@ -524,6 +990,8 @@ void TilemapVX::setOX(int value)
 
 	p->origin.x = value;
 	p->mapViewportDirty = true;
+
+	Scene::markDirty();
 }
 
 void TilemapVX::setOY(int value)
@@ -535,6 +1003,8 @@ void TilemapVX::setOY(int value)
 
 	p->origin.y = value;
 	p->mapViewportDirty = true;
+
+	Scene::markDirty();
 }
 
 void TilemapVX::releaseResources()
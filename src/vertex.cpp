@@ -53,6 +53,15 @@ static const VertexAttribute VertexAttribs[] =
 	{ Shader::TexCoord, 2, GL_FLOAT, o(Vertex, texPos) }
 };
 
+static const VertexAttribute SpriteVertexAttribs[] =
+{
+	{ Shader::Position, 2, GL_FLOAT, o(SpriteVertex, pos)    },
+	{ Shader::TexCoord, 2, GL_FLOAT, o(SpriteVertex, texPos) },
+	{ Shader::Color,    4, GL_FLOAT, o(SpriteVertex, color)  },
+	{ Shader::Tone,     4, GL_FLOAT, o(SpriteVertex, tone)   },
+	{ Shader::Effect,   4, GL_FLOAT, o(SpriteVertex, effect) }
+};
+
 #define DEF_TRAITS(VertType) \
 	template<> \
 	const VertexAttribute *VertexTraits<VertType>::attr = VertType##Attribs; \
@@ -62,3 +71,4 @@ static const VertexAttribute VertexAttribs[] =
 DEF_TRAITS(SVertex);
 DEF_TRAITS(CVertex);
 DEF_TRAITS(Vertex);
+DEF_TRAITS(SpriteVertex);
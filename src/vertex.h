@@ -51,6 +51,18 @@ struct Vertex
 	Vertex();
 };
 
+/* Sprite batch Vertex; carries all per-sprite
+ * effect state that is otherwise set via uniforms */
+struct SpriteVertex
+{
+	Vec2 pos;
+	Vec2 texPos;
+	Vec4 color;
+	Vec4 tone;
+	/* x: opacity, y: bush depth, z: bush opacity */
+	Vec4 effect;
+};
+
 struct VertexAttribute
 {
 	Shader::Attribute index;
@@ -215,6 +215,13 @@ void Viewport::draw()
 	composite();
 }
 
+bool Viewport::isCulled()
+{
+	/* Empty or entirely off-screen viewports
+	 * can skip compositing their elements */
+	return !p->isOnScreen;
+}
+
 void Viewport::onGeometryChange(const Geometry &geo)
 {
 	p->screenRect = geo.rect;
@@ -53,6 +53,7 @@ private:
 
 	void composite();
 	void draw();
+	bool isCulled();
 	void onGeometryChange(const Geometry &);
 	bool isEffectiveViewport(Rect *&, Color *&, Tone *&) const;
 
@@ -34,6 +34,8 @@
 #include "texpool.h"
 #include "glstate.h"
 
+#include <SDL_rect.h>
+
 #include <sigc++/connection.h>
 
 template<typename T>
@@ -180,6 +182,7 @@ struct WindowPrivate
 	sigc::connection cursorRectCon;
 
 	Vec2i sceneOffset;
+	IntRect sceneRect;
 
 	Vec2i position;
 	Vec2i size;
@@ -220,6 +223,11 @@ struct WindowPrivate
 			p->drawControls();
 		}
 
+		bool isCulled()
+		{
+			return p->isCulled();
+		}
+
 		void release()
 		{
 			unlink();
@@ -424,7 +432,7 @@ struct WindowPrivate
 		glState.viewport.pushSet(IntRect(0, 0, baseTex.width, baseTex.height));
 		glState.clearColor.pushSet(Vec4());
 
-		SimpleAlphaShader &shader = shState->shaders().simpleAlpha;
+		SimpleAlphaShader &shader = shState->shaders().simpleAlpha();
 		shader.bind();
 		shader.applyViewportProj();
 		shader.setTranslation(Vec2i());
@@ -548,6 +556,14 @@ struct WindowPrivate
 		}
 	}
 
+	/* Everything we draw is clipped to the window rect */
+	bool isCulled() const
+	{
+		const IntRect windowRect(position + sceneOffset, size);
+
+		return !SDL_HasIntersection(&windowRect, &sceneRect);
+	}
+
 	void drawBase()
 	{
 		if (nullOrDisposed(windowskin))
@@ -556,7 +572,7 @@ struct WindowPrivate
 		if (size == Vec2i(0, 0))
 			return;
 
-		SimpleAlphaShader &shader = shState->shaders().simpleAlpha;
+		SimpleAlphaShader &shader = shState->shaders().simpleAlpha();
 		shader.bind();
 		shader.applyViewportProj();
 		shader.setTranslation(position + sceneOffset);
@@ -604,7 +620,7 @@ struct WindowPrivate
 		glState.scissorBox.push();
 		glState.scissorBox.setIntersect(windowRect);
 
-		SimpleAlphaShader &shader = shState->shaders().simpleAlpha;
+		SimpleAlphaShader &shader = shState->shaders().simpleAlpha();
 		shader.bind();
 		shader.applyViewportProj();
 
@@ -628,8 +644,24 @@ struct WindowPrivate
 
 			shader.setTranslation(efPos + (Vec2i(16) - contentsOffset));
 
-			contents->bindTex(shader);
-			contentsQuad.draw();
+			if (contents->isMega())
+			{
+				/* Draw it tile by tile, the scissor box
+				 * takes care of the ones out of view */
+				for (int i = 0; i < contents->megaTileCount(); ++i)
+				{
+					const IntRect r = contents->megaTileRect(i);
+
+					contentsQuad.setTexPosRect(FloatRect(0, 0, r.w, r.h), r);
+					contents->bindMegaTileLocal(shader, i);
+					contentsQuad.draw();
+				}
+			}
+			else
+			{
+				contents->bindTex(shader);
+				contentsQuad.draw();
+			}
 		}
 
 		glState.scissorBox.pop();
@@ -661,7 +693,10 @@ struct WindowPrivate
 		}
 
 		if (updateArray)
+		{
 			controlsQuadArray.commit();
+			Scene::markDirty();
+		}
 	}
 
 	void stepAnimations()
@@ -697,10 +732,10 @@ void Window::update()
 	p->stepAnimations();
 }
 
-DEF_ATTR_SIMPLE(Window, X,          int,     p->position.x)
-DEF_ATTR_SIMPLE(Window, Y,          int,     p->position.y)
 DEF_ATTR_SIMPLE(Window, CursorRect, Rect&,  *p->cursorRect)
 
+DEF_ATTR_RD_SIMPLE(Window, X,               int,     p->position.x)
+DEF_ATTR_RD_SIMPLE(Window, Y,               int,     p->position.y)
 DEF_ATTR_RD_SIMPLE(Window, Windowskin,      Bitmap*, p->windowskin)
 DEF_ATTR_RD_SIMPLE(Window, Contents,        Bitmap*, p->contents)
 DEF_ATTR_RD_SIMPLE(Window, Stretch,         bool,    p->bgStretch)
@@ -714,16 +749,42 @@ DEF_ATTR_RD_SIMPLE(Window, Opacity,         int,     p->opacity)
 DEF_ATTR_RD_SIMPLE(Window, BackOpacity,     int,     p->backOpacity)
 DEF_ATTR_RD_SIMPLE(Window, ContentsOpacity, int,     p->contentsOpacity)
 
+void Window::setX(int value)
+{
+	guardDisposed();
+
+	if (p->position.x == value)
+		return;
+
+	p->position.x = value;
+	Scene::markDirty();
+}
+
+void Window::setY(int value)
+{
+	guardDisposed();
+
+	if (p->position.y == value)
+		return;
+
+	p->position.y = value;
+	Scene::markDirty();
+}
+
 void Window::setWindowskin(Bitmap *value)
 {
 	guardDisposed();
 
+	if (p->windowskin == value)
+		return;
+
 	p->windowskin = value;
+	Scene::markDirty();
 
 	if (nullOrDisposed(value))
 		return;
 
-	value->ensureNonMega();
+	value->ensureNonAtlas();
 }
 
 void Window::setContents(Bitmap *value)
@@ -735,11 +796,12 @@ void Window::setContents(Bitmap *value)
 
 	p->contents = value;
 	p->controlsVertDirty = true;
+	Scene::markDirty();
 
 	if (nullOrDisposed(value))
 		return;
 
-	value->ensureNonMega();
+	value->ensureNonAtlas();
 	p->contentsQuad.setTexPosRect(value->rect(), value->rect());
 }
 
@@ -752,6 +814,8 @@ void Window::setStretch(bool value)
 
 	p->bgStretch = value;
 	p->baseVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void Window::setActive(bool value)
@@ -763,6 +827,8 @@ void Window::setActive(bool value)
 
 	p->active = value;
 	p->cursorAniAlphaIdx = 0;
+
+	Scene::markDirty();
 }
 
 void Window::setPause(bool value)
@@ -776,6 +842,8 @@ void Window::setPause(bool value)
 	p->pauseAniAlphaIdx = 0;
 	p->pauseAniQuadIdx = 0;
 	p->controlsVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void Window::setWidth(int value)
@@ -787,6 +855,8 @@ void Window::setWidth(int value)
 
 	p->size.x = value;
 	p->baseVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void Window::setHeight(int value)
@@ -798,6 +868,8 @@ void Window::setHeight(int value)
 
 	p->size.y = value;
 	p->baseVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void Window::setOX(int value)
@@ -809,6 +881,8 @@ void Window::setOX(int value)
 
 	p->contentsOffset.x = value;
 	p->controlsVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void Window::setOY(int value)
@@ -820,6 +894,8 @@ void Window::setOY(int value)
 
 	p->contentsOffset.y = value;
 	p->controlsVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void Window::setOpacity(int value)
@@ -831,6 +907,8 @@ void Window::setOpacity(int value)
 
 	p->opacity = value;
 	p->opacityDirty = true;
+
+	Scene::markDirty();
 }
 
 void Window::setBackOpacity(int value)
@@ -842,6 +920,8 @@ void Window::setBackOpacity(int value)
 
 	p->backOpacity = value;
 	p->opacityDirty = true;
+
+	Scene::markDirty();
 }
 
 void Window::setContentsOpacity(int value)
@@ -853,6 +933,8 @@ void Window::setContentsOpacity(int value)
 
 	p->contentsOpacity = value;
 	p->contentsQuad.setColor(Vec4(1, 1, 1, p->contentsOpacity.norm));
+
+	Scene::markDirty();
 }
 
 void Window::initDynAttribs()
@@ -867,9 +949,15 @@ void Window::draw()
 	p->drawBase();
 }
 
+bool Window::isCulled()
+{
+	return p->isCulled();
+}
+
 void Window::onGeometryChange(const Scene::Geometry &geo)
 {
 	p->sceneOffset = geo.offset();
+	p->sceneRect = geo.rect;
 }
 
 void Window::setZ(int value)
@@ -34,6 +34,7 @@
 
 #include <limits>
 #include <algorithm>
+#include <SDL_rect.h>
 #include <sigc++/connection.h>
 
 #define DEF_Z         (rgssVer >= 3 ? 100 :   0)
@@ -220,6 +221,7 @@ struct WindowVXPrivate
 	uint8_t cursorAlphaIdx;
 
 	Vec2i sceneOffset;
+	IntRect sceneRect;
 
 	WindowVXPrivate(int x, int y, int w, int h)
 	    : windowskin(0),
@@ -427,7 +429,7 @@ struct WindowVXPrivate
 
 		if (backOpacity < 255 || tone->hasEffect())
 		{
-			PlaneShader &planeShader = shState->shaders().plane;
+			PlaneShader &planeShader = shState->shaders().plane();
 			planeShader.bind();
 
 			planeShader.setColor(Vec4());
@@ -439,7 +441,7 @@ struct WindowVXPrivate
 		}
 		else
 		{
-			shader = &shState->shaders().simple;
+			shader = &shState->shaders().simple();
 			shader->bind();
 		}
 
@@ -461,9 +463,9 @@ struct WindowVXPrivate
 		glState.blendMode.set(BlendNormal);
 
 		/* If we used plane shader before, switch to simple */
-		if (shader != &shState->shaders().simple)
+		if (shader != &shState->shaders().simple())
 		{
-			shader = &shState->shaders().simple;
+			shader = &shState->shaders().simple();
 			shader->bind();
 			shader->setTranslation(Vec2i());
 			shader->applyViewportProj();
@@ -665,6 +667,11 @@ struct WindowVXPrivate
 			if (++pauseQuadIdx == pauseQuadN)
 				pauseQuadIdx = 0;
 		}
+
+		/* The animations only show if there's a cursor
+		 * or pause sign to draw in the first place */
+		if ((active && cursorVert.count() > 0) || (pause && pauseVert))
+			Scene::markDirty();
 	}
 
 	void prepare()
@@ -732,7 +739,7 @@ struct WindowVXPrivate
 
 		Vec2i trans = geo.pos() + sceneOffset;
 
-		SimpleAlphaShader &shader = shState->shaders().simpleAlpha;
+		SimpleAlphaShader &shader = shState->shaders().simpleAlpha();
 		shader.bind();
 		shader.applyViewportProj();
 
@@ -862,6 +869,8 @@ void WindowVX::move(int x, int y, int width, int height)
 
 	p->geo = IntRect(Vec2i(x, y), size);
 	p->updateBaseQuad();
+
+	Scene::markDirty();
 }
 
 bool WindowVX::isOpen() const
@@ -878,11 +887,11 @@ bool WindowVX::isClosed() const
 	return p->openness == 0;
 }
 
-DEF_ATTR_SIMPLE(WindowVX, X,          int,     p->geo.x)
-DEF_ATTR_SIMPLE(WindowVX, Y,          int,     p->geo.y)
 DEF_ATTR_SIMPLE(WindowVX, CursorRect, Rect&,  *p->cursorRect)
 DEF_ATTR_SIMPLE(WindowVX, Tone,       Tone&,  *p->tone)
 
+DEF_ATTR_RD_SIMPLE(WindowVX, X,               int,     p->geo.x)
+DEF_ATTR_RD_SIMPLE(WindowVX, Y,               int,     p->geo.y)
 DEF_ATTR_RD_SIMPLE(WindowVX, Windowskin,      Bitmap*, p->windowskin)
 DEF_ATTR_RD_SIMPLE(WindowVX, Contents,        Bitmap*, p->contents)
 DEF_ATTR_RD_SIMPLE(WindowVX, Active,          bool,    p->active)
@@ -899,6 +908,28 @@ DEF_ATTR_RD_SIMPLE(WindowVX, BackOpacity,     int,     p->backOpacity)
 DEF_ATTR_RD_SIMPLE(WindowVX, ContentsOpacity, int,     p->contentsOpacity)
 DEF_ATTR_RD_SIMPLE(WindowVX, Openness,        int,     p->openness)
 
+void WindowVX::setX(int value)
+{
+	guardDisposed();
+
+	if (p->geo.x == value)
+		return;
+
+	p->geo.x = value;
+	Scene::markDirty();
+}
+
+void WindowVX::setY(int value)
+{
+	guardDisposed();
+
+	if (p->geo.y == value)
+		return;
+
+	p->geo.y = value;
+	Scene::markDirty();
+}
+
 void WindowVX::setWindowskin(Bitmap *value)
 {
 	guardDisposed();
@@ -908,6 +939,10 @@ void WindowVX::setWindowskin(Bitmap *value)
 
 	p->windowskin = value;
 	p->base.texDirty = true;
+	Scene::markDirty();
+
+	if (!nullOrDisposed(value))
+		value->ensureNonAtlas();
 }
 
 void WindowVX::setContents(Bitmap *value)
@@ -918,10 +953,13 @@ void WindowVX::setContents(Bitmap *value)
 		return;
 
 	p->contents = value;
+	Scene::markDirty();
 
 	if (nullOrDisposed(value))
 		return;
 
+	value->ensureNonAtlas();
+
 	FloatRect rect = p->contents->rect();
 	p->contentsQuad.setTexPosRect(rect, rect);
 	p->ctrlVertDirty = true;
@@ -937,6 +975,8 @@ void WindowVX::setActive(bool value)
 	p->active = value;
 	p->cursorAlphaIdx = cursorAlphaResetIdx;
 	p->updateCursorAlpha();
+
+	Scene::markDirty();
 }
 
 void WindowVX::setArrowsVisible(bool value)
@@ -948,6 +988,8 @@ void WindowVX::setArrowsVisible(bool value)
 
 	p->arrowsVisible = value;
 	p->ctrlVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void WindowVX::setPause(bool value)
@@ -961,6 +1003,8 @@ void WindowVX::setPause(bool value)
 	p->pauseAlphaIdx = 0;
 	p->pauseQuadIdx = 0;
 	p->ctrlVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void WindowVX::setWidth(int value)
@@ -977,6 +1021,8 @@ void WindowVX::setWidth(int value)
 	p->clipRectDirty = true;
 	p->ctrlVertDirty = true;
 	p->updateBaseQuad();
+
+	Scene::markDirty();
 }
 
 void WindowVX::setHeight(int value)
@@ -993,6 +1039,8 @@ void WindowVX::setHeight(int value)
 	p->clipRectDirty = true;
 	p->ctrlVertDirty = true;
 	p->updateBaseQuad();
+
+	Scene::markDirty();
 }
 
 void WindowVX::setOX(int value)
@@ -1004,6 +1052,8 @@ void WindowVX::setOX(int value)
 
 	p->contentsOff.x = value;
 	p->ctrlVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void WindowVX::setOY(int value)
@@ -1015,6 +1065,8 @@ void WindowVX::setOY(int value)
 
 	p->contentsOff.y = value;
 	p->ctrlVertDirty = true;
+
+	Scene::markDirty();
 }
 
 void WindowVX::setPadding(int value)
@@ -1027,6 +1079,8 @@ void WindowVX::setPadding(int value)
 	p->padding = value;
 	p->paddingBottom = value;
 	p->clipRectDirty = true;
+
+	Scene::markDirty();
 }
 
 void WindowVX::setPaddingBottom(int value)
@@ -1038,6 +1092,8 @@ void WindowVX::setPaddingBottom(int value)
 
 	p->paddingBottom = value;
 	p->clipRectDirty = true;
+
+	Scene::markDirty();
 }
 
 void WindowVX::setOpacity(int value)
@@ -1049,6 +1105,8 @@ void WindowVX::setOpacity(int value)
 
 	p->opacity = value;
 	p->base.quad.setColor(Vec4(1, 1, 1, p->opacity.norm));
+
+	Scene::markDirty();
 }
 
 void WindowVX::setBackOpacity(int value)
@@ -1060,6 +1118,8 @@ void WindowVX::setBackOpacity(int value)
 
 	p->backOpacity = value;
 	p->base.texDirty = true;
+
+	Scene::markDirty();
 }
 
 void WindowVX::setContentsOpacity(int value)
@@ -1071,6 +1131,8 @@ void WindowVX::setContentsOpacity(int value)
 
 	p->contentsOpacity = value;
 	p->contentsQuad.setColor(Vec4(1, 1, 1, p->contentsOpacity.norm));
+
+	Scene::markDirty();
 }
 
 void WindowVX::setOpenness(int value)
@@ -1082,6 +1144,8 @@ void WindowVX::setOpenness(int value)
 
 	p->openness = value;
 	p->updateBaseQuad();
+
+	Scene::markDirty();
 }
 
 void WindowVX::initDynAttribs()
@@ -1101,9 +1165,18 @@ void WindowVX::draw()
 	p->draw();
 }
 
+bool WindowVX::isCulled()
+{
+	/* Everything we draw is clipped to the window rect */
+	const IntRect windowRect(p->geo.pos() + p->sceneOffset, p->geo.size());
+
+	return !SDL_HasIntersection(&windowRect, &p->sceneRect);
+}
+
 void WindowVX::onGeometryChange(const Scene::Geometry &geo)
 {
 	p->sceneOffset = geo.offset();
+	p->sceneRect = geo.rect;
 }
 
 void WindowVX::releaseResources()
@@ -72,6 +72,7 @@ private:
 	WindowVXPrivate *p;
 
 	void draw();
+	bool isCulled();
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
@@ -0,0 +1,224 @@
+/*
+** mkxp-bake.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Converts every image below the given directories (usually
+ * a game's Graphics folder) into a baked image placed next to
+ * it, which the engine then loads instead of the original.
+ *
+ *   mkxp-bake [--raw] [--force] <directory>...
+ *
+ * Images whose baked version is newer are skipped unless
+ * --force is given. --raw stores pixels uncompressed, trading
+ * disk space for even faster loading */
+
+#include "bakedimage.h"
+
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+static const char *imageExts[] =
+{
+	"png", "jpg", "jpeg", "bmp", "tga", "gif", "webp", 0
+};
+
+struct Options
+{
+	BakedImage::Codec codec;
+	bool force;
+};
+
+struct Totals
+{
+	int baked;
+	int skipped;
+	int failed;
+	size_t bytesIn;
+	size_t bytesOut;
+};
+
+static bool isImageExt(const char *ext)
+{
+	for (size_t i = 0; imageExts[i]; ++i)
+		if (SDL_strcasecmp(ext, imageExts[i]) == 0)
+			return true;
+
+	return false;
+}
+
+static bool statFile(const std::string &path, struct stat &st)
+{
+	return stat(path.c_str(), &st) == 0;
+}
+
+static void bakeFile(const std::string &path, const std::string &bakedPath,
+                     const Options &opts, Totals &totals)
+{
+	struct stat srcSt, dstSt;
+
+	if (!statFile(path, srcSt))
+		return;
+
+	if (!opts.force && statFile(bakedPath, dstSt) && dstSt.st_mtime >= srcSt.st_mtime)
+	{
+		++totals.skipped;
+		return;
+	}
+
+	SDL_Surface *surf = IMG_Load(path.c_str());
+
+	if (surf && surf->format->format != SDL_PIXELFORMAT_ABGR8888)
+	{
+		SDL_Surface *conv = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ABGR8888, 0);
+		SDL_FreeSurface(surf);
+		surf = conv;
+	}
+
+	if (!surf)
+	{
+		fprintf(stderr, "%s: %s\n", path.c_str(), SDL_GetError());
+		++totals.failed;
+		return;
+	}
+
+	SDL_RWops *ops = SDL_RWFromFile(bakedPath.c_str(), "wb");
+	bool ok = ops && BakedImage::write(ops, surf, opts.codec);
+
+	if (ops)
+		SDL_RWclose(ops);
+
+	SDL_FreeSurface(surf);
+
+	if (!ok)
+	{
+		fprintf(stderr, "%s: Could not write %s\n", path.c_str(), bakedPath.c_str());
+		remove(bakedPath.c_str());
+		++totals.failed;
+		return;
+	}
+
+	statFile(bakedPath, dstSt);
+
+	totals.bytesIn += srcSt.st_size;
+	totals.bytesOut += dstSt.st_size;
+	++totals.baked;
+}
+
+static void bakeDir(const std::string &dirPath, const Options &opts, Totals &totals)
+{
+	DIR *dir = opendir(dirPath.c_str());
+
+	if (!dir)
+	{
+		fprintf(stderr, "%s: Could not open directory\n", dirPath.c_str());
+		return;
+	}
+
+	while (struct dirent *ent = readdir(dir))
+	{
+		const char *name = ent->d_name;
+
+		if (!strcmp(name, ".") || !strcmp(name, ".."))
+			continue;
+
+		const std::string path = dirPath + "/" + name;
+		struct stat st;
+
+		if (!statFile(path, st))
+			continue;
+
+		if (S_ISDIR(st.st_mode))
+		{
+			bakeDir(path, opts, totals);
+			continue;
+		}
+
+		const char *dot = strrchr(name, '.');
+
+		if (!dot || !isImageExt(dot + 1))
+			continue;
+
+		const std::string bakedPath =
+			path.substr(0, path.size() - strlen(dot)) + "." + BakedImage::extension;
+
+		bakeFile(path, bakedPath, opts, totals);
+	}
+
+	closedir(dir);
+}
+
+static void printUsage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [--raw] [--force] <directory>...\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	Options opts;
+	opts.codec = BakedImage::QOI;
+	opts.force = false;
+
+	Totals totals = { 0, 0, 0, 0, 0 };
+	int dirCount = 0;
+
+	if (IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG) == 0)
+	{
+		fprintf(stderr, "Could not initialize SDL_image: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--raw"))
+			opts.codec = BakedImage::Raw;
+		else if (!strcmp(argv[i], "--force"))
+			opts.force = true;
+		else if (argv[i][0] == '-')
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+		else
+		{
+			bakeDir(argv[i], opts, totals);
+			++dirCount;
+		}
+	}
+
+	IMG_Quit();
+
+	if (dirCount == 0)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	printf("Baked %d images (%d up to date, %d failed), %.1f MB -> %.1f MB\n",
+	       totals.baked, totals.skipped, totals.failed,
+	       totals.bytesIn / 1048576.0, totals.bytesOut / 1048576.0);
+
+	return totals.failed ? 1 : 0;
+}